@@ -0,0 +1,131 @@
+#pragma once
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// What every benchmark shares: the timer, the loop that runs a case until it has had its
+// time, the seconds per case read from the command line and a report that prints a table one
+// cell at a time. A benchmark includes this and only defines its cases.
+
+#define BENCHMARK_DEFAULT_SECONDS 0.25
+#define BENCHMARK_MIN_ITERATIONS 3
+
+// The first argument, or BENCHMARK_DEFAULT_SECONDS
+inline double GetBenchmarkSeconds(int argc, char** argv)
+{
+	return (argc > 1) ? atof(argv[1]) : BENCHMARK_DEFAULT_SECONDS;
+}
+
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer()
+	{
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+		last = start;
+	}
+
+	// Seconds since the last lap, or since the timer was made, and starts the next lap
+	double Lap()
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		double seconds = Seconds(last, now);
+		last = now;
+		return seconds;
+	}
+
+	// Seconds since the timer was made, up to the end of the last lap
+	double Elapsed() const
+	{
+		return Seconds(start, last);
+	}
+
+private:
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER start;
+	LARGE_INTEGER last;
+
+	double Seconds(const LARGE_INTEGER& from, const LARGE_INTEGER& to) const
+	{
+		return (double)(to.QuadPart - from.QuadPart) / (double)frequency.QuadPart;
+	}
+};
+
+// Calls iteration(timer) at least BENCHMARK_MIN_ITERATIONS times and until seconds of wall
+// time have gone by, and returns how many times it ran. A lap starts just before each call,
+// so an iteration times its stages by adding up timer.Lap() after each one; a lap it does not
+// want, like setting up untimed work, it just throws away. Returning false stops the case
+// once the minimum is reached, for cases that would only repeat themselves.
+template <typename Iteration>
+unsigned int RunBenchmarkCase(double seconds, Iteration iteration)
+{
+	BenchmarkTimer timer;
+	unsigned int iterations = 0;
+	for (;;)
+	{
+		timer.Lap();
+		bool more = iteration(timer);
+		timer.Lap();
+		++iterations;
+		if (iterations >= BENCHMARK_MIN_ITERATIONS && (!more || timer.Elapsed() >= seconds))
+			return iterations;
+	}
+}
+
+// One column of a report. A negative width lines the column up on the left, as printf does.
+struct BenchmarkColumn
+{
+	const char* heading;
+	int width;
+};
+
+// Prints a table a row at a time, each cell padded to its column
+class BenchmarkReport
+{
+public:
+	BenchmarkReport(const BenchmarkColumn* columns, unsigned int columnCount)
+		: columns(columns, columns + columnCount), column(0)
+	{
+	}
+
+	void PrintHeader()
+	{
+		for (unsigned int i = 0; i < columns.size(); ++i)
+			Text(columns[i].heading);
+		EndRow();
+	}
+
+	void Text(const char* text)
+	{
+		int width = (column < columns.size()) ? columns[column].width : 0;
+		printf(column ? " %*s" : "%*s", width, text);
+		++column;
+	}
+
+	void Number(double value, int decimals)
+	{
+		char text[64];
+		sprintf_s(text, "%.*f", decimals, value);
+		Text(text);
+	}
+
+	// A cell that does not apply to this row
+	void Skip()
+	{
+		Text("-");
+	}
+
+	// Ends the row; a note is printed after the last cell
+	void EndRow(const char* note = "")
+	{
+		printf("%s\n", note);
+		column = 0;
+	}
+
+private:
+	std::vector<BenchmarkColumn> columns;
+	unsigned int column;
+};
@@ -0,0 +1,274 @@
+//************************************************************
+//********* BOUNDING VOLUME HIERARCHY BENCHMARK **************
+//************************************************************
+
+// Times keeping a BoundingVolumeHierarchy up to date and searching it, for a thousand to a
+// hundred thousand spheres scattered over a wide, flat scene. Each size goes through:
+//   build     - building the tree from scratch
+//   move few  - one sphere in a hundred moved, then refit
+//   move all  - every sphere moved a little, then refit (or rebuilt if that got too costly)
+//   frustum   - the spheres in a view looking across the scene
+//   sphere    - the spheres touching a query sphere a few objects across, many times
+//   ray       - the first sphere along a ray across the scene, many times
+// Queries are also timed as a scan over every sphere: FrustumCuller's SSE pass for the
+// frustum and a plain loop for the others. Times are per operation; the query times are for
+// every query of the case.
+//
+// Usage: BoundingVolumeHierarchyBenchmark [seconds per case]
+
+#include <math.h>
+#include <vector>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/BoundingVolumeHierarchy.h"
+
+using namespace std;
+
+#define BENCHMARK_SCENE_SIZE 1000.0f
+#define BENCHMARK_SCENE_HEIGHT 20.0f
+#define BENCHMARK_MOVE_STEP 100 // One sphere in this many moves in the move few case
+#define BENCHMARK_QUERIES 1000 // Sphere queries and rays a case makes
+#define BENCHMARK_QUERY_RADIUS 10.0f
+
+enum TreeCase
+{
+	TREE_BUILD,
+	TREE_MOVE_FEW,
+	TREE_MOVE_ALL,
+	TREE_FRUSTUM,
+	TREE_SPHERE,
+	TREE_RAY,
+	TREE_CASE_COUNT
+};
+
+static const char* caseNames[TREE_CASE_COUNT] = { "build", "move few", "move all", "frustum", "sphere", "ray" };
+static const unsigned int sphereCounts[] = { 1000, 10000, 100000 };
+
+struct SCENE
+{
+	vector<XMFLOAT4> spheres;
+	BoundingVolumeHierarchy tree;
+	FrustumCuller culler;
+	XMFLOAT4 planes[FRUSTUM_PLANE_COUNT];
+	vector<XMFLOAT4> queries; // Sphere query centers and radii
+	vector<XMFLOAT3> rayOrigins;
+	vector<XMFLOAT3> rayDirections;
+	vector<unsigned int> results;
+};
+
+struct CaseResult
+{
+	double treeSeconds;
+	double scanSeconds;
+	double found; // Spheres the tree found, or the nodes it refit
+	unsigned int iterations;
+};
+
+static float Random(float range)
+{
+	return (float)rand() / (float)RAND_MAX * range;
+}
+
+static void MakeScene(SCENE& scene, unsigned int count)
+{
+	srand(count);
+	scene.tree.Reserve(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		XMFLOAT4 sphere(Random(BENCHMARK_SCENE_SIZE), Random(BENCHMARK_SCENE_HEIGHT), Random(BENCHMARK_SCENE_SIZE), 0.5f + Random(2.0f));
+		scene.spheres.push_back(sphere);
+		scene.tree.Add(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w);
+		scene.culler.Add(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w);
+	}
+	scene.tree.Update();
+
+	XMVECTOR eye = XMVectorSet(BENCHMARK_SCENE_SIZE * 0.5f, 10.0f, 0.0f, 1.0f);
+	XMVECTOR target = XMVectorSet(BENCHMARK_SCENE_SIZE * 0.5f, 0.0f, BENCHMARK_SCENE_SIZE * 0.5f, 1.0f);
+	XMMATRIX viewProjection = XMMatrixLookAtLH(eye, target, XMVectorSet(0, 1, 0, 0)) *
+		XMMatrixPerspectiveFovLH(XMConvertToRadians(65), 1.0f, 0.1f, BENCHMARK_SCENE_SIZE * 0.3f);
+	FrustumCuller::ExtractPlanes(viewProjection, scene.planes);
+	scene.culler.SetViewCount(1);
+	scene.culler.SetView(0, scene.planes);
+
+	for (unsigned int i = 0; i < BENCHMARK_QUERIES; ++i)
+	{
+		scene.queries.push_back(XMFLOAT4(Random(BENCHMARK_SCENE_SIZE), Random(BENCHMARK_SCENE_HEIGHT), Random(BENCHMARK_SCENE_SIZE), BENCHMARK_QUERY_RADIUS));
+		scene.rayOrigins.push_back(XMFLOAT3(Random(BENCHMARK_SCENE_SIZE), Random(BENCHMARK_SCENE_HEIGHT), Random(BENCHMARK_SCENE_SIZE)));
+		float angle = Random(XM_2PI);
+		scene.rayDirections.push_back(XMFLOAT3(cosf(angle), Random(0.1f) - 0.05f, sinf(angle)));
+	}
+}
+
+// Moves the spheres of the case a little, somewhere that depends on the frame
+static void Move(SCENE& scene, TreeCase treeCase, unsigned int frame)
+{
+	unsigned int step = (treeCase == TREE_MOVE_FEW) ? BENCHMARK_MOVE_STEP : 1;
+	float offset = ((frame & 1) ? 1.0f : -1.0f);
+	for (unsigned int i = (treeCase == TREE_MOVE_FEW) ? frame % step : 0; i < scene.spheres.size(); i += step)
+	{
+		XMFLOAT4& sphere = scene.spheres[i];
+		sphere.x += offset * ((i & 1) ? 1.0f : -1.0f);
+		sphere.z += offset;
+		scene.tree.SetSphere(i, XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w);
+	}
+}
+
+static double RunTree(SCENE& scene, TreeCase treeCase, unsigned int frame)
+{
+	double found = 0;
+	switch (treeCase)
+	{
+	case TREE_BUILD:
+		scene.tree.Rebuild();
+		break;
+	case TREE_MOVE_FEW:
+	case TREE_MOVE_ALL:
+		Move(scene, treeCase, frame);
+		scene.tree.Update();
+		found = scene.tree.GetRefitCount();
+		break;
+	case TREE_FRUSTUM:
+		scene.results.clear();
+		scene.tree.QueryFrustum(scene.planes, scene.results);
+		found = (double)scene.results.size();
+		break;
+	case TREE_SPHERE:
+		scene.results.clear();
+		for (unsigned int i = 0; i < scene.queries.size(); ++i)
+			scene.tree.QuerySphere(XMFLOAT3(scene.queries[i].x, scene.queries[i].y, scene.queries[i].z), scene.queries[i].w, scene.results);
+		found = (double)scene.results.size();
+		break;
+	case TREE_RAY:
+		for (unsigned int i = 0; i < scene.rayOrigins.size(); ++i)
+		{
+			if (scene.tree.RayCast(XMLoadFloat3(&scene.rayOrigins[i]), XMLoadFloat3(&scene.rayDirections[i]), BENCHMARK_SCENE_SIZE, nullptr) != BVH_NONE)
+				++found;
+		}
+		break;
+	default:
+		break;
+	}
+	return found;
+}
+
+// The same queries with a look at every sphere
+static void RunScan(SCENE& scene, TreeCase treeCase)
+{
+	const vector<XMFLOAT4>& spheres = scene.spheres;
+	switch (treeCase)
+	{
+	case TREE_FRUSTUM:
+		scene.culler.Cull();
+		break;
+	case TREE_SPHERE:
+		scene.results.clear();
+		for (unsigned int q = 0; q < scene.queries.size(); ++q)
+		{
+			const XMFLOAT4& query = scene.queries[q];
+			for (unsigned int i = 0; i < spheres.size(); ++i)
+			{
+				float x = spheres[i].x - query.x;
+				float y = spheres[i].y - query.y;
+				float z = spheres[i].z - query.z;
+				float reach = spheres[i].w + query.w;
+				if (x * x + y * y + z * z <= reach * reach)
+					scene.results.push_back(i);
+			}
+		}
+		break;
+	case TREE_RAY:
+		scene.results.clear();
+		for (unsigned int r = 0; r < scene.rayOrigins.size(); ++r)
+		{
+			XMFLOAT3 origin = scene.rayOrigins[r];
+			XMFLOAT3 direction;
+			XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&scene.rayDirections[r])));
+			float nearest = BENCHMARK_SCENE_SIZE;
+			unsigned int hit = BVH_NONE;
+			for (unsigned int i = 0; i < spheres.size(); ++i)
+			{
+				float mx = origin.x - spheres[i].x;
+				float my = origin.y - spheres[i].y;
+				float mz = origin.z - spheres[i].z;
+				float b = mx * direction.x + my * direction.y + mz * direction.z;
+				float c = mx * mx + my * my + mz * mz - spheres[i].w * spheres[i].w;
+				if (c > 0 && (b > 0 || b * b < c))
+					continue;
+				float t = (c > 0) ? -b - sqrtf(b * b - c) : 0.0f;
+				if (t <= nearest)
+				{
+					nearest = t;
+					hit = i;
+				}
+			}
+			scene.results.push_back(hit);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static bool IsQuery(TreeCase treeCase)
+{
+	return treeCase == TREE_FRUSTUM || treeCase == TREE_SPHERE || treeCase == TREE_RAY;
+}
+
+static CaseResult Measure(SCENE& scene, TreeCase treeCase, double secondsPerCase)
+{
+	bool scanned = IsQuery(treeCase);
+	CaseResult total = {};
+	unsigned int frame = 0;
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		total.found += RunTree(scene, treeCase, frame++);
+		total.treeSeconds += timer.Lap();
+		if (scanned)
+			RunScan(scene, treeCase);
+		total.scanSeconds += timer.Lap();
+		return true;
+	});
+	return total;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "Spheres", 8 }, { "Case", -10 }, { "Found/refit", 12 }, { "Tree us", 12 }, { "Scan us", 12 }, { "Rebuilds", 9 },
+};
+
+static void Report(BenchmarkReport& report, unsigned int count, TreeCase treeCase, const CaseResult& result, unsigned int rebuilds)
+{
+	double n = result.iterations;
+	report.Number(count, 0);
+	report.Text(caseNames[treeCase]);
+	report.Number(result.found / n, 0);
+	report.Number(result.treeSeconds / n * 1e6, 1);
+	if (IsQuery(treeCase))
+		report.Number(result.scanSeconds / n * 1e6, 1);
+	else
+		report.Skip();
+	report.Number(rebuilds, 0);
+	report.EndRow();
+}
+
+int main(int argc, char** argv)
+{
+	double secondsPerCase = GetBenchmarkSeconds(argc, argv);
+
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+	for (unsigned int c = 0; c < sizeof(sphereCounts) / sizeof(sphereCounts[0]); ++c)
+	{
+		unsigned int count = sphereCounts[c];
+		SCENE scene;
+		MakeScene(scene, count);
+
+		for (unsigned int t = 0; t < TREE_CASE_COUNT; ++t)
+		{
+			unsigned int rebuilds = scene.tree.GetRebuildCount();
+			CaseResult result = Measure(scene, (TreeCase)t, secondsPerCase);
+			Report(report, count, (TreeCase)t, result, scene.tree.GetRebuildCount() - rebuilds);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,317 @@
+//************************************************************
+//****************** ENTITY BENCHMARK ************************
+//************************************************************
+
+// Times the per-frame work of drawn objects, for a thousand to a hundred thousand of them:
+// writing their world matrices to the constant ring, placing and culling their bounding
+// spheres, and submitting the visible ones of two views to a draw queue that sends them on
+// to a RenderContext that only counts. Objects use one of sixteen meshes and materials and
+// one in eight is blended. They are spread over a grid that each view sees about half of.
+// The same frame is run two ways:
+//   entities - an EntityStore walked an archetype at a time by an EntityRenderer
+//   objects  - separately allocated objects that each keep their own world matrix, mesh
+//              and material and are visited one at a time through a virtual call
+// Times are per frame, with the queue's sort and flush counted apart.
+//
+// Usage: EntityBenchmark [seconds per case]
+
+#include <vector>
+#include <algorithm>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/EntityStore.h"
+#include "../Win32Project1/EntityRenderer.h"
+#include "../Win32Project1/RecordingRenderContext.h"
+
+using namespace std;
+
+#define BENCHMARK_VIEWS 2
+#define BENCHMARK_KINDS 16 // Meshes and materials shared out between the objects
+#define BENCHMARK_BLEND_STEP 8 // One object in this many is blended
+#define BENCHMARK_GRID_WIDTH 100
+#define BENCHMARK_SPACING 4.0f
+#define BENCHMARK_RADIUS 1.5f
+
+enum LayoutCase
+{
+	LAYOUT_ENTITIES,
+	LAYOUT_OBJECTS,
+	LAYOUT_CASE_COUNT
+};
+
+static const char* caseNames[LAYOUT_CASE_COUNT] = { "entities", "objects" };
+static const unsigned int objectCounts[] = { 1000, 10000, 100000 };
+
+struct CaseResult
+{
+	double frameSeconds;
+	double flushSeconds;
+	double submitted;
+	unsigned int iterations;
+};
+
+// What every object needs to be drawn, kept with the object the way a class per kind of
+// renderable object would
+class RENDERABLE
+{
+public:
+	RENDERABLE(const MESH_COMPONENT& mesh, const MATERIAL_COMPONENT& material, bool blended)
+		: mesh(mesh), material(material), blended(blended)
+	{
+	}
+	virtual ~RENDERABLE()
+	{
+	}
+
+	virtual void Update(const TransformHierarchy& transforms, unsigned int node, ConstantBufferRing& constantRing)
+	{
+		XMMATRIX world = transforms.GetWorldMatrix(node);
+		XMStoreFloat4x4(&worldMatrix, world);
+		constants = constantRing.Write(&world, sizeof(world));
+	}
+
+	virtual void Render(ConstantBufferRing& constantRing, FXMVECTOR eyePosition, DrawQueue* drawQueue)
+	{
+		constantRing.Bind(drawQueue, RENDER_STAGE_VERTEX, DRAW_QUEUE_OBJECT_SLOT, constants);
+		XMVECTOR position = XMLoadFloat4x4(&worldMatrix).r[3];
+		drawQueue->SetSortDepth(XMVectorGetX(XMVector3Length(position - eyePosition)));
+		drawQueue->SetIndexBuffer(mesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+		drawQueue->SetVertexBuffer(mesh.vertexBuffer, mesh.vertexStride, 0);
+		drawQueue->SetInputLayout(mesh.layout);
+		drawQueue->SetPrimitiveTopology(mesh.topology);
+		drawQueue->SetVertexShader(material.vertexShader);
+		drawQueue->SetGeometryShader(nullptr);
+		drawQueue->SetPixelShader(material.pixelShader);
+		drawQueue->SetShaderResources(RENDER_STAGE_PIXEL, 0, material.textureCount, material.textures);
+		drawQueue->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &material.sampler);
+		if (blended)
+		{
+			drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+			drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+		}
+		else
+			drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+	}
+
+	const XMFLOAT4X4& GetWorldMatrix() const
+	{
+		return worldMatrix;
+	}
+
+private:
+
+	MESH_COMPONENT mesh;
+	MATERIAL_COMPONENT material;
+	XMFLOAT4X4 worldMatrix;
+	CONSTANT_ALLOCATION constants;
+	bool blended;
+};
+
+// Handles that are never dereferenced; the render context behind the queue only counts
+template <typename T>
+static T* FakeHandle(unsigned int kind, unsigned int which)
+{
+	return (T*)(size_t)(0x1000 + kind * 0x100 + which * 8);
+}
+
+static MESH_COMPONENT Mesh(unsigned int kind)
+{
+	MESH_COMPONENT mesh = {};
+	mesh.vertexBuffer = FakeHandle<ID3D11Buffer>(kind, 0);
+	mesh.vertexStride = 32;
+	mesh.indexBuffer = FakeHandle<ID3D11Buffer>(kind, 1);
+	mesh.indexCount = 36 * (kind + 1);
+	mesh.layout = FakeHandle<ID3D11InputLayout>(kind % 2, 2);
+	mesh.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	return mesh;
+}
+
+static MATERIAL_COMPONENT Material(unsigned int kind)
+{
+	MATERIAL_COMPONENT material = {};
+	material.vertexShader = FakeHandle<ID3D11VertexShader>(kind % 2, 3);
+	material.pixelShader = FakeHandle<ID3D11PixelShader>(kind % 4, 4);
+	material.textures[0] = FakeHandle<ID3D11ShaderResourceView>(kind, 5);
+	material.textureCount = 1;
+	material.sampler = FakeHandle<ID3D11SamplerState>(0, 6);
+	return material;
+}
+
+// The views look along the grid from either end, each seeing a little over half of it
+static void SetViews(FrustumCuller& culler, XMVECTOR eyePositions[BENCHMARK_VIEWS], unsigned int count)
+{
+	float depth = (float)(count / BENCHMARK_GRID_WIDTH + 1) * BENCHMARK_SPACING;
+	float middle = BENCHMARK_GRID_WIDTH * BENCHMARK_SPACING * 0.5f;
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.1f, depth * 0.6f + 10.0f);
+	eyePositions[0] = XMVectorSet(middle, 10.0f, -10.0f, 1.0f);
+	eyePositions[1] = XMVectorSet(middle, 10.0f, depth + 10.0f, 1.0f);
+
+	culler.SetViewCount(BENCHMARK_VIEWS);
+	for (unsigned int v = 0; v < BENCHMARK_VIEWS; ++v)
+	{
+		XMVECTOR target = XMVectorSet(middle, 0.0f, depth * 0.5f, 1.0f);
+		XMFLOAT4 planes[FRUSTUM_PLANE_COUNT];
+		FrustumCuller::ExtractPlanes(XMMatrixLookAtLH(eyePositions[v], target, XMVectorSet(0, 1, 0, 0)) * projection, planes);
+		culler.SetView(v, planes);
+	}
+}
+
+static void MakeTransforms(TransformHierarchy& transforms, unsigned int count)
+{
+	transforms.Reserve(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		unsigned int node = transforms.Add(TRANSFORM_HIERARCHY_NO_PARENT);
+		XMFLOAT3 position((float)(i % BENCHMARK_GRID_WIDTH) * BENCHMARK_SPACING, 0.0f, (float)(i / BENCHMARK_GRID_WIDTH) * BENCHMARK_SPACING);
+		transforms.SetLocalPosition(node, position);
+	}
+	transforms.Update();
+}
+
+// Sends the queue's draws on and counts the time apart from the rest of the frame
+static void Flush(DrawQueue& drawQueue, ConstantBufferRing& constantRing, RecordingRenderContext& counter, CaseResult& total,
+	BenchmarkTimer& timer)
+{
+	drawQueue.Flush();
+	constantRing.EndFrame(nullptr);
+	total.flushSeconds += timer.Lap();
+	counter.Reset();
+}
+
+static CaseResult MeasureEntities(unsigned int count, double secondsPerCase)
+{
+	TransformHierarchy transforms;
+	MakeTransforms(transforms, count);
+	EntityStore store;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		bool blended = (i % BENCHMARK_BLEND_STEP) == 0;
+		unsigned int entity = store.Create(ENTITY_TRANSFORM | ENTITY_MESH | ENTITY_MATERIAL | ENTITY_BOUNDS |
+			(blended ? ENTITY_RENDER_FLAGS : 0));
+		store.SetTransform(entity, i);
+		store.SetMesh(entity, Mesh(i % BENCHMARK_KINDS));
+		store.SetMaterial(entity, Material(i % BENCHMARK_KINDS));
+		store.SetBoundingRadius(entity, BENCHMARK_RADIUS);
+		store.SetRenderFlags(entity, RENDER_FLAG_BLENDED);
+	}
+
+	EntityRenderer renderer;
+	renderer.Initialize(nullptr);
+	FrustumCuller culler;
+	XMVECTOR eyePositions[BENCHMARK_VIEWS];
+	SetViews(culler, eyePositions, count);
+	RecordingRenderContext counter(false);
+	DrawQueue drawQueue;
+	drawQueue.Initialize(&counter, nullptr);
+	ConstantBufferRing constantRing;
+	constantRing.Initialize(nullptr, count * 64);
+
+	CaseResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		constantRing.BeginFrame(nullptr);
+		renderer.Update(store, transforms, constantRing);
+		renderer.Cull(store, transforms, culler, 0);
+		culler.Cull();
+		constantRing.Upload(&drawQueue, nullptr);
+		for (unsigned int v = 0; v < BENCHMARK_VIEWS; ++v)
+		{
+			renderer.Submit(store, transforms, culler, v, eyePositions[v], constantRing, &drawQueue);
+			total.submitted += renderer.GetSubmittedCount();
+		}
+		total.frameSeconds += timer.Lap();
+
+		Flush(drawQueue, constantRing, counter, total, timer);
+		return true;
+	});
+	return total;
+}
+
+static CaseResult MeasureObjects(unsigned int count, double secondsPerCase)
+{
+	TransformHierarchy transforms;
+	MakeTransforms(transforms, count);
+	// Allocated in a shuffled order so that neighbours in the list are not neighbours in
+	// memory, as objects made at different times would not be
+	vector<unsigned int> order(count);
+	for (unsigned int i = 0; i < count; ++i)
+		order[i] = i;
+	srand(count);
+	random_shuffle(order.begin(), order.end());
+	vector<RENDERABLE*> objects(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		unsigned int o = order[i];
+		objects[o] = new RENDERABLE(Mesh(o % BENCHMARK_KINDS), Material(o % BENCHMARK_KINDS), (o % BENCHMARK_BLEND_STEP) == 0);
+	}
+
+	FrustumCuller culler;
+	for (unsigned int i = 0; i < count; ++i)
+		culler.Add(XMFLOAT3(0, 0, 0), BENCHMARK_RADIUS);
+	XMVECTOR eyePositions[BENCHMARK_VIEWS];
+	SetViews(culler, eyePositions, count);
+	RecordingRenderContext counter(false);
+	DrawQueue drawQueue;
+	drawQueue.Initialize(&counter, nullptr);
+	ConstantBufferRing constantRing;
+	constantRing.Initialize(nullptr, count * 64);
+
+	CaseResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		constantRing.BeginFrame(nullptr);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			objects[i]->Update(transforms, i, constantRing);
+			culler.SetSphere(i, XMLoadFloat4x4(&objects[i]->GetWorldMatrix()), BENCHMARK_RADIUS);
+		}
+		culler.Cull();
+		constantRing.Upload(&drawQueue, nullptr);
+		for (unsigned int v = 0; v < BENCHMARK_VIEWS; ++v)
+		{
+			const vector<unsigned int>& visible = culler.GetVisible(v);
+			for (unsigned int i = 0; i < visible.size(); ++i)
+				objects[visible[i]]->Render(constantRing, eyePositions[v], &drawQueue);
+			total.submitted += visible.size();
+		}
+		total.frameSeconds += timer.Lap();
+
+		Flush(drawQueue, constantRing, counter, total, timer);
+		return true;
+	});
+
+	for (unsigned int i = 0; i < count; ++i)
+		delete objects[i];
+	return total;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "Objects", 8 }, { "Layout", -10 }, { "Submitted", 10 }, { "Frame ms", 12 }, { "Flush ms", 12 },
+};
+
+static void Report(BenchmarkReport& report, unsigned int count, LayoutCase layoutCase, const CaseResult& result)
+{
+	double n = result.iterations;
+	report.Number(count, 0);
+	report.Text(caseNames[layoutCase]);
+	report.Number(result.submitted / n, 0);
+	report.Number(result.frameSeconds / n * 1e3, 3);
+	report.Number(result.flushSeconds / n * 1e3, 3);
+	report.EndRow();
+}
+
+int main(int argc, char** argv)
+{
+	double secondsPerCase = GetBenchmarkSeconds(argc, argv);
+
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+	for (unsigned int c = 0; c < sizeof(objectCounts) / sizeof(objectCounts[0]); ++c)
+	{
+		unsigned int count = objectCounts[c];
+		Report(report, count, LAYOUT_ENTITIES, MeasureEntities(count, secondsPerCase));
+		Report(report, count, LAYOUT_OBJECTS, MeasureObjects(count, secondsPerCase));
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+//************************************************************
+//************ INSTANCE UPDATE BENCHMARK *********************
+//************************************************************
+
+// Times what moving instances costs on the CPU, for InstanceBuffer sizes from a thousand
+// to a million. Each size goes through four changes:
+//   all       - every instance moved through SetPositions, one array per axis
+//   single    - every instance moved through SetPosition, one call each
+//   scattered - one instance in a hundred moved, spread over the whole buffer
+//   block     - one tenth of the instances moved, next to each other
+// and for each the time to make the change and the time for Upload to pack the changed
+// ranges and send them are reported per changed instance. Uploads go to a
+// RecordingRenderContext that keeps nothing, which is the packing cost alone, and to a
+// Direct3D device when one can be made, which adds what UpdateSubresource costs the driver.
+//
+// Usage: InstanceUpdateBenchmark [seconds per case]
+
+#include <d3d11.h>
+#include <math.h>
+#include <vector>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/InstanceBuffer.h"
+#include "../Win32Project1/RecordingRenderContext.h"
+#include "../Win32Project1/D3D11RenderContext.h"
+
+using namespace std;
+
+#define BENCHMARK_SCATTER_STEP 100 // One instance in this many moves in the scattered case
+#define BENCHMARK_BLOCK_FRACTION 10 // One instance in this many moves in the block case
+
+enum UpdateCase
+{
+	UPDATE_ALL,
+	UPDATE_SINGLE,
+	UPDATE_SCATTERED,
+	UPDATE_BLOCK,
+	UPDATE_CASE_COUNT
+};
+
+static const char* caseNames[UPDATE_CASE_COUNT] = { "all", "single", "scattered", "block" };
+static const unsigned int instanceCounts[] = { 1000, 10000, 100000, 1000000 };
+
+struct CaseResult
+{
+	double updateSeconds;
+	double uploadSeconds;
+	unsigned int changed;
+	unsigned int uploaded;
+	unsigned int calls;
+	unsigned int iterations;
+};
+
+// Moves the instances the case changes, to somewhere that depends on the frame so that
+// nothing can be skipped
+static unsigned int Update(InstanceBuffer& instances, UpdateCase updateCase, unsigned int frame, vector<float>& x, vector<float>& y, vector<float>& z)
+{
+	unsigned int count = instances.GetCount();
+	float offset = (float)(frame & 255) * 0.01f;
+	switch (updateCase)
+	{
+	case UPDATE_ALL:
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			x[i] = (float)(i & 1023) + offset;
+			y[i] = offset;
+			z[i] = (float)(i >> 10) + offset;
+		}
+		instances.SetPositions(0, count, &x[0], &y[0], &z[0]);
+		return count;
+	case UPDATE_SINGLE:
+		for (unsigned int i = 0; i < count; ++i)
+			instances.SetPosition(i, XMFLOAT3((float)(i & 1023) + offset, offset, (float)(i >> 10) + offset));
+		return count;
+	case UPDATE_SCATTERED:
+	{
+		// Starts somewhere else each frame so that the same instances are not always the ones sent
+		unsigned int changed = 0;
+		for (unsigned int i = frame % BENCHMARK_SCATTER_STEP; i < count; i += BENCHMARK_SCATTER_STEP, ++changed)
+			instances.SetPosition(i, XMFLOAT3((float)(i & 1023) + offset, offset, (float)(i >> 10) + offset));
+		return changed;
+	}
+	case UPDATE_BLOCK:
+	{
+		unsigned int blockSize = max(count / BENCHMARK_BLOCK_FRACTION, 1u);
+		unsigned int first = (frame * blockSize) % (count - blockSize + 1);
+		for (unsigned int i = 0; i < blockSize; ++i)
+		{
+			x[i] = (float)((first + i) & 1023) + offset;
+			y[i] = offset;
+			z[i] = (float)((first + i) >> 10) + offset;
+		}
+		instances.SetPositions(first, blockSize, &x[0], &y[0], &z[0]);
+		return blockSize;
+	}
+	default:
+		return 0;
+	}
+}
+
+static CaseResult Measure(InstanceBuffer& instances, UpdateCase updateCase, RenderContext* renderContext, ID3D11DeviceContext* deviceContext, double secondsPerCase)
+{
+	vector<float> x(instances.GetCount()), y(instances.GetCount()), z(instances.GetCount());
+	// Sends whatever is left from the last case, so that it is not counted against this one
+	instances.Upload(renderContext);
+
+	CaseResult total = {};
+	unsigned int frame = 0;
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		total.changed += Update(instances, updateCase, frame++, x, y, z);
+		total.updateSeconds += timer.Lap();
+		instances.Upload(renderContext);
+		total.uploadSeconds += timer.Lap();
+
+		total.uploaded += instances.GetUploadedInstances();
+		total.calls += instances.GetUploadCallCount();
+
+		// Keeps the driver from queueing copies without end; not counted
+		if (deviceContext)
+			deviceContext->Flush();
+		return true;
+	});
+	return total;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "Instances", 10 }, { "Case", -10 }, { "Changed", 10 }, { "Sent", 10 }, { "Calls", 8 },
+	{ "Update ns/ins", 14 }, { "Upload ns/ins", 14 }, { "Upload MB/s", 10 },
+};
+
+static void Run(const char* target, ID3D11Device* device, RenderContext* renderContext, ID3D11DeviceContext* deviceContext, double secondsPerCase)
+{
+	printf("\n%s\n", target);
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+
+	for (unsigned int i = 0; i < sizeof(instanceCounts) / sizeof(instanceCounts[0]); ++i)
+	{
+		InstanceBuffer instances;
+		if (!instances.Resize(device, instanceCounts[i]))
+		{
+			report.Number(instanceCounts[i], 0);
+			report.EndRow("  could not make the buffer");
+			continue;
+		}
+
+		for (unsigned int c = 0; c < UPDATE_CASE_COUNT; ++c)
+		{
+			CaseResult result = Measure(instances, (UpdateCase)c, renderContext, deviceContext, secondsPerCase);
+			double n = result.iterations;
+			double changed = result.changed / n;
+			double uploadSeconds = result.uploadSeconds / n;
+			double bytes = result.uploaded / n * sizeof(INSTANCE_DATA);
+			report.Number(instanceCounts[i], 0);
+			report.Text(caseNames[c]);
+			report.Number(changed, 0);
+			report.Number(result.uploaded / n, 0);
+			report.Number(result.calls / n, 1);
+			report.Number(result.updateSeconds / n / changed * 1e9, 2);
+			report.Number(uploadSeconds / changed * 1e9, 2);
+			report.Number(uploadSeconds > 0 ? bytes / (1024.0 * 1024.0) / uploadSeconds : 0, 1);
+			report.EndRow();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	double secondsPerCase = GetBenchmarkSeconds(argc, argv);
+
+	RecordingRenderContext recorder(false);
+	Run("Recording render context (packing only)", nullptr, &recorder, nullptr, secondsPerCase);
+
+	// Hardware if there is any, otherwise the software rasterizer, which still says what the
+	// runtime costs
+	D3D_DRIVER_TYPE driverTypes[] = { D3D_DRIVER_TYPE_HARDWARE, D3D_DRIVER_TYPE_WARP };
+	const char* driverNames[] = { "Direct3D hardware device", "Direct3D WARP device" };
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		ID3D11Device* device = nullptr;
+		ID3D11DeviceContext* deviceContext = nullptr;
+		HRESULT result = D3D11CreateDevice(nullptr, driverTypes[i], NULL, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, &deviceContext);
+		if (FAILED(result))
+			continue;
+
+		D3D11RenderContext renderContext;
+		renderContext.Initialize(deviceContext);
+		Run(driverNames[i], device, &renderContext, deviceContext, secondsPerCase);
+		renderContext.Release();
+		deviceContext->Release();
+		device->Release();
+		break;
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+//************************************************************
+//************ OCCLUSION CULLER BENCHMARK ********************
+//************************************************************
+
+// Times an OcclusionCuller for a thousand to a hundred thousand spheres scattered behind,
+// around and in front of a wall of occluders, seen from in front of it. The wall is split
+// into a few, a few thousand or a few tens of thousands of triangles, as the turret and
+// larger meshes would be. Each size goes through:
+//   rasterize - drawing the wall into the depth buffer, hierarchical Z included
+//   test      - testing every sphere against it
+// Times are per frame, and the hidden column is how many spheres the test found behind the
+// wall.
+//
+// Usage: OcclusionCullerBenchmark [seconds per case]
+
+#include <vector>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/OcclusionCuller.h"
+
+using namespace std;
+
+#define BENCHMARK_WALL_WIDTH 60.0f
+#define BENCHMARK_WALL_HEIGHT 20.0f
+#define BENCHMARK_SCENE_SIZE 100.0f // Spheres are this far across and deep, the wall halfway in
+
+enum OcclusionCase
+{
+	OCCLUSION_RASTERIZE,
+	OCCLUSION_TEST,
+	OCCLUSION_CASE_COUNT
+};
+
+static const char* caseNames[OCCLUSION_CASE_COUNT] = { "rasterize", "test" };
+static const unsigned int wallCells[] = { 1, 32, 100 }; // Each way, two triangles a cell
+static const unsigned int sphereCounts[] = { 1000, 10000, 100000 };
+
+struct SCENE
+{
+	OcclusionCuller culler;
+	unsigned int wall;
+	XMFLOAT4X4 viewProjection;
+	vector<XMFLOAT4> spheres;
+};
+
+struct CaseResult
+{
+	double seconds;
+	double hidden;
+	unsigned int iterations;
+};
+
+static float Random(float range)
+{
+	return (float)rand() / (float)RAND_MAX * range;
+}
+
+static void MakeScene(SCENE& scene, unsigned int cells, unsigned int count)
+{
+	srand(count);
+	vector<Vertex> verticies;
+	vector<unsigned int> indicies;
+	for (unsigned int y = 0; y <= cells; ++y)
+	{
+		for (unsigned int x = 0; x <= cells; ++x)
+		{
+			Vertex vertex = {};
+			vertex.pos = XMFLOAT3(((float)x / cells - 0.5f) * BENCHMARK_WALL_WIDTH, (float)y / cells * BENCHMARK_WALL_HEIGHT, 0.0f);
+			verticies.push_back(vertex);
+		}
+	}
+	for (unsigned int y = 0; y < cells; ++y)
+	{
+		for (unsigned int x = 0; x < cells; ++x)
+		{
+			unsigned int corner = y * (cells + 1) + x;
+			unsigned int cell[6] = { corner, corner + cells + 1, corner + 1, corner + 1, corner + cells + 1, corner + cells + 2 };
+			indicies.insert(indicies.end(), cell, cell + 6);
+		}
+	}
+	scene.wall = scene.culler.AddOccluderMesh(&verticies[0], (unsigned int)verticies.size(), &indicies[0], (unsigned int)indicies.size());
+
+	XMMATRIX viewProjection = XMMatrixLookAtLH(XMVectorSet(0, 5, -BENCHMARK_SCENE_SIZE * 0.5f, 1), XMVectorSet(0, 5, 0, 1), XMVectorSet(0, 1, 0, 0)) *
+		XMMatrixPerspectiveFovLH(XMConvertToRadians(65), 2.0f, 0.1f, BENCHMARK_SCENE_SIZE * 2);
+	XMStoreFloat4x4(&scene.viewProjection, viewProjection);
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		float x = Random(BENCHMARK_SCENE_SIZE) - BENCHMARK_SCENE_SIZE * 0.5f;
+		float z = Random(BENCHMARK_SCENE_SIZE * 0.5f) + ((i & 3) ? 1.0f : -BENCHMARK_SCENE_SIZE * 0.4f); // A quarter in front of the wall
+		scene.spheres.push_back(XMFLOAT4(x, Random(BENCHMARK_WALL_HEIGHT), z, 0.5f + Random(1.5f)));
+	}
+}
+
+static void Rasterize(SCENE& scene)
+{
+	scene.culler.Begin(XMLoadFloat4x4(&scene.viewProjection));
+	scene.culler.AddOccluder(scene.wall, XMMatrixIdentity());
+	scene.culler.Finish();
+}
+
+static double Test(const SCENE& scene)
+{
+	double hidden = 0;
+	for (unsigned int i = 0; i < scene.spheres.size(); ++i)
+	{
+		const XMFLOAT4& sphere = scene.spheres[i];
+		if (!scene.culler.IsVisible(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w))
+			++hidden;
+	}
+	return hidden;
+}
+
+static CaseResult Measure(SCENE& scene, OcclusionCase occlusionCase, double secondsPerCase)
+{
+	Rasterize(scene);
+	CaseResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		if (occlusionCase == OCCLUSION_RASTERIZE)
+			Rasterize(scene);
+		else
+			total.hidden += Test(scene);
+		total.seconds += timer.Lap();
+		return true;
+	});
+	return total;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "Triangles", 9 }, { "Spheres", 8 }, { "Case", -10 }, { "Frame us", 12 }, { "Hidden", 10 },
+};
+
+int main(int argc, char** argv)
+{
+	double secondsPerCase = GetBenchmarkSeconds(argc, argv);
+
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+	for (unsigned int w = 0; w < sizeof(wallCells) / sizeof(wallCells[0]); ++w)
+	{
+		for (unsigned int c = 0; c < sizeof(sphereCounts) / sizeof(sphereCounts[0]); ++c)
+		{
+			SCENE scene;
+			MakeScene(scene, wallCells[w], sphereCounts[c]);
+			for (unsigned int o = 0; o < OCCLUSION_CASE_COUNT; ++o)
+			{
+				CaseResult result = Measure(scene, (OcclusionCase)o, secondsPerCase);
+				double n = result.iterations;
+				report.Number(scene.culler.GetTriangleCount(), 0);
+				report.Number(sphereCounts[c], 0);
+				report.Text(caseNames[o]);
+				report.Number(result.seconds / n * 1e6, 1);
+				if (o == OCCLUSION_TEST)
+					report.Number(result.hidden / n, 0);
+				else
+					report.Skip();
+				report.EndRow();
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "../Win32Project1/DrawQueue.h"
+#include "../Win32Project1/RecordingRenderContext.h"
+#include "Tests.h"
+
+using namespace std;
+
+#define TEST_OBJECT_BUFFER 1 // Id of the constant buffer every test object reads its constants from
+#define TEST_WRITE_MARK 1000 // Added to a written value in a trace, to tell it from a draw
+#define TEST_INSTANCE_BUFFER 2
+#define TEST_INSTANCED_SHADER 750 // Id of the instanced vertex shader that stands in for shader 0
+#define TEST_INSTANCE_COUNT 100
+#define TEST_MAX_OBJECT_SIZE 128 // Bytes of object constants the instancing tests write at most
+
+enum TEST_CONSTANTS
+{
+	TEST_CONSTANTS_NONE,
+	TEST_CONSTANTS_BOUND, // Binds the object buffer and reads whatever it already holds
+	TEST_CONSTANTS_WRITTEN // Writes its index count to the object buffer, then binds it
+};
+
+struct TEST_OBJECT
+{
+	unsigned int shader;
+	unsigned int texture;
+	bool blended;
+	float depth;
+	unsigned int indexCount; // Tells the draws apart once they reach the target
+	TEST_CONSTANTS constants;
+};
+
+// Sets everything a draw reads but its constants, the way each object in the scene does
+static void SetObjectState(DrawQueue& queue, const TEST_OBJECT& object)
+{
+	ID3D11ShaderResourceView* views[2] = { FakeObject<ID3D11ShaderResourceView>(200), FakeObject<ID3D11ShaderResourceView>(100 + object.texture) };
+	ID3D11SamplerState* sampler = FakeObject<ID3D11SamplerState>(300);
+
+	queue.SetSortDepth(object.depth);
+	queue.SetIndexBuffer(FakeObject<ID3D11Buffer>(400), DXGI_FORMAT_R32_UINT, 0);
+	queue.SetVertexBuffer(FakeObject<ID3D11Buffer>(500), 44, 0);
+	queue.SetInputLayout(FakeObject<ID3D11InputLayout>(600));
+	queue.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	queue.SetVertexShader(FakeObject<ID3D11VertexShader>(700 + object.shader));
+	queue.SetGeometryShader(nullptr);
+	queue.SetPixelShader(FakeObject<ID3D11PixelShader>(800 + object.shader));
+	queue.SetShaderResources(RENDER_STAGE_PIXEL, 0, 2, views);
+	queue.SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	queue.SetBlendState(object.blended ? FakeObject<ID3D11BlendState>(900) : nullptr);
+	queue.SetRasterizerState(FakeObject<ID3D11RasterizerState>(1000));
+}
+
+static void SubmitObject(DrawQueue& queue, const TEST_OBJECT& object)
+{
+	ID3D11Buffer* objectBuffer = FakeObject<ID3D11Buffer>(TEST_OBJECT_BUFFER);
+	SetObjectState(queue, object);
+	if (object.constants == TEST_CONSTANTS_WRITTEN)
+	{
+		uint32_t constants[4] = { object.indexCount, 0, 0, 0 };
+		queue.WriteConstants(objectBuffer, constants, sizeof(constants));
+	}
+	if (object.constants != TEST_CONSTANTS_NONE)
+		queue.SetConstantBuffers(RENDER_STAGE_VERTEX, DRAW_QUEUE_OBJECT_SLOT, 1, &objectBuffer);
+	queue.DrawIndexed(object.indexCount, 0, 0);
+}
+
+// The draws the target was given, by index count, with the values written to buffer
+// between them marked with TEST_WRITE_MARK
+static vector<unsigned int> TraceDraws(const RecordingRenderContext& recording, ID3D11Buffer* buffer)
+{
+	vector<unsigned int> trace;
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	for (unsigned int i = 0; i < commands.size(); ++i)
+	{
+		const RENDER_COMMAND& command = commands[i];
+		if (command.type == RENDER_DRAW_INDEXED)
+			trace.push_back(command.arguments[0]);
+		else if (command.type == RENDER_WRITE_CONSTANTS && command.objects[0] == buffer)
+		{
+			uint32_t value;
+			memcpy(&value, recording.GetConstantData(command), sizeof(value));
+			trace.push_back(TEST_WRITE_MARK + value);
+		}
+	}
+	return trace;
+}
+
+static bool TraceIs(const vector<unsigned int>& trace, const unsigned int* expected, unsigned int count)
+{
+	return trace.size() == count && equal(trace.begin(), trace.end(), expected);
+}
+
+// Opaque draws go by shader, then material, then front to back, and keep their order when
+// they tie; transparent ones follow, back to front
+static void TestSortedOrder()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, false, 5, 10 },
+		{ 1, 0, false, 1, 20 },
+		{ 0, 1, false, 1, 30 },
+		{ 0, 0, false, 2, 40 },
+		{ 0, 0, true, 1, 50 },
+		{ 0, 0, true, 9, 60 },
+		{ 0, 0, false, 3, 70 },
+		{ 0, 0, false, 3, 80 },
+	};
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	queue.Initialize(&recording, nullptr);
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+		SubmitObject(queue, objects[i]);
+	TEST_CHECK(recording.GetCommands().empty());
+
+	queue.Flush();
+	unsigned int expected[] = { 40, 70, 80, 10, 30, 20, 60, 50 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, nullptr), expected, ARRAYSIZE(expected)));
+	TEST_CHECK(queue.GetSubmittedDrawCount() == ARRAYSIZE(objects));
+	TEST_CHECK(queue.GetEmittedDrawCount() == ARRAYSIZE(objects));
+	TEST_CHECK(queue.GetSortCount() == 1);
+}
+
+// Only what changed from the last draw reaches the target, until Invalidate
+static void TestRedundantState()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, false, 1, 10 },
+		{ 0, 0, false, 2, 20 },
+		{ 0, 1, false, 3, 30 },
+	};
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	queue.Initialize(&recording, nullptr);
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+		SubmitObject(queue, objects[i]);
+	queue.Flush();
+
+	// The first draw sends all eleven calls its object made; the second none, and the third
+	// only the one view that changed
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	if (TEST_CHECK(commands.size() == 15))
+	{
+		TEST_CHECK(commands[11].type == RENDER_DRAW_INDEXED && commands[11].arguments[0] == 10);
+		TEST_CHECK(commands[12].type == RENDER_DRAW_INDEXED && commands[12].arguments[0] == 20);
+		TEST_CHECK(commands[13].type == RENDER_SET_SHADER_RESOURCES && commands[13].stage == RENDER_STAGE_PIXEL);
+		TEST_CHECK(commands[13].arguments[0] == 1 && commands[13].arguments[1] == 1);
+		TEST_CHECK(commands[13].objects[0] == FakeObject<ID3D11ShaderResourceView>(101));
+		TEST_CHECK(commands[14].type == RENDER_DRAW_INDEXED && commands[14].arguments[0] == 30);
+	}
+	TEST_CHECK(queue.GetSubmittedStateCount() == 33);
+	TEST_CHECK(queue.GetEmittedStateCount() == 12);
+
+	// What the target was last given carries over to the next flush
+	recording.Reset();
+	SubmitObject(queue, objects[0]);
+	queue.Flush();
+	TEST_CHECK(recording.GetCommands().size() == 2);
+	TEST_CHECK(recording.GetCount(RENDER_SET_SHADER_RESOURCES) == 1);
+
+	recording.Reset();
+	queue.Invalidate();
+	SubmitObject(queue, objects[0]);
+	queue.Flush();
+	TEST_CHECK(recording.GetCommands().size() == 12);
+}
+
+// Constants written between draws wait for the draw that reads them, wherever it sorts to
+static void TestDeferredWrites()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, false, 3, 10, TEST_CONSTANTS_WRITTEN },
+		{ 0, 0, false, 2, 20, TEST_CONSTANTS_WRITTEN },
+		{ 0, 0, false, 1, 30, TEST_CONSTANTS_WRITTEN },
+	};
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	queue.Initialize(&recording, nullptr);
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+		SubmitObject(queue, objects[i]);
+	TEST_CHECK(recording.GetCommands().empty());
+
+	queue.Flush();
+	// Front to back, each after its own write, and the buffer is left with the last one made
+	unsigned int expected[] = { 1030, 30, 1020, 20, 1010, 10, 1030 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, FakeObject<ID3D11Buffer>(TEST_OBJECT_BUFFER)), expected, ARRAYSIZE(expected)));
+	TEST_CHECK(queue.GetSortCount() == 1);
+}
+
+// A flush leaves each written buffer with its last write, sending it only if the draws did not
+static void TestLatestWrites()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, false, 1, 10, TEST_CONSTANTS_WRITTEN },
+		{ 0, 0, false, 2, 20, TEST_CONSTANTS_WRITTEN },
+	};
+	ID3D11Buffer* frameBuffer = FakeObject<ID3D11Buffer>(2);
+	uint32_t frameConstants[2][4] = { { 7 }, { 8 } };
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	queue.Initialize(&recording, nullptr);
+
+	// Nothing reads the frame buffer, so only its second write is sent
+	queue.WriteConstants(frameBuffer, frameConstants[0], sizeof(frameConstants[0]));
+	SubmitObject(queue, objects[0]);
+	SubmitObject(queue, objects[1]);
+	queue.DrawIndexed(20, 0, 0);
+	queue.WriteConstants(frameBuffer, frameConstants[1], sizeof(frameConstants[1]));
+	queue.Flush();
+
+	// The last draw already read the last write, so the object buffer is not written again
+	unsigned int expected[] = { 1010, 10, 1020, 20, 20 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, FakeObject<ID3D11Buffer>(TEST_OBJECT_BUFFER)), expected, ARRAYSIZE(expected)));
+	unsigned int expectedFrame[] = { 10, 20, 20, TEST_WRITE_MARK + 8 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, frameBuffer), expectedFrame, ARRAYSIZE(expectedFrame)));
+
+	// Without any draws the writes still go through
+	recording.Reset();
+	queue.WriteConstants(frameBuffer, frameConstants[0], sizeof(frameConstants[0]));
+	queue.Flush();
+	unsigned int expectedAlone[] = { TEST_WRITE_MARK + 7 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, frameBuffer), expectedAlone, ARRAYSIZE(expectedAlone)));
+}
+
+// A draw that reads what a buffer held before the flush is sent before a later write to
+// that buffer, even though it sorts after the draw that reads the write
+static void TestWriteAfterUnwrittenRead()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, false, 5, 10, TEST_CONSTANTS_BOUND },
+		{ 0, 0, false, 1, 20, TEST_CONSTANTS_WRITTEN },
+	};
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	queue.Initialize(&recording, nullptr);
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+		SubmitObject(queue, objects[i]);
+	queue.Flush();
+
+	unsigned int expected[] = { 10, 1020, 20 };
+	TEST_CHECK(TraceIs(TraceDraws(recording, FakeObject<ID3D11Buffer>(TEST_OBJECT_BUFFER)), expected, ARRAYSIZE(expected)));
+	TEST_CHECK(queue.GetSortCount() == 2);
+}
+
+// Draws the object with size bytes of its own constants, which start with value
+static void SubmitInstance(DrawQueue& queue, const TEST_OBJECT& object, uint32_t value, unsigned int size)
+{
+	uint32_t constants[TEST_MAX_OBJECT_SIZE / 4] = { value };
+	ID3D11Buffer* objectBuffer = FakeObject<ID3D11Buffer>(TEST_OBJECT_BUFFER);
+	SetObjectState(queue, object);
+	queue.WriteConstants(objectBuffer, constants, size);
+	queue.SetConstantBuffers(RENDER_STAGE_VERTEX, DRAW_QUEUE_OBJECT_SLOT, 1, &objectBuffer);
+	queue.DrawIndexed(object.indexCount, 0, 0);
+}
+
+// A queue that merges the draws of shader 0, with a fake instance buffer
+static void InitializeInstancing(DrawQueue& queue, RecordingRenderContext& recording, unsigned int objectSize)
+{
+	queue.Initialize(&recording, nullptr);
+	queue.SetInstanceBuffer(FakeObject<ID3D11Buffer>(TEST_INSTANCE_BUFFER));
+	queue.AddInstancedShader(FakeObject<ID3D11VertexShader>(700), FakeObject<ID3D11VertexShader>(TEST_INSTANCED_SHADER), objectSize);
+}
+
+// The instanced draws the target was given, each with the first value of every instance's
+// constants in the instance buffer written just before it
+static vector<vector<uint32_t> > TraceInstances(const RecordingRenderContext& recording, unsigned int objectSize)
+{
+	vector<vector<uint32_t> > batches;
+	const uint8_t* instances = nullptr;
+	unsigned int instancesSize = 0;
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	for (unsigned int i = 0; i < commands.size(); ++i)
+	{
+		const RENDER_COMMAND& command = commands[i];
+		if (command.type == RENDER_WRITE_CONSTANTS && command.objects[0] == FakeObject<ID3D11Buffer>(TEST_INSTANCE_BUFFER))
+		{
+			instances = recording.GetConstantData(command);
+			instancesSize = command.arguments[0];
+		}
+		else if (command.type == RENDER_DRAW_INDEXED_INSTANCED)
+		{
+			vector<uint32_t> batch;
+			for (unsigned int instance = 0; instance < command.arguments[1] && instances && (instance + 1) * objectSize <= instancesSize; ++instance)
+			{
+				uint32_t value;
+				memcpy(&value, instances + instance * objectSize, sizeof(value));
+				batch.push_back(value);
+			}
+			batches.push_back(batch);
+			instances = nullptr;
+		}
+	}
+	return batches;
+}
+
+// Whether batch holds the values first, first - 1 and on for count instances
+static bool BatchCountsDown(const vector<uint32_t>& batch, uint32_t first, unsigned int count)
+{
+	if (batch.size() != count)
+		return false;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		if (batch[i] != first - i)
+			return false;
+	}
+	return true;
+}
+
+// Matching opaque draws go as one instanced draw per instance buffer's worth, front to back,
+// with their constants gathered in that order
+static void TestInstancedDraws()
+{
+	TEST_OBJECT object = { 0, 0, false, 0, 36 };
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	InitializeInstancing(queue, recording, 64);
+	for (unsigned int i = 0; i < TEST_INSTANCE_COUNT; ++i)
+	{
+		object.depth = (float)(TEST_INSTANCE_COUNT - i);
+		SubmitInstance(queue, object, i, 64);
+	}
+	queue.Flush();
+
+	// 4096 bytes hold 64 instances of 64 bytes
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED) == 0);
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED_INSTANCED) == 2);
+	TEST_CHECK(recording.GetInstanceCount() == TEST_INSTANCE_COUNT);
+	TEST_CHECK(queue.GetSubmittedDrawCount() == TEST_INSTANCE_COUNT);
+	TEST_CHECK(queue.GetEmittedDrawCount() == 2);
+	vector<vector<uint32_t> > batches = TraceInstances(recording, 64);
+	if (TEST_CHECK(batches.size() == 2))
+	{
+		TEST_CHECK(BatchCountsDown(batches[0], TEST_INSTANCE_COUNT - 1, 64));
+		TEST_CHECK(BatchCountsDown(batches[1], TEST_INSTANCE_COUNT - 65, TEST_INSTANCE_COUNT - 64));
+	}
+
+	// Each went with the instanced shader, reading the instance buffer in the object slot
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	bool instancedShader = false;
+	bool instanceBuffer = false;
+	for (unsigned int i = 0; i < commands.size(); ++i)
+	{
+		const RENDER_COMMAND& command = commands[i];
+		if (command.type == RENDER_SET_VERTEX_SHADER)
+			instancedShader = command.objects[0] == FakeObject<ID3D11VertexShader>(TEST_INSTANCED_SHADER);
+		else if (command.type == RENDER_SET_CONSTANT_BUFFERS && command.stage == RENDER_STAGE_VERTEX && command.arguments[0] == DRAW_QUEUE_OBJECT_SLOT)
+			instanceBuffer = command.objects[0] == FakeObject<ID3D11Buffer>(TEST_INSTANCE_BUFFER);
+		else if (command.type == RENDER_DRAW_INDEXED_INSTANCED)
+		{
+			TEST_CHECK(command.arguments[0] == 36 && command.arguments[2] == 0 && command.arguments[4] == 0);
+			TEST_CHECK(instancedShader && instanceBuffer);
+		}
+	}
+}
+
+// Instances are packed objectSize bytes apart, as many as fit; sizes the instanced shader
+// could not index are refused
+static void TestObjectSizes()
+{
+	TEST_OBJECT object = { 0, 0, false, 1, 36 };
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	InitializeInstancing(queue, recording, 80);
+	for (unsigned int i = 0; i < TEST_INSTANCE_COUNT; ++i)
+		SubmitInstance(queue, object, TEST_INSTANCE_COUNT - i, 80);
+	queue.Flush();
+
+	// 51 instances of 80 bytes fit in 4096
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	for (unsigned int i = 0; i < commands.size(); ++i)
+	{
+		if (commands[i].type == RENDER_WRITE_CONSTANTS && commands[i].objects[0] == FakeObject<ID3D11Buffer>(TEST_INSTANCE_BUFFER))
+			TEST_CHECK(commands[i].arguments[0] == 51 * 80 || commands[i].arguments[0] == (TEST_INSTANCE_COUNT - 51) * 80);
+	}
+	vector<vector<uint32_t> > batches = TraceInstances(recording, 80);
+	if (TEST_CHECK(batches.size() == 2))
+	{
+		TEST_CHECK(BatchCountsDown(batches[0], TEST_INSTANCE_COUNT, 51));
+		TEST_CHECK(BatchCountsDown(batches[1], TEST_INSTANCE_COUNT - 51, TEST_INSTANCE_COUNT - 51));
+	}
+
+	// Constants too small for the instanced shader keep the draws apart
+	recording.Reset();
+	for (unsigned int i = 0; i < 3; ++i)
+		SubmitInstance(queue, object, i, 64);
+	queue.Flush();
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED) == 3);
+
+	unsigned int refusedSizes[] = { 0, 72, DRAW_QUEUE_INSTANCE_BUFFER_SIZE / 2 + 16 };
+	for (unsigned int i = 0; i < ARRAYSIZE(refusedSizes); ++i)
+	{
+		DrawQueue refusing;
+		recording.Reset();
+		InitializeInstancing(refusing, recording, refusedSizes[i]);
+		for (unsigned int j = 0; j < 3; ++j)
+			SubmitInstance(refusing, object, j, TEST_MAX_OBJECT_SIZE);
+		refusing.Flush();
+		TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED) == 3);
+		TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED_INSTANCED) == 0);
+	}
+}
+
+// Transparent draws only merge with the ones next to them back to front; opaque ones merge
+// past anything
+static void TestTransparentInstances()
+{
+	TEST_OBJECT objects[] =
+	{
+		{ 0, 0, true, 9, 36 },
+		{ 0, 1, true, 8, 36 },
+		{ 0, 0, true, 7, 36 },
+		{ 0, 0, true, 6, 36 },
+	};
+	RecordingRenderContext recording;
+	DrawQueue queue;
+	InitializeInstancing(queue, recording, 64);
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+		SubmitInstance(queue, objects[i], i, 64);
+	queue.Flush();
+
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	vector<unsigned int> drawInstances;
+	for (unsigned int i = 0; i < commands.size(); ++i)
+	{
+		if (commands[i].type == RENDER_DRAW_INDEXED)
+			drawInstances.push_back(1);
+		else if (commands[i].type == RENDER_DRAW_INDEXED_INSTANCED)
+			drawInstances.push_back(commands[i].arguments[1]);
+	}
+	unsigned int expected[] = { 1, 1, 2 };
+	TEST_CHECK(TraceIs(drawInstances, expected, ARRAYSIZE(expected)));
+	vector<vector<uint32_t> > batches = TraceInstances(recording, 64);
+	TEST_CHECK(batches.size() == 1 && batches[0].size() == 2 && batches[0][0] == 2 && batches[0][1] == 3);
+
+	recording.Reset();
+	for (unsigned int i = 0; i < ARRAYSIZE(objects); ++i)
+	{
+		objects[i].blended = false;
+		SubmitInstance(queue, objects[i], i, 64);
+	}
+	queue.Flush();
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED) == 1);
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED_INSTANCED) == 1);
+	TEST_CHECK(recording.GetInstanceCount() == ARRAYSIZE(objects));
+}
+
+void TestDrawQueue()
+{
+	TestSortedOrder();
+	TestRedundantState();
+	TestDeferredWrites();
+	TestLatestWrites();
+	TestWriteAfterUnwrittenRead();
+	TestInstancedDraws();
+	TestObjectSizes();
+	TestTransparentInstances();
+}
@@ -0,0 +1,123 @@
+#include <vector>
+
+#include "../Win32Project1/FilteringRenderContext.h"
+#include "../Win32Project1/RecordingRenderContext.h"
+#include "Tests.h"
+
+using namespace std;
+
+// Whether the last call the target got binds count objects from slot on, starting with first
+static bool LastBindIs(const RecordingRenderContext& recording, RENDER_COMMAND_TYPE type, unsigned int slot, unsigned int count, const void* first)
+{
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	if (commands.empty())
+		return false;
+	const RENDER_COMMAND& command = commands.back();
+	return command.type == type && command.stage == RENDER_STAGE_PIXEL && command.arguments[0] == slot && command.arguments[1] == count && command.objects[0] == first;
+}
+
+// Binding several slots where only one changed sends just that slot
+static void TestMultiSlotBind()
+{
+	RecordingRenderContext recording;
+	FilteringRenderContext filtering;
+	filtering.Initialize(&recording);
+
+	ID3D11ShaderResourceView* views[3] = { FakeObject<ID3D11ShaderResourceView>(1), FakeObject<ID3D11ShaderResourceView>(2), FakeObject<ID3D11ShaderResourceView>(3) };
+	ID3D11SamplerState* samplers[3] = { FakeObject<ID3D11SamplerState>(4), FakeObject<ID3D11SamplerState>(5), FakeObject<ID3D11SamplerState>(6) };
+	ID3D11Buffer* buffers[3] = { FakeObject<ID3D11Buffer>(7), FakeObject<ID3D11Buffer>(8), FakeObject<ID3D11Buffer>(9) };
+	filtering.SetShaderResources(RENDER_STAGE_PIXEL, 2, 3, views);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_SHADER_RESOURCES, 2, 3, views[0]));
+	filtering.SetSamplers(RENDER_STAGE_PIXEL, 2, 3, samplers);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_SAMPLERS, 2, 3, samplers[0]));
+	filtering.SetConstantBuffers(RENDER_STAGE_PIXEL, 2, 3, buffers);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_CONSTANT_BUFFERS, 2, 3, buffers[0]));
+
+	views[1] = FakeObject<ID3D11ShaderResourceView>(10);
+	filtering.SetShaderResources(RENDER_STAGE_PIXEL, 2, 3, views);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_SHADER_RESOURCES, 3, 1, views[1]));
+	samplers[1] = FakeObject<ID3D11SamplerState>(11);
+	filtering.SetSamplers(RENDER_STAGE_PIXEL, 2, 3, samplers);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_SAMPLERS, 3, 1, samplers[1]));
+	buffers[1] = FakeObject<ID3D11Buffer>(12);
+	filtering.SetConstantBuffers(RENDER_STAGE_PIXEL, 2, 3, buffers);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_CONSTANT_BUFFERS, 3, 1, buffers[1]));
+
+	// The first and last changing sends the middle one with them
+	views[0] = FakeObject<ID3D11ShaderResourceView>(13);
+	views[2] = FakeObject<ID3D11ShaderResourceView>(14);
+	filtering.SetShaderResources(RENDER_STAGE_PIXEL, 2, 3, views);
+	TEST_CHECK(LastBindIs(recording, RENDER_SET_SHADER_RESOURCES, 2, 3, views[0]));
+	TEST_CHECK(recording.GetCommands().size() == 7);
+	TEST_CHECK(filtering.GetFilteredCount() == 0);
+}
+
+// A call that would bind what is already bound never reaches the target
+static void TestRepeatedBind()
+{
+	RecordingRenderContext recording;
+	FilteringRenderContext filtering;
+	filtering.Initialize(&recording);
+
+	D3D11_VIEWPORT viewport = { 0, 0, 1000, 500, 0, 1 };
+	ID3D11ShaderResourceView* views[2] = { FakeObject<ID3D11ShaderResourceView>(1), FakeObject<ID3D11ShaderResourceView>(2) };
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		filtering.SetVertexShader(FakeObject<ID3D11VertexShader>(3));
+		filtering.SetIndexBuffer(FakeObject<ID3D11Buffer>(4), DXGI_FORMAT_R32_UINT, 0);
+		filtering.SetBlendState(nullptr);
+		filtering.SetViewport(viewport);
+		filtering.SetConstantBufferRange(RENDER_STAGE_VERTEX, 1, FakeObject<ID3D11Buffer>(5), 16, 4);
+		filtering.SetShaderResources(RENDER_STAGE_PIXEL, 0, 2, views);
+		filtering.DrawIndexed(36, 0, 0);
+	}
+	TEST_CHECK(recording.GetCommands().size() == 8);
+	TEST_CHECK(recording.GetCount(RENDER_DRAW_INDEXED) == 2);
+	TEST_CHECK(filtering.GetFilteredCount(RENDER_SET_VERTEX_SHADER) == 1);
+	TEST_CHECK(filtering.GetFilteredCount(RENDER_SET_BLEND_STATE) == 1);
+	TEST_CHECK(filtering.GetFilteredCount(RENDER_SET_SHADER_RESOURCES) == 1);
+	TEST_CHECK(filtering.GetFilteredCount() == 6);
+
+	// Anything that differs still goes through
+	filtering.SetIndexBuffer(FakeObject<ID3D11Buffer>(4), DXGI_FORMAT_R32_UINT, 12);
+	filtering.SetConstantBufferRange(RENDER_STAGE_VERTEX, 1, FakeObject<ID3D11Buffer>(5), 32, 4);
+	viewport.Width = 800;
+	filtering.SetViewport(viewport);
+	TEST_CHECK(recording.GetCommands().size() == 11);
+
+	filtering.ResetCounts();
+	TEST_CHECK(filtering.GetFilteredCount() == 0);
+}
+
+// After Invalidate nothing is known to be bound, so the same calls go through again
+static void TestInvalidate()
+{
+	RecordingRenderContext recording;
+	FilteringRenderContext filtering;
+	filtering.Initialize(&recording);
+
+	ID3D11SamplerState* sampler = FakeObject<ID3D11SamplerState>(1);
+	filtering.SetPixelShader(FakeObject<ID3D11PixelShader>(2));
+	filtering.SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	filtering.SetRenderTargets(FakeObject<ID3D11RenderTargetView>(3), nullptr);
+	filtering.SetPixelShader(FakeObject<ID3D11PixelShader>(2));
+	filtering.SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	filtering.SetRenderTargets(FakeObject<ID3D11RenderTargetView>(3), nullptr);
+	TEST_CHECK(recording.GetCommands().size() == 3);
+
+	filtering.Invalidate();
+	filtering.SetPixelShader(FakeObject<ID3D11PixelShader>(2));
+	filtering.SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	filtering.SetRenderTargets(FakeObject<ID3D11RenderTargetView>(3), nullptr);
+	TEST_CHECK(recording.GetCommands().size() == 6);
+	TEST_CHECK(recording.GetCommands().back().type == RENDER_SET_RENDER_TARGETS);
+	TEST_CHECK(recording.GetCount(RENDER_SET_SAMPLERS) == 2);
+	TEST_CHECK(filtering.GetFilteredCount() == 3);
+}
+
+void TestFilteringRenderContext()
+{
+	TestMultiSlotBind();
+	TestRepeatedBind();
+	TestInvalidate();
+}
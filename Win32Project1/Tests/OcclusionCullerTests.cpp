@@ -0,0 +1,143 @@
+#include <math.h>
+#include <vector>
+
+#include "../Win32Project1/OcclusionCuller.h"
+#include "Tests.h"
+
+using namespace std;
+
+#define TEST_QUAD_DEPTH 10.0f // The quad faces the camera this far along z
+#define TEST_QUAD_SIZE 2.0f // And reaches this far from the middle of the screen each way
+#define TEST_NEAR_PLANE 1.0f
+#define TEST_FAR_PLANE 100.0f
+
+// Looking down z from the origin, with the aspect ratio of the depth buffer
+static XMMATRIX TestViewProjection()
+{
+	return XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)OCCLUSION_WIDTH / OCCLUSION_HEIGHT, TEST_NEAR_PLANE, TEST_FAR_PLANE);
+}
+
+// The quad split into cells by cells squares of two triangles each
+static unsigned int AddQuad(OcclusionCuller& culler, unsigned int cells)
+{
+	vector<Vertex> verticies;
+	vector<unsigned int> indicies;
+	for (unsigned int y = 0; y <= cells; ++y)
+	{
+		for (unsigned int x = 0; x <= cells; ++x)
+		{
+			Vertex vertex = {};
+			vertex.pos = XMFLOAT3(((float)x / cells * 2 - 1) * TEST_QUAD_SIZE, ((float)y / cells * 2 - 1) * TEST_QUAD_SIZE, TEST_QUAD_DEPTH);
+			verticies.push_back(vertex);
+		}
+	}
+	for (unsigned int y = 0; y < cells; ++y)
+	{
+		for (unsigned int x = 0; x < cells; ++x)
+		{
+			unsigned int corner = y * (cells + 1) + x;
+			unsigned int cell[6] = { corner, corner + cells + 1, corner + 1, corner + 1, corner + cells + 1, corner + cells + 2 };
+			indicies.insert(indicies.end(), cell, cell + 6);
+		}
+	}
+	return culler.AddOccluderMesh(&verticies[0], (unsigned int)verticies.size(), &indicies[0], (unsigned int)indicies.size());
+}
+
+static void DrawQuad(OcclusionCuller& culler, unsigned int mesh)
+{
+	culler.Begin(TestViewProjection());
+	culler.AddOccluder(mesh, XMMatrixIdentity());
+	culler.Finish();
+}
+
+// The depth the quad lands at, as the projection puts it
+static float QuadDepth()
+{
+	return XMVectorGetZ(XMVector3TransformCoord(XMVectorSet(0, 0, TEST_QUAD_DEPTH, 1), TestViewProjection()));
+}
+
+// The quad's depth is where it is drawn, and only there; a tile takes it only when the quad
+// covers all of it
+static void TestQuadDepth()
+{
+	OcclusionCuller culler;
+	TEST_CHECK(culler.GetDepth(OCCLUSION_WIDTH / 2, OCCLUSION_HEIGHT / 2) == 1.0f);
+	DrawQuad(culler, AddQuad(culler, 1));
+	TEST_CHECK(culler.GetTriangleCount() == 2);
+
+	// The quad covers a tenth of the width and a fifth of the height, around the middle
+	float quadDepth = QuadDepth();
+	TEST_CHECK(fabsf(culler.GetDepth(OCCLUSION_WIDTH / 2, OCCLUSION_HEIGHT / 2) - quadDepth) < 1e-5f);
+	TEST_CHECK(fabsf(culler.GetDepth(120, 55) - quadDepth) < 1e-5f);
+	TEST_CHECK(fabsf(culler.GetDepth(136, 73) - quadDepth) < 1e-5f);
+	TEST_CHECK(culler.GetDepth(110, OCCLUSION_HEIGHT / 2) == 1.0f);
+	TEST_CHECK(culler.GetDepth(OCCLUSION_WIDTH / 2, 80) == 1.0f);
+	TEST_CHECK(culler.GetDepth(0, 0) == 1.0f);
+	TEST_CHECK(culler.GetDepth(OCCLUSION_WIDTH, 0) == 1.0f);
+
+	unsigned int middleTileX = OCCLUSION_WIDTH / 2 / OCCLUSION_TILE_SIZE;
+	unsigned int middleTileY = OCCLUSION_HEIGHT / 2 / OCCLUSION_TILE_SIZE;
+	TEST_CHECK(fabsf(culler.GetTileDepth(middleTileX, middleTileY) - quadDepth) < 1e-5f);
+	TEST_CHECK(fabsf(culler.GetTileDepth(middleTileX - 1, middleTileY - 1) - quadDepth) < 1e-5f);
+	// Pixels 112 to 119 across, and the quad starts at 115
+	TEST_CHECK(culler.GetTileDepth(middleTileX - 2, middleTileY) == 1.0f);
+	TEST_CHECK(culler.GetTileDepth(0, 0) == 1.0f);
+
+	// A frame without the quad clears it again
+	culler.Begin(TestViewProjection());
+	culler.Finish();
+	TEST_CHECK(culler.GetTriangleCount() == 0);
+	TEST_CHECK(culler.GetDepth(OCCLUSION_WIDTH / 2, OCCLUSION_HEIGHT / 2) == 1.0f);
+	TEST_CHECK(culler.GetTileDepth(middleTileX, middleTileY) == 1.0f);
+}
+
+// Only a sphere wholly behind the quad is hidden
+static void TestSpheres()
+{
+	OcclusionCuller culler;
+	DrawQuad(culler, AddQuad(culler, 1));
+
+	TEST_CHECK(!culler.IsVisible(XMFLOAT3(0, 0, TEST_QUAD_DEPTH * 2), 0.5f));
+	TEST_CHECK(!culler.IsVisible(XMFLOAT3(0.5f, -0.5f, TEST_QUAD_DEPTH + 4), 0.5f));
+	// Behind it, but reaching a tile the quad only partly covers
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(1.5f, 0, TEST_QUAD_DEPTH + 2), 0.5f));
+	// Beside the quad, in front of it and reaching through it
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(TEST_QUAD_SIZE * 4, 0, TEST_QUAD_DEPTH * 2), 0.5f));
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(0, TEST_QUAD_SIZE * 3, TEST_QUAD_DEPTH * 2), 0.5f));
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(0, 0, TEST_QUAD_DEPTH / 2), 0.5f));
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(0, 0, TEST_QUAD_DEPTH + 0.25f), 0.5f));
+	// Across the near plane, and behind the camera
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(0, 0, TEST_NEAR_PLANE), 0.5f));
+	TEST_CHECK(culler.IsVisible(XMFLOAT3(0, 0, -TEST_QUAD_DEPTH), 0.5f));
+}
+
+// A quad finely split enough to go to the worker threads draws the same depth, frame after
+// frame, as the same quad drawn on the calling thread
+static void TestThreadedQuad()
+{
+	OcclusionCuller single;
+	DrawQuad(single, AddQuad(single, 1));
+
+	OcclusionCuller threaded;
+	unsigned int mesh = AddQuad(threaded, 32);
+	for (unsigned int frame = 0; frame < 3; ++frame)
+	{
+		DrawQuad(threaded, mesh);
+		TEST_CHECK(threaded.GetTriangleCount() >= OCCLUSION_THREADED_TRIANGLES);
+
+		unsigned int mismatches = 0;
+		for (unsigned int y = 0; y < OCCLUSION_HEIGHT; ++y)
+			for (unsigned int x = 0; x < OCCLUSION_WIDTH; ++x)
+				if (fabsf(threaded.GetDepth(x, y) - single.GetDepth(x, y)) > 1e-5f)
+					++mismatches;
+		TEST_CHECK(mismatches == 0);
+		TEST_CHECK(!threaded.IsVisible(XMFLOAT3(0, 0, TEST_QUAD_DEPTH * 2), 0.5f));
+	}
+}
+
+void TestOcclusionCuller()
+{
+	TestQuadDepth();
+	TestSpheres();
+	TestThreadedQuad();
+}
@@ -0,0 +1,115 @@
+#include <d3d11.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../Win32Project1/PNGTextureLoader.h"
+#include "Tests.h"
+
+using namespace std;
+
+static void AppendBigEndian32(vector<uint8_t>& file, uint32_t value)
+{
+	file.push_back((uint8_t)(value >> 24));
+	file.push_back((uint8_t)(value >> 16));
+	file.push_back((uint8_t)(value >> 8));
+	file.push_back((uint8_t)value);
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; ++bit)
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+static void AppendChunk(vector<uint8_t>& file, const char type[4], const vector<uint8_t>& data)
+{
+	AppendBigEndian32(file, (uint32_t)data.size());
+	size_t start = file.size();
+	file.insert(file.end(), type, type + 4);
+	file.insert(file.end(), data.begin(), data.end());
+	AppendBigEndian32(file, Crc32(&file[start], file.size() - start));
+}
+
+// An RGBA8 PNG whose zlib stream holds the rows uncompressed, in stored blocks of at most
+// blockSize bytes, the way zlib writes level 0 and incompressible data
+static vector<uint8_t> BuildStoredPNG(const vector<uint8_t>& rows, uint32_t width, uint32_t height, size_t blockSize)
+{
+	static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	vector<uint8_t> file(signature, signature + 8);
+
+	vector<uint8_t> header;
+	AppendBigEndian32(header, width);
+	AppendBigEndian32(header, height);
+	uint8_t depthTypeMethods[5] = { 8, 6, 0, 0, 0 };
+	header.insert(header.end(), depthTypeMethods, depthTypeMethods + 5);
+	AppendChunk(file, "IHDR", header);
+
+	vector<uint8_t> stream;
+	stream.push_back(0x78);
+	stream.push_back(0x01);
+	for (size_t offset = 0; offset < rows.size(); offset += blockSize)
+	{
+		size_t length = min(blockSize, rows.size() - offset);
+		stream.push_back(offset + length == rows.size() ? 1 : 0);
+		stream.push_back((uint8_t)length);
+		stream.push_back((uint8_t)(length >> 8));
+		stream.push_back((uint8_t)~length);
+		stream.push_back((uint8_t)(~length >> 8));
+		stream.insert(stream.end(), rows.begin() + offset, rows.begin() + offset + length);
+	}
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		a = (a + rows[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	AppendBigEndian32(stream, (b << 16) | a);
+	AppendChunk(file, "IDAT", stream);
+
+	AppendChunk(file, "IEND", vector<uint8_t>());
+	return file;
+}
+
+// Several stored blocks in a row, each longer than what the bit buffer holds when it starts
+static void TestStoredBlocks(uint32_t width, uint32_t height, size_t blockSize)
+{
+	vector<uint8_t> rows;
+	vector<uint8_t> expected;
+	uint32_t seed = width * 31 + height;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		rows.push_back(0); // No filter
+		for (uint32_t x = 0; x < width * 4; ++x)
+		{
+			seed = seed * 1664525 + 1013904223;
+			rows.push_back((uint8_t)(seed >> 24));
+			expected.push_back(rows.back());
+		}
+	}
+	vector<uint8_t> file = BuildStoredPNG(rows, width, height, blockSize);
+
+	unique_ptr<uint8_t[]> pixels;
+	size_t decodedWidth = 0, decodedHeight = 0;
+	D3D11_SUBRESOURCE_DATA initData;
+	if (!TEST_CHECK(SUCCEEDED(DecodePNGFromMemory(&file[0], file.size(), pixels, &decodedWidth, &decodedHeight, &initData))))
+		return;
+	TEST_CHECK(decodedWidth == width && decodedHeight == height);
+	TEST_CHECK(initData.SysMemPitch == width * 4);
+	TEST_CHECK(memcmp(pixels.get(), &expected[0], expected.size()) == 0);
+}
+
+void TestPNGTextureLoader()
+{
+	TestStoredBlocks(16, 16, 100);
+	TestStoredBlocks(16, 16, 9);
+	// Incompressible rows split the way zlib splits them, at 65535 bytes
+	TestStoredBlocks(160, 120, 65535);
+}
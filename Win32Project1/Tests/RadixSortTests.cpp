@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <vector>
+
+#include "../Win32Project1/RadixSort.h"
+#include "Tests.h"
+
+using namespace std;
+
+#define TEST_ITEM_COUNT 1000
+
+// The same numbers every run, over all 64 bits
+static uint64_t NextRandom(uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static bool KeyLess(const RADIX_SORT_ITEM& a, const RADIX_SORT_ITEM& b)
+{
+	return a.key < b.key;
+}
+
+// Items numbered 0 up in the order they came in, as the draw queue numbers them
+static vector<RADIX_SORT_ITEM> MakeItems(const vector<uint64_t>& keys)
+{
+	vector<RADIX_SORT_ITEM> items(keys.size());
+	for (unsigned int i = 0; i < keys.size(); ++i)
+	{
+		items[i].key = keys[i];
+		items[i].index = i;
+	}
+	return items;
+}
+
+static bool SameItems(const vector<RADIX_SORT_ITEM>& a, const vector<RADIX_SORT_ITEM>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (unsigned int i = 0; i < a.size(); ++i)
+	{
+		if (a[i].key != b[i].key || a[i].index != b[i].index)
+			return false;
+	}
+	return true;
+}
+
+// Whether RadixSort puts the keys in the order std::stable_sort does, equal keys included
+static bool SortsLikeStableSort(const vector<uint64_t>& keys)
+{
+	vector<RADIX_SORT_ITEM> items = MakeItems(keys);
+	vector<RADIX_SORT_ITEM> expected = items;
+	vector<RADIX_SORT_ITEM> scratch;
+	stable_sort(expected.begin(), expected.end(), KeyLess);
+	RadixSort(items, scratch);
+	return SameItems(items, expected);
+}
+
+static void TestRandomKeys()
+{
+	uint64_t state = 88172645463325252ull;
+	vector<uint64_t> keys;
+	for (unsigned int i = 0; i < TEST_ITEM_COUNT; ++i)
+		keys.push_back(NextRandom(state));
+	TEST_CHECK(SortsLikeStableSort(keys));
+
+	// Too few to sort, and the scratch kept from a larger sort
+	TEST_CHECK(SortsLikeStableSort(vector<uint64_t>()));
+	TEST_CHECK(SortsLikeStableSort(vector<uint64_t>(1, 5)));
+	keys.resize(3);
+	TEST_CHECK(SortsLikeStableSort(keys));
+}
+
+// Equal keys stay in the order they came in, whichever passes are skipped
+static void TestEqualKeys()
+{
+	uint64_t state = 2463534242ull;
+	vector<uint64_t> keys;
+	for (unsigned int i = 0; i < TEST_ITEM_COUNT; ++i)
+		keys.push_back(NextRandom(state) % 4);
+	TEST_CHECK(SortsLikeStableSort(keys));
+
+	for (unsigned int i = 0; i < keys.size(); ++i)
+		keys[i] = (keys[i] << 62) | 0x0123456789abcdull;
+	TEST_CHECK(SortsLikeStableSort(keys));
+
+	TEST_CHECK(SortsLikeStableSort(vector<uint64_t>(TEST_ITEM_COUNT, 42)));
+}
+
+// Each bit counts, in the top byte as much as the bottom one
+static void TestEveryBit()
+{
+	vector<uint64_t> keys;
+	for (int bit = 63; bit >= 0; --bit)
+		keys.push_back(1ull << bit);
+	keys.push_back(0);
+	keys.push_back(~0ull);
+	TEST_CHECK(SortsLikeStableSort(keys));
+
+	// One key a bit above the others, for each bit
+	bool allSorted = true;
+	for (unsigned int bit = 0; bit < 64; ++bit)
+	{
+		vector<uint64_t> single(3, 0);
+		single[0] = 1ull << bit;
+		allSorted = allSorted && SortsLikeStableSort(single);
+	}
+	TEST_CHECK(allSorted);
+}
+
+// An order is only reused while it still sorts the items exactly as RadixSort would
+static void TestReuseSortOrder()
+{
+	uint64_t state = 1181783497276652981ull;
+	vector<uint64_t> keys;
+	for (unsigned int i = 0; i < TEST_ITEM_COUNT; ++i)
+		keys.push_back(NextRandom(state) % 64);
+	vector<RADIX_SORT_ITEM> order = MakeItems(keys);
+	vector<RADIX_SORT_ITEM> scratch;
+	RadixSort(order, scratch);
+
+	vector<RADIX_SORT_ITEM> items = MakeItems(keys);
+	TEST_CHECK(ReuseSortOrder(order, items, scratch));
+	TEST_CHECK(SameItems(items, order));
+
+	// A key that moved past its neighbour, and one that now ties with a later item
+	vector<uint64_t> changed = keys;
+	changed[order[0].index] = 64;
+	items = MakeItems(changed);
+	TEST_CHECK(!ReuseSortOrder(order, items, scratch));
+	TEST_CHECK(SameItems(items, MakeItems(changed)));
+
+	unsigned int tie = 0;
+	while (tie + 1 < order.size() && !(order[tie].key < order[tie + 1].key && order[tie + 1].index < order[tie].index))
+		++tie;
+	if (TEST_CHECK(tie + 1 < order.size()))
+	{
+		changed = keys;
+		changed[order[tie].index] = order[tie + 1].key;
+		items = MakeItems(changed);
+		TEST_CHECK(!ReuseSortOrder(order, items, scratch));
+	}
+
+	// Another count, and an order naming items that are not there
+	keys.pop_back();
+	items = MakeItems(keys);
+	TEST_CHECK(!ReuseSortOrder(order, items, scratch));
+
+	vector<RADIX_SORT_ITEM> shortOrder(order.begin(), order.end() - 1);
+	shortOrder[0].index = TEST_ITEM_COUNT;
+	TEST_CHECK(!ReuseSortOrder(shortOrder, items, scratch));
+	TEST_CHECK(SameItems(items, MakeItems(keys)));
+}
+
+void TestRadixSort()
+{
+	TestRandomKeys();
+	TestEqualKeys();
+	TestEveryBit();
+	TestReuseSortOrder();
+}
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "../Win32Project1/RecordingRenderContext.h"
+#include "Tests.h"
+
+using namespace std;
+
+struct OBJECT_CONSTANTS
+{
+	float world[16];
+	float color[4];
+};
+
+// A frame the way the scene draws one: the target is set up and cleared, two meshes are
+// drawn with their own constants, then a batch of instances
+static void RecordFrame(RenderContext* context)
+{
+	D3D11_VIEWPORT viewport = { 0, 0, 1000, 500, 0, 1 };
+	float clearColor[4] = { 0, 0, 1, 1 };
+	ID3D11Buffer* frameConstants = FakeObject<ID3D11Buffer>(1);
+	ID3D11Buffer* objectConstants = FakeObject<ID3D11Buffer>(2);
+	ID3D11ShaderResourceView* views[2] = { FakeObject<ID3D11ShaderResourceView>(3), FakeObject<ID3D11ShaderResourceView>(4) };
+
+	context->SetRenderTargets(FakeObject<ID3D11RenderTargetView>(5), FakeObject<ID3D11DepthStencilView>(6));
+	context->SetViewport(viewport);
+	context->ClearRenderTarget(FakeObject<ID3D11RenderTargetView>(5), clearColor);
+	context->ClearDepth(FakeObject<ID3D11DepthStencilView>(6), 1.0f);
+	context->SetConstantBuffers(RENDER_STAGE_VERTEX, 0, 1, &frameConstants);
+
+	for (unsigned int mesh = 0; mesh < 2; ++mesh)
+	{
+		OBJECT_CONSTANTS constants = {};
+		constants.world[0] = constants.world[5] = constants.world[10] = constants.world[15] = 1;
+		constants.world[12] = (float)mesh;
+		constants.color[0] = 0.5f * mesh;
+
+		context->SetVertexBuffer(FakeObject<ID3D11Buffer>(10 + mesh), 44, 0);
+		context->SetIndexBuffer(FakeObject<ID3D11Buffer>(20 + mesh), DXGI_FORMAT_R32_UINT, 0);
+		context->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->SetVertexShader(FakeObject<ID3D11VertexShader>(30));
+		context->SetPixelShader(FakeObject<ID3D11PixelShader>(31 + mesh));
+		context->SetShaderResources(RENDER_STAGE_PIXEL, 0, 2 - mesh, views);
+		context->WriteConstants(objectConstants, &constants, sizeof(constants));
+		context->SetConstantBuffers(RENDER_STAGE_VERTEX, 1, 1, &objectConstants);
+		context->DrawIndexed(36 * (mesh + 1), 0, 0);
+	}
+
+	uint32_t instanceData[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	context->UploadConstants(objectConstants, 256, instanceData, sizeof(instanceData));
+	context->SetConstantBufferRange(RENDER_STAGE_VERTEX, 1, objectConstants, 16, 32);
+	context->DrawIndexedInstanced(36, 100, 6, -2, 0);
+}
+
+// Every call comes back in order, with the objects, numbers and data it was given
+static void TestDrawStream()
+{
+	RecordingRenderContext recording;
+	RecordFrame(&recording);
+
+	const vector<RENDER_COMMAND>& commands = recording.GetCommands();
+	static const RENDER_COMMAND_TYPE expected[] =
+	{
+		RENDER_SET_RENDER_TARGETS, RENDER_SET_VIEWPORT, RENDER_CLEAR_RENDER_TARGET, RENDER_CLEAR_DEPTH, RENDER_SET_CONSTANT_BUFFERS,
+		RENDER_SET_VERTEX_BUFFER, RENDER_SET_INDEX_BUFFER, RENDER_SET_PRIMITIVE_TOPOLOGY, RENDER_SET_VERTEX_SHADER, RENDER_SET_PIXEL_SHADER,
+		RENDER_SET_SHADER_RESOURCES, RENDER_WRITE_CONSTANTS, RENDER_SET_CONSTANT_BUFFERS, RENDER_DRAW_INDEXED,
+		RENDER_SET_VERTEX_BUFFER, RENDER_SET_INDEX_BUFFER, RENDER_SET_PRIMITIVE_TOPOLOGY, RENDER_SET_VERTEX_SHADER, RENDER_SET_PIXEL_SHADER,
+		RENDER_SET_SHADER_RESOURCES, RENDER_WRITE_CONSTANTS, RENDER_SET_CONSTANT_BUFFERS, RENDER_DRAW_INDEXED,
+		RENDER_UPLOAD_CONSTANTS, RENDER_SET_CONSTANT_BUFFER_RANGE, RENDER_DRAW_INDEXED_INSTANCED,
+	};
+	const unsigned int expectedCount = sizeof(expected) / sizeof(expected[0]);
+	if (!TEST_CHECK(commands.size() == expectedCount))
+		return;
+	unsigned int wrongTypes = 0;
+	for (unsigned int i = 0; i < expectedCount; ++i)
+		if (commands[i].type != expected[i])
+			++wrongTypes;
+	if (!TEST_CHECK(wrongTypes == 0))
+		return;
+
+	// The target and its clears
+	TEST_CHECK(commands[0].objects[0] == FakeObject<ID3D11RenderTargetView>(5) && commands[0].objects[1] == FakeObject<ID3D11DepthStencilView>(6));
+	TEST_CHECK(commands[1].arguments[2] == 1000 && commands[1].arguments[3] == 500);
+	float clearColor[4];
+	memcpy(clearColor, commands[2].arguments, sizeof(clearColor));
+	TEST_CHECK(clearColor[0] == 0 && clearColor[2] == 1 && clearColor[3] == 1);
+	float depth;
+	memcpy(&depth, commands[3].arguments, sizeof(depth));
+	TEST_CHECK(depth == 1.0f);
+
+	// The second mesh
+	const RENDER_COMMAND* mesh = &commands[14];
+	TEST_CHECK(mesh[0].objects[0] == FakeObject<ID3D11Buffer>(11) && mesh[0].arguments[0] == 44);
+	TEST_CHECK(mesh[1].objects[0] == FakeObject<ID3D11Buffer>(21) && mesh[1].arguments[0] == DXGI_FORMAT_R32_UINT);
+	TEST_CHECK(mesh[2].arguments[0] == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	TEST_CHECK(mesh[4].objects[0] == FakeObject<ID3D11PixelShader>(32));
+	TEST_CHECK(mesh[5].stage == RENDER_STAGE_PIXEL && mesh[5].arguments[0] == 0 && mesh[5].arguments[1] == 1);
+	TEST_CHECK(mesh[5].objects[0] == FakeObject<ID3D11ShaderResourceView>(3) && mesh[5].objects[1] == nullptr);
+	TEST_CHECK(mesh[7].stage == RENDER_STAGE_VERTEX && mesh[7].arguments[0] == 1 && mesh[7].objects[0] == FakeObject<ID3D11Buffer>(2));
+	TEST_CHECK(mesh[8].arguments[0] == 72 && mesh[8].arguments[1] == 0);
+
+	// Each mesh's constants are kept as they were when written, not as the buffer ended up
+	const OBJECT_CONSTANTS* first = (const OBJECT_CONSTANTS*)recording.GetConstantData(commands[11]);
+	const OBJECT_CONSTANTS* second = (const OBJECT_CONSTANTS*)recording.GetConstantData(mesh[6]);
+	if (TEST_CHECK(first && second))
+	{
+		TEST_CHECK(commands[11].arguments[0] == sizeof(OBJECT_CONSTANTS));
+		TEST_CHECK(first->world[12] == 0 && first->color[0] == 0);
+		TEST_CHECK(second->world[12] == 1 && second->color[0] == 0.5f);
+	}
+	TEST_CHECK(recording.GetConstantData(commands[13]) == nullptr);
+
+	// The instanced batch
+	const RENDER_COMMAND& upload = commands[23];
+	const uint32_t* instanceData = (const uint32_t*)recording.GetConstantData(upload);
+	TEST_CHECK(upload.arguments[0] == 32 && upload.arguments[1] == 256);
+	TEST_CHECK(instanceData && instanceData[0] == 1 && instanceData[7] == 8);
+	TEST_CHECK(commands[24].arguments[0] == 1 && commands[24].arguments[1] == 16 && commands[24].arguments[2] == 32);
+	const RENDER_COMMAND& draw = commands[25];
+	TEST_CHECK(draw.arguments[0] == 36 && draw.arguments[1] == 100 && draw.arguments[2] == 6 && (int)draw.arguments[3] == -2 && draw.arguments[4] == 0);
+
+	TEST_CHECK(recording.GetDrawCount() == 3);
+	TEST_CHECK(recording.GetInstanceCount() == 102);
+	TEST_CHECK(recording.GetStateChangeCount() == 18);
+	TEST_CHECK(recording.GetCount(RENDER_SET_CONSTANT_BUFFERS) == 3);
+	TEST_CHECK(recording.GetConstantBytes() == 2 * sizeof(OBJECT_CONSTANTS) + 8 * sizeof(uint32_t));
+	TEST_CHECK(recording.GetBufferBytes() == 0);
+}
+
+// Without commands kept the counts are the same; Reset forgets both
+static void TestCountsOnly()
+{
+	RecordingRenderContext recording;
+	RecordingRenderContext counting(false);
+	RecordFrame(&recording);
+	RecordFrame(&counting);
+
+	TEST_CHECK(counting.GetCommands().empty());
+	TEST_CHECK(counting.GetCommandCount() == recording.GetCommandCount());
+	TEST_CHECK(counting.GetDrawCount() == recording.GetDrawCount());
+	TEST_CHECK(counting.GetInstanceCount() == recording.GetInstanceCount());
+	TEST_CHECK(counting.GetConstantBytes() == recording.GetConstantBytes());
+
+	recording.Reset();
+	TEST_CHECK(recording.GetCommands().empty());
+	TEST_CHECK(recording.GetCommandCount() == 0 && recording.GetInstanceCount() == 0 && recording.GetConstantBytes() == 0);
+
+	RecordFrame(&recording);
+	TEST_CHECK(recording.GetCommandCount() == counting.GetCommandCount());
+	TEST_CHECK(recording.GetCommands().size() == counting.GetCommandCount());
+}
+
+void TestRecordingRenderContext()
+{
+	TestDrawStream();
+	TestCountsOnly();
+}
@@ -0,0 +1,35 @@
+//************************************************************
+//************ TESTS *****************************************
+//************************************************************
+
+#include <stdio.h>
+
+#include "Tests.h"
+
+static unsigned int checkCount = 0;
+static unsigned int failureCount = 0;
+
+bool CheckTest(bool passed, const char* condition, const char* file, int line)
+{
+	++checkCount;
+	if (!passed)
+	{
+		++failureCount;
+		printf("%s(%d): failed: %s\n", file, line, condition);
+	}
+	return passed;
+}
+
+int main()
+{
+	TestPNGTextureLoader();
+	TestRecordingRenderContext();
+	TestVirtualTexture();
+	TestOcclusionCuller();
+	TestFilteringRenderContext();
+	TestRadixSort();
+	TestDrawQueue();
+
+	printf("%u of %u checks passed\n", checkCount - failureCount, checkCount);
+	return failureCount ? 1 : 0;
+}
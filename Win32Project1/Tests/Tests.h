@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+// Checks for the parts of the game that run without a device. Each Test function below
+// lives in its own file and is run in order by main; a failed check is reported with where
+// it is and the run carries on, so one pass shows every failure.
+//
+// Usage: Tests
+
+// Counts the check and reports it if it failed. Returns whether it passed, so a test can
+// skip what depends on it.
+bool CheckTest(bool passed, const char* condition, const char* file, int line);
+
+#define TEST_CHECK(condition) CheckTest((condition) ? true : false, #condition, __FILE__, __LINE__)
+
+// Objects are only compared, never called, so any distinct address stands in for one
+template <typename T>
+static T* FakeObject(uintptr_t id)
+{
+	return reinterpret_cast<T*>(id * 16);
+}
+
+void TestPNGTextureLoader();
+void TestRecordingRenderContext();
+void TestVirtualTexture();
+void TestOcclusionCuller();
+void TestFilteringRenderContext();
+void TestRadixSort();
+void TestDrawQueue();
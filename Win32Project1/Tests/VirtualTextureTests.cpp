@@ -0,0 +1,205 @@
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include "../Win32Project1/VirtualTexture.h"
+#include "Tests.h"
+
+using namespace std;
+
+#define TEST_TEXTURE_SIZE 512 // Four tiles across at the top level, then two, then one
+#define TEST_TEXTURE_LEVELS 3
+#define TEST_CACHE_TILES_WIDE 2 // Four slots, one of them pinned to the coarsest tile
+
+// Every texel holds where it came from, so a cooked tile says which texels it copied
+static void WriteTexel(uint8_t* texel, unsigned int level, unsigned int x, unsigned int y)
+{
+	texel[0] = (uint8_t)x;
+	texel[1] = (uint8_t)y;
+	texel[2] = (uint8_t)((x >> 8) | ((y >> 8) << 4));
+	texel[3] = (uint8_t)level;
+}
+
+// An RGBA8 DDS file with TEST_TEXTURE_LEVELS levels, each texel written by WriteTexel
+static bool PrepareTestTexture(VirtualTexture& texture, unsigned int cacheTilesWide)
+{
+	const uint32_t header[32] =
+	{
+		0x20534444, // "DDS "
+		124, 0x0002100F, TEST_TEXTURE_SIZE, TEST_TEXTURE_SIZE, TEST_TEXTURE_SIZE * 4, 0, TEST_TEXTURE_LEVELS,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		32, 0x41, 0, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000, // Pixel format
+		0x401008, 0, 0, 0, 0
+	};
+	vector<uint8_t> file((const uint8_t*)header, (const uint8_t*)header + sizeof(header));
+	for (unsigned int level = 0; level < TEST_TEXTURE_LEVELS; ++level)
+	{
+		unsigned int size = TEST_TEXTURE_SIZE >> level;
+		size_t start = file.size();
+		file.resize(start + size * size * 4);
+		for (unsigned int y = 0; y < size; ++y)
+			for (unsigned int x = 0; x < size; ++x)
+				WriteTexel(&file[start + (y * size + x) * 4], level, x, y);
+	}
+
+	DDS_TEXTURE_INFO info;
+	if (!TEST_CHECK(SUCCEEDED(GetDDSTextureInfo(&file[0], file.size(), &info))) || !TEST_CHECK(info.mipCount == TEST_TEXTURE_LEVELS))
+		return false;
+
+	unique_ptr<uint8_t[]> ddsData(new uint8_t[file.size()]);
+	memcpy(ddsData.get(), &file[0], file.size());
+	return TEST_CHECK(texture.Prepare(ddsData, file.size(), info, cacheTilesWide));
+}
+
+// One frame of feedback in which each entry was wanted by one pixel
+static void SendFeedback(VirtualTexture& texture, const uint32_t* entries, unsigned int count)
+{
+	texture.ProcessFeedback(entries, count, 1, count * sizeof(uint32_t));
+}
+
+static bool PageTableEntryIs(const VirtualTexture& texture, unsigned int level, unsigned int x, unsigned int y, unsigned int slotX, unsigned int slotY, unsigned int residentLevel)
+{
+	unsigned int foundX, foundY, foundLevel;
+	texture.GetPageTableEntry(level, x, y, &foundX, &foundY, &foundLevel);
+	return foundX == slotX && foundY == slotY && foundLevel == residentLevel;
+}
+
+// Every texel of a cooked tile, border included, is the texel of its level at the same place,
+// wrapped around the edges
+static void TestCookTile()
+{
+	VirtualTexture texture;
+	if (!PrepareTestTexture(texture, TEST_CACHE_TILES_WIDE))
+		return;
+	TEST_CHECK(texture.GetLevelCount() == TEST_TEXTURE_LEVELS);
+	TEST_CHECK(texture.GetTilesWide(0) == 4 && texture.GetTilesHigh(0) == 4);
+	TEST_CHECK(texture.GetTilesWide(2) == 1 && texture.GetTilesHigh(2) == 1);
+
+	size_t rowPitch = texture.GetTileRowPitch();
+	TEST_CHECK(rowPitch == VT_PADDED_TILE_SIZE * 4);
+	vector<uint8_t> tile(rowPitch * VT_PADDED_TILE_SIZE);
+
+	// A corner tile, an inner one, the far corner and the only tile of the coarsest level
+	const unsigned int tiles[][3] = { { 0, 0, 0 }, { 0, 1, 2 }, { 0, 3, 3 }, { 1, 1, 0 }, { 2, 0, 0 } };
+	for (unsigned int t = 0; t < sizeof(tiles) / sizeof(tiles[0]); ++t)
+	{
+		unsigned int level = tiles[t][0];
+		unsigned int size = TEST_TEXTURE_SIZE >> level;
+		texture.CookTile(level, tiles[t][1], tiles[t][2], &tile[0], rowPitch);
+
+		unsigned int mismatches = 0;
+		for (unsigned int row = 0; row < VT_PADDED_TILE_SIZE; ++row)
+		{
+			for (unsigned int column = 0; column < VT_PADDED_TILE_SIZE; ++column)
+			{
+				unsigned int x = (tiles[t][1] * VT_TILE_SIZE + column + size - VT_TILE_BORDER) % size;
+				unsigned int y = (tiles[t][2] * VT_TILE_SIZE + row + size - VT_TILE_BORDER) % size;
+				uint8_t expected[4];
+				WriteTexel(expected, level, x, y);
+				if (memcmp(&tile[row * rowPitch + column * 4], expected, 4) != 0)
+					++mismatches;
+			}
+		}
+		TEST_CHECK(mismatches == 0);
+	}
+}
+
+// With the cache full, the tile seen longest ago makes room, and a tile seen this frame never does
+static void TestEvictionOrder()
+{
+	VirtualTexture texture;
+	if (!PrepareTestTexture(texture, TEST_CACHE_TILES_WIDE))
+		return;
+	TEST_CHECK(texture.GetResidentCount() == 1 && texture.IsResident(2, 0, 0));
+
+	// Three frames fill the three free slots with the level 1 tiles along the top and left
+	const uint32_t first[] = { VT_PACK_FEEDBACK(1, 0, 0) };
+	const uint32_t second[] = { VT_PACK_FEEDBACK(1, 1, 0) };
+	const uint32_t third[] = { VT_PACK_FEEDBACK(1, 0, 1) };
+	SendFeedback(texture, first, 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	SendFeedback(texture, second, 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	SendFeedback(texture, third, 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(texture.GetResidentCount() == 4 && texture.GetEvictionCount() == 0);
+
+	// (1, 0) is seen again, so (0, 0), seen first, goes for the new tile
+	const uint32_t fourth[] = { VT_PACK_FEEDBACK(1, 1, 0), VT_PACK_FEEDBACK(1, 1, 1) };
+	SendFeedback(texture, fourth, 2);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(!texture.IsResident(1, 0, 0));
+	TEST_CHECK(texture.IsResident(1, 1, 0) && texture.IsResident(1, 0, 1) && texture.IsResident(1, 1, 1));
+	TEST_CHECK(texture.GetEvictionCount() == 1);
+
+	// Now (0, 1) is the oldest
+	SendFeedback(texture, first, 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(texture.IsResident(1, 0, 0) && !texture.IsResident(1, 0, 1));
+	TEST_CHECK(texture.GetEvictionCount() == 2);
+
+	// Every resident tile is on screen, so the missing one waits and nothing is evicted
+	const uint32_t crowded[] = { VT_PACK_FEEDBACK(1, 0, 0), VT_PACK_FEEDBACK(1, 1, 0), VT_PACK_FEEDBACK(1, 1, 1), VT_PACK_FEEDBACK(1, 0, 1) };
+	SendFeedback(texture, crowded, 4);
+	TEST_CHECK(texture.GetRequestCount() == 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 0);
+	TEST_CHECK(!texture.IsResident(1, 0, 1) && texture.GetEvictionCount() == 2);
+	TEST_CHECK(texture.IsResident(2, 0, 0));
+}
+
+// Every tile's entry points at the nearest resident tile at or above it, as tiles come and go
+static void TestPageTable()
+{
+	VirtualTexture texture;
+	if (!PrepareTestTexture(texture, TEST_CACHE_TILES_WIDE))
+		return;
+
+	// At first everything samples the pinned coarsest tile in slot 0
+	for (unsigned int level = 0; level < TEST_TEXTURE_LEVELS; ++level)
+		for (unsigned int y = 0; y < texture.GetTilesHigh(level); ++y)
+			for (unsigned int x = 0; x < texture.GetTilesWide(level); ++x)
+				TEST_CHECK(PageTableEntryIs(texture, level, x, y, 0, 0, 2));
+
+	// A top level tile is requested with its missing parent, and the parent comes first
+	const uint32_t fine[] = { VT_PACK_FEEDBACK(0, 3, 2) };
+	SendFeedback(texture, fine, 1);
+	TEST_CHECK(texture.GetRequestCount() == 2);
+	TEST_CHECK(texture.Service(1) == 1);
+	TEST_CHECK(texture.IsResident(1, 1, 1) && !texture.IsResident(0, 3, 2));
+	TEST_CHECK(PageTableEntryIs(texture, 1, 1, 1, 1, 0, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 2, 2, 1, 0, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 3, 2, 1, 0, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 3, 3, 1, 0, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 1, 2, 0, 0, 2));
+
+	SendFeedback(texture, fine, 1);
+	TEST_CHECK(texture.GetRequestCount() == 1);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(PageTableEntryIs(texture, 0, 3, 2, 0, 1, 0));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 2, 2, 1, 0, 1));
+
+	// Two more tiles fill the cache, then the parent, least recently seen, is evicted. Its
+	// tiles fall back to the coarsest tile, except the child that is still resident.
+	const uint32_t others[] = { VT_PACK_FEEDBACK(1, 0, 0), VT_PACK_FEEDBACK(0, 3, 2) };
+	SendFeedback(texture, others, 2);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(PageTableEntryIs(texture, 1, 0, 0, 1, 1, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 1, 1, 1, 1, 1));
+
+	const uint32_t replacement[] = { VT_PACK_FEEDBACK(1, 1, 0), VT_PACK_FEEDBACK(1, 0, 0), VT_PACK_FEEDBACK(0, 3, 2) };
+	SendFeedback(texture, replacement, 3);
+	TEST_CHECK(texture.Service(VT_UPLOADS_PER_FRAME) == 1);
+	TEST_CHECK(!texture.IsResident(1, 1, 1) && texture.IsResident(1, 1, 0));
+	TEST_CHECK(PageTableEntryIs(texture, 1, 1, 0, 1, 0, 1));
+	TEST_CHECK(PageTableEntryIs(texture, 1, 1, 1, 0, 0, 2));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 2, 2, 0, 0, 2));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 3, 3, 0, 0, 2));
+	TEST_CHECK(PageTableEntryIs(texture, 0, 3, 2, 0, 1, 0));
+}
+
+void TestVirtualTexture()
+{
+	TestCookTile();
+	TestEvictionOrder();
+	TestPageTable();
+}
@@ -0,0 +1,807 @@
+//************************************************************
+//************ TEXTURE LOAD BENCHMARK ************************
+//************************************************************
+
+// Times the device independent half of the DDS loader over a corpus of DDS files built in
+// memory, one for every pixel format branch of GetDXGIFormat and GetLegacyFormat and every
+// layout FillInitData walks: mip chains, arrays, cubemaps, cube arrays, volumes, 1D textures,
+// block compressed sizes that are not multiples of four and files that ship one level.
+//
+// Each load is split into the three stages the game goes through before CreateTexture2D:
+//   parse   - GetDDSTextureInfo, the header checks and format lookup
+//   convert - LoadDDSTextureDataFromMemory, legacy format expansion and mip generation
+//   slice   - GetDDSSubresourceData, pointing a D3D11_SUBRESOURCE_DATA at every surface
+// Throughput is file bytes over stage time. Allocations are counted by replacing the global
+// operator new, so they include the mip generator's worker threads.
+//
+// PNGs are timed through DecodePNGFromMemory, inflate and unfilter together, the same way:
+// the repository's own PNGs, read from the game's directory, and synthetic ones whose rows
+// are stored uncompressed so the time goes to one unfilter, for 3 and 4 byte pixels.
+//
+// Every Direct3D 9 format the legacy converter expands is also timed on its own, calling
+// LegacyFormatConverter directly on a mip chain the size of the synthetic PNGs:
+//   surfaces - ConvertLegacySurfaces over the whole chain, allocation included
+//   rows     - ConvertLegacyScanline over the top level into one reused row
+//
+// Usage: TextureLoadBenchmark [seconds per file] [directory holding the game's PNGs]
+
+#include <d3d11.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/DDSTextureLoader.h"
+#include "../Win32Project1/LegacyFormatConverter.h"
+#include "../Win32Project1/MipChainGenerator.h"
+#include "../Win32Project1/PNGTextureLoader.h"
+
+using namespace std;
+
+#define BENCHMARK_MAX_SUBRESOURCES (16 * 2048)
+#define BENCHMARK_PNG_DIRECTORY L"..\\Win32Project1"
+#define BENCHMARK_PNG_SIZE 1024 // Synthetic PNGs are this many pixels square
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC 0x00000004
+#define DDS_RGB 0x00000040
+#define DDS_RGBA 0x00000041
+#define DDS_LUMINANCE 0x00020000
+#define DDS_LUMINANCEA 0x00020001
+#define DDS_ALPHA 0x00000002
+#define DDS_HEADER_FLAGS_TEXTURE 0x00001007
+#define DDS_HEADER_FLAGS_MIPMAP 0x00020000
+#define DDS_HEADER_FLAGS_VOLUME 0x00800000
+#define DDS_SURFACE_FLAGS_TEXTURE 0x00001000
+#define DDS_SURFACE_FLAGS_MIPMAP 0x00400008
+#define DDS_CUBEMAP_ALLFACES 0x0000FE00
+#define DDS_FLAGS_VOLUME 0x00200000
+
+#ifndef MAKEFOURCC
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+#endif
+
+#pragma pack(push, 1)
+struct DDS_PIXELFORMAT
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t RGBBitCount;
+	uint32_t masks[4];
+};
+
+struct DDS_HEADER
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDS_PIXELFORMAT ddspf;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+
+struct DDS_HEADER_DXT10
+{
+	DXGI_FORMAT dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t reserved;
+};
+#pragma pack(pop)
+
+//************************************************************
+//************ ALLOCATION COUNTING ***************************
+//************************************************************
+
+static atomic<unsigned long long> allocationCount(0);
+static atomic<unsigned long long> allocationBytes(0);
+
+static void* CountedAllocation(size_t size)
+{
+	allocationCount++;
+	allocationBytes += size;
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+	void* p = CountedAllocation(size);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = CountedAllocation(size);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const nothrow_t&)
+{
+	return CountedAllocation(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&)
+{
+	return CountedAllocation(size);
+}
+
+void operator delete(void* p) { free(p); }
+void operator delete[](void* p) { free(p); }
+void operator delete(void* p, const nothrow_t&) { free(p); }
+void operator delete[](void* p, const nothrow_t&) { free(p); }
+
+//************************************************************
+//************ SYNTHETIC CORPUS ******************************
+//************************************************************
+
+// A file that exercises one branch of the loader. The pixel format is written the way the
+// tools that made each kind of file wrote it: masks, a FourCC, a D3DFORMAT number in the
+// FourCC, or a DX10 header with a DXGI format.
+struct CorpusEntry
+{
+	const char* name;
+	uint32_t pixelFlags;
+	uint32_t fourCC;
+	uint32_t bitCount;
+	uint32_t masks[4];
+	DXGI_FORMAT format; // Only for DX10 headers
+	D3D11_RESOURCE_DIMENSION dimension;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t mipCount; // 0 for the full chain
+	uint32_t arraySize; // Cubes for a cubemap
+	bool cubeMap;
+	bool loads; // False for files the loader is expected to reject
+};
+
+#define MASKS(flags, bits, r, g, b, a) flags, 0, bits, { r, g, b, a }, DXGI_FORMAT_UNKNOWN
+#define FOURCC(code) DDS_FOURCC, code, 0, { 0, 0, 0, 0 }, DXGI_FORMAT_UNKNOWN
+#define DX10(format) DDS_FOURCC, MAKEFOURCC('D', 'X', '1', '0'), 0, { 0, 0, 0, 0 }, format
+#define TEX1D D3D11_RESOURCE_DIMENSION_TEXTURE1D
+#define TEX2D D3D11_RESOURCE_DIMENSION_TEXTURE2D
+#define TEX3D D3D11_RESOURCE_DIMENSION_TEXTURE3D
+
+static const CorpusEntry corpus[] =
+{
+	// GetDXGIFormat, 32 bit masks
+	{ "A8B8G8R8", MASKS(DDS_RGBA, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A8R8G8B8", MASKS(DDS_RGBA, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "X8R8G8B8", MASKS(DDS_RGB, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A2B10G10R10", MASKS(DDS_RGBA, 32, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "G16R16", MASKS(DDS_RGB, 32, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R32F masks", MASKS(DDS_RGB, 32, 0xffffffff, 0x00000000, 0x00000000, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// 16 bit masks; A4R4G4B4 is native with DXGI 1.2 and expanded otherwise
+	{ "A1R5G5B5", MASKS(DDS_RGBA, 16, 0x7c00, 0x03e0, 0x001f, 0x8000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R5G6B5", MASKS(DDS_RGB, 16, 0xf800, 0x07e0, 0x001f, 0x0000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A4R4G4B4", MASKS(DDS_RGBA, 16, 0x0f00, 0x00f0, 0x000f, 0xf000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A8R3G3B2 (none)", MASKS(DDS_RGBA, 16, 0x00e0, 0x001c, 0x0003, 0xff00), TEX2D, 512, 512, 1, 0, 1, false, false },
+
+	// Luminance and alpha
+	{ "L16", MASKS(DDS_LUMINANCE, 16, 0xffff, 0, 0, 0), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A8", MASKS(DDS_ALPHA, 8, 0, 0, 0, 0xff), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// FourCC block compressed and packed formats
+	{ "DXT1", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "DXT2", FOURCC(MAKEFOURCC('D', 'X', 'T', '2')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "DXT3", FOURCC(MAKEFOURCC('D', 'X', 'T', '3')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "DXT4", FOURCC(MAKEFOURCC('D', 'X', 'T', '4')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "DXT5", FOURCC(MAKEFOURCC('D', 'X', 'T', '5')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "ATI1", FOURCC(MAKEFOURCC('A', 'T', 'I', '1')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "BC4U", FOURCC(MAKEFOURCC('B', 'C', '4', 'U')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "BC4S", FOURCC(MAKEFOURCC('B', 'C', '4', 'S')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "ATI2", FOURCC(MAKEFOURCC('A', 'T', 'I', '2')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "BC5U", FOURCC(MAKEFOURCC('B', 'C', '5', 'U')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "BC5S", FOURCC(MAKEFOURCC('B', 'C', '5', 'S')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "RGBG", FOURCC(MAKEFOURCC('R', 'G', 'B', 'G')), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "GRGB", FOURCC(MAKEFOURCC('G', 'R', 'G', 'B')), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// D3DFORMAT numbers in the FourCC
+	{ "A16B16G16R16", FOURCC(36), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "Q16W16V16U16", FOURCC(110), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R16F", FOURCC(111), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "G16R16F", FOURCC(112), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A16B16G16R16F", FOURCC(113), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R32F", FOURCC(114), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "G32R32F", FOURCC(115), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A32B32G32R32F", FOURCC(116), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// Direct3D 9 formats expanded to 32 bits by the convert stage
+	{ "R8G8B8", MASKS(DDS_RGB, 24, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "B8G8R8", MASKS(DDS_RGB, 24, 0x000000ff, 0x0000ff00, 0x00ff0000, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "X8B8G8R8", MASKS(DDS_RGB, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0x00000000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "X1R5G5B5", MASKS(DDS_RGB, 16, 0x7c00, 0x03e0, 0x001f, 0x0000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "X4R4G4B4", MASKS(DDS_RGB, 16, 0x0f00, 0x00f0, 0x000f, 0x0000), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "L8", MASKS(DDS_LUMINANCE, 8, 0xff, 0, 0, 0), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A4L4", MASKS(DDS_LUMINANCEA, 8, 0x0f, 0, 0, 0xf0), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "A8L8", MASKS(DDS_LUMINANCEA, 16, 0xff, 0, 0, 0xff00), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// DX10 headers
+	{ "BC6H_UF16", DX10(DXGI_FORMAT_BC6H_UF16), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "BC7_UNORM_SRGB", DX10(DXGI_FORMAT_BC7_UNORM_SRGB), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R16G16B16A16_FLOAT", DX10(DXGI_FORMAT_R16G16B16A16_FLOAT), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R11G11B10_FLOAT", DX10(DXGI_FORMAT_R11G11B10_FLOAT), TEX2D, 512, 512, 1, 0, 1, false, true },
+	{ "R8G8B8A8_UNORM_SRGB", DX10(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB), TEX2D, 512, 512, 1, 0, 1, false, true },
+
+	// Sizes and mip counts
+	{ "RGBA8 64", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 64, 64, 1, 0, 1, false, true },
+	{ "RGBA8 2048", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 2048, 2048, 1, 0, 1, false, true },
+	{ "RGBA8 2048 top only", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 2048, 2048, 1, 1, 1, false, true },
+	{ "RGBA8 1000x600 top only", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 1000, 600, 1, 1, 1, false, true },
+	{ "RGBA8 1x1", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 1, 1, 1, 1, 1, false, true },
+	{ "DXT1 64", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 64, 64, 1, 0, 1, false, true },
+	{ "DXT1 2048", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 2048, 2048, 1, 0, 1, false, true },
+	{ "DXT1 4096", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 4096, 4096, 1, 0, 1, false, true },
+	{ "DXT1 1000x600", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 1000, 600, 1, 0, 1, false, true },
+	{ "DXT1 2048 top only", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 2048, 2048, 1, 1, 1, false, true },
+	{ "BC7 2048", DX10(DXGI_FORMAT_BC7_UNORM), TEX2D, 2048, 2048, 1, 0, 1, false, true },
+	{ "L8 1024 top only", MASKS(DDS_LUMINANCE, 8, 0xff, 0, 0, 0), TEX2D, 1024, 1024, 1, 1, 1, false, true },
+	{ "RGBG 255x128 top only", FOURCC(MAKEFOURCC('R', 'G', 'B', 'G')), TEX2D, 255, 128, 1, 1, 1, false, true },
+
+	// Arrays, cubemaps and volumes
+	{ "BC1 array of 8", DX10(DXGI_FORMAT_BC1_UNORM), TEX2D, 512, 512, 1, 0, 8, false, true },
+	{ "RGBA8 array of 8 top only", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX2D, 256, 256, 1, 1, 8, false, true },
+	{ "A8R8G8B8 cube", MASKS(DDS_RGBA, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000), TEX2D, 256, 256, 1, 0, 1, true, true },
+	{ "R8G8B8 cube", MASKS(DDS_RGB, 24, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000), TEX2D, 256, 256, 1, 0, 1, true, true },
+	{ "DXT5 cube", FOURCC(MAKEFOURCC('D', 'X', 'T', '5')), TEX2D, 512, 512, 1, 0, 1, true, true },
+	{ "BC1 cube array of 4", DX10(DXGI_FORMAT_BC1_UNORM), TEX2D, 128, 128, 1, 0, 4, true, true },
+	{ "A8R8G8B8 volume", MASKS(DDS_RGBA, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000), TEX3D, 64, 64, 64, 0, 1, false, true },
+	{ "X1R5G5B5 volume", MASKS(DDS_RGB, 16, 0x7c00, 0x03e0, 0x001f, 0x0000), TEX3D, 64, 64, 64, 0, 1, false, true },
+	{ "BC1 volume", DX10(DXGI_FORMAT_BC1_UNORM), TEX3D, 128, 128, 32, 0, 1, false, true },
+	{ "RGBA8 1D array of 4", DX10(DXGI_FORMAT_R8G8B8A8_UNORM), TEX1D, 4096, 1, 1, 0, 4, false, true },
+
+	// Short files
+	{ "DXT1 2048 truncated", FOURCC(MAKEFOURCC('D', 'X', 'T', '1')), TEX2D, 2048, 2048, 1, 0, 1, false, false },
+};
+
+static size_t CountLevels(const CorpusEntry& entry)
+{
+	// A volume keeps halving until its depth is one as well
+	return entry.mipCount ? entry.mipCount : CountMipLevels(max<uint32_t>(entry.width, entry.depth), entry.height);
+}
+
+// Bytes of surface data behind the headers. Files described by masks are sized by their bit
+// count, since the legacy ones do not have a DXGI format until they are converted; the rest
+// are sized by the loader itself.
+static size_t SurfaceBytes(const CorpusEntry& entry, const DDS_TEXTURE_INFO* info)
+{
+	if (entry.bitCount == 0 && info)
+		return GetDDSTextureMemorySize(*info);
+
+	size_t total = 0;
+	size_t width = entry.width;
+	size_t height = entry.height;
+	size_t depth = entry.depth;
+	for (size_t level = 0; level < CountLevels(entry); ++level)
+	{
+		total += ((width * entry.bitCount + 7) / 8) * height * depth;
+		width = max<size_t>(width >> 1, 1);
+		height = max<size_t>(height >> 1, 1);
+		depth = max<size_t>(depth >> 1, 1);
+	}
+	return total * entry.arraySize * (entry.cubeMap ? 6 : 1);
+}
+
+static vector<uint8_t> BuildFile(const CorpusEntry& entry)
+{
+	bool dx10 = (entry.fourCC == MAKEFOURCC('D', 'X', '1', '0'));
+	size_t headerSize = sizeof(uint32_t) + sizeof(DDS_HEADER) + (dx10 ? sizeof(DDS_HEADER_DXT10) : 0);
+	vector<uint8_t> file(headerSize, 0);
+
+	*(uint32_t*)&file[0] = DDS_MAGIC;
+	DDS_HEADER* header = (DDS_HEADER*)&file[sizeof(uint32_t)];
+	header->size = sizeof(DDS_HEADER);
+	header->flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP;
+	header->width = entry.width;
+	header->height = entry.height;
+	header->mipMapCount = (uint32_t)CountLevels(entry);
+	header->ddspf.size = sizeof(DDS_PIXELFORMAT);
+	header->ddspf.flags = entry.pixelFlags;
+	header->ddspf.fourCC = entry.fourCC;
+	header->ddspf.RGBBitCount = entry.bitCount;
+	memcpy(header->ddspf.masks, entry.masks, sizeof(entry.masks));
+	header->caps = DDS_SURFACE_FLAGS_TEXTURE | DDS_SURFACE_FLAGS_MIPMAP;
+
+	if (dx10)
+	{
+		DDS_HEADER_DXT10* extension = (DDS_HEADER_DXT10*)&file[sizeof(uint32_t) + sizeof(DDS_HEADER)];
+		extension->dxgiFormat = entry.format;
+		extension->resourceDimension = entry.dimension;
+		extension->miscFlag = entry.cubeMap ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+		extension->arraySize = entry.arraySize;
+		if (entry.dimension == TEX3D)
+			header->depth = entry.depth;
+	}
+	else if (entry.dimension == TEX3D)
+	{
+		header->flags |= DDS_HEADER_FLAGS_VOLUME;
+		header->depth = entry.depth;
+		header->caps2 = DDS_FLAGS_VOLUME;
+	}
+	else if (entry.cubeMap)
+		header->caps2 = DDS_CUBEMAP_ALLFACES;
+
+	DDS_TEXTURE_INFO info;
+	bool described = SUCCEEDED(GetDDSTextureInfo(&file[0], file.size(), &info));
+	size_t surfaceBytes = SurfaceBytes(entry, described ? &info : nullptr);
+	if (!entry.loads && described)
+		surfaceBytes -= 1;
+
+	// Any bytes will do; a simple generator keeps the converters from seeing only zeros
+	file.resize(headerSize + surfaceBytes);
+	uint32_t seed = 0x12345678;
+	for (size_t i = headerSize; i < file.size(); ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		file[i] = (uint8_t)(seed >> 24);
+	}
+	return file;
+}
+
+struct PNGFile
+{
+	const wchar_t* name;
+	bool decodes;
+};
+
+static const PNGFile pngFiles[] =
+{
+	{ L"Box_wood01.png", true },
+	{ L"T_HeavyTurret_N.png", true },
+	{ L"T_HeavyTurret_S.png", true },
+	{ L"floor.png", false }, // A JPEG under a PNG name; the floor comes from Floor.dds
+	{ L"heaventorch_diffuse.png", true },
+	{ L"treeWillow_Trunk_D.png", true },
+};
+
+static const char* pngFilterNames[5] = { "none", "sub", "up", "average", "paeth" };
+
+static bool ReadWholeFile(const wchar_t* fileName, vector<uint8_t>& file)
+{
+	HANDLE handle = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	DWORD read = 0;
+	bool succeeded = GetFileSizeEx(handle, &size) && size.HighPart == 0 && size.LowPart > 0;
+	if (succeeded)
+	{
+		file.resize(size.LowPart);
+		succeeded = ReadFile(handle, &file[0], size.LowPart, &read, nullptr) && read == size.LowPart;
+	}
+	CloseHandle(handle);
+	return succeeded;
+}
+
+static void AppendBigEndian32(vector<uint8_t>& file, uint32_t value)
+{
+	file.push_back((uint8_t)(value >> 24));
+	file.push_back((uint8_t)(value >> 16));
+	file.push_back((uint8_t)(value >> 8));
+	file.push_back((uint8_t)value);
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; ++bit)
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+static void AppendChunk(vector<uint8_t>& file, const char type[4], const vector<uint8_t>& data)
+{
+	AppendBigEndian32(file, (uint32_t)data.size());
+	size_t start = file.size();
+	file.insert(file.end(), type, type + 4);
+	file.insert(file.end(), data.begin(), data.end());
+	AppendBigEndian32(file, Crc32(&file[start], file.size() - start));
+}
+
+// A BENCHMARK_PNG_SIZE square RGB or RGBA PNG with every row filtered the same way. The rows
+// are stored in uncompressed deflate blocks, so inflating them is little more than a copy.
+static vector<uint8_t> BuildFilteredPNG(uint8_t filter, unsigned int bytesPerPixel)
+{
+	static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	vector<uint8_t> file(signature, signature + 8);
+
+	vector<uint8_t> header;
+	AppendBigEndian32(header, BENCHMARK_PNG_SIZE);
+	AppendBigEndian32(header, BENCHMARK_PNG_SIZE);
+	uint8_t depthTypeMethods[5] = { 8, (uint8_t)(bytesPerPixel == 4 ? 6 : 2), 0, 0, 0 };
+	header.insert(header.end(), depthTypeMethods, depthTypeMethods + 5);
+	AppendChunk(file, "IHDR", header);
+
+	vector<uint8_t> rows;
+	uint32_t seed = 0x12345678;
+	for (unsigned int y = 0; y < BENCHMARK_PNG_SIZE; ++y)
+	{
+		rows.push_back(filter);
+		for (unsigned int x = 0; x < BENCHMARK_PNG_SIZE * bytesPerPixel; ++x)
+		{
+			seed = seed * 1664525 + 1013904223;
+			rows.push_back((uint8_t)(seed >> 24));
+		}
+	}
+
+	vector<uint8_t> stream;
+	stream.push_back(0x78);
+	stream.push_back(0x01);
+	for (size_t offset = 0; offset < rows.size(); offset += 65535)
+	{
+		size_t length = min<size_t>(65535, rows.size() - offset);
+		stream.push_back(offset + length == rows.size() ? 1 : 0);
+		stream.push_back((uint8_t)length);
+		stream.push_back((uint8_t)(length >> 8));
+		stream.push_back((uint8_t)~length);
+		stream.push_back((uint8_t)(~length >> 8));
+		stream.insert(stream.end(), rows.begin() + offset, rows.begin() + offset + length);
+	}
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		a = (a + rows[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	AppendBigEndian32(stream, (b << 16) | a);
+	AppendChunk(file, "IDAT", stream);
+
+	AppendChunk(file, "IEND", vector<uint8_t>());
+	return file;
+}
+
+struct LegacyCase
+{
+	const char* name;
+	LEGACY_FORMAT format;
+};
+
+static const LegacyCase legacyCases[] =
+{
+	{ "R8G8B8", LEGACY_FORMAT_R8G8B8 },
+	{ "B8G8R8", LEGACY_FORMAT_B8G8R8 },
+	{ "X8B8G8R8", LEGACY_FORMAT_X8B8G8R8 },
+	{ "X1R5G5B5", LEGACY_FORMAT_X1R5G5B5 },
+	{ "A4R4G4B4", LEGACY_FORMAT_A4R4G4B4 },
+	{ "X4R4G4B4", LEGACY_FORMAT_X4R4G4B4 },
+	{ "L8", LEGACY_FORMAT_L8 },
+	{ "A8L8", LEGACY_FORMAT_A8L8 },
+	{ "A4L4", LEGACY_FORMAT_A4L4 },
+};
+
+// A full BENCHMARK_PNG_SIZE square chain of the legacy format, laid out the way a DDS file is
+static vector<uint8_t> BuildLegacySurfaces(LEGACY_FORMAT format)
+{
+	size_t bytes = 0;
+	for (size_t size = BENCHMARK_PNG_SIZE; size > 0; size >>= 1)
+		bytes += size * size * GetLegacyBitsPerPixel(format) / 8;
+
+	vector<uint8_t> surfaces(bytes);
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < surfaces.size(); ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		surfaces[i] = (uint8_t)(seed >> 24);
+	}
+	return surfaces;
+}
+
+//************************************************************
+//************ MEASUREMENT ***********************************
+//************************************************************
+
+struct StageResult
+{
+	double parseSeconds;
+	double convertSeconds;
+	double sliceSeconds;
+	unsigned long long allocations;
+	unsigned long long allocatedBytes;
+	unsigned int iterations;
+	DDS_TEXTURE_INFO info;
+	HRESULT result;
+};
+
+static StageResult Measure(const vector<uint8_t>& file, double secondsPerFile, vector<D3D11_SUBRESOURCE_DATA>& surfaces)
+{
+	// The budget is wall time, copies included, so files that load quickly do not spend it
+	// all copying
+	StageResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerFile, [&](BenchmarkTimer& timer) -> bool
+	{
+		// Stands in for the read; neither the copy nor its buffer is counted
+		unique_ptr<uint8_t[]> data(new uint8_t[file.size()]);
+		memcpy(data.get(), &file[0], file.size());
+		size_t dataSize = file.size();
+
+		unsigned long long allocationsBefore = allocationCount;
+		unsigned long long bytesBefore = allocationBytes;
+		timer.Lap();
+
+		HRESULT result = GetDDSTextureInfo(data.get(), dataSize, &total.info);
+		total.parseSeconds += timer.Lap();
+		if (SUCCEEDED(result))
+			result = LoadDDSTextureDataFromMemory(data, &dataSize, &total.info);
+		total.convertSeconds += timer.Lap();
+		if (SUCCEEDED(result) && total.info.mipCount * total.info.arraySize > surfaces.size())
+			result = E_OUTOFMEMORY;
+		if (SUCCEEDED(result))
+			result = GetDDSSubresourceData(data.get(), dataSize, total.info, &surfaces[0]);
+		total.sliceSeconds += timer.Lap();
+
+		total.allocations += allocationCount - allocationsBefore;
+		total.allocatedBytes += allocationBytes - bytesBefore;
+		total.result = result;
+
+		// A rejected file fails the same way every time
+		return SUCCEEDED(result);
+	});
+	return total;
+}
+
+struct DecodeResult
+{
+	double seconds;
+	unsigned long long allocations;
+	unsigned long long allocatedBytes;
+	unsigned int iterations;
+	size_t width;
+	size_t height;
+	HRESULT result;
+};
+
+static DecodeResult MeasurePNG(const vector<uint8_t>& file, double secondsPerFile)
+{
+	DecodeResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerFile, [&](BenchmarkTimer& timer) -> bool
+	{
+		unique_ptr<uint8_t[]> pixels;
+		D3D11_SUBRESOURCE_DATA initData;
+		unsigned long long allocationsBefore = allocationCount;
+		unsigned long long bytesBefore = allocationBytes;
+		timer.Lap();
+
+		total.result = DecodePNGFromMemory(&file[0], file.size(), pixels, &total.width, &total.height, &initData);
+		total.seconds += timer.Lap();
+
+		total.allocations += allocationCount - allocationsBefore;
+		total.allocatedBytes += allocationBytes - bytesBefore;
+		return SUCCEEDED(total.result);
+	});
+	return total;
+}
+
+struct ConvertResult
+{
+	double surfacesSeconds;
+	double rowsSeconds;
+	unsigned long long allocations;
+	unsigned int iterations;
+	size_t convertedSize;
+	HRESULT result;
+};
+
+static ConvertResult MeasureLegacy(LEGACY_FORMAT format, const vector<uint8_t>& surfaces, double secondsPerFormat)
+{
+	size_t rowBytes = BENCHMARK_PNG_SIZE * GetLegacyBitsPerPixel(format) / 8;
+	vector<uint8_t> row(BENCHMARK_PNG_SIZE * 4);
+
+	ConvertResult total = {};
+	total.iterations = RunBenchmarkCase(secondsPerFormat, [&](BenchmarkTimer& timer) -> bool
+	{
+		unique_ptr<uint8_t[]> converted;
+		unsigned long long allocationsBefore = allocationCount;
+		timer.Lap();
+
+		total.result = ConvertLegacySurfaces(format, BENCHMARK_PNG_SIZE, BENCHMARK_PNG_SIZE, 1, CountMipLevels(BENCHMARK_PNG_SIZE, BENCHMARK_PNG_SIZE), 1,
+			&surfaces[0], surfaces.size(), converted, &total.convertedSize);
+		total.surfacesSeconds += timer.Lap();
+		total.allocations += allocationCount - allocationsBefore;
+
+		for (unsigned int y = 0; y < BENCHMARK_PNG_SIZE; ++y)
+			ConvertLegacyScanline(format, &surfaces[y * rowBytes], BENCHMARK_PNG_SIZE, &row[0]);
+		total.rowsSeconds += timer.Lap();
+		return SUCCEEDED(total.result);
+	});
+	return total;
+}
+
+static double MegabytesPerSecond(size_t bytes, double seconds)
+{
+	return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "File", -26 }, { "Fmt", 4 }, { "Size", 11 }, { "KB", 9 }, { "Parse us", 10 }, { "Conv us", 10 },
+	{ "Conv MB/s", 10 }, { "Slice us", 10 }, { "Load MB/s", 10 }, { "Allocs", 8 }, { "Alloc KB", 10 },
+};
+
+static const BenchmarkColumn pngColumns[] =
+{
+	{ "PNG", -26 }, { "Size", 11 }, { "KB", 9 }, { "Decode us", 10 }, { "File MB/s", 10 }, { "Pixel MB/s", 10 },
+	{ "Allocs", 8 }, { "Alloc KB", 10 },
+};
+
+static const BenchmarkColumn legacyColumns[] =
+{
+	{ "Legacy format", -26 }, { "Size", 11 }, { "KB", 9 }, { "Chain us", 10 }, { "Src MB/s", 10 }, { "Dst MB/s", 10 },
+	{ "Allocs", 8 }, { "Row ns/px", 10 },
+};
+
+static void ReportPNG(BenchmarkReport& report, const char* name, const vector<uint8_t>& file, const DecodeResult& decode, bool decodes)
+{
+	char size[32];
+	sprintf_s(size, "%ux%u", (unsigned int)decode.width, (unsigned int)decode.height);
+	report.Text(name);
+	if (FAILED(decode.result))
+	{
+		char note[64];
+		sprintf_s(note, "  rejected (0x%08X)%s", (unsigned int)decode.result, decodes ? "  UNEXPECTED" : "");
+		report.Skip();
+		report.Number(file.size() / 1024.0, 1);
+		report.EndRow(note);
+		return;
+	}
+
+	double n = decode.iterations;
+	report.Text(size);
+	report.Number(file.size() / 1024.0, 1);
+	report.Number(decode.seconds / n * 1e6, 1);
+	report.Number(MegabytesPerSecond(file.size(), decode.seconds / n), 1);
+	report.Number(MegabytesPerSecond(decode.width * decode.height * 4, decode.seconds / n), 1);
+	report.Number(decode.allocations / n, 1);
+	report.Number(decode.allocatedBytes / n / 1024.0, 1);
+	report.EndRow(decodes ? "" : "  UNEXPECTED");
+}
+
+int main(int argc, char** argv)
+{
+	double secondsPerFile = GetBenchmarkSeconds(argc, argv);
+	wchar_t pngDirectory[MAX_PATH] = BENCHMARK_PNG_DIRECTORY;
+	if (argc > 2)
+		swprintf_s(pngDirectory, MAX_PATH, L"%S", argv[2]);
+	vector<D3D11_SUBRESOURCE_DATA> surfaces(BENCHMARK_MAX_SUBRESOURCES);
+
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+
+	unsigned int unexpected = 0;
+	size_t corpusBytes = 0;
+	double corpusSeconds = 0;
+	for (unsigned int i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i)
+	{
+		const CorpusEntry& entry = corpus[i];
+		vector<uint8_t> file = BuildFile(entry);
+		StageResult stages = Measure(file, secondsPerFile, surfaces);
+
+		bool loaded = SUCCEEDED(stages.result);
+		if (loaded != entry.loads)
+			++unexpected;
+
+		char size[32];
+		sprintf_s(size, "%ux%ux%u", entry.width, entry.height, entry.dimension == TEX3D ? entry.depth : entry.arraySize * (entry.cubeMap ? 6 : 1));
+		report.Text(entry.name);
+		if (!loaded)
+		{
+			char note[64];
+			sprintf_s(note, "  rejected (0x%08X)%s", (unsigned int)stages.result, entry.loads ? "  UNEXPECTED" : "");
+			report.Skip();
+			report.Text(size);
+			report.Number(file.size() / 1024.0, 1);
+			report.EndRow(note);
+			continue;
+		}
+
+		double n = stages.iterations;
+		double loadSeconds = (stages.parseSeconds + stages.convertSeconds + stages.sliceSeconds) / n;
+		corpusBytes += file.size();
+		corpusSeconds += loadSeconds;
+		report.Number(stages.info.format, 0);
+		report.Text(size);
+		report.Number(file.size() / 1024.0, 1);
+		report.Number(stages.parseSeconds / n * 1e6, 2);
+		report.Number(stages.convertSeconds / n * 1e6, 1);
+		report.Number(MegabytesPerSecond(file.size(), stages.convertSeconds / n), 1);
+		report.Number(stages.sliceSeconds / n * 1e6, 2);
+		report.Number(MegabytesPerSecond(file.size(), loadSeconds), 1);
+		report.Number(stages.allocations / n, 1);
+		report.Number(stages.allocatedBytes / n / 1024.0, 1);
+		report.EndRow(entry.loads ? "" : "  UNEXPECTED");
+	}
+
+	printf("\nCorpus: %.1f MB in %.2f ms per pass, %.1f MB/s\n\n", corpusBytes / (1024.0 * 1024.0), corpusSeconds * 1e3, MegabytesPerSecond(corpusBytes, corpusSeconds));
+
+	BenchmarkReport pngReport(pngColumns, sizeof(pngColumns) / sizeof(pngColumns[0]));
+	pngReport.PrintHeader();
+	for (unsigned int i = 0; i < sizeof(pngFiles) / sizeof(pngFiles[0]); ++i)
+	{
+		wchar_t path[MAX_PATH];
+		swprintf_s(path, MAX_PATH, L"%s\\%s", pngDirectory, pngFiles[i].name);
+		char name[64];
+		sprintf_s(name, "%ls", pngFiles[i].name);
+
+		vector<uint8_t> file;
+		if (!ReadWholeFile(path, file))
+		{
+			pngReport.Text(name);
+			pngReport.EndRow("  not found");
+			continue;
+		}
+		DecodeResult decode = MeasurePNG(file, secondsPerFile);
+		if (SUCCEEDED(decode.result) != pngFiles[i].decodes)
+			++unexpected;
+		ReportPNG(pngReport, name, file, decode, pngFiles[i].decodes);
+	}
+	for (unsigned int bytesPerPixel = 3; bytesPerPixel <= 4; ++bytesPerPixel)
+	{
+		for (uint8_t filter = 0; filter < 5; ++filter)
+		{
+			vector<uint8_t> file = BuildFilteredPNG(filter, bytesPerPixel);
+			DecodeResult decode = MeasurePNG(file, secondsPerFile);
+			if (FAILED(decode.result))
+				++unexpected;
+			char name[64];
+			sprintf_s(name, "%s stored %s", bytesPerPixel == 4 ? "RGBA8" : "RGB8", pngFilterNames[filter]);
+			ReportPNG(pngReport, name, file, decode, true);
+		}
+	}
+
+	printf("\n");
+	BenchmarkReport legacyReport(legacyColumns, sizeof(legacyColumns) / sizeof(legacyColumns[0]));
+	legacyReport.PrintHeader();
+	for (unsigned int i = 0; i < sizeof(legacyCases) / sizeof(legacyCases[0]); ++i)
+	{
+		vector<uint8_t> surfaces = BuildLegacySurfaces(legacyCases[i].format);
+		ConvertResult convert = MeasureLegacy(legacyCases[i].format, surfaces, secondsPerFile);
+
+		char size[32];
+		sprintf_s(size, "%ux%u", BENCHMARK_PNG_SIZE, BENCHMARK_PNG_SIZE);
+		legacyReport.Text(legacyCases[i].name);
+		legacyReport.Text(size);
+		legacyReport.Number(surfaces.size() / 1024.0, 1);
+		if (FAILED(convert.result))
+		{
+			char note[64];
+			sprintf_s(note, "  failed (0x%08X)  UNEXPECTED", (unsigned int)convert.result);
+			++unexpected;
+			legacyReport.EndRow(note);
+			continue;
+		}
+
+		double n = convert.iterations;
+		legacyReport.Number(convert.surfacesSeconds / n * 1e6, 1);
+		legacyReport.Number(MegabytesPerSecond(surfaces.size(), convert.surfacesSeconds / n), 1);
+		legacyReport.Number(MegabytesPerSecond(convert.convertedSize, convert.surfacesSeconds / n), 1);
+		legacyReport.Number(convert.allocations / n, 1);
+		legacyReport.Number(convert.rowsSeconds / n / (BENCHMARK_PNG_SIZE * BENCHMARK_PNG_SIZE) * 1e9, 2);
+		legacyReport.EndRow();
+	}
+
+	if (unexpected)
+		printf("%u files did not load the way they should have\n", unexpected);
+	return unexpected ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+//************************************************************
+//************ TRANSFORM HIERARCHY BENCHMARK *****************
+//************************************************************
+
+// Times bringing world matrices up to date, for trees of a thousand to a hundred thousand
+// nodes. The first thousand nodes are roots and every other node has four children, so
+// the trees are a few levels deep. Each size goes through four changes:
+//   all       - every node moved
+//   roots     - only the roots moved, which moves everything under them
+//   scattered - one node in a hundred moved, spread over the whole tree
+//   none      - nothing moved
+// The same moves are made on a TransformHierarchy and on separately allocated nodes that
+// keep their own matrices and a pointer to their parent, updated one after another the way
+// objects holding a world matrix each would be. Times are per frame and per node updated.
+//
+// Usage: TransformHierarchyBenchmark [seconds per case]
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "../Benchmark/Benchmark.h"
+#include "../Win32Project1/TransformHierarchy.h"
+
+using namespace std;
+
+#define BENCHMARK_ROOTS 1000
+#define BENCHMARK_CHILDREN 4
+#define BENCHMARK_SCATTER_STEP 100 // One node in this many moves in the scattered case
+
+enum MoveCase
+{
+	MOVE_ALL,
+	MOVE_ROOTS,
+	MOVE_SCATTERED,
+	MOVE_NONE,
+	MOVE_CASE_COUNT
+};
+
+static const char* caseNames[MOVE_CASE_COUNT] = { "all", "roots", "scattered", "none" };
+static const unsigned int nodeCounts[] = { 1000, 10000, 100000 };
+
+// A node as an object with a world matrix of its own would keep it
+struct OBJECT_NODE
+{
+	OBJECT_NODE* parent;
+	XMFLOAT3 position;
+	XMFLOAT4 rotation;
+	XMFLOAT3 scale;
+	XMFLOAT4X4 worldMatrix;
+	bool dirty;
+};
+
+struct CaseResult
+{
+	double moveSeconds;
+	double updateSeconds;
+	double updated;
+	unsigned int iterations;
+};
+
+static unsigned int Parent(unsigned int index)
+{
+	return (index < BENCHMARK_ROOTS) ? TRANSFORM_HIERARCHY_NO_PARENT : (index - BENCHMARK_ROOTS) / BENCHMARK_CHILDREN;
+}
+
+// The nodes the case moves this frame. Starts somewhere else each frame so that the same
+// nodes are not always the ones moved.
+static void Moved(MoveCase moveCase, unsigned int count, unsigned int frame, vector<unsigned int>& moved)
+{
+	moved.clear();
+	switch (moveCase)
+	{
+	case MOVE_ALL:
+		for (unsigned int i = 0; i < count; ++i)
+			moved.push_back(i);
+		break;
+	case MOVE_ROOTS:
+		for (unsigned int i = 0; i < min(count, (unsigned int)BENCHMARK_ROOTS); ++i)
+			moved.push_back(i);
+		break;
+	case MOVE_SCATTERED:
+		for (unsigned int i = frame % BENCHMARK_SCATTER_STEP; i < count; i += BENCHMARK_SCATTER_STEP)
+			moved.push_back(i);
+		break;
+	default:
+		break;
+	}
+}
+
+// Somewhere that depends on the frame, so that nothing can be skipped
+static void Pose(unsigned int index, unsigned int frame, XMFLOAT3& position, XMFLOAT4& rotation)
+{
+	float offset = (float)(frame & 255) * 0.01f;
+	position = XMFLOAT3((float)(index & 15) + offset, 1.0f, (float)((index >> 4) & 15));
+	XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYaw(0, offset + (float)index * 0.001f, 0));
+}
+
+static CaseResult MeasureHierarchy(TransformHierarchy& transforms, MoveCase moveCase, double secondsPerCase)
+{
+	vector<unsigned int> moved;
+	XMFLOAT3 position, scale(1, 1, 1);
+	XMFLOAT4 rotation;
+	// Brings in whatever is left from the last case, so that it is not counted against this one
+	transforms.Update();
+
+	CaseResult total = {};
+	unsigned int frame = 0;
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		Moved(moveCase, transforms.GetCount(), frame, moved);
+		timer.Lap();
+		for (unsigned int i = 0; i < moved.size(); ++i)
+		{
+			Pose(moved[i], frame, position, rotation);
+			transforms.SetLocalTransform(moved[i], position, rotation, scale);
+		}
+		total.moveSeconds += timer.Lap();
+		transforms.Update();
+		total.updateSeconds += timer.Lap();
+
+		total.updated += transforms.GetUpdatedCount();
+		++frame;
+		return true;
+	});
+	return total;
+}
+
+static CaseResult MeasureObjects(vector<OBJECT_NODE*>& nodes, MoveCase moveCase, double secondsPerCase)
+{
+	vector<unsigned int> moved;
+	CaseResult total = {};
+	unsigned int frame = 0;
+	total.iterations = RunBenchmarkCase(secondsPerCase, [&](BenchmarkTimer& timer) -> bool
+	{
+		Moved(moveCase, (unsigned int)nodes.size(), frame, moved);
+		timer.Lap();
+		for (unsigned int i = 0; i < moved.size(); ++i)
+		{
+			OBJECT_NODE* node = nodes[moved[i]];
+			Pose(moved[i], frame, node->position, node->rotation);
+			node->dirty = true;
+		}
+		total.moveSeconds += timer.Lap();
+
+		// Each object asks its parent whether it moved, as the scattered ones have to
+		unsigned int updatedNodes = 0;
+		for (unsigned int i = 0; i < nodes.size(); ++i)
+		{
+			OBJECT_NODE* node = nodes[i];
+			if (!node->dirty && !(node->parent && node->parent->dirty))
+				continue;
+			XMMATRIX local = XMMatrixAffineTransformation(XMLoadFloat3(&node->scale), XMVectorZero(), XMLoadFloat4(&node->rotation), XMLoadFloat3(&node->position));
+			if (node->parent)
+				local = XMMatrixMultiply(local, XMLoadFloat4x4(&node->parent->worldMatrix));
+			XMStoreFloat4x4(&node->worldMatrix, local);
+			node->dirty = true;
+			++updatedNodes;
+		}
+		for (unsigned int i = 0; i < nodes.size(); ++i)
+			nodes[i]->dirty = false;
+		total.updateSeconds += timer.Lap();
+
+		total.updated += updatedNodes;
+		++frame;
+		return true;
+	});
+	return total;
+}
+
+static const BenchmarkColumn columns[] =
+{
+	{ "Nodes", 8 }, { "Layout", -10 }, { "Case", -10 }, { "Updated", 10 }, { "Frame us", 14 }, { "Update ns/node", 14 },
+};
+
+static void Report(BenchmarkReport& report, unsigned int count, const char* layout, MoveCase moveCase, const CaseResult& result)
+{
+	double n = result.iterations;
+	double updated = result.updated / n;
+	report.Number(count, 0);
+	report.Text(layout);
+	report.Text(caseNames[moveCase]);
+	report.Number(updated, 0);
+	report.Number((result.moveSeconds + result.updateSeconds) / n * 1e6, 1);
+	report.Number(updated > 0 ? result.updateSeconds / n / updated * 1e9 : 0, 2);
+	report.EndRow();
+}
+
+int main(int argc, char** argv)
+{
+	double secondsPerCase = GetBenchmarkSeconds(argc, argv);
+
+	BenchmarkReport report(columns, sizeof(columns) / sizeof(columns[0]));
+	report.PrintHeader();
+	for (unsigned int c = 0; c < sizeof(nodeCounts) / sizeof(nodeCounts[0]); ++c)
+	{
+		unsigned int count = nodeCounts[c];
+
+		TransformHierarchy transforms;
+		transforms.Reserve(count);
+		for (unsigned int i = 0; i < count; ++i)
+			transforms.Add(Parent(i));
+
+		// Allocated in a shuffled order so that neighbours in the tree are not neighbours in
+		// memory, as objects made at different times would not be
+		vector<unsigned int> order(count);
+		for (unsigned int i = 0; i < count; ++i)
+			order[i] = i;
+		srand(count);
+		random_shuffle(order.begin(), order.end());
+		vector<OBJECT_NODE*> nodes(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			OBJECT_NODE* node = new OBJECT_NODE;
+			node->position = XMFLOAT3(0, 0, 0);
+			node->rotation = XMFLOAT4(0, 0, 0, 1);
+			node->scale = XMFLOAT3(1, 1, 1);
+			XMStoreFloat4x4(&node->worldMatrix, XMMatrixIdentity());
+			node->dirty = true;
+			nodes[order[i]] = node;
+		}
+		for (unsigned int i = 0; i < count; ++i)
+			nodes[i]->parent = (Parent(i) == TRANSFORM_HIERARCHY_NO_PARENT) ? nullptr : nodes[Parent(i)];
+
+		for (unsigned int m = 0; m < MOVE_CASE_COUNT; ++m)
+		{
+			Report(report, count, "hierarchy", (MoveCase)m, MeasureHierarchy(transforms, (MoveCase)m, secondsPerCase));
+			Report(report, count, "objects", (MoveCase)m, MeasureObjects(nodes, (MoveCase)m, secondsPerCase));
+		}
+
+		for (unsigned int i = 0; i < count; ++i)
+			delete nodes[i];
+	}
+	return 0;
+}
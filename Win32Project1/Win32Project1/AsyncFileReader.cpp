@@ -0,0 +1,350 @@
+#include "AsyncFileReader.h"
+
+AsyncFileReader::AsyncFileReader()
+{
+	completionPort = nullptr;
+	stagingMemory = nullptr;
+	shuttingDown = false;
+	requestsInFlight = 0;
+	bytesRead = 0;
+	filesRead = 0;
+}
+
+
+AsyncFileReader::~AsyncFileReader()
+{
+	Shutdown();
+}
+
+void AsyncFileReader::Initialize()
+{
+	shuttingDown = false;
+	completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, ASYNC_READ_NUM_WORKERS);
+	if (completionPort)
+		stagingMemory = (uint8_t*)VirtualAlloc(nullptr, ASYNC_READ_QUEUE_DEPTH * ASYNC_READ_CHUNK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	if (completionPort && stagingMemory)
+	{
+		// VirtualAlloc hands out whole pages, so every chunk starts on a sector boundary
+		for (unsigned int i = 0; i < ASYNC_READ_QUEUE_DEPTH; ++i)
+		{
+			chunks[i].staging = stagingMemory + i * ASYNC_READ_CHUNK_SIZE;
+			freeChunks.push_back(&chunks[i]);
+		}
+		for (unsigned int i = 0; i < ASYNC_READ_NUM_WORKERS; ++i)
+			workers.push_back(thread(&AsyncFileReader::CompletionWorker, this));
+	}
+	else
+	{
+		if (completionPort)
+			CloseHandle(completionPort);
+		completionPort = nullptr;
+		for (unsigned int i = 0; i < ASYNC_READ_NUM_WORKERS; ++i)
+			workers.push_back(thread(&AsyncFileReader::BlockingWorker, this));
+	}
+}
+
+void AsyncFileReader::Prefetch(const wchar_t* filename)
+{
+	{
+		lock_guard<mutex> lock(readMutex);
+		multimap<wstring, ReadRequest*>::iterator found = requests.find(filename);
+		if (found != requests.end())
+		{
+			found->second->claimsLeft++;
+			return;
+		}
+	}
+
+	ReadRequest* request = new ReadRequest();
+	request->filename = filename;
+	request->file = INVALID_HANDLE_VALUE;
+	request->unbuffered = false;
+	request->size = 0;
+	request->nextOffset = 0;
+	request->completedBytes = 0;
+	request->chunksInFlight = 0;
+	request->claimsLeft = 1;
+	request->loadsWaiting = 0;
+	request->failed = false;
+	request->done = false;
+
+	// Opening can wait on the disk, so it happens before taking the lock
+	if (completionPort)
+		request->failed = !Open(request);
+
+	lock_guard<mutex> lock(readMutex);
+	requests.insert(make_pair(request->filename, request));
+	++requestsInFlight;
+	if (!completionPort)
+	{
+		blockingQueue.push_back(request);
+		readQueued.notify_one();
+	}
+	else if (request->failed || request->size == 0)
+		Finish(request);
+	else
+	{
+		issueQueue.push_back(request);
+		IssueReads();
+	}
+}
+
+bool AsyncFileReader::Load(const wchar_t* filename, unique_ptr<uint8_t[]>& data, size_t* dataSize)
+{
+	*dataSize = 0;
+
+	// Claim one Prefetch of the file, making one if nothing was queued for it
+	unique_lock<mutex> lock(readMutex);
+	multimap<wstring, ReadRequest*>::iterator found = requests.find(filename);
+	while (found == requests.end())
+	{
+		lock.unlock();
+		Prefetch(filename);
+		lock.lock();
+		found = requests.find(filename);
+	}
+
+	ReadRequest* request = found->second;
+	request->loadsWaiting++;
+	if (--request->claimsLeft == 0)
+		requests.erase(found);
+
+	readFinished.wait(lock, [request]() { return request->done; });
+
+	// The last load out takes the buffer; anyone sharing the read before it gets a copy
+	bool succeeded = !request->failed;
+	bool lastLoad = (--request->loadsWaiting == 0 && request->claimsLeft == 0);
+	if (succeeded)
+	{
+		*dataSize = request->size;
+		if (lastLoad)
+			data.swap(request->data);
+		else
+		{
+			data.reset(new uint8_t[max(request->size, (size_t)1)]);
+			memcpy(data.get(), request->data.get(), request->size);
+		}
+	}
+	if (lastLoad)
+		delete request;
+
+	return succeeded;
+}
+
+void AsyncFileReader::Shutdown()
+{
+	{
+		unique_lock<mutex> lock(readMutex);
+		if (workers.empty())
+			return;
+
+		// Reads in flight still write into their buffers and the staging chunks
+		shuttingDown = true;
+		readQueued.notify_all();
+		readFinished.wait(lock, [this]() { return requestsInFlight == 0; });
+
+		// Prefetches that were never loaded give up their claims. A request a Load is still
+		// waiting on is then freed by the last such Load, which now finds no claims left.
+		for (multimap<wstring, ReadRequest*>::iterator i = requests.begin(); i != requests.end(); ++i)
+		{
+			ReadRequest* request = i->second;
+			request->claimsLeft = 0;
+			if (request->loadsWaiting == 0)
+				delete request;
+		}
+		requests.clear();
+		readFinished.notify_all();
+	}
+
+	if (completionPort)
+	{
+		for (unsigned int i = 0; i < workers.size(); ++i)
+			PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+	}
+	for (unsigned int i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+
+	freeChunks.clear();
+	issueQueue.clear();
+
+	if (completionPort)
+		CloseHandle(completionPort);
+	completionPort = nullptr;
+	if (stagingMemory)
+		VirtualFree(stagingMemory, 0, MEM_RELEASE);
+	stagingMemory = nullptr;
+}
+
+bool AsyncFileReader::Open(ReadRequest* request)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(request->filename.c_str(), GetFileExInfoStandard, &attributes) || attributes.nFileSizeHigh > 0)
+		return false;
+
+	request->size = attributes.nFileSizeLow;
+	request->unbuffered = (request->size >= ASYNC_READ_UNBUFFERED_SIZE);
+	DWORD flags = FILE_FLAG_OVERLAPPED | (request->unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN);
+	request->file = CreateFileW(request->filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+
+	// Some volumes refuse unbuffered handles; going through the cache is fine for those
+	if (request->file == INVALID_HANDLE_VALUE && request->unbuffered)
+	{
+		request->unbuffered = false;
+		request->file = CreateFileW(request->filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	}
+
+	if (request->file == INVALID_HANDLE_VALUE || !CreateIoCompletionPort(request->file, completionPort, 0, 0))
+		return false;
+
+	request->data.reset(new uint8_t[max(request->size, (size_t)1)]);
+	return true;
+}
+
+// Called with readMutex held. Fills every free chunk, oldest request first, so the files the
+// loaders asked for first are the first to finish.
+void AsyncFileReader::IssueReads()
+{
+	while (!freeChunks.empty() && !issueQueue.empty())
+	{
+		ReadRequest* request = issueQueue.front();
+		if (request->failed || request->nextOffset >= request->size)
+		{
+			issueQueue.pop_front();
+			continue;
+		}
+
+		ReadChunk* chunk = freeChunks.back();
+		freeChunks.pop_back();
+		chunk->request = request;
+		chunk->offset = request->nextOffset;
+		chunk->length = min(request->size - request->nextOffset, (size_t)ASYNC_READ_CHUNK_SIZE);
+		request->nextOffset += chunk->length;
+		request->chunksInFlight++;
+
+		// Unbuffered reads have to cover whole sectors; the last one just stops at the end of the file
+		DWORD readLength = (DWORD)chunk->length;
+		uint8_t* destination = request->data.get() + chunk->offset;
+		if (request->unbuffered)
+		{
+			readLength = (DWORD)((chunk->length + ASYNC_READ_SECTOR_SIZE - 1) & ~(size_t)(ASYNC_READ_SECTOR_SIZE - 1));
+			destination = chunk->staging;
+		}
+
+		// A read that finishes straight away still posts its completion to the port
+		ZeroMemory(&chunk->overlapped, sizeof(chunk->overlapped));
+		chunk->overlapped.Offset = (DWORD)chunk->offset;
+		if (!ReadFile(request->file, destination, readLength, nullptr, &chunk->overlapped) && GetLastError() != ERROR_IO_PENDING)
+		{
+			request->failed = true;
+			request->chunksInFlight--;
+			freeChunks.push_back(chunk);
+			if (request->chunksInFlight == 0)
+				Finish(request);
+		}
+	}
+}
+
+// Called with readMutex held
+void AsyncFileReader::Finish(ReadRequest* request)
+{
+	if (request->file != INVALID_HANDLE_VALUE)
+		CloseHandle(request->file);
+	request->file = INVALID_HANDLE_VALUE;
+
+	if (request->failed)
+		request->data.reset();
+	else
+	{
+		bytesRead += request->size;
+		++filesRead;
+	}
+
+	request->done = true;
+	--requestsInFlight;
+	readFinished.notify_all();
+}
+
+void AsyncFileReader::CompletionWorker()
+{
+	for (;;)
+	{
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = nullptr;
+		BOOL succeeded = GetQueuedCompletionStatus(completionPort, &bytes, &key, &overlapped, INFINITE);
+
+		// Shutdown posts one empty packet per worker
+		if (!overlapped)
+			return;
+
+		ReadChunk* chunk = (ReadChunk*)overlapped;
+		ReadRequest* request = chunk->request;
+		bool chunkRead = succeeded && bytes >= chunk->length;
+		if (chunkRead && request->unbuffered)
+			memcpy(request->data.get() + chunk->offset, chunk->staging, chunk->length);
+
+		lock_guard<mutex> lock(readMutex);
+		request->chunksInFlight--;
+		if (chunkRead)
+			request->completedBytes += chunk->length;
+		else
+			request->failed = true;
+		freeChunks.push_back(chunk);
+
+		if (request->chunksInFlight == 0 && (request->failed || request->completedBytes == request->size))
+			Finish(request);
+		IssueReads();
+	}
+}
+
+void AsyncFileReader::BlockingWorker()
+{
+	for (;;)
+	{
+		ReadRequest* request = nullptr;
+		{
+			unique_lock<mutex> lock(readMutex);
+			readQueued.wait(lock, [this]() { return shuttingDown || !blockingQueue.empty(); });
+			if (blockingQueue.empty())
+				return;
+			request = blockingQueue.front();
+			blockingQueue.pop_front();
+		}
+
+		HANDLE file = CreateFileW(request->filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER fileSize = {};
+		bool readAll = (file != INVALID_HANDLE_VALUE) && GetFileSizeEx(file, &fileSize) && fileSize.HighPart == 0;
+		if (readAll)
+		{
+			DWORD read = 0;
+			request->size = fileSize.LowPart;
+			request->data.reset(new uint8_t[max(request->size, (size_t)1)]);
+			readAll = ReadFile(file, request->data.get(), fileSize.LowPart, &read, nullptr) && read == fileSize.LowPart;
+		}
+
+		lock_guard<mutex> lock(readMutex);
+		request->file = file;
+		request->failed = !readAll;
+		Finish(request);
+	}
+}
+
+// Accessors
+bool AsyncFileReader::UsesCompletionPort() const
+{
+	return completionPort != nullptr;
+}
+
+size_t AsyncFileReader::GetBytesRead()
+{
+	lock_guard<mutex> lock(readMutex);
+	return bytesRead;
+}
+
+unsigned int AsyncFileReader::GetFilesRead()
+{
+	lock_guard<mutex> lock(readMutex);
+	return filesRead;
+}
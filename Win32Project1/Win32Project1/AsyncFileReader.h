@@ -0,0 +1,95 @@
+#pragma once
+#include "defines.h"
+#include <map>
+#include <string>
+#include <deque>
+#include <condition_variable>
+
+#define ASYNC_READ_NUM_WORKERS 2
+#define ASYNC_READ_QUEUE_DEPTH 16
+#define ASYNC_READ_CHUNK_SIZE (256 * 1024)
+#define ASYNC_READ_UNBUFFERED_SIZE (512 * 1024) // Files at least this large bypass the system cache
+#define ASYNC_READ_SECTOR_SIZE 4096
+
+// Reads whole files for the loaders. Everything that is needed at startup is queued up front
+// with Prefetch so the reads overlap each other and the loader threads' parsing; a loader
+// then calls Load for the same file and only waits if it has not arrived yet.
+//
+// Reads go through an I/O completion port. Every file is split into chunks and up to
+// ASYNC_READ_QUEUE_DEPTH of them are in flight at once across all files, with a handful
+// of worker threads handling completions. Large files are opened unbuffered and read into
+// page aligned staging chunks allocated once in Initialize, then copied out. If the port
+// cannot be created the same workers fall back to plain blocking reads, one file each.
+class AsyncFileReader
+{
+public:
+	AsyncFileReader();
+	~AsyncFileReader();
+
+	void Initialize();
+
+	// Safe to call from any thread. Prefetching a file again before it is loaded shares the
+	// read; each Prefetch should be matched by one Load.
+	void Prefetch(const wchar_t* filename);
+
+	// Hands over the whole file, waiting for a prefetched read or starting one now. False if
+	// the file could not be read.
+	bool Load(const wchar_t* filename, unique_ptr<uint8_t[]>& data, size_t* dataSize);
+
+	// Waits for reads still in flight, then stops the workers
+	void Shutdown();
+
+	// Accessors
+	bool UsesCompletionPort() const;
+	size_t GetBytesRead();
+	unsigned int GetFilesRead();
+
+private:
+
+	struct ReadRequest
+	{
+		wstring filename;
+		HANDLE file;
+		bool unbuffered;
+		unique_ptr<uint8_t[]> data;
+		size_t size;
+		size_t nextOffset;
+		size_t completedBytes;
+		unsigned int chunksInFlight;
+		unsigned int claimsLeft; // Prefetches not yet matched by a Load
+		unsigned int loadsWaiting;
+		bool failed;
+		bool done;
+	};
+
+	struct ReadChunk
+	{
+		OVERLAPPED overlapped; // First, so a completed OVERLAPPED* is the chunk
+		ReadRequest* request;
+		size_t offset;
+		size_t length;
+		uint8_t* staging;
+	};
+
+	HANDLE completionPort;
+	uint8_t* stagingMemory;
+	ReadChunk chunks[ASYNC_READ_QUEUE_DEPTH];
+	vector<ReadChunk*> freeChunks;
+	deque<ReadRequest*> issueQueue;
+	deque<ReadRequest*> blockingQueue;
+	multimap<wstring, ReadRequest*> requests;
+	vector<thread> workers;
+	mutex readMutex;
+	condition_variable readQueued;
+	condition_variable readFinished;
+	bool shuttingDown;
+	unsigned int requestsInFlight;
+	size_t bytesRead;
+	unsigned int filesRead;
+
+	bool Open(ReadRequest* request);
+	void IssueReads();
+	void Finish(ReadRequest* request);
+	void CompletionWorker();
+	void BlockingWorker();
+};
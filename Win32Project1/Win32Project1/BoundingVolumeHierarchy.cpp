@@ -0,0 +1,571 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <float.h>
+
+static float SurfaceArea(const XMFLOAT3& minimum, const XMFLOAT3& maximum)
+{
+	float x = maximum.x - minimum.x;
+	float y = maximum.y - minimum.y;
+	float z = maximum.z - minimum.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static void Grow(XMFLOAT3& minimum, XMFLOAT3& maximum, float x, float y, float z, float radius)
+{
+	minimum.x = min(minimum.x, x - radius);
+	minimum.y = min(minimum.y, y - radius);
+	minimum.z = min(minimum.z, z - radius);
+	maximum.x = max(maximum.x, x + radius);
+	maximum.y = max(maximum.y, y + radius);
+	maximum.z = max(maximum.z, z + radius);
+}
+
+// Where a ray enters a box, given one over each component of its direction. False if it
+// misses the box or only meets it further away than maxDistance.
+static bool RayEntersBox(const float origin[3], const float inverseDirection[3], const XMFLOAT3& minimum, const XMFLOAT3& maximum,
+	float maxDistance, float& entry)
+{
+	const float* low = &minimum.x;
+	const float* high = &maximum.x;
+	float enter = 0.0f;
+	float leave = maxDistance;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float t0 = (low[axis] - origin[axis]) * inverseDirection[axis];
+		float t1 = (high[axis] - origin[axis]) * inverseDirection[axis];
+		enter = max(enter, min(t0, t1));
+		leave = min(leave, max(t0, t1));
+	}
+	entry = enter;
+	return enter <= leave;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+	needsRebuild = false;
+	surfaceArea = 0;
+	builtCost = 0;
+	refitCount = 0;
+	rebuildCount = 0;
+}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy()
+{
+}
+
+unsigned int BoundingVolumeHierarchy::Add(const XMFLOAT3& center, float radius)
+{
+	unsigned int index = (unsigned int)centerX.size();
+	centerX.push_back(center.x);
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	this->radius.push_back(radius);
+	objectLeaves.push_back(0);
+	moved.push_back(0);
+	needsRebuild = true;
+	return index;
+}
+
+void BoundingVolumeHierarchy::Reserve(unsigned int count)
+{
+	centerX.reserve(count);
+	centerY.reserve(count);
+	centerZ.reserve(count);
+	radius.reserve(count);
+	objectLeaves.reserve(count);
+	moved.reserve(count);
+	order.reserve(count);
+}
+
+void BoundingVolumeHierarchy::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+	nodes.clear();
+	order.clear();
+	objectLeaves.clear();
+	movedObjects.clear();
+	moved.clear();
+	refitQueue.clear();
+	queued.clear();
+	needsRebuild = false;
+	surfaceArea = 0;
+	builtCost = 0;
+}
+
+void BoundingVolumeHierarchy::Update()
+{
+	refitCount = 0;
+	if (needsRebuild)
+	{
+		Rebuild();
+		return;
+	}
+
+	for (unsigned int i = 0; i < movedObjects.size(); ++i)
+	{
+		unsigned int leaf = objectLeaves[movedObjects[i]];
+		moved[movedObjects[i]] = 0;
+		if (queued[leaf])
+			continue;
+		queued[leaf] = 1;
+		refitQueue.push_back(leaf);
+		push_heap(refitQueue.begin(), refitQueue.end());
+	}
+	movedObjects.clear();
+
+	// Children come after their parents, so taking the highest index first refits every node
+	// after all of its children. A node whose box stays the same leaves its parent alone.
+	while (!refitQueue.empty())
+	{
+		pop_heap(refitQueue.begin(), refitQueue.end());
+		unsigned int node = refitQueue.back();
+		refitQueue.pop_back();
+		queued[node] = 0;
+		++refitCount;
+
+		unsigned int parent = nodes[node].parent;
+		if (Refit(node) && parent != BVH_NONE && !queued[parent])
+		{
+			queued[parent] = 1;
+			refitQueue.push_back(parent);
+			push_heap(refitQueue.begin(), refitQueue.end());
+		}
+	}
+
+	if (GetCost() > builtCost * BVH_REBUILD_RATIO)
+		Rebuild();
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+	unsigned int count = GetCount();
+	nodes.clear();
+	order.resize(count);
+	for (unsigned int i = 0; i < count; ++i)
+		order[i] = i;
+	for (unsigned int i = 0; i < movedObjects.size(); ++i)
+		moved[movedObjects[i]] = 0;
+	movedObjects.clear();
+	refitQueue.clear();
+	needsRebuild = false;
+	surfaceArea = 0;
+	++rebuildCount;
+
+	if (count > 0)
+	{
+		BVH_NODE root = {};
+		root.objectCount = count;
+		root.parent = BVH_NONE;
+		nodes.push_back(root);
+		// Each split adds the children after every node there is, so this reaches them all
+		for (unsigned int node = 0; node < nodes.size(); ++node)
+			Split(node);
+	}
+	queued.assign(nodes.size(), 0);
+	builtCost = GetCost();
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT], vector<unsigned int>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	vector<unsigned int> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVH_NODE& node = nodes[stack.back()];
+		stack.pop_back();
+
+		// Out when the corner furthest along a plane's normal is behind it; wholly in when
+		// the corner furthest against every normal is in front of it
+		bool outside = false;
+		bool inside = true;
+		for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT && !outside; ++plane)
+		{
+			const XMFLOAT4& p = planes[plane];
+			float furthest = p.x * (p.x >= 0 ? node.maximum.x : node.minimum.x) + p.y * (p.y >= 0 ? node.maximum.y : node.minimum.y) +
+				p.z * (p.z >= 0 ? node.maximum.z : node.minimum.z) + p.w;
+			float nearest = p.x * (p.x >= 0 ? node.minimum.x : node.maximum.x) + p.y * (p.y >= 0 ? node.minimum.y : node.maximum.y) +
+				p.z * (p.z >= 0 ? node.minimum.z : node.maximum.z) + p.w;
+			outside = furthest < 0;
+			inside = inside && nearest >= 0;
+		}
+		if (outside)
+			continue;
+
+		if (inside)
+			results.insert(results.end(), order.begin() + node.firstObject, order.begin() + node.firstObject + node.objectCount);
+		else if (node.firstChild == 0)
+		{
+			for (unsigned int i = node.firstObject; i < node.firstObject + node.objectCount; ++i)
+			{
+				if (SphereInFrustum(order[i], planes))
+					results.push_back(order[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.firstChild);
+			stack.push_back(node.firstChild + 1);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QuerySphere(const XMFLOAT3& center, float radius, vector<unsigned int>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	vector<unsigned int> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	float radiusSquared = radius * radius;
+	while (!stack.empty())
+	{
+		const BVH_NODE& node = nodes[stack.back()];
+		stack.pop_back();
+
+		// Distance to the nearest point of the box, and to its furthest corner
+		float dx = max(max(node.minimum.x - center.x, center.x - node.maximum.x), 0.0f);
+		float dy = max(max(node.minimum.y - center.y, center.y - node.maximum.y), 0.0f);
+		float dz = max(max(node.minimum.z - center.z, center.z - node.maximum.z), 0.0f);
+		if (dx * dx + dy * dy + dz * dz > radiusSquared)
+			continue;
+		float fx = max(center.x - node.minimum.x, node.maximum.x - center.x);
+		float fy = max(center.y - node.minimum.y, node.maximum.y - center.y);
+		float fz = max(center.z - node.minimum.z, node.maximum.z - center.z);
+
+		if (fx * fx + fy * fy + fz * fz <= radiusSquared)
+			results.insert(results.end(), order.begin() + node.firstObject, order.begin() + node.firstObject + node.objectCount);
+		else if (node.firstChild == 0)
+		{
+			for (unsigned int i = node.firstObject; i < node.firstObject + node.objectCount; ++i)
+			{
+				unsigned int object = order[i];
+				float x = centerX[object] - center.x;
+				float y = centerY[object] - center.y;
+				float z = centerZ[object] - center.z;
+				float reach = radius + this->radius[object];
+				if (x * x + y * y + z * z <= reach * reach)
+					results.push_back(object);
+			}
+		}
+		else
+		{
+			stack.push_back(node.firstChild);
+			stack.push_back(node.firstChild + 1);
+		}
+	}
+}
+
+unsigned int BoundingVolumeHierarchy::RayCast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance, float* distance) const
+{
+	if (nodes.empty() || XMVectorGetX(XMVector3LengthSq(direction)) == 0)
+		return BVH_NONE;
+
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, XMVector3Normalize(direction));
+	float start[3] = { o.x, o.y, o.z };
+	float along[3] = { d.x, d.y, d.z };
+	// A ray along an axis never crosses the other axes' slabs, which a huge inverse gives
+	// without the 0 * infinity of the slab it starts on
+	float inverseDirection[3];
+	for (unsigned int axis = 0; axis < 3; ++axis)
+		inverseDirection[axis] = (fabsf(along[axis]) > 1e-20f) ? 1.0f / along[axis] : ((along[axis] >= 0) ? 1e30f : -1e30f);
+
+	unsigned int hit = BVH_NONE;
+	float nearest = maxDistance;
+	float entry;
+	vector<unsigned int> stack;
+	stack.reserve(64);
+	if (RayEntersBox(start, inverseDirection, nodes[0].minimum, nodes[0].maximum, nearest, entry))
+		stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVH_NODE& node = nodes[stack.back()];
+		stack.pop_back();
+		// The box was entered before anything was hit, but maybe not before what has been since
+		if (!RayEntersBox(start, inverseDirection, node.minimum, node.maximum, nearest, entry))
+			continue;
+
+		if (node.firstChild == 0)
+		{
+			for (unsigned int i = node.firstObject; i < node.firstObject + node.objectCount; ++i)
+			{
+				unsigned int object = order[i];
+				float mx = o.x - centerX[object];
+				float my = o.y - centerY[object];
+				float mz = o.z - centerZ[object];
+				float b = mx * d.x + my * d.y + mz * d.z;
+				float c = mx * mx + my * my + mz * mz - radius[object] * radius[object];
+				// Outside and heading away, or passing by
+				if (c > 0 && (b > 0 || b * b < c))
+					continue;
+				float t = (c > 0) ? -b - sqrtf(b * b - c) : 0.0f;
+				if (t <= nearest)
+				{
+					nearest = t;
+					hit = object;
+				}
+			}
+			continue;
+		}
+
+		// The nearer child goes on top, so it is searched first and shortens the ray for the other
+		float entries[2];
+		bool enters[2];
+		for (unsigned int child = 0; child < 2; ++child)
+			enters[child] = RayEntersBox(start, inverseDirection, nodes[node.firstChild + child].minimum, nodes[node.firstChild + child].maximum, nearest, entries[child]);
+		unsigned int first = (enters[0] && enters[1] && entries[1] < entries[0]) ? 1 : 0;
+		if (enters[1 - first])
+			stack.push_back(node.firstChild + 1 - first);
+		if (enters[first])
+			stack.push_back(node.firstChild + first);
+	}
+
+	if (hit != BVH_NONE && distance)
+		*distance = nearest;
+	return hit;
+}
+
+// Accessors
+unsigned int BoundingVolumeHierarchy::GetCount() const
+{
+	return (unsigned int)centerX.size();
+}
+
+unsigned int BoundingVolumeHierarchy::GetNodeCount() const
+{
+	return (unsigned int)nodes.size();
+}
+
+XMFLOAT4 BoundingVolumeHierarchy::GetSphere(unsigned int index) const
+{
+	if (index >= GetCount())
+		return XMFLOAT4(0, 0, 0, 0);
+	return XMFLOAT4(centerX[index], centerY[index], centerZ[index], radius[index]);
+}
+
+float BoundingVolumeHierarchy::GetCost() const
+{
+	if (nodes.empty())
+		return 0;
+	float rootArea = SurfaceArea(nodes[0].minimum, nodes[0].maximum);
+	return (rootArea > 0) ? surfaceArea / rootArea : 1.0f;
+}
+
+unsigned int BoundingVolumeHierarchy::GetRefitCount() const
+{
+	return refitCount;
+}
+
+unsigned int BoundingVolumeHierarchy::GetRebuildCount() const
+{
+	return rebuildCount;
+}
+
+// Mutators
+void BoundingVolumeHierarchy::SetSphere(unsigned int index, const XMFLOAT3& center, float radius)
+{
+	if (index >= GetCount())
+		return;
+	if (centerX[index] == center.x && centerY[index] == center.y && centerZ[index] == center.z && this->radius[index] == radius)
+		return;
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	this->radius[index] = radius;
+	if (!moved[index])
+	{
+		moved[index] = 1;
+		movedObjects.push_back(index);
+	}
+}
+
+void BoundingVolumeHierarchy::SetSphere(unsigned int index, FXMMATRIX worldMatrix, float radius)
+{
+	float scale = max(max(XMVectorGetX(XMVector3Length(worldMatrix.r[0])), XMVectorGetX(XMVector3Length(worldMatrix.r[1]))), XMVectorGetX(XMVector3Length(worldMatrix.r[2])));
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, worldMatrix.r[3]);
+	SetSphere(index, center, radius * scale);
+}
+
+// Private Member Functions
+void BoundingVolumeHierarchy::Split(unsigned int node)
+{
+	unsigned int first = nodes[node].firstObject;
+	unsigned int count = nodes[node].objectCount;
+	ObjectBounds(first, count, nodes[node].minimum, nodes[node].maximum);
+	surfaceArea += SurfaceArea(nodes[node].minimum, nodes[node].maximum);
+	if (count <= BVH_LEAF_SIZE)
+	{
+		for (unsigned int i = first; i < first + count; ++i)
+			objectLeaves[order[i]] = node;
+		return;
+	}
+
+	// Split along the axis the centers are most spread over
+	float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (unsigned int i = first; i < first + count; ++i)
+	{
+		unsigned int object = order[i];
+		low[0] = min(low[0], centerX[object]);
+		low[1] = min(low[1], centerY[object]);
+		low[2] = min(low[2], centerZ[object]);
+		high[0] = max(high[0], centerX[object]);
+		high[1] = max(high[1], centerY[object]);
+		high[2] = max(high[2], centerZ[object]);
+	}
+	unsigned int axis = 0;
+	for (unsigned int i = 1; i < 3; ++i)
+	{
+		if (high[i] - low[i] > high[axis] - low[axis])
+			axis = i;
+	}
+	const float* centers = (axis == 0) ? &centerX[0] : ((axis == 1) ? &centerY[0] : &centerZ[0]);
+	float extent = high[axis] - low[axis];
+
+	unsigned int leftCount = 0;
+	if (extent > 0)
+	{
+		// Each object goes in the bin its center is in, and the split goes between two bins
+		float binScale = BVH_BINS / extent * 0.9999f;
+		unsigned int binCounts[BVH_BINS] = {};
+		XMFLOAT3 binMinimum[BVH_BINS];
+		XMFLOAT3 binMaximum[BVH_BINS];
+		for (unsigned int bin = 0; bin < BVH_BINS; ++bin)
+		{
+			binMinimum[bin] = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			binMaximum[bin] = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		}
+		for (unsigned int i = first; i < first + count; ++i)
+		{
+			unsigned int object = order[i];
+			unsigned int bin = min((unsigned int)((centers[object] - low[axis]) * binScale), (unsigned int)BVH_BINS - 1);
+			++binCounts[bin];
+			Grow(binMinimum[bin], binMaximum[bin], centerX[object], centerY[object], centerZ[object], radius[object]);
+		}
+
+		// What a split after each bin costs: each side's area times the objects in it
+		float rightAreas[BVH_BINS];
+		unsigned int rightCounts[BVH_BINS];
+		XMFLOAT3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		unsigned int objects = 0;
+		for (unsigned int bin = BVH_BINS - 1; bin > 0; --bin)
+		{
+			if (binCounts[bin] > 0)
+			{
+				minimum = XMFLOAT3(min(minimum.x, binMinimum[bin].x), min(minimum.y, binMinimum[bin].y), min(minimum.z, binMinimum[bin].z));
+				maximum = XMFLOAT3(max(maximum.x, binMaximum[bin].x), max(maximum.y, binMaximum[bin].y), max(maximum.z, binMaximum[bin].z));
+			}
+			objects += binCounts[bin];
+			rightCounts[bin] = objects;
+			rightAreas[bin] = (objects > 0) ? SurfaceArea(minimum, maximum) : 0;
+		}
+
+		float bestCost = FLT_MAX;
+		unsigned int bestBin = BVH_BINS;
+		minimum = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		maximum = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		objects = 0;
+		for (unsigned int bin = 0; bin + 1 < BVH_BINS; ++bin)
+		{
+			if (binCounts[bin] > 0)
+			{
+				minimum = XMFLOAT3(min(minimum.x, binMinimum[bin].x), min(minimum.y, binMinimum[bin].y), min(minimum.z, binMinimum[bin].z));
+				maximum = XMFLOAT3(max(maximum.x, binMaximum[bin].x), max(maximum.y, binMaximum[bin].y), max(maximum.z, binMaximum[bin].z));
+			}
+			objects += binCounts[bin];
+			if (objects == 0 || rightCounts[bin + 1] == 0)
+				continue;
+			float cost = SurfaceArea(minimum, maximum) * objects + rightAreas[bin + 1] * rightCounts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = bin;
+				leftCount = objects;
+			}
+		}
+
+		if (bestBin < BVH_BINS)
+		{
+			unsigned int left = first;
+			for (unsigned int i = first; i < first + count; ++i)
+			{
+				unsigned int bin = min((unsigned int)((centers[order[i]] - low[axis]) * binScale), (unsigned int)BVH_BINS - 1);
+				if (bin <= bestBin)
+					swap(order[i], order[left++]);
+			}
+		}
+	}
+
+	// Centers too close together to bin are split down the middle
+	if (leftCount == 0)
+	{
+		leftCount = count / 2;
+		vector<unsigned int>::iterator begin = order.begin() + first;
+		nth_element(begin, begin + leftCount, begin + count, [centers](unsigned int a, unsigned int b) { return centers[a] < centers[b]; });
+	}
+
+	BVH_NODE child = {};
+	child.parent = node;
+	child.firstObject = first;
+	child.objectCount = leftCount;
+	nodes[node].firstChild = (unsigned int)nodes.size();
+	nodes.push_back(child);
+	child.firstObject = first + leftCount;
+	child.objectCount = count - leftCount;
+	nodes.push_back(child);
+}
+
+bool BoundingVolumeHierarchy::Refit(unsigned int node)
+{
+	BVH_NODE& refitted = nodes[node];
+	XMFLOAT3 minimum, maximum;
+	if (refitted.firstChild == 0)
+		ObjectBounds(refitted.firstObject, refitted.objectCount, minimum, maximum);
+	else
+	{
+		const BVH_NODE& left = nodes[refitted.firstChild];
+		const BVH_NODE& right = nodes[refitted.firstChild + 1];
+		minimum = XMFLOAT3(min(left.minimum.x, right.minimum.x), min(left.minimum.y, right.minimum.y), min(left.minimum.z, right.minimum.z));
+		maximum = XMFLOAT3(max(left.maximum.x, right.maximum.x), max(left.maximum.y, right.maximum.y), max(left.maximum.z, right.maximum.z));
+	}
+
+	if (memcmp(&minimum, &refitted.minimum, sizeof(minimum)) == 0 && memcmp(&maximum, &refitted.maximum, sizeof(maximum)) == 0)
+		return false;
+	surfaceArea += SurfaceArea(minimum, maximum) - SurfaceArea(refitted.minimum, refitted.maximum);
+	refitted.minimum = minimum;
+	refitted.maximum = maximum;
+	return true;
+}
+
+void BoundingVolumeHierarchy::ObjectBounds(unsigned int first, unsigned int count, XMFLOAT3& minimum, XMFLOAT3& maximum) const
+{
+	minimum = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	maximum = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned int i = first; i < first + count; ++i)
+	{
+		unsigned int object = order[i];
+		Grow(minimum, maximum, centerX[object], centerY[object], centerZ[object], radius[object]);
+	}
+}
+
+bool BoundingVolumeHierarchy::SphereInFrustum(unsigned int object, const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT]) const
+{
+	for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT; ++plane)
+	{
+		const XMFLOAT4& p = planes[plane];
+		if (p.x * centerX[object] + p.y * centerY[object] + p.z * centerZ[object] + p.w < -radius[object])
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "defines.h"
+#include "FrustumCuller.h"
+
+#define BVH_NONE 0xFFFFFFFF
+#define BVH_LEAF_SIZE 4 // Objects a leaf holds at most
+#define BVH_BINS 16 // Places a node is tried split at when building
+#define BVH_REBUILD_RATIO 1.5f // Refitted trees that cost this much more to search than when built are built again
+
+// A tree of boxes over bounding spheres, for finding the objects in a frustum, touching a
+// sphere or hit by a ray without looking at every object. Each node's box holds its
+// objects, and every node's objects are one run of an ordering of all of them, so a node
+// that is wholly inside a query hands over its run without going further down.
+//
+// Moving a sphere only marks it. Update refits the boxes from the moved objects' leaves up
+// to the root, each node once, so a few objects moving among many cost a few paths through
+// the tree. Refitted boxes can grow to overlap, so Update also keeps the summed surface area
+// of the boxes, which is what a search is expected to cost, and builds the tree again when
+// that reaches BVH_REBUILD_RATIO times what it was after the last build. A build splits
+// each node where the surface area heuristic says is cheapest, tried at BVH_BINS places
+// along its longest axis. Adding objects builds the tree again too.
+class BoundingVolumeHierarchy
+{
+public:
+	BoundingVolumeHierarchy();
+	~BoundingVolumeHierarchy();
+
+	// Adds a sphere and returns the index queries report it by. It is in the tree after the
+	// next Update.
+	unsigned int Add(const XMFLOAT3& center, float radius);
+	void Reserve(unsigned int count);
+	void Clear();
+
+	// Refits the tree to the spheres moved since the last Update, or builds it again
+	void Update();
+	void Rebuild();
+
+	// Each query sees the tree as of the last Update and adds to the end of the results.
+	// Spheres in a frustum are those not wholly behind one of its planes, as FrustumCuller
+	// has them.
+	void QueryFrustum(const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT], vector<unsigned int>& results) const;
+	void QuerySphere(const XMFLOAT3& center, float radius, vector<unsigned int>& results) const;
+	// The first sphere a ray enters within maxDistance, or BVH_NONE. Rays starting inside a
+	// sphere enter it at distance 0.
+	unsigned int RayCast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance, float* distance) const;
+
+	// Accessors
+	unsigned int GetCount() const;
+	unsigned int GetNodeCount() const;
+	// Center in xyz, radius in w
+	XMFLOAT4 GetSphere(unsigned int index) const;
+	// Summed surface area of the boxes over the root's; about how many boxes a ray is tested
+	// against
+	float GetCost() const;
+	// What the last Update did
+	unsigned int GetRefitCount() const;
+	unsigned int GetRebuildCount() const;
+
+	// Mutators
+	void SetSphere(unsigned int index, const XMFLOAT3& center, float radius);
+	// Around the matrix's origin, grown by its largest scale
+	void SetSphere(unsigned int index, FXMMATRIX worldMatrix, float radius);
+
+private:
+
+	struct BVH_NODE
+	{
+		XMFLOAT3 minimum;
+		unsigned int firstChild; // The second follows it. 0 for leaves, since the root is no one's child.
+		XMFLOAT3 maximum;
+		unsigned int firstObject; // Into order
+		unsigned int objectCount;
+		unsigned int parent;
+	};
+
+	vector<float> centerX;
+	vector<float> centerY;
+	vector<float> centerZ;
+	vector<float> radius;
+	vector<BVH_NODE> nodes; // Parents before their children
+	vector<unsigned int> order; // The objects, in the order the leaves hold them
+	vector<unsigned int> objectLeaves;
+	vector<unsigned int> movedObjects;
+	vector<uint8_t> moved;
+	vector<unsigned int> refitQueue; // A heap, so the deepest nodes come out first
+	vector<uint8_t> queued;
+	bool needsRebuild;
+	float surfaceArea; // Of every box
+	float builtCost;
+	unsigned int refitCount;
+	unsigned int rebuildCount;
+
+	// Makes the node's box hold its objects and, if it has more than a leaf holds, splits
+	// them between two new children
+	void Split(unsigned int node);
+	// Works out the node's box from its objects or children. False if it did not change.
+	bool Refit(unsigned int node);
+	void ObjectBounds(unsigned int first, unsigned int count, XMFLOAT3& minimum, XMFLOAT3& maximum) const;
+	bool SphereInFrustum(unsigned int object, const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT]) const;
+};
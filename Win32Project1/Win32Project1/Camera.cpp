@@ -0,0 +1,116 @@
+#include "Camera.h"
+
+Camera::Camera()
+{
+	worldMatrix = XMMatrixIdentity();
+	projectionMatrix = XMMatrixIdentity();
+	viewMatrix = XMMatrixIdentity();
+	viewProjectionMatrix = XMMatrixIdentity();
+	memset(frustumPlanes, 0, sizeof(frustumPlanes));
+	WorldMatrixChanged();
+}
+
+Camera::~Camera()
+{
+}
+
+void Camera::Translate(float offsetX, float offsetY, float offsetZ)
+{
+	worldMatrix = XMMatrixMultiply(XMMatrixTranslation(offsetX, offsetY, offsetZ), worldMatrix);
+	WorldMatrixChanged();
+}
+
+void Camera::RotateLocal(FXMMATRIX rotation)
+{
+	XMVECTOR position = worldMatrix.r[3];
+	worldMatrix.r[3] = XMVectorSet(0, 0, 0, 1);
+	worldMatrix = XMMatrixMultiply(rotation, worldMatrix);
+	worldMatrix.r[3] = position;
+	WorldMatrixChanged();
+}
+
+void Camera::Rotate(FXMMATRIX rotation)
+{
+	XMVECTOR position = worldMatrix.r[3];
+	worldMatrix.r[3] = XMVectorSet(0, 0, 0, 1);
+	worldMatrix = XMMatrixMultiply(worldMatrix, rotation);
+	worldMatrix.r[3] = position;
+	WorldMatrixChanged();
+}
+
+// Accessors
+XMMATRIX Camera::GetWorldMatrix() const
+{
+	return worldMatrix;
+}
+
+XMVECTOR Camera::GetPosition() const
+{
+	return worldMatrix.r[3];
+}
+
+XMVECTOR Camera::GetForward() const
+{
+	return worldMatrix.r[2];
+}
+
+XMMATRIX Camera::GetViewMatrix()
+{
+	if (viewDirty)
+	{
+		viewMatrix = XMMatrixInverse(nullptr, worldMatrix);
+		viewDirty = false;
+	}
+	return viewMatrix;
+}
+
+XMMATRIX Camera::GetProjectionMatrix() const
+{
+	return projectionMatrix;
+}
+
+XMMATRIX Camera::GetViewProjectionMatrix()
+{
+	if (viewProjectionDirty)
+	{
+		viewProjectionMatrix = XMMatrixMultiply(GetViewMatrix(), projectionMatrix);
+		viewProjectionDirty = false;
+	}
+	return viewProjectionMatrix;
+}
+
+const XMFLOAT4* Camera::GetFrustumPlanes()
+{
+	if (frustumPlanesDirty)
+	{
+		FrustumCuller::ExtractPlanes(GetViewProjectionMatrix(), frustumPlanes);
+		frustumPlanesDirty = false;
+	}
+	return frustumPlanes;
+}
+
+// Mutators
+void Camera::SetWorldMatrix(FXMMATRIX matrix)
+{
+	worldMatrix = matrix;
+	WorldMatrixChanged();
+}
+
+// The window sets the projection every frame whether or not it changed, so an unchanged
+// one keeps what was worked out from it
+void Camera::SetProjectionMatrix(FXMMATRIX matrix)
+{
+	if (memcmp(&matrix, &projectionMatrix, sizeof(XMMATRIX)) == 0)
+		return;
+	projectionMatrix = matrix;
+	viewProjectionDirty = true;
+	frustumPlanesDirty = true;
+}
+
+// Private Member Functions
+void Camera::WorldMatrixChanged()
+{
+	viewDirty = true;
+	viewProjectionDirty = true;
+	frustumPlanesDirty = true;
+}
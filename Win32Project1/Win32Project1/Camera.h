@@ -0,0 +1,49 @@
+#pragma once
+#include "defines.h"
+#include "FrustumCuller.h"
+
+// Where a view is seen from. The camera's own transform, from camera space to the world, is
+// the one that is changed; the view matrix, the view-projection matrix and the frustum
+// planes are worked out from it and the projection the first time they are asked for after
+// either changes, and kept until the next change.
+class Camera
+{
+public:
+	Camera();
+	~Camera();
+
+	// Moves along the camera's own axes
+	void Translate(float offsetX, float offsetY, float offsetZ);
+	// Turns about the camera's own axes, in place
+	void RotateLocal(FXMMATRIX rotation);
+	// Turns about the world's axes, in place
+	void Rotate(FXMMATRIX rotation);
+
+	// Accessors
+	// Camera space to world space
+	XMMATRIX GetWorldMatrix() const;
+	XMVECTOR GetPosition() const;
+	XMVECTOR GetForward() const;
+	XMMATRIX GetViewMatrix();
+	XMMATRIX GetProjectionMatrix() const;
+	XMMATRIX GetViewProjectionMatrix();
+	// Normalized and facing inwards, in FrustumCuller's order
+	const XMFLOAT4* GetFrustumPlanes();
+
+	// Mutators
+	void SetWorldMatrix(FXMMATRIX matrix);
+	void SetProjectionMatrix(FXMMATRIX matrix);
+
+private:
+
+	XMMATRIX worldMatrix;
+	XMMATRIX projectionMatrix;
+	XMMATRIX viewMatrix;
+	XMMATRIX viewProjectionMatrix;
+	XMFLOAT4 frustumPlanes[FRUSTUM_PLANE_COUNT];
+	bool viewDirty;
+	bool viewProjectionDirty;
+	bool frustumPlanesDirty;
+
+	void WorldMatrixChanged();
+};
@@ -0,0 +1,280 @@
+#include "ConstantBufferRing.h"
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+static unsigned int AlignConstants(unsigned int size)
+{
+	return (size + CONSTANT_RING_ALIGNMENT - 1) & ~(CONSTANT_RING_ALIGNMENT - 1);
+}
+
+ConstantBufferRing::ConstantBufferRing()
+{
+	device = nullptr;
+	buffer = nullptr;
+	memset(fallbackBuffers, 0, sizeof(fallbackBuffers));
+	supportsRanges = false;
+	capacity = 0;
+	head = 0;
+	frameStart = 0;
+	uploaded = false;
+	peakFrameBytes = 0;
+	uploadCount = 0;
+	stallCount = 0;
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	Release();
+}
+
+void ConstantBufferRing::Initialize(ID3D11Device* device, unsigned int size)
+{
+	this->device = device;
+	capacity = AlignConstants(size);
+	head = 0;
+
+	// Without a device the frames only go to the render context, which records the ranges
+	if (!device)
+	{
+		supportsRanges = true;
+		return;
+	}
+
+	// Both come with the Direct3D 11.1 runtime, but the driver has to ask for them
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	supportsRanges = SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+	if (supportsRanges)
+		supportsRanges = CreateBuffer(capacity);
+}
+
+void ConstantBufferRing::BeginFrame(ID3D11DeviceContext* deviceContext)
+{
+	frameData.clear();
+	uploaded = false;
+
+	while (!framesInFlight.empty() && RetireOldestFrame(deviceContext, false))
+		;
+}
+
+CONSTANT_ALLOCATION ConstantBufferRing::Write(const void* data, unsigned int size)
+{
+	CONSTANT_ALLOCATION allocation;
+	allocation.offset = (unsigned int)frameData.size();
+	allocation.size = size;
+
+	// Every allocation starts on a boundary a range can be bound at
+	frameData.resize(allocation.offset + AlignConstants(size), 0);
+	memcpy(&frameData[allocation.offset], data, size);
+	return allocation;
+}
+
+void ConstantBufferRing::Upload(RenderContext* renderContext, ID3D11DeviceContext* deviceContext)
+{
+	unsigned int bytes = (unsigned int)frameData.size();
+	peakFrameBytes = max(peakFrameBytes, bytes);
+	uploaded = true;
+	if (bytes == 0 || !supportsRanges)
+		return;
+
+	// The frames already in the old buffer keep it alive on the GPU until they are done
+	if (bytes > capacity)
+	{
+		unsigned int newCapacity = max(capacity, (unsigned int)CONSTANT_RING_ALIGNMENT);
+		while (newCapacity < bytes * 2)
+			newCapacity *= 2;
+		if (device && !CreateBuffer(newCapacity))
+			return;
+		capacity = newCapacity;
+		while (!framesInFlight.empty())
+		{
+			if (framesInFlight.front().query)
+				freeQueries.push_back(framesInFlight.front().query);
+			framesInFlight.pop_front();
+		}
+		head = 0;
+	}
+
+	// A frame is never split across the end of the buffer
+	unsigned int start = (head + bytes <= capacity) ? head : 0;
+	while (Overlaps(start, bytes))
+	{
+		if (!RetireOldestFrame(deviceContext, false))
+		{
+			++stallCount;
+			RetireOldestFrame(deviceContext, true);
+		}
+	}
+
+	frameStart = start;
+	head = start + bytes;
+	renderContext->UploadConstants(buffer, frameStart, &frameData[0], bytes);
+	++uploadCount;
+}
+
+void ConstantBufferRing::Bind(RenderContext* renderContext, RENDER_STAGE stage, unsigned int slot, const CONSTANT_ALLOCATION& allocation)
+{
+	if (!uploaded || allocation.offset + allocation.size > frameData.size())
+		return;
+
+	if (supportsRanges)
+	{
+		renderContext->SetConstantBufferRange(stage, slot, buffer, (frameStart + allocation.offset) / 16, AlignConstants(allocation.size) / 16);
+		return;
+	}
+
+	ID3D11Buffer* fallbackBuffer = GetFallbackBuffer(stage, slot);
+	if (!fallbackBuffer || allocation.size > CONSTANT_RING_FALLBACK_SIZE)
+		return;
+	renderContext->WriteConstants(fallbackBuffer, &frameData[allocation.offset], allocation.size);
+	renderContext->SetConstantBuffers(stage, slot, 1, &fallbackBuffer);
+}
+
+void ConstantBufferRing::EndFrame(ID3D11DeviceContext* deviceContext)
+{
+	if (!uploaded || frameData.empty() || !supportsRanges)
+		return;
+
+	FrameInFlight frame;
+	frame.query = nullptr;
+	frame.start = frameStart;
+	frame.size = (unsigned int)frameData.size();
+
+	if (device && deviceContext)
+	{
+		if (!freeQueries.empty())
+		{
+			frame.query = freeQueries.back();
+			freeQueries.pop_back();
+		}
+		else
+		{
+			D3D11_QUERY_DESC queryDesc = {};
+			queryDesc.Query = D3D11_QUERY_EVENT;
+			if (FAILED(device->CreateQuery(&queryDesc, &frame.query)))
+				frame.query = nullptr;
+		}
+		if (frame.query)
+			deviceContext->End(frame.query);
+	}
+
+	framesInFlight.push_back(frame);
+}
+
+void ConstantBufferRing::Release()
+{
+	SAFE_RELEASE(buffer);
+	for (unsigned int stage = 0; stage < RENDER_STAGE_COUNT; ++stage)
+	{
+		for (unsigned int slot = 0; slot < D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT; ++slot)
+			SAFE_RELEASE(fallbackBuffers[stage][slot]);
+	}
+	for (unsigned int i = 0; i < framesInFlight.size(); ++i)
+		SAFE_RELEASE(framesInFlight[i].query);
+	framesInFlight.clear();
+	for (unsigned int i = 0; i < freeQueries.size(); ++i)
+		SAFE_RELEASE(freeQueries[i]);
+	freeQueries.clear();
+	device = nullptr;
+	supportsRanges = false;
+}
+
+// Accessors
+bool ConstantBufferRing::SupportsRanges() const
+{
+	return supportsRanges;
+}
+
+unsigned int ConstantBufferRing::GetCapacity() const
+{
+	return capacity;
+}
+
+unsigned int ConstantBufferRing::GetFrameBytes() const
+{
+	return (unsigned int)frameData.size();
+}
+
+unsigned int ConstantBufferRing::GetPeakFrameBytes() const
+{
+	return peakFrameBytes;
+}
+
+unsigned int ConstantBufferRing::GetUploadCount() const
+{
+	return uploadCount;
+}
+
+unsigned int ConstantBufferRing::GetStallCount() const
+{
+	return stallCount;
+}
+
+// Private Member Functions
+bool ConstantBufferRing::Overlaps(unsigned int start, unsigned int size) const
+{
+	for (unsigned int i = 0; i < framesInFlight.size(); ++i)
+	{
+		const FrameInFlight& frame = framesInFlight[i];
+		if (start < frame.start + frame.size && frame.start < start + size)
+			return true;
+	}
+	return false;
+}
+
+// False if the oldest frame is still on the GPU and wait was not asked for
+bool ConstantBufferRing::RetireOldestFrame(ID3D11DeviceContext* deviceContext, bool wait)
+{
+	FrameInFlight& frame = framesInFlight.front();
+	if (frame.query && deviceContext)
+	{
+		if (wait)
+		{
+			while (deviceContext->GetData(frame.query, nullptr, 0, 0) == S_FALSE)
+				this_thread::yield();
+		}
+		else if (deviceContext->GetData(frame.query, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			return false;
+	}
+
+	if (frame.query)
+		freeQueries.push_back(frame.query);
+	framesInFlight.pop_front();
+	return true;
+}
+
+bool ConstantBufferRing::CreateBuffer(unsigned int size)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.ByteWidth = size;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	ID3D11Buffer* newBuffer = nullptr;
+	if (FAILED(device->CreateBuffer(&bufferDesc, nullptr, &newBuffer)))
+		return false;
+
+	SAFE_RELEASE(buffer);
+	buffer = newBuffer;
+	return true;
+}
+
+ID3D11Buffer* ConstantBufferRing::GetFallbackBuffer(RENDER_STAGE stage, unsigned int slot)
+{
+	if (!device || slot >= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+		return nullptr;
+
+	ID3D11Buffer*& fallbackBuffer = fallbackBuffers[stage][slot];
+	if (!fallbackBuffer)
+	{
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		bufferDesc.ByteWidth = CONSTANT_RING_FALLBACK_SIZE;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(device->CreateBuffer(&bufferDesc, nullptr, &fallbackBuffer)))
+			fallbackBuffer = nullptr;
+	}
+	return fallbackBuffer;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "defines.h"
+#include "RenderContext.h"
+#include <deque>
+
+#define CONSTANT_RING_SIZE (256 * 1024)
+#define CONSTANT_RING_ALIGNMENT 256 // Bytes; ranges have to start on a multiple of 16 constants
+#define CONSTANT_RING_FALLBACK_SIZE 4096 // Largest allocation bound when ranges are not supported
+
+// Where one block of constants ended up; only meaningful for the frame it was written in
+struct CONSTANT_ALLOCATION
+{
+	unsigned int offset; // Bytes from the start of the frame's block
+	unsigned int size;
+};
+
+// All the constants of a frame in one dynamic buffer. Constants are written into memory as the
+// frame is prepared, sent to the GPU with a single map before the first draw, and each draw
+// binds its slice with SetConstantBufferRange instead of mapping a buffer of its own.
+//
+// Frames are placed one after another around the buffer. An event query marks where each
+// one ends on the GPU; a frame only reuses space once the GPU has passed the queries of the
+// frames that were there, and waits for them if it catches up. A frame that does not fit is
+// given a bigger buffer.
+//
+// Devices that cannot bind ranges of a constant buffer or map one without discarding it get
+// a buffer per slot instead, written as each slice is bound, which is how every draw worked
+// before. Without a device nothing is created and the frames only go to the render context.
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing();
+	~ConstantBufferRing();
+
+	void Initialize(ID3D11Device* device, unsigned int size);
+
+	// At the start of a frame, before any Write. Forgets the last frame's constants and frees
+	// the space of frames the GPU has finished.
+	void BeginFrame(ID3D11DeviceContext* deviceContext);
+
+	// Copies size bytes of constants into the frame
+	CONSTANT_ALLOCATION Write(const void* data, unsigned int size);
+
+	// Places the frame in the buffer and sends it to the GPU in one map. After every Write
+	// and before any Bind.
+	void Upload(RenderContext* renderContext, ID3D11DeviceContext* deviceContext);
+
+	// Binds an allocation of this frame to a constant buffer slot
+	void Bind(RenderContext* renderContext, RENDER_STAGE stage, unsigned int slot, const CONSTANT_ALLOCATION& allocation);
+
+	// After the frame's last draw; marks where it ends on the GPU
+	void EndFrame(ID3D11DeviceContext* deviceContext);
+
+	void Release();
+
+	// Accessors
+	bool SupportsRanges() const;
+	unsigned int GetCapacity() const;
+	unsigned int GetFrameBytes() const;
+	unsigned int GetPeakFrameBytes() const;
+	unsigned int GetUploadCount() const;
+	// Times a frame had to wait for the GPU to finish with its space
+	unsigned int GetStallCount() const;
+
+private:
+
+	struct FrameInFlight
+	{
+		ID3D11Query* query;
+		unsigned int start;
+		unsigned int size;
+	};
+
+	ID3D11Device* device;
+	ID3D11Buffer* buffer;
+	ID3D11Buffer* fallbackBuffers[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	bool supportsRanges;
+	unsigned int capacity;
+	unsigned int head;
+	unsigned int frameStart;
+	vector<uint8_t> frameData;
+	deque<FrameInFlight> framesInFlight;
+	vector<ID3D11Query*> freeQueries;
+	bool uploaded;
+	unsigned int peakFrameBytes;
+	unsigned int uploadCount;
+	unsigned int stallCount;
+
+	bool Overlaps(unsigned int start, unsigned int size) const;
+	bool RetireOldestFrame(ID3D11DeviceContext* deviceContext, bool wait);
+	bool CreateBuffer(unsigned int size);
+	ID3D11Buffer* GetFallbackBuffer(RENDER_STAGE stage, unsigned int slot);
+};
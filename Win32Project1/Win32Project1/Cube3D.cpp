@@ -1,6 +1,7 @@
 #include "Cube3D.h"
 #include "GeneralVertexShader.csh"
 #include "GeneralPixelShader.csh"
+#include "PackedPixelShader.csh"
 #include "DDSTextureLoader.h"
 
 #define NUMVERTICIES 24
@@ -12,6 +13,7 @@ Cube3D::Cube3D()
 {
 	worldMatrix = XMMatrixIdentity();
 	verticies = new Vertex[NUMVERTICIES];
+	boundingRadius = 0;
 }
 
 
@@ -33,8 +35,13 @@ void Cube3D::Initialize(ID3D11Device* device, float initX, float initY, float in
 	worldMatrix = XMMatrixTranslation(initX, initY, initZ);
 	numIndicies = NUMINDICIES;
 	CreateVerticies();
+	boundingRadius = BoundingRadius(verticies, NUMVERTICIES);
 
-	HRESULT result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
+	// A null filename means the texture is supplied later through SetShaderResourceView
+	HRESULT result = S_OK;
+	shaderResourceView = nullptr;
+	if (filename)
+		result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
 
 	D3D11_BUFFER_DESC bufferDesc = {};
 	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -60,6 +67,7 @@ void Cube3D::Initialize(ID3D11Device* device, float initX, float initY, float in
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
 
@@ -88,21 +96,18 @@ void Cube3D::Initialize(ID3D11Device* device, float initX, float initY, float in
 	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
 }
 
-void Cube3D::Run(ID3D11DeviceContext* deviceContext)
+void Cube3D::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);	
-	deviceContext->PSSetShaderResources(0, 1, &shaderResourceView);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetGeometryShader(nullptr);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 1, &shaderResourceView);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
 }
 
 void Cube3D::Translate(float offsetX, float offsetY, float offsetZ)
@@ -145,16 +150,60 @@ ID3D11InputLayout* Cube3D::GetLayout() const
 	return layout;
 }
 
+ID3D11ShaderResourceView* Cube3D::GetShaderResourceView() const
+{
+	return shaderResourceView;
+}
+
 ID3D11SamplerState* Cube3D::GetSampler() const
 {
 	return sampler;
 }
 
+float Cube3D::GetBoundingRadius() const
+{
+	return boundingRadius;
+}
+
 void Cube3D::SetWorldMatrix(const XMMATRIX* matrix)
 {
 	worldMatrix = *matrix;
 }
 
+void Cube3D::SetShaderResourceView(ID3D11ShaderResourceView* view)
+{
+	if (view == shaderResourceView)
+		return;
+
+	if (view)
+		view->AddRef();
+	SAFE_RELEASE(shaderResourceView);
+	shaderResourceView = view;
+}
+
+bool Cube3D::UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement)
+{
+	if (!ApplyTexturePlacement(verticies, NUMVERTICIES, placement))
+		return false;
+
+	SAFE_RELEASE(buffer);
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = sizeof(Vertex)* NUMVERTICIES;
+
+	D3D11_SUBRESOURCE_DATA subresourceDesc;
+	subresourceDesc.pSysMem = verticies;
+
+	HRESULT result = device->CreateBuffer(&bufferDesc, &subresourceDesc, &buffer);
+
+	SAFE_RELEASE(pixelShader);
+	result = device->CreatePixelShader(PackedPixelShader, sizeof(PackedPixelShader), NULL, &pixelShader);
+
+	SetShaderResourceView(page);
+	return true;
+}
+
 // Private Member Functions
 void Cube3D::CreateVerticies()
 {
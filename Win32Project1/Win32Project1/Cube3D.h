@@ -1,5 +1,7 @@
 #pragma once
 #include "defines.h"
+#include "RenderContext.h"
+#include "TexturePacker.h"
 
 class Cube3D
 {
@@ -9,7 +11,7 @@ public:
 
 	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -23,10 +25,15 @@ public:
 	ID3D11InputLayout* GetLayout() const;
 	ID3D11ShaderResourceView* GetShaderResourceView() const;
 	ID3D11SamplerState* GetSampler() const;
+	// Radius of a sphere about the origin of the model that holds all of it
+	float GetBoundingRadius() const;
 
 	// Mutators
 
 	void SetWorldMatrix(const XMMATRIX* matrix);
+	void SetShaderResourceView(ID3D11ShaderResourceView* view);
+	// Draws with a page from the TexturePacker from now on. Call once, after Initialize.
+	bool UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement);
 
 private:
 
@@ -40,6 +47,7 @@ private:
 	ID3D11ShaderResourceView* shaderResourceView;
 	ID3D11SamplerState* sampler;
 	Vertex* verticies;
+	float boundingRadius;
 
 	struct SEND_TO_OBJECT
 	{
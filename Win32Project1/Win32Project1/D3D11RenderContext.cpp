@@ -0,0 +1,189 @@
+#include "D3D11RenderContext.h"
+#include <string.h>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+D3D11RenderContext::D3D11RenderContext()
+{
+	deviceContext = nullptr;
+	deviceContext1 = nullptr;
+}
+
+D3D11RenderContext::~D3D11RenderContext()
+{
+	Release();
+}
+
+void D3D11RenderContext::Initialize(ID3D11DeviceContext* deviceContext)
+{
+	this->deviceContext = deviceContext;
+	if (FAILED(deviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&deviceContext1)))
+		deviceContext1 = nullptr;
+}
+
+void D3D11RenderContext::Release()
+{
+	SAFE_RELEASE(deviceContext1);
+	deviceContext = nullptr;
+}
+
+void D3D11RenderContext::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	deviceContext->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11RenderContext::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	deviceContext->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+}
+
+void D3D11RenderContext::SetInputLayout(ID3D11InputLayout* layout)
+{
+	deviceContext->IASetInputLayout(layout);
+}
+
+void D3D11RenderContext::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	deviceContext->IASetPrimitiveTopology(topology);
+}
+
+void D3D11RenderContext::SetVertexShader(ID3D11VertexShader* shader)
+{
+	deviceContext->VSSetShader(shader, NULL, 0);
+}
+
+void D3D11RenderContext::SetGeometryShader(ID3D11GeometryShader* shader)
+{
+	deviceContext->GSSetShader(shader, NULL, 0);
+}
+
+void D3D11RenderContext::SetPixelShader(ID3D11PixelShader* shader)
+{
+	deviceContext->PSSetShader(shader, NULL, 0);
+}
+
+void D3D11RenderContext::SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+	if (stage == RENDER_STAGE_VERTEX)
+		deviceContext->VSSetConstantBuffers(slot, count, buffers);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		deviceContext->GSSetConstantBuffers(slot, count, buffers);
+	else
+		deviceContext->PSSetConstantBuffers(slot, count, buffers);
+}
+
+void D3D11RenderContext::SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (!deviceContext1)
+	{
+		SetConstantBuffers(stage, slot, 1, &buffer);
+		return;
+	}
+
+	if (stage == RENDER_STAGE_VERTEX)
+		deviceContext1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		deviceContext1->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	else
+		deviceContext1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+}
+
+void D3D11RenderContext::SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+	if (stage == RENDER_STAGE_VERTEX)
+		deviceContext->VSSetShaderResources(slot, count, views);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		deviceContext->GSSetShaderResources(slot, count, views);
+	else
+		deviceContext->PSSetShaderResources(slot, count, views);
+}
+
+void D3D11RenderContext::SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (stage == RENDER_STAGE_VERTEX)
+		deviceContext->VSSetSamplers(slot, count, samplers);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		deviceContext->GSSetSamplers(slot, count, samplers);
+	else
+		deviceContext->PSSetSamplers(slot, count, samplers);
+}
+
+void D3D11RenderContext::SetBlendState(ID3D11BlendState* state)
+{
+	deviceContext->OMSetBlendState(state, NULL, 0xffffffff);
+}
+
+void D3D11RenderContext::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	deviceContext->RSSetState(state);
+}
+
+void D3D11RenderContext::SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	deviceContext->OMSetRenderTargets(renderTarget ? 1 : 0, renderTarget ? &renderTarget : nullptr, depthStencil);
+}
+
+void D3D11RenderContext::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	deviceContext->RSSetViewports(1, &viewport);
+}
+
+void D3D11RenderContext::ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4])
+{
+	deviceContext->ClearRenderTargetView(renderTarget, color);
+}
+
+void D3D11RenderContext::ClearDepth(ID3D11DepthStencilView* depthStencil, float depth)
+{
+	deviceContext->ClearDepthStencilView(depthStencil, D3D11_CLEAR_DEPTH, depth, 0);
+}
+
+void D3D11RenderContext::WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(deviceContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, data, size);
+	deviceContext->Unmap(buffer, 0);
+}
+
+void D3D11RenderContext::UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(deviceContext->Map(buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+		return;
+	memcpy((uint8_t*)mapped.pData + offset, data, size);
+	deviceContext->Unmap(buffer, 0);
+}
+
+void D3D11RenderContext::UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+	deviceContext->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
+
+void D3D11RenderContext::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	deviceContext->Draw(vertexCount, startVertex);
+}
+
+void D3D11RenderContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	deviceContext->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11RenderContext::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	deviceContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+// Accessors
+ID3D11DeviceContext* D3D11RenderContext::GetDeviceContext() const
+{
+	return deviceContext;
+}
+
+bool D3D11RenderContext::SupportsConstantBufferRanges() const
+{
+	return deviceContext1 != nullptr;
+}
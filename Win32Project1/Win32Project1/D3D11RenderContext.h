@@ -0,0 +1,48 @@
+#pragma once
+#include "RenderContext.h"
+#include <d3d11_1.h>
+
+// Sends every call straight on to a device context. Constant buffer ranges need the
+// Direct3D 11.1 runtime; without it SetConstantBufferRange binds the whole buffer.
+class D3D11RenderContext : public RenderContext
+{
+public:
+	D3D11RenderContext();
+	~D3D11RenderContext();
+
+	void Initialize(ID3D11DeviceContext* deviceContext);
+	void Release();
+
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetGeometryShader(ID3D11GeometryShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers);
+	void SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+	void ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* depthStencil, float depth);
+	void WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size);
+	void UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	// Accessors
+	ID3D11DeviceContext* GetDeviceContext() const;
+	bool SupportsConstantBufferRanges() const;
+
+private:
+
+	ID3D11DeviceContext* deviceContext;
+	ID3D11DeviceContext1* deviceContext1;
+};
@@ -22,8 +22,11 @@
 #include <assert.h>
 #include <algorithm>
 #include <memory>
+#include <new>
 
 #include "DDSTextureLoader.h"
+#include "MipChainGenerator.h"
+#include "LegacyFormatConverter.h"
 
 //NOTE: This define specifies that you're running this on Windows 7 instead of Windows 8
 // If you are running this on 8, just remove this define.
@@ -135,6 +138,68 @@ typedef public std::unique_ptr<void, handle_closer> ScopedHandle;
 
 inline HANDLE safe_handle( HANDLE h ) { return (h == INVALID_HANDLE_VALUE) ? 0 : h; }
 
+//--------------------------------------------------------------------------------------
+// Finds the headers and surface data in a whole DDS file held in memory
+//--------------------------------------------------------------------------------------
+static HRESULT ParseTextureData( _In_reads_bytes_(ddsDataSize) uint8_t* ddsData,
+                                 _In_ size_t ddsDataSize,
+                                 DDS_HEADER** header,
+                                 uint8_t** bitData,
+                                 size_t* bitSize
+                               )
+{
+    if (!header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) ) )
+    {
+        return E_FAIL;
+    }
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData );
+    if (dwMagicNumber != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    DDS_HEADER* hdr = reinterpret_cast<DDS_HEADER*>( ddsData + sizeof( uint32_t ) );
+
+    // Verify header to validate DDS file
+    if (hdr->size != sizeof(DDS_HEADER) ||
+        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return E_FAIL;
+    }
+
+    // Check for DX10 extension
+    bool bDXT10Header = false;
+    if ((hdr->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
+        {
+            return E_FAIL;
+        }
+
+        bDXT10Header = true;
+    }
+
+    // setup the pointers in the process request
+    *header = hdr;
+    ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
+                       + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
+    *bitData = ddsData + offset;
+    *bitSize = ddsDataSize - offset;
+
+    return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
                                         std::unique_ptr<uint8_t[]>& ddsData,
@@ -220,47 +285,11 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
         return E_FAIL;
     }
 
-    // DDS files always start with the same magic number ("DDS ")
-    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData.get() );
-    if (dwMagicNumber != DDS_MAGIC)
-    {
-        return E_FAIL;
-    }
-
-    DDS_HEADER* hdr = reinterpret_cast<DDS_HEADER*>( ddsData.get() + sizeof( uint32_t ) );
-
-    // Verify header to validate DDS file
-    if (hdr->size != sizeof(DDS_HEADER) ||
-        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
-    {
-        return E_FAIL;
-    }
-
-    // Check for DX10 extension
-    bool bDXT10Header = false;
-    if ((hdr->ddspf.flags & DDS_FOURCC) &&
-        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
-    {
-        // Must be long enough for both headers and magic value
-        if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
-        {
-            return E_FAIL;
-        }
-
-        bDXT10Header = true;
-    }
-
-    // setup the pointers in the process request
-    *header = hdr;
-    ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
-                       + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
-    *bitData = ddsData.get() + offset;
-    *bitSize = FileSize.LowPart - offset;
-
-    return S_OK;
+    return ParseTextureData( ddsData.get(), FileSize.LowPart, header, bitData, bitSize );
 }
 
 
+
 //--------------------------------------------------------------------------------------
 // Return the BPP for a particular format
 //--------------------------------------------------------------------------------------
@@ -703,6 +732,81 @@ static DXGI_FORMAT GetDXGIFormat( const DDS_PIXELFORMAT& ddpf )
 }
 
 
+//--------------------------------------------------------------------------------------
+// Direct3D 9 formats that get expanded to 32bpp at load. This is checked before
+// GetDXGIFormat, so L8 and A8L8 come out grey rather than as R8/R8G8.
+//--------------------------------------------------------------------------------------
+static LEGACY_FORMAT GetLegacyFormat( const DDS_PIXELFORMAT& ddpf )
+{
+    if (ddpf.flags & DDS_RGB)
+    {
+        switch (ddpf.RGBBitCount)
+        {
+        case 32:
+            if (ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0x00000000))
+            {
+                return LEGACY_FORMAT_X8B8G8R8;
+            }
+            break;
+
+        case 24:
+            if (ISBITMASK(0x00ff0000,0x0000ff00,0x000000ff,0x00000000))
+            {
+                return LEGACY_FORMAT_R8G8B8;
+            }
+            if (ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0x00000000))
+            {
+                return LEGACY_FORMAT_B8G8R8;
+            }
+            break;
+
+        case 16:
+            if (ISBITMASK(0x7c00,0x03e0,0x001f,0x0000))
+            {
+                return LEGACY_FORMAT_X1R5G5B5;
+            }
+
+#ifndef DXGI_1_2_FORMATS
+            if (ISBITMASK(0x0f00,0x00f0,0x000f,0xf000))
+            {
+                return LEGACY_FORMAT_A4R4G4B4;
+            }
+#endif
+
+            if (ISBITMASK(0x0f00,0x00f0,0x000f,0x0000))
+            {
+                return LEGACY_FORMAT_X4R4G4B4;
+            }
+            break;
+        }
+    }
+    else if (ddpf.flags & DDS_LUMINANCE)
+    {
+        if (8 == ddpf.RGBBitCount)
+        {
+            if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x00000000))
+            {
+                return LEGACY_FORMAT_L8;
+            }
+            if (ISBITMASK(0x0f,0x00,0x00,0xf0))
+            {
+                return LEGACY_FORMAT_A4L4;
+            }
+        }
+
+        if (16 == ddpf.RGBBitCount)
+        {
+            if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x0000ff00))
+            {
+                return LEGACY_FORMAT_A8L8;
+            }
+        }
+    }
+
+    return LEGACY_FORMAT_UNKNOWN;
+}
+
+
 //--------------------------------------------------------------------------------------
 static HRESULT FillInitData( _In_ size_t width,
                              _In_ size_t height,
@@ -1045,6 +1149,7 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     uint32_t resDim = D3D11_RESOURCE_DIMENSION_UNKNOWN;
     size_t arraySize = 1;
     DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    LEGACY_FORMAT legacyFormat = LEGACY_FORMAT_UNKNOWN;
     bool isCubeMap = false;
 
     size_t mipCount = header->mipMapCount;
@@ -1111,7 +1216,9 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     }
     else
     {
-        format = GetDXGIFormat( header->ddspf );
+        legacyFormat = GetLegacyFormat( header->ddspf );
+        format = (legacyFormat != LEGACY_FORMAT_UNKNOWN) ? GetLegacyConversionFormat( legacyFormat )
+                                                         : GetDXGIFormat( header->ddspf );
 
         if (format == DXGI_FORMAT_UNKNOWN)
         {
@@ -1191,6 +1298,42 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
             break;
     }
 
+    // Legacy data is expanded to the 32bpp format chosen above before anything else reads it
+    std::unique_ptr<uint8_t[]> convertedData;
+    if (legacyFormat != LEGACY_FORMAT_UNKNOWN)
+    {
+        size_t convertedSize = 0;
+        hr = ConvertLegacySurfaces( legacyFormat, width, height, depth, mipCount, arraySize,
+                                    bitData, bitSize, convertedData, &convertedSize );
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        bitData = convertedData.get();
+        bitSize = convertedSize;
+    }
+
+    // Single-level 2D textures and cubemaps get their chain built here so they are not
+    // sampled at full resolution in the distance. The colour data is assumed to be sRGB
+    // authored, as every texture in this project is.
+    std::unique_ptr<uint8_t[]> mipData;
+    if ( (mipCount == 1) &&
+         (resDim == D3D11_RESOURCE_DIMENSION_TEXTURE2D) &&
+         (width > 1 || height > 1) &&
+         CanGenerateMipChain( format ) )
+    {
+        size_t mipDataSize = 0;
+        size_t generatedMipCount = 0;
+        if ( SUCCEEDED( GenerateMipChain( width, height, arraySize, format, MIP_FILTER_BOX, true,
+                                          bitData, bitSize, mipData, &mipDataSize, &generatedMipCount ) ) )
+        {
+            bitData = mipData.get();
+            bitSize = mipDataSize;
+            mipCount = generatedMipCount;
+        }
+    }
+
     // Create the texture
     std::unique_ptr<D3D11_SUBRESOURCE_DATA> initData( new D3D11_SUBRESOURCE_DATA[ mipCount * arraySize ] );
     if ( !initData )
@@ -1253,6 +1396,76 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     return hr;
 }
 
+//--------------------------------------------------------------------------------------
+static HRESULT GetTextureInfo( _In_ const DDS_HEADER* header,
+                               _Out_ DDS_TEXTURE_INFO* info )
+{
+    info->dimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+    info->width = header->width;
+    info->height = header->height;
+    info->depth = 1;
+    info->mipCount = (header->mipMapCount) ? header->mipMapCount : 1;
+    info->arraySize = 1;
+    info->format = DXGI_FORMAT_UNKNOWN;
+    info->isCubeMap = false;
+
+    if ((header->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == header->ddspf.fourCC ))
+    {
+        const DDS_HEADER_DXT10* d3d10ext = reinterpret_cast<const DDS_HEADER_DXT10*>( (const char*)header + sizeof(DDS_HEADER) );
+
+        info->format = d3d10ext->dxgiFormat;
+        info->arraySize = d3d10ext->arraySize;
+        info->dimension = static_cast<D3D11_RESOURCE_DIMENSION>( d3d10ext->resourceDimension );
+
+        switch ( info->dimension )
+        {
+        case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+            info->height = 1;
+            break;
+
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+            if (d3d10ext->miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE)
+            {
+                info->arraySize *= 6;
+                info->isCubeMap = true;
+            }
+            break;
+
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+            info->depth = header->depth;
+            break;
+
+        default:
+            return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+        }
+    }
+    else
+    {
+        LEGACY_FORMAT legacyFormat = GetLegacyFormat( header->ddspf );
+        info->format = (legacyFormat != LEGACY_FORMAT_UNKNOWN) ? GetLegacyConversionFormat( legacyFormat )
+                                                               : GetDXGIFormat( header->ddspf );
+
+        if (header->flags & DDS_HEADER_FLAGS_VOLUME)
+        {
+            info->dimension = D3D11_RESOURCE_DIMENSION_TEXTURE3D;
+            info->depth = header->depth;
+        }
+        else if (header->caps2 & DDS_CUBEMAP)
+        {
+            info->arraySize = 6;
+            info->isCubeMap = true;
+        }
+    }
+
+    if (info->arraySize == 0 || BitsPerPixel( info->format ) == 0)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+    }
+
+    return S_OK;
+}
+
 //--------------------------------------------------------------------------------------
 HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                     _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
@@ -1415,3 +1628,239 @@ HRESULT CreateDDSTextureFromFile( _In_ ID3D11Device* d3dDevice,
 
     return hr;
 }
+
+//--------------------------------------------------------------------------------------
+// Converts legacy formats and generates missing mips for a file that is already in memory
+//--------------------------------------------------------------------------------------
+static HRESULT PrepareTextureData( std::unique_ptr<uint8_t[]>& ddsData,
+                                   _In_ const DDS_HEADER* header,
+                                   _In_ const uint8_t* bitData,
+                                   _In_ size_t bitSize,
+                                   _Out_ size_t* ddsDataSize,
+                                   _Out_opt_ DDS_TEXTURE_INFO* info )
+{
+    DDS_TEXTURE_INFO textureInfo;
+    HRESULT hr = GetTextureInfo( header, &textureInfo );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    size_t headerSize = bitData - ddsData.get();
+
+    // Legacy formats are converted once here and the header rewritten to describe the
+    // 32bpp result, so every later CreateDDSTextureFromMemory call skips the conversion
+    LEGACY_FORMAT legacyFormat = GetLegacyFormat( header->ddspf );
+    if (legacyFormat != LEGACY_FORMAT_UNKNOWN)
+    {
+        std::unique_ptr<uint8_t[]> convertedData;
+        size_t convertedSize = 0;
+        hr = ConvertLegacySurfaces( legacyFormat, textureInfo.width, textureInfo.height, textureInfo.depth,
+                                    textureInfo.mipCount, textureInfo.arraySize, bitData, bitSize,
+                                    convertedData, &convertedSize );
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        std::unique_ptr<uint8_t[]> converted( new (std::nothrow) uint8_t[ headerSize + convertedSize ] );
+        if ( !converted )
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        memcpy( converted.get(), ddsData.get(), headerSize );
+        memcpy( converted.get() + headerSize, convertedData.get(), convertedSize );
+
+        DDS_HEADER* convertedHeader = reinterpret_cast<DDS_HEADER*>( converted.get() + sizeof( uint32_t ) );
+        convertedHeader->ddspf.flags = DDS_RGBA;
+        convertedHeader->ddspf.RGBBitCount = 32;
+        convertedHeader->ddspf.RBitMask = (textureInfo.format == DXGI_FORMAT_B8G8R8A8_UNORM) ? 0x00ff0000 : 0x000000ff;
+        convertedHeader->ddspf.GBitMask = 0x0000ff00;
+        convertedHeader->ddspf.BBitMask = (textureInfo.format == DXGI_FORMAT_B8G8R8A8_UNORM) ? 0x000000ff : 0x00ff0000;
+        convertedHeader->ddspf.ABitMask = 0xff000000;
+        convertedHeader->pitchOrLinearSize = static_cast<uint32_t>( textureInfo.width * 4 );
+
+        ddsData.swap( converted );
+        bitData = ddsData.get() + headerSize;
+        bitSize = convertedSize;
+    }
+
+    if ( (textureInfo.mipCount == 1) &&
+         (textureInfo.dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D) &&
+         (textureInfo.width > 1 || textureInfo.height > 1) &&
+         CanGenerateMipChain( textureInfo.format ) )
+    {
+        std::unique_ptr<uint8_t[]> mipData;
+        size_t mipDataSize = 0;
+        size_t mipCount = 0;
+        hr = GenerateMipChain( textureInfo.width, textureInfo.height, textureInfo.arraySize, textureInfo.format,
+                               MIP_FILTER_BOX, true, bitData, bitSize, mipData, &mipDataSize, &mipCount );
+
+        // Rebuild the file in memory with the same headers and the full chain behind them
+        std::unique_ptr<uint8_t[]> expanded( SUCCEEDED(hr) ? new (std::nothrow) uint8_t[ headerSize + mipDataSize ] : nullptr );
+        if ( expanded )
+        {
+            memcpy( expanded.get(), ddsData.get(), headerSize );
+            memcpy( expanded.get() + headerSize, mipData.get(), mipDataSize );
+
+            DDS_HEADER* expandedHeader = reinterpret_cast<DDS_HEADER*>( expanded.get() + sizeof( uint32_t ) );
+            expandedHeader->mipMapCount = static_cast<uint32_t>( mipCount );
+            expandedHeader->flags |= DDS_HEADER_FLAGS_MIPMAP;
+            expandedHeader->caps |= DDS_SURFACE_FLAGS_MIPMAP;
+
+            ddsData.swap( expanded );
+            bitSize = mipDataSize;
+            textureInfo.mipCount = mipCount;
+        }
+    }
+
+    *ddsDataSize = headerSize + bitSize;
+    if (info)
+    {
+        *info = textureInfo;
+    }
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT LoadDDSTextureDataFromFile( _In_z_ const wchar_t* fileName,
+                                    std::unique_ptr<uint8_t[]>& ddsData,
+                                    _Out_ size_t* ddsDataSize,
+                                    _Out_opt_ DDS_TEXTURE_INFO* info )
+{
+    if (!fileName || !ddsDataSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ddsDataSize = 0;
+
+    DDS_HEADER* header = nullptr;
+    uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    HRESULT hr = LoadTextureDataFromFile( fileName,
+                                          ddsData,
+                                          &header,
+                                          &bitData,
+                                          &bitSize
+                                        );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return PrepareTextureData( ddsData, header, bitData, bitSize, ddsDataSize, info );
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT LoadDDSTextureDataFromMemory( std::unique_ptr<uint8_t[]>& ddsData,
+                                      _Inout_ size_t* ddsDataSize,
+                                      _Out_opt_ DDS_TEXTURE_INFO* info )
+{
+    if (!ddsData || !ddsDataSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    DDS_HEADER* header = nullptr;
+    uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    HRESULT hr = ParseTextureData( ddsData.get(), *ddsDataSize, &header, &bitData, &bitSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return PrepareTextureData( ddsData, header, bitData, bitSize, ddsDataSize, info );
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT GetDDSTextureInfo( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                           _In_ size_t ddsDataSize,
+                           _Out_ DDS_TEXTURE_INFO* info )
+{
+    if (!ddsData || !info)
+    {
+        return E_INVALIDARG;
+    }
+
+    DDS_HEADER* header = nullptr;
+    uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    HRESULT hr = ParseTextureData( const_cast<uint8_t*>( ddsData ), ddsDataSize, &header, &bitData, &bitSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return GetTextureInfo( header, info );
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT GetDDSSubresourceData( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                               _In_ size_t ddsDataSize,
+                               _In_ const DDS_TEXTURE_INFO& info,
+                               _Out_writes_(info.mipCount * info.arraySize) D3D11_SUBRESOURCE_DATA* initData )
+{
+    if (!ddsData || !initData)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (ddsDataSize < (sizeof(uint32_t) + sizeof(DDS_HEADER)) ||
+        *reinterpret_cast<const uint32_t*>( ddsData ) != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    const DDS_HEADER* header = reinterpret_cast<const DDS_HEADER*>( ddsData + sizeof( uint32_t ) );
+    size_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER );
+    if ((header->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == header->ddspf.fourCC))
+    {
+        offset += sizeof( DDS_HEADER_DXT10 );
+    }
+
+    if (ddsDataSize < offset)
+    {
+        return E_FAIL;
+    }
+
+    size_t skipMip = 0;
+    size_t twidth = 0;
+    size_t theight = 0;
+    size_t tdepth = 0;
+    return FillInitData( info.width, info.height, info.depth, info.mipCount, info.arraySize, info.format, 0,
+                         ddsDataSize - offset, ddsData + offset, twidth, theight, tdepth, skipMip, initData );
+}
+
+//--------------------------------------------------------------------------------------
+size_t GetDDSTextureMemorySize( _In_ const DDS_TEXTURE_INFO& info,
+                                _In_ size_t maxsize )
+{
+    // Mirrors the level selection in FillInitData
+    size_t total = 0;
+    size_t w = info.width;
+    size_t h = info.height;
+    size_t d = info.depth;
+    for( size_t i = 0; i < info.mipCount; i++ )
+    {
+        if ( (info.mipCount <= 1) || !maxsize || (w <= maxsize && h <= maxsize && d <= maxsize) )
+        {
+            size_t NumBytes = 0;
+            GetSurfaceInfo( w, h, info.format, &NumBytes, nullptr, nullptr );
+            total += NumBytes * d;
+        }
+
+        w = std::max<size_t>( w >> 1, 1 );
+        h = std::max<size_t>( h >> 1, 1 );
+        d = std::max<size_t>( d >> 1, 1 );
+    }
+
+    return total * info.arraySize;
+}
@@ -23,6 +23,7 @@
 #endif
 
 #include <d3d11.h>
+#include <memory>
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
@@ -49,3 +50,52 @@ HRESULT CreateDDSTextureFromFile( _In_ ID3D11Device* d3dDevice,
                                   _Out_opt_ ID3D11ShaderResourceView** textureView,
                                   _In_ size_t maxsize = 0
                                 );
+
+struct DDS_TEXTURE_INFO
+{
+    D3D11_RESOURCE_DIMENSION    dimension;
+    size_t                      width;
+    size_t                      height;
+    size_t                      depth;
+    size_t                      mipCount;
+    size_t                      arraySize;  // Six per cube
+    DXGI_FORMAT                 format;
+    bool                        isCubeMap;
+};
+
+// Reads a DDS file into memory for later calls to CreateDDSTextureFromMemory. A texture that
+// ships with a single level has its chain generated here, once, so every later call can pick
+// its top level with 'maxsize' without repeating the work.
+HRESULT LoadDDSTextureDataFromFile( _In_z_ const wchar_t* szFileName,
+                                    std::unique_ptr<uint8_t[]>& ddsData,
+                                    _Out_ size_t* ddsDataSize,
+                                    _Out_opt_ DDS_TEXTURE_INFO* info
+                                  );
+
+// The same for a whole file that was read elsewhere, e.g. by the AsyncFileReader. 'ddsDataSize'
+// holds the file size on the way in and the size of the prepared data on the way out.
+HRESULT LoadDDSTextureDataFromMemory( std::unique_ptr<uint8_t[]>& ddsData,
+                                      _Inout_ size_t* ddsDataSize,
+                                      _Out_opt_ DDS_TEXTURE_INFO* info
+                                    );
+
+// Reads only the headers of a DDS file held in memory. The format is the one the data ends
+// up in after LoadDDSTextureDataFromMemory, so legacy formats report their 32bpp
+// conversion; 'mipCount' is what the file stores.
+HRESULT GetDDSTextureInfo( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                           _In_ size_t ddsDataSize,
+                           _Out_ DDS_TEXTURE_INFO* info
+                         );
+
+// Points one D3D11_SUBRESOURCE_DATA per mip of every array slice (slice-major, the order
+// CreateTexture2D expects) at the surfaces in a buffer from LoadDDSTextureDataFromFile
+HRESULT GetDDSSubresourceData( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                               _In_ size_t ddsDataSize,
+                               _In_ const DDS_TEXTURE_INFO& info,
+                               _Out_writes_(info.mipCount * info.arraySize) D3D11_SUBRESOURCE_DATA* initData
+                             );
+
+// Bytes of video memory the texture takes when it is created with the given 'maxsize'
+size_t GetDDSTextureMemorySize( _In_ const DDS_TEXTURE_INFO& info,
+                                _In_ size_t maxsize = 0
+                              );
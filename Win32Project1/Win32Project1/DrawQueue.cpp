@@ -0,0 +1,790 @@
+#include "DrawQueue.h"
+#include <algorithm>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+// From the top of the key down: pass, then for opaque draws shader, material, mesh and
+// depth, and for transparent ones depth first
+#define SORT_KEY_PASS_BITS 2
+#define SORT_KEY_DEPTH_BITS 28
+#define SORT_KEY_SHADER_BITS 10
+#define SORT_KEY_MATERIAL_BITS 12
+#define SORT_KEY_MESH_BITS 12
+
+// Numbers the distinct keys in the order they are first seen; there are only a handful a pass
+template <typename KEY>
+static unsigned int FindOrAddKey(vector<KEY>& keys, const KEY& key)
+{
+	for (unsigned int i = 0; i < keys.size(); ++i)
+	{
+		if (memcmp(&keys[i], &key, sizeof(KEY)) == 0)
+			return i;
+	}
+	keys.push_back(key);
+	return (unsigned int)keys.size() - 1;
+}
+
+static uint64_t KeyField(unsigned int value, unsigned int bits)
+{
+	uint64_t largest = (1ull << bits) - 1;
+	return min((uint64_t)value, largest);
+}
+
+// Positive floats sort the same as their bits do; the top 28 of the 31 are plenty
+static unsigned int QuantizeDepth(float depth)
+{
+	if (!(depth > 0))
+		return 0;
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (31 - SORT_KEY_DEPTH_BITS);
+}
+
+static uint64_t MakeSortKey(RENDER_PASS pass, float depth, unsigned int shaderId, unsigned int materialId, unsigned int meshId)
+{
+	uint64_t key = (uint64_t)pass << (64 - SORT_KEY_PASS_BITS);
+	uint64_t quantizedDepth = QuantizeDepth(depth);
+	uint64_t shader = KeyField(shaderId, SORT_KEY_SHADER_BITS);
+	uint64_t material = KeyField(materialId, SORT_KEY_MATERIAL_BITS);
+	uint64_t mesh = KeyField(meshId, SORT_KEY_MESH_BITS);
+
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		// Farthest first
+		quantizedDepth = ~quantizedDepth & ((1ull << SORT_KEY_DEPTH_BITS) - 1);
+		key |= quantizedDepth << (SORT_KEY_SHADER_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS);
+		key |= shader << (SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS);
+		key |= material << SORT_KEY_MESH_BITS;
+		key |= mesh;
+	}
+	else
+	{
+		key |= shader << (SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS + SORT_KEY_DEPTH_BITS);
+		key |= material << (SORT_KEY_MESH_BITS + SORT_KEY_DEPTH_BITS);
+		key |= mesh << SORT_KEY_DEPTH_BITS;
+		key |= quantizedDepth;
+	}
+	return key;
+}
+
+DrawQueue::DrawQueue()
+{
+	target = nullptr;
+	memset(&current, 0, sizeof(current));
+	memset(&emitted, 0, sizeof(emitted));
+	emittedValid = false;
+	sortDepth = 0;
+	instanceBuffer = nullptr;
+	ownsInstanceBuffer = false;
+	submittedStateCount = 0;
+	emittedStateCount = 0;
+	submittedDrawCount = 0;
+	emittedDrawCount = 0;
+	sortCount = 0;
+	reusedSortCount = 0;
+}
+
+DrawQueue::~DrawQueue()
+{
+	Release();
+}
+
+void DrawQueue::Initialize(RenderContext* target, ID3D11Device* device)
+{
+	this->target = target;
+	Invalidate();
+
+	ReleaseInstanceBuffer();
+	if (device)
+	{
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.ByteWidth = DRAW_QUEUE_INSTANCE_BUFFER_SIZE;
+		HRESULT result = device->CreateBuffer(&bufferDesc, NULL, &instanceBuffer);
+		ownsInstanceBuffer = instanceBuffer != nullptr;
+	}
+}
+
+void DrawQueue::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	++submittedStateCount;
+	current.indexBuffer = buffer;
+	current.indexFormat = format;
+	current.indexOffset = offset;
+}
+
+void DrawQueue::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	++submittedStateCount;
+	current.vertexBuffer = buffer;
+	current.vertexStride = stride;
+	current.vertexOffset = offset;
+}
+
+void DrawQueue::SetInputLayout(ID3D11InputLayout* layout)
+{
+	++submittedStateCount;
+	current.layout = layout;
+}
+
+void DrawQueue::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	++submittedStateCount;
+	current.topology = topology;
+}
+
+void DrawQueue::SetVertexShader(ID3D11VertexShader* shader)
+{
+	++submittedStateCount;
+	current.vertexShader = shader;
+}
+
+void DrawQueue::SetGeometryShader(ID3D11GeometryShader* shader)
+{
+	++submittedStateCount;
+	current.geometryShader = shader;
+}
+
+void DrawQueue::SetPixelShader(ID3D11PixelShader* shader)
+{
+	++submittedStateCount;
+	current.pixelShader = shader;
+}
+
+void DrawQueue::SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+	++submittedStateCount;
+	for (unsigned int i = 0; i < count && slot + i < DRAW_QUEUE_SLOT_COUNT; ++i)
+	{
+		DRAW_CONSTANT_BINDING& binding = current.constantBuffers[stage][slot + i];
+		binding.buffer = buffers ? buffers[i] : nullptr;
+		binding.firstConstant = 0;
+		binding.constantCount = 0;
+		binding.write = -1;
+	}
+}
+
+void DrawQueue::SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	++submittedStateCount;
+	if (slot >= DRAW_QUEUE_SLOT_COUNT)
+		return;
+	DRAW_CONSTANT_BINDING& binding = current.constantBuffers[stage][slot];
+	binding.buffer = buffer;
+	binding.firstConstant = firstConstant;
+	binding.constantCount = constantCount;
+	binding.write = -1;
+}
+
+void DrawQueue::SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+	++submittedStateCount;
+	for (unsigned int i = 0; i < count && slot + i < DRAW_QUEUE_SLOT_COUNT; ++i)
+		current.shaderResources[stage][slot + i] = views ? views[i] : nullptr;
+}
+
+void DrawQueue::SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	++submittedStateCount;
+	for (unsigned int i = 0; i < count && slot + i < DRAW_QUEUE_SLOT_COUNT; ++i)
+		current.samplers[stage][slot + i] = samplers ? samplers[i] : nullptr;
+}
+
+void DrawQueue::SetBlendState(ID3D11BlendState* state)
+{
+	++submittedStateCount;
+	current.blendState = state;
+}
+
+void DrawQueue::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	++submittedStateCount;
+	current.rasterizerState = state;
+}
+
+void DrawQueue::SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	Flush();
+	++submittedStateCount;
+	++emittedStateCount;
+	target->SetRenderTargets(renderTarget, depthStencil);
+}
+
+void DrawQueue::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	Flush();
+	++submittedStateCount;
+	++emittedStateCount;
+	target->SetViewport(viewport);
+}
+
+void DrawQueue::ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4])
+{
+	Flush();
+	target->ClearRenderTarget(renderTarget, color);
+}
+
+void DrawQueue::ClearDepth(ID3D11DepthStencilView* depthStencil, float depth)
+{
+	Flush();
+	target->ClearDepth(depthStencil, depth);
+}
+
+// Kept until a draw that reads the buffer is sent, since the draws before it in the
+// queue may end up after it. A waiting draw that reads what the buffer held before any
+// write through the queue cannot be given it back, so those draws are sent first.
+void DrawQueue::WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	if (find(unwrittenBuffers.begin(), unwrittenBuffers.end(), buffer) != unwrittenBuffers.end())
+		Flush();
+
+	CONSTANT_WRITE write;
+	write.buffer = buffer;
+	write.offset = writeData.size();
+	write.size = size;
+	writes.push_back(write);
+	writeData.insert(writeData.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+void DrawQueue::UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	Flush();
+	target->UploadConstants(buffer, offset, data, size);
+	if (!instanceBuffer)
+		return;
+
+	// Whatever this replaced in the buffer is gone
+	for (unsigned int i = 0; i < uploads.size();)
+	{
+		const CONSTANT_UPLOAD& upload = uploads[i];
+		if (upload.buffer == buffer && upload.offset < offset + size && offset < upload.offset + upload.data.size())
+			uploads.erase(uploads.begin() + i);
+		else
+			++i;
+	}
+
+	CONSTANT_UPLOAD upload;
+	upload.buffer = buffer;
+	upload.offset = offset;
+	upload.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+	uploads.push_back(upload);
+}
+
+void DrawQueue::UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	Flush();
+	target->UpdateBuffer(buffer, offset, data, size);
+}
+
+void DrawQueue::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	unsigned int arguments[] = { vertexCount, startVertex };
+	AddDraw(RENDER_DRAW, arguments, ARRAYSIZE(arguments));
+}
+
+void DrawQueue::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	unsigned int arguments[] = { indexCount, startIndex, (unsigned int)baseVertex };
+	AddDraw(RENDER_DRAW_INDEXED, arguments, ARRAYSIZE(arguments));
+}
+
+void DrawQueue::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	unsigned int arguments[] = { indexCount, instanceCount, startIndex, (unsigned int)baseVertex, startInstance };
+	AddDraw(RENDER_DRAW_INDEXED_INSTANCED, arguments, ARRAYSIZE(arguments));
+}
+
+void DrawQueue::Flush()
+{
+	if (!items.empty())
+	{
+		// Ids for each distinct state, in the order they were first drawn with
+		shaders.clear();
+		materials.clear();
+		meshes.clear();
+		stateIds.resize(states.size() * 3);
+		for (unsigned int i = 0; i < states.size(); ++i)
+		{
+			const DRAW_STATE& state = states[i];
+
+			SHADER_KEY shader;
+			memset(&shader, 0, sizeof(shader));
+			shader.vertexShader = state.vertexShader;
+			shader.geometryShader = state.geometryShader;
+			shader.pixelShader = state.pixelShader;
+			shader.layout = state.layout;
+			stateIds[i * 3] = FindOrAddKey(shaders, shader);
+
+			MATERIAL_KEY material;
+			memset(&material, 0, sizeof(material));
+			memcpy(material.shaderResources, state.shaderResources[RENDER_STAGE_PIXEL], sizeof(material.shaderResources));
+			memcpy(material.samplers, state.samplers[RENDER_STAGE_PIXEL], sizeof(material.samplers));
+			material.blendState = state.blendState;
+			stateIds[i * 3 + 1] = FindOrAddKey(materials, material);
+
+			MESH_KEY mesh;
+			memset(&mesh, 0, sizeof(mesh));
+			mesh.indexBuffer = state.indexBuffer;
+			mesh.vertexBuffer = state.vertexBuffer;
+			mesh.indexOffset = state.indexOffset;
+			mesh.vertexOffset = state.vertexOffset;
+			mesh.topology = state.topology;
+			stateIds[i * 3 + 2] = FindOrAddKey(meshes, mesh);
+		}
+
+		sortItems.resize(items.size());
+		for (unsigned int i = 0; i < items.size(); ++i)
+		{
+			const DRAW_ITEM& item = items[i];
+			RENDER_PASS pass = states[item.state].blendState ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+			const unsigned int* ids = &stateIds[item.state * 3];
+			sortItems[i].key = MakeSortKey(pass, item.depth, ids[0], ids[1], ids[2]);
+			sortItems[i].index = i;
+		}
+		// Last frame's order for this flush is tried before sorting
+		if (sortCount < DRAW_QUEUE_SORT_HISTORY)
+		{
+			vector<RADIX_SORT_ITEM>& history = sortHistory[sortCount];
+			if (ReuseSortOrder(history, sortItems, sortScratch))
+				++reusedSortCount;
+			else
+				RadixSort(sortItems, sortScratch);
+			history = sortItems;
+		}
+		else
+			RadixSort(sortItems, sortScratch);
+		++sortCount;
+
+		// States that match in all but the object constants share a group, -1 when they
+		// cannot be drawn instanced
+		instanceGroups.assign(states.size(), -1);
+		if (instanceBuffer)
+		{
+			groups.clear();
+			for (unsigned int i = 0; i < states.size(); ++i)
+			{
+				if (!FindInstancedShader(states[i].vertexShader))
+					continue;
+				DRAW_STATE group;
+				memcpy(&group, &states[i], sizeof(group));
+				memset(&group.constantBuffers[RENDER_STAGE_VERTEX][DRAW_QUEUE_OBJECT_SLOT], 0, sizeof(DRAW_CONSTANT_BINDING));
+				instanceGroups[i] = (int)FindOrAddKey(groups, group);
+			}
+		}
+
+		sent.assign(sortItems.size(), false);
+		for (unsigned int i = 0; i < sortItems.size(); ++i)
+		{
+			if (sent[i])
+				continue;
+
+			GatherInstances(i);
+			if (batch.size() > 1)
+				EmitInstances();
+			else
+			{
+				const DRAW_ITEM& item = items[sortItems[i].index];
+				EmitState(states[item.state]);
+				EmitDraw(item);
+			}
+		}
+	}
+
+	// Leave every written buffer holding its last write, as it would have without the queue
+	for (unsigned int i = 0; i < writes.size(); ++i)
+	{
+		bool latest = true;
+		for (unsigned int j = i + 1; j < writes.size() && latest; ++j)
+			latest = writes[j].buffer != writes[i].buffer;
+		if (!latest)
+			continue;
+
+		int& contents = FindBufferContents(writes[i].buffer);
+		if (contents != (int)i)
+			target->WriteConstants(writes[i].buffer, &writeData[writes[i].offset], writes[i].size);
+	}
+
+	items.clear();
+	states.clear();
+	writes.clear();
+	writeData.clear();
+	bufferContents.clear();
+	unwrittenBuffers.clear();
+}
+
+// A draw's slots that were never set are left alone afterwards rather than cleared, as
+// every object binds the slots its shaders read
+void DrawQueue::Invalidate()
+{
+	memset(&emitted, 0, sizeof(emitted));
+	emittedValid = false;
+	bufferContents.clear();
+}
+
+void DrawQueue::ResetCounts()
+{
+	submittedStateCount = 0;
+	emittedStateCount = 0;
+	submittedDrawCount = 0;
+	emittedDrawCount = 0;
+	sortCount = 0;
+	reusedSortCount = 0;
+}
+
+void DrawQueue::Release()
+{
+	ReleaseInstanceBuffer();
+	instancedShaders.clear();
+	uploads.clear();
+}
+
+// Accessors
+unsigned int DrawQueue::GetSubmittedStateCount() const
+{
+	return submittedStateCount;
+}
+
+unsigned int DrawQueue::GetEmittedStateCount() const
+{
+	return emittedStateCount;
+}
+
+unsigned int DrawQueue::GetSubmittedDrawCount() const
+{
+	return submittedDrawCount;
+}
+
+unsigned int DrawQueue::GetEmittedDrawCount() const
+{
+	return emittedDrawCount;
+}
+
+unsigned int DrawQueue::GetSortCount() const
+{
+	return sortCount;
+}
+
+unsigned int DrawQueue::GetReusedSortCount() const
+{
+	return reusedSortCount;
+}
+
+// Mutators
+void DrawQueue::SetSortDepth(float depth)
+{
+	sortDepth = depth;
+}
+
+void DrawQueue::SetInstanceBuffer(ID3D11Buffer* buffer)
+{
+	ReleaseInstanceBuffer();
+	instanceBuffer = buffer;
+}
+
+void DrawQueue::AddInstancedShader(ID3D11VertexShader* shader, ID3D11VertexShader* instancedShader, unsigned int objectSize)
+{
+	if (!shader || !instancedShader || !objectSize || objectSize % 16 || objectSize > DRAW_QUEUE_INSTANCE_BUFFER_SIZE / 2)
+		return;
+
+	INSTANCED_SHADER instanced;
+	instanced.shader = shader;
+	instanced.instancedShader = instancedShader;
+	instanced.objectSize = objectSize;
+	instancedShaders.push_back(instanced);
+}
+
+// Private Member Functions
+void DrawQueue::AddDraw(RENDER_COMMAND_TYPE type, const unsigned int* arguments, unsigned int argumentCount)
+{
+	DRAW_STATE state;
+	memcpy(&state, &current, sizeof(state));
+
+	// Point whole buffers at the last write made to them before this draw, and remember
+	// the buffers read without one
+	for (unsigned int stage = 0; stage < RENDER_STAGE_COUNT; ++stage)
+	{
+		for (unsigned int slot = 0; slot < DRAW_QUEUE_SLOT_COUNT; ++slot)
+		{
+			DRAW_CONSTANT_BINDING& binding = state.constantBuffers[stage][slot];
+			if (!binding.buffer)
+				continue;
+			for (int i = (int)writes.size() - 1; i >= 0 && !binding.constantCount; --i)
+			{
+				if (writes[i].buffer == binding.buffer)
+				{
+					binding.write = i;
+					break;
+				}
+			}
+			if (binding.write < 0 && find(unwrittenBuffers.begin(), unwrittenBuffers.end(), binding.buffer) == unwrittenBuffers.end())
+				unwrittenBuffers.push_back(binding.buffer);
+		}
+	}
+
+	if (states.empty() || memcmp(&states.back(), &state, sizeof(state)) != 0)
+		states.push_back(state);
+
+	++submittedDrawCount;
+	DRAW_ITEM item = {};
+	item.type = type;
+	item.state = (unsigned int)states.size() - 1;
+	item.depth = sortDepth;
+	memcpy(item.arguments, arguments, argumentCount * sizeof(unsigned int));
+	items.push_back(item);
+}
+
+// Collects the sorted draws that can be sent in one instanced draw with the one at first
+void DrawQueue::GatherInstances(unsigned int first)
+{
+	batch.clear();
+	batch.push_back(first);
+	sent[first] = true;
+
+	const DRAW_ITEM& item = items[sortItems[first].index];
+	const DRAW_STATE& state = states[item.state];
+	int group = instanceGroups[item.state];
+	if (group < 0 || item.type != RENDER_DRAW_INDEXED)
+		return;
+	const INSTANCED_SHADER* instanced = FindInstancedShader(state.vertexShader);
+	if (!FindObjectConstants(state, instanced->objectSize))
+		return;
+
+	bool transparent = state.blendState != nullptr;
+	unsigned int maxInstances = DRAW_QUEUE_INSTANCE_BUFFER_SIZE / instanced->objectSize;
+	for (unsigned int i = first + 1; i < sortItems.size() && batch.size() < maxInstances; ++i)
+	{
+		const DRAW_ITEM& other = items[sortItems[i].index];
+		bool matches = !sent[i] && other.type == item.type && instanceGroups[other.state] == group &&
+			memcmp(other.arguments, item.arguments, sizeof(item.arguments)) == 0 &&
+			FindObjectConstants(states[other.state], instanced->objectSize);
+		if (matches)
+		{
+			batch.push_back(i);
+			sent[i] = true;
+		}
+		else if (transparent || states[other.state].blendState)
+			break;
+	}
+}
+
+void DrawQueue::EmitState(const DRAW_STATE& state)
+{
+	bool all = !emittedValid;
+
+	if (all || state.indexBuffer != emitted.indexBuffer || state.indexFormat != emitted.indexFormat || state.indexOffset != emitted.indexOffset)
+	{
+		target->SetIndexBuffer(state.indexBuffer, state.indexFormat, state.indexOffset);
+		++emittedStateCount;
+	}
+	if (all || state.vertexBuffer != emitted.vertexBuffer || state.vertexStride != emitted.vertexStride || state.vertexOffset != emitted.vertexOffset)
+	{
+		target->SetVertexBuffer(state.vertexBuffer, state.vertexStride, state.vertexOffset);
+		++emittedStateCount;
+	}
+	if (all || state.layout != emitted.layout)
+	{
+		target->SetInputLayout(state.layout);
+		++emittedStateCount;
+	}
+	if (all || state.topology != emitted.topology)
+	{
+		target->SetPrimitiveTopology(state.topology);
+		++emittedStateCount;
+	}
+	if (all || state.vertexShader != emitted.vertexShader)
+	{
+		target->SetVertexShader(state.vertexShader);
+		++emittedStateCount;
+	}
+	if (all || state.geometryShader != emitted.geometryShader)
+	{
+		target->SetGeometryShader(state.geometryShader);
+		++emittedStateCount;
+	}
+	if (all || state.pixelShader != emitted.pixelShader)
+	{
+		target->SetPixelShader(state.pixelShader);
+		++emittedStateCount;
+	}
+
+	for (unsigned int stage = 0; stage < RENDER_STAGE_COUNT; ++stage)
+	{
+		RENDER_STAGE renderStage = (RENDER_STAGE)stage;
+
+		for (unsigned int slot = 0; slot < DRAW_QUEUE_SLOT_COUNT; ++slot)
+		{
+			const DRAW_CONSTANT_BINDING& binding = state.constantBuffers[stage][slot];
+			const DRAW_CONSTANT_BINDING& previous = emitted.constantBuffers[stage][slot];
+			EmitConstants(binding);
+			if (binding.buffer == previous.buffer && binding.firstConstant == previous.firstConstant && binding.constantCount == previous.constantCount)
+				continue;
+
+			if (binding.constantCount)
+				target->SetConstantBufferRange(renderStage, slot, binding.buffer, binding.firstConstant, binding.constantCount);
+			else
+				target->SetConstantBuffers(renderStage, slot, 1, &binding.buffer);
+			++emittedStateCount;
+		}
+
+		// Runs of neighbouring slots that changed go in one call
+		const ID3D11ShaderResourceView* const* views = state.shaderResources[stage];
+		const ID3D11ShaderResourceView* const* previousViews = emitted.shaderResources[stage];
+		for (unsigned int slot = 0; slot < DRAW_QUEUE_SLOT_COUNT;)
+		{
+			unsigned int end = slot;
+			while (end < DRAW_QUEUE_SLOT_COUNT && views[end] != previousViews[end])
+				++end;
+			if (end == slot)
+			{
+				++slot;
+				continue;
+			}
+			target->SetShaderResources(renderStage, slot, end - slot, &state.shaderResources[stage][slot]);
+			++emittedStateCount;
+			slot = end;
+		}
+
+		const ID3D11SamplerState* const* samplers = state.samplers[stage];
+		const ID3D11SamplerState* const* previousSamplers = emitted.samplers[stage];
+		for (unsigned int slot = 0; slot < DRAW_QUEUE_SLOT_COUNT;)
+		{
+			unsigned int end = slot;
+			while (end < DRAW_QUEUE_SLOT_COUNT && samplers[end] != previousSamplers[end])
+				++end;
+			if (end == slot)
+			{
+				++slot;
+				continue;
+			}
+			target->SetSamplers(renderStage, slot, end - slot, &state.samplers[stage][slot]);
+			++emittedStateCount;
+			slot = end;
+		}
+	}
+
+	if (all || state.blendState != emitted.blendState)
+	{
+		target->SetBlendState(state.blendState);
+		++emittedStateCount;
+	}
+	if (all || state.rasterizerState != emitted.rasterizerState)
+	{
+		target->SetRasterizerState(state.rasterizerState);
+		++emittedStateCount;
+	}
+
+	memcpy(&emitted, &state, sizeof(emitted));
+	emittedValid = true;
+}
+
+void DrawQueue::EmitConstants(const DRAW_CONSTANT_BINDING& binding)
+{
+	if (binding.write < 0 || !binding.buffer)
+		return;
+
+	int& contents = FindBufferContents(binding.buffer);
+	if (contents == binding.write)
+		return;
+
+	const CONSTANT_WRITE& write = writes[binding.write];
+	target->WriteConstants(write.buffer, &writeData[write.offset], write.size);
+	contents = binding.write;
+}
+
+void DrawQueue::EmitDraw(const DRAW_ITEM& item)
+{
+	++emittedDrawCount;
+	const unsigned int* arguments = item.arguments;
+	if (item.type == RENDER_DRAW)
+		target->Draw(arguments[0], arguments[1]);
+	else if (item.type == RENDER_DRAW_INDEXED)
+		target->DrawIndexed(arguments[0], arguments[1], (int)arguments[2]);
+	else
+		target->DrawIndexedInstanced(arguments[0], arguments[1], arguments[2], (int)arguments[3], arguments[4]);
+}
+
+// Sends the gathered draws as one, with their object constants in the instance buffer
+void DrawQueue::EmitInstances()
+{
+	const DRAW_ITEM& item = items[sortItems[batch[0]].index];
+	DRAW_STATE state;
+	memcpy(&state, &states[item.state], sizeof(state));
+	const INSTANCED_SHADER* instanced = FindInstancedShader(state.vertexShader);
+
+	instanceData.resize(batch.size() * instanced->objectSize);
+	for (unsigned int i = 0; i < batch.size(); ++i)
+	{
+		const DRAW_STATE& instanceState = states[items[sortItems[batch[i]].index].state];
+		memcpy(&instanceData[i * instanced->objectSize], FindObjectConstants(instanceState, instanced->objectSize), instanced->objectSize);
+	}
+	target->WriteConstants(instanceBuffer, &instanceData[0], (unsigned int)instanceData.size());
+
+	state.vertexShader = instanced->instancedShader;
+	DRAW_CONSTANT_BINDING& binding = state.constantBuffers[RENDER_STAGE_VERTEX][DRAW_QUEUE_OBJECT_SLOT];
+	binding.buffer = instanceBuffer;
+	binding.firstConstant = 0;
+	binding.constantCount = 0;
+	binding.write = -1;
+	EmitState(state);
+
+	++emittedDrawCount;
+	target->DrawIndexedInstanced(item.arguments[0], (unsigned int)batch.size(), item.arguments[1], (int)item.arguments[2], 0);
+}
+
+// Only the buffer Initialize made is the queue's to release
+void DrawQueue::ReleaseInstanceBuffer()
+{
+	if (ownsInstanceBuffer)
+		SAFE_RELEASE(instanceBuffer);
+	instanceBuffer = nullptr;
+	ownsInstanceBuffer = false;
+}
+
+int& DrawQueue::FindBufferContents(ID3D11Buffer* buffer)
+{
+	for (unsigned int i = 0; i < bufferContents.size(); ++i)
+	{
+		if (bufferContents[i].first == buffer)
+			return bufferContents[i].second;
+	}
+	bufferContents.push_back(make_pair(buffer, -1));
+	return bufferContents.back().second;
+}
+
+const DrawQueue::INSTANCED_SHADER* DrawQueue::FindInstancedShader(ID3D11VertexShader* shader) const
+{
+	for (unsigned int i = 0; i < instancedShaders.size(); ++i)
+	{
+		if (instancedShaders[i].shader == shader)
+			return &instancedShaders[i];
+	}
+	return nullptr;
+}
+
+// The object constants a draw reads, from the write or upload that put them in the buffer,
+// or null when the queue never saw them
+const uint8_t* DrawQueue::FindObjectConstants(const DRAW_STATE& state, unsigned int size) const
+{
+	const DRAW_CONSTANT_BINDING& binding = state.constantBuffers[RENDER_STAGE_VERTEX][DRAW_QUEUE_OBJECT_SLOT];
+	if (!binding.buffer)
+		return nullptr;
+
+	if (binding.write >= 0)
+	{
+		const CONSTANT_WRITE& write = writes[binding.write];
+		return (write.size >= size) ? &writeData[write.offset] : nullptr;
+	}
+
+	unsigned int start = binding.firstConstant * 16;
+	if (binding.constantCount && binding.constantCount * 16 < size)
+		return nullptr;
+	for (int i = (int)uploads.size() - 1; i >= 0; --i)
+	{
+		const CONSTANT_UPLOAD& upload = uploads[i];
+		if (upload.buffer == binding.buffer && upload.offset <= start && start + size <= upload.offset + upload.data.size())
+			return &upload.data[start - upload.offset];
+	}
+	return nullptr;
+}
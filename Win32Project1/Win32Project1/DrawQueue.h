@@ -0,0 +1,239 @@
+#pragma once
+#include "defines.h"
+#include "RenderContext.h"
+#include "RadixSort.h"
+
+#define DRAW_QUEUE_SLOT_COUNT 8 // Constant buffer, resource and sampler slots kept per stage; later slots are ignored
+#define DRAW_QUEUE_OBJECT_SLOT 0 // Vertex constant buffer slot that holds the constants of a single object
+#define DRAW_QUEUE_INSTANCE_BUFFER_SIZE 4096 // Bytes of object constants one instanced draw can read
+#define DRAW_QUEUE_SORT_HISTORY 16 // Flushes a frame that remember their order for the next frame
+
+enum RENDER_PASS
+{
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_TRANSPARENT, // Anything drawn with a blend state, back to front
+	RENDER_PASS_COUNT
+};
+
+struct DRAW_CONSTANT_BINDING
+{
+	ID3D11Buffer* buffer;
+	unsigned int firstConstant;
+	unsigned int constantCount; // 0 when the whole buffer was bound through SetConstantBuffers
+	int write; // The WriteConstants the buffer has to hold for the draw, or -1
+};
+
+// Everything a draw reads that the objects set through a RenderContext
+struct DRAW_STATE
+{
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	unsigned int indexOffset;
+	ID3D11Buffer* vertexBuffer;
+	unsigned int vertexStride;
+	unsigned int vertexOffset;
+	ID3D11InputLayout* layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	ID3D11VertexShader* vertexShader;
+	ID3D11GeometryShader* geometryShader;
+	ID3D11PixelShader* pixelShader;
+	DRAW_CONSTANT_BINDING constantBuffers[RENDER_STAGE_COUNT][DRAW_QUEUE_SLOT_COUNT];
+	ID3D11ShaderResourceView* shaderResources[RENDER_STAGE_COUNT][DRAW_QUEUE_SLOT_COUNT];
+	ID3D11SamplerState* samplers[RENDER_STAGE_COUNT][DRAW_QUEUE_SLOT_COUNT];
+	ID3D11BlendState* blendState;
+	ID3D11RasterizerState* rasterizerState;
+};
+
+// Holds on to the draws of a pass and sends them to another RenderContext sorted, with only
+// the state that changed from one draw to the next.
+//
+// Calls that set state only change what the queue will use for the next draw. Each draw
+// keeps a copy of that state and a 64 bit key: the pass, then the shaders, the material
+// (pixel resources, samplers and blend state), the mesh and the depth set with
+// SetSortDepth. Opaque draws sort front to back inside each mesh; transparent ones sort
+// back to front before anything else. Draws with the same key keep the order they were
+// made in, so an object that draws twice still does so in its own order.
+//
+// The first DRAW_QUEUE_SORT_HISTORY flushes after ResetCounts each keep the order they sent
+// their draws in. The same flush next frame, usually the same view drawing the same things,
+// checks that order against its own keys and only sorts if it no longer holds.
+//
+// Draws of a shader added with AddInstancedShader that match in everything but the object
+// constants in DRAW_QUEUE_OBJECT_SLOT are sent as one DrawIndexedInstanced. Their object
+// constants are gathered into one buffer for the instanced shader to index. Opaque draws
+// are merged anywhere in their pass. Transparent ones are only merged when they are already
+// next to each other back to front, since drawing them together must not change what
+// blends over what.
+//
+// Constant writes wait with the draws, each sent just before the first draw that reads it.
+// Writing a buffer that a waiting draw reads without a write of its own flushes first.
+//
+// Render targets, viewports, clears, uploads and buffer updates go straight through after
+// the waiting draws are flushed, since they divide passes. Anything else that touches the
+// device context behind the queue's back has to be followed by Invalidate.
+class DrawQueue : public RenderContext
+{
+public:
+	DrawQueue();
+	~DrawQueue();
+
+	// Without a device there is no instance buffer, and draws are never merged unless one is
+	// given through SetInstanceBuffer
+	void Initialize(RenderContext* target, ID3D11Device* device);
+
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetGeometryShader(ID3D11GeometryShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers);
+	void SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+	void ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* depthStencil, float depth);
+	void WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size);
+	void UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	// Sorts the waiting draws and sends them on
+	void Flush();
+	// Forgets what the target was last given, so the next draw sends all of its state
+	void Invalidate();
+	// Also starts a frame, so each flush after it is matched with the same one last frame
+	void ResetCounts();
+	void Release();
+
+	// Accessors
+	// State calls made on the queue since ResetCounts, and how many of them reached the target
+	unsigned int GetSubmittedStateCount() const;
+	unsigned int GetEmittedStateCount() const;
+	// Draws made on the queue since ResetCounts, and how many draws they were sent as
+	unsigned int GetSubmittedDrawCount() const;
+	unsigned int GetEmittedDrawCount() const;
+	// Flushes with draws since ResetCounts, and how many of them kept last frame's order
+	unsigned int GetSortCount() const;
+	unsigned int GetReusedSortCount() const;
+
+	// Mutators
+	// Distance from the camera of the draws that follow, for their sort keys
+	void SetSortDepth(float depth);
+	// Gathers the object constants of merged draws into buffer, which the caller keeps and
+	// releases, in place of the one Initialize made. Null stops draws from being merged.
+	void SetInstanceBuffer(ID3D11Buffer* buffer);
+	// Draws made with shader may be merged and sent with instancedShader, which reads
+	// objectSize bytes of object constants for each instance from an array in the object slot
+	void AddInstancedShader(ID3D11VertexShader* shader, ID3D11VertexShader* instancedShader, unsigned int objectSize);
+
+private:
+
+	struct DRAW_ITEM
+	{
+		RENDER_COMMAND_TYPE type;
+		unsigned int state;
+		float depth;
+		unsigned int arguments[5];
+	};
+
+	struct CONSTANT_WRITE
+	{
+		ID3D11Buffer* buffer;
+		size_t offset;
+		unsigned int size;
+	};
+
+	// What was uploaded through the queue, for reading the object constants back
+	struct CONSTANT_UPLOAD
+	{
+		ID3D11Buffer* buffer;
+		unsigned int offset;
+		vector<uint8_t> data;
+	};
+
+	struct INSTANCED_SHADER
+	{
+		ID3D11VertexShader* shader;
+		ID3D11VertexShader* instancedShader;
+		unsigned int objectSize;
+	};
+
+	// The parts of a state the sort keys number
+	struct SHADER_KEY
+	{
+		ID3D11VertexShader* vertexShader;
+		ID3D11GeometryShader* geometryShader;
+		ID3D11PixelShader* pixelShader;
+		ID3D11InputLayout* layout;
+	};
+
+	struct MATERIAL_KEY
+	{
+		ID3D11ShaderResourceView* shaderResources[DRAW_QUEUE_SLOT_COUNT];
+		ID3D11SamplerState* samplers[DRAW_QUEUE_SLOT_COUNT];
+		ID3D11BlendState* blendState;
+	};
+
+	struct MESH_KEY
+	{
+		ID3D11Buffer* indexBuffer;
+		ID3D11Buffer* vertexBuffer;
+		unsigned int indexOffset;
+		unsigned int vertexOffset;
+		D3D11_PRIMITIVE_TOPOLOGY topology;
+	};
+
+	RenderContext* target;
+	DRAW_STATE current;
+	DRAW_STATE emitted;
+	bool emittedValid;
+	float sortDepth;
+	vector<DRAW_STATE> states;
+	vector<DRAW_ITEM> items;
+	vector<CONSTANT_WRITE> writes;
+	vector<uint8_t> writeData;
+	vector<pair<ID3D11Buffer*, int> > bufferContents;
+	vector<ID3D11Buffer*> unwrittenBuffers; // Read by a waiting draw as they were before any write through the queue
+	// Kept between flushes so that a flush only allocates when it is the largest yet
+	vector<SHADER_KEY> shaders;
+	vector<MATERIAL_KEY> materials;
+	vector<MESH_KEY> meshes;
+	vector<unsigned int> stateIds;
+	vector<DRAW_STATE> groups;
+	vector<RADIX_SORT_ITEM> sortItems;
+	vector<RADIX_SORT_ITEM> sortScratch;
+	vector<RADIX_SORT_ITEM> sortHistory[DRAW_QUEUE_SORT_HISTORY];
+	ID3D11Buffer* instanceBuffer;
+	bool ownsInstanceBuffer;
+	vector<INSTANCED_SHADER> instancedShaders;
+	vector<CONSTANT_UPLOAD> uploads;
+	vector<int> instanceGroups;
+	vector<bool> sent;
+	vector<unsigned int> batch;
+	vector<uint8_t> instanceData;
+	unsigned int submittedStateCount;
+	unsigned int emittedStateCount;
+	unsigned int submittedDrawCount;
+	unsigned int emittedDrawCount;
+	unsigned int sortCount;
+	unsigned int reusedSortCount;
+
+	void AddDraw(RENDER_COMMAND_TYPE type, const unsigned int* arguments, unsigned int argumentCount);
+	void GatherInstances(unsigned int first);
+	void EmitState(const DRAW_STATE& state);
+	void EmitConstants(const DRAW_CONSTANT_BINDING& binding);
+	void EmitDraw(const DRAW_ITEM& item);
+	void EmitInstances();
+	void ReleaseInstanceBuffer();
+	int& FindBufferContents(ID3D11Buffer* buffer);
+	const INSTANCED_SHADER* FindInstancedShader(ID3D11VertexShader* shader) const;
+	const uint8_t* FindObjectConstants(const DRAW_STATE& state, unsigned int size) const;
+};
@@ -0,0 +1,154 @@
+#include "EntityRenderer.h"
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+#define ENTITY_DRAWN (ENTITY_TRANSFORM | ENTITY_MESH | ENTITY_MATERIAL)
+
+EntityRenderer::EntityRenderer()
+{
+	blendState = nullptr;
+	backFaceState = nullptr;
+	frontFaceState = nullptr;
+	submittedCount = 0;
+}
+
+EntityRenderer::~EntityRenderer()
+{
+	Release();
+}
+
+void EntityRenderer::Initialize(ID3D11Device* device)
+{
+	if (!device)
+		return;
+
+	// As the loaded models draw themselves
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.AlphaToCoverageEnable = true;
+	blendDesc.RenderTarget[0].BlendEnable = true;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	HRESULT result = device->CreateBlendState(&blendDesc, &blendState);
+
+	D3D11_RASTERIZER_DESC rasterDesc = {};
+	rasterDesc.AntialiasedLineEnable = false;
+	rasterDesc.FillMode = D3D11_FILL_SOLID;
+	rasterDesc.CullMode = D3D11_CULL_BACK;
+	result = device->CreateRasterizerState(&rasterDesc, &frontFaceState);
+
+	rasterDesc.CullMode = D3D11_CULL_FRONT;
+	result = device->CreateRasterizerState(&rasterDesc, &backFaceState);
+}
+
+void EntityRenderer::Update(const EntityStore& store, const TransformHierarchy& transforms, ConstantBufferRing& constantRing)
+{
+	constants.resize(store.GetArchetypeCount());
+	for (unsigned int a = 0; a < store.GetArchetypeCount(); ++a)
+	{
+		const ENTITY_ARCHETYPE& archetype = store.GetArchetype(a);
+		constants[a].clear();
+		if ((archetype.components & ENTITY_DRAWN) != ENTITY_DRAWN)
+			continue;
+
+		unsigned int rows = (unsigned int)archetype.entities.size();
+		constants[a].resize(rows);
+		for (unsigned int row = 0; row < rows; ++row)
+		{
+			XMMATRIX worldMatrix = transforms.GetWorldMatrix(archetype.transforms[row]);
+			constants[a][row] = constantRing.Write(&worldMatrix, sizeof(worldMatrix));
+		}
+	}
+}
+
+void EntityRenderer::Cull(const EntityStore& store, const TransformHierarchy& transforms, FrustumCuller& culler, unsigned int firstSphere)
+{
+	unsigned int sphere = firstSphere;
+	firstSpheres.resize(store.GetArchetypeCount());
+	for (unsigned int a = 0; a < store.GetArchetypeCount(); ++a)
+	{
+		const ENTITY_ARCHETYPE& archetype = store.GetArchetype(a);
+		firstSpheres[a] = ENTITY_NONE;
+		if ((archetype.components & (ENTITY_DRAWN | ENTITY_BOUNDS)) != (ENTITY_DRAWN | ENTITY_BOUNDS))
+			continue;
+
+		firstSpheres[a] = sphere;
+		unsigned int rows = (unsigned int)archetype.entities.size();
+		while (culler.GetCount() < sphere + rows)
+			culler.Add(XMFLOAT3(0, 0, 0), 0);
+		for (unsigned int row = 0; row < rows; ++row, ++sphere)
+			culler.SetSphere(sphere, transforms.GetWorldMatrix(archetype.transforms[row]), archetype.boundingRadii[row]);
+	}
+}
+
+void EntityRenderer::Submit(const EntityStore& store, const TransformHierarchy& transforms, const FrustumCuller& culler, unsigned int view,
+	FXMVECTOR eyePosition, ConstantBufferRing& constantRing, DrawQueue* drawQueue)
+{
+	submittedCount = 0;
+	for (unsigned int a = 0; a < store.GetArchetypeCount() && a < constants.size(); ++a)
+	{
+		const ENTITY_ARCHETYPE& archetype = store.GetArchetype(a);
+		if ((archetype.components & ENTITY_DRAWN) != ENTITY_DRAWN)
+			continue;
+		unsigned int firstSphere = (a < firstSpheres.size()) ? firstSpheres[a] : ENTITY_NONE;
+		bool flagged = (archetype.components & ENTITY_RENDER_FLAGS) != 0;
+
+		for (unsigned int row = 0; row < archetype.entities.size(); ++row)
+		{
+			uint32_t flags = flagged ? archetype.renderFlags[row] : 0;
+			if (flags & RENDER_FLAG_HIDDEN)
+				continue;
+			if (firstSphere != ENTITY_NONE && !culler.IsVisible(view, firstSphere + row))
+				continue;
+
+			constantRing.Bind(drawQueue, RENDER_STAGE_VERTEX, DRAW_QUEUE_OBJECT_SLOT, constants[a][row]);
+			XMVECTOR position = transforms.GetWorldMatrix(archetype.transforms[row]).r[3];
+			drawQueue->SetSortDepth(XMVectorGetX(XMVector3Length(position - eyePosition)));
+
+			const MESH_COMPONENT& mesh = archetype.meshes[row];
+			drawQueue->SetIndexBuffer(mesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			drawQueue->SetVertexBuffer(mesh.vertexBuffer, mesh.vertexStride, 0);
+			drawQueue->SetInputLayout(mesh.layout);
+			drawQueue->SetPrimitiveTopology(mesh.topology);
+
+			const MATERIAL_COMPONENT& material = archetype.materials[row];
+			drawQueue->SetVertexShader(material.vertexShader);
+			drawQueue->SetGeometryShader(nullptr);
+			drawQueue->SetPixelShader(material.pixelShader);
+			if (material.textureCount > 0)
+				drawQueue->SetShaderResources(RENDER_STAGE_PIXEL, 0, material.textureCount, material.textures);
+			drawQueue->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &material.sampler);
+
+			if (flags & RENDER_FLAG_BLENDED)
+			{
+				drawQueue->SetBlendState(blendState);
+				drawQueue->SetRasterizerState(backFaceState);
+				drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+				drawQueue->SetRasterizerState(frontFaceState);
+				drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+				drawQueue->SetRasterizerState(nullptr);
+				drawQueue->SetBlendState(nullptr);
+			}
+			else
+				drawQueue->DrawIndexed(mesh.indexCount, 0, 0);
+			++submittedCount;
+		}
+	}
+}
+
+void EntityRenderer::Release()
+{
+	SAFE_RELEASE(blendState);
+	SAFE_RELEASE(backFaceState);
+	SAFE_RELEASE(frontFaceState);
+}
+
+// Accessors
+unsigned int EntityRenderer::GetSubmittedCount() const
+{
+	return submittedCount;
+}
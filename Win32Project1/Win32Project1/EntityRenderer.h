@@ -0,0 +1,48 @@
+#pragma once
+#include "defines.h"
+#include "EntityStore.h"
+#include "TransformHierarchy.h"
+#include "FrustumCuller.h"
+#include "ConstantBufferRing.h"
+#include "DrawQueue.h"
+
+// The per-frame work for every entity that is drawn, done a whole archetype at a time:
+// Update writes world matrices into the constant ring, Cull hands bounding spheres to a
+// FrustumCuller and Submit sends the visible entities of a view to a draw queue. An
+// entity is drawn when it has a transform, a mesh and a material. Bounds make it culled
+// and render flags change how it is drawn.
+//
+// Update, Cull and Submit go together in that order each frame, with nothing created or
+// destroyed in the store in between, since the constants and spheres are found by row.
+class EntityRenderer
+{
+public:
+	EntityRenderer();
+	~EntityRenderer();
+
+	// States for blended entities. Without a device they are left out and blended entities
+	// draw with whatever is bound.
+	void Initialize(ID3D11Device* device);
+
+	void Update(const EntityStore& store, const TransformHierarchy& transforms, ConstantBufferRing& constantRing);
+	// Places the spheres from firstSphere on, adding any the culler is missing
+	void Cull(const EntityStore& store, const TransformHierarchy& transforms, FrustumCuller& culler, unsigned int firstSphere);
+	void Submit(const EntityStore& store, const TransformHierarchy& transforms, const FrustumCuller& culler, unsigned int view,
+		FXMVECTOR eyePosition, ConstantBufferRing& constantRing, DrawQueue* drawQueue);
+
+	void Release();
+
+	// Accessors
+	// Entities the last Submit drew
+	unsigned int GetSubmittedCount() const;
+
+private:
+
+	ID3D11BlendState* blendState;
+	ID3D11RasterizerState* backFaceState;
+	ID3D11RasterizerState* frontFaceState;
+	// By archetype, then by row, for this frame
+	vector<vector<CONSTANT_ALLOCATION> > constants;
+	vector<unsigned int> firstSpheres; // ENTITY_NONE for archetypes that are not culled
+	unsigned int submittedCount;
+};
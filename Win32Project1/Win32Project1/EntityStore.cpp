@@ -0,0 +1,240 @@
+#include "EntityStore.h"
+
+// Swaps the last element into index and drops the last
+template <typename T>
+static void RemoveSwap(vector<T>& values, unsigned int index)
+{
+	if (values.empty())
+		return;
+	values[index] = values.back();
+	values.pop_back();
+}
+
+EntityStore::EntityStore()
+{
+	entityCount = 0;
+}
+
+EntityStore::~EntityStore()
+{
+}
+
+unsigned int EntityStore::Create(unsigned int components)
+{
+	unsigned int entity;
+	if (!freeEntities.empty())
+	{
+		entity = freeEntities.back();
+		freeEntities.pop_back();
+	}
+	else
+	{
+		entity = (unsigned int)locations.size();
+		locations.push_back(ENTITY_LOCATION());
+	}
+
+	unsigned int archetype = FindArchetype(components);
+	locations[entity].archetype = archetype;
+	locations[entity].row = AppendRow(archetype, entity);
+	++entityCount;
+	return entity;
+}
+
+void EntityStore::Destroy(unsigned int entity)
+{
+	if (entity >= locations.size() || locations[entity].archetype == ENTITY_NONE)
+		return;
+	RemoveRow(locations[entity].archetype, locations[entity].row);
+	locations[entity].archetype = ENTITY_NONE;
+	freeEntities.push_back(entity);
+	--entityCount;
+}
+
+void EntityStore::Clear()
+{
+	archetypes.clear();
+	locations.clear();
+	freeEntities.clear();
+	entityCount = 0;
+}
+
+// Accessors
+unsigned int EntityStore::GetEntityCount() const
+{
+	return entityCount;
+}
+
+unsigned int EntityStore::GetArchetypeCount() const
+{
+	return (unsigned int)archetypes.size();
+}
+
+const ENTITY_ARCHETYPE& EntityStore::GetArchetype(unsigned int index) const
+{
+	return archetypes[index];
+}
+
+unsigned int EntityStore::GetComponents(unsigned int entity) const
+{
+	if (entity >= locations.size() || locations[entity].archetype == ENTITY_NONE)
+		return 0;
+	return archetypes[locations[entity].archetype].components;
+}
+
+unsigned int EntityStore::CountWith(unsigned int components) const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < archetypes.size(); ++i)
+	{
+		if ((archetypes[i].components & components) == components)
+			count += (unsigned int)archetypes[i].entities.size();
+	}
+	return count;
+}
+
+// Mutators
+void EntityStore::SetComponents(unsigned int entity, unsigned int components)
+{
+	if (entity >= locations.size() || locations[entity].archetype == ENTITY_NONE)
+		return;
+	ENTITY_LOCATION& location = locations[entity];
+	if (archetypes[location.archetype].components == components)
+		return;
+
+	unsigned int archetype = FindArchetype(components);
+	unsigned int row = AppendRow(archetype, entity);
+	CopyRow(location.archetype, location.row, archetype, row);
+	RemoveRow(location.archetype, location.row);
+	location.archetype = archetype;
+	location.row = row;
+}
+
+void EntityStore::SetTransform(unsigned int entity, unsigned int node)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_TRANSFORM, row);
+	if (archetype)
+		archetype->transforms[row] = node;
+}
+
+void EntityStore::SetMesh(unsigned int entity, const MESH_COMPONENT& mesh)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_MESH, row);
+	if (archetype)
+		archetype->meshes[row] = mesh;
+}
+
+void EntityStore::SetMaterial(unsigned int entity, const MATERIAL_COMPONENT& material)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_MATERIAL, row);
+	if (archetype)
+		archetype->materials[row] = material;
+}
+
+void EntityStore::SetTexture(unsigned int entity, unsigned int slot, ID3D11ShaderResourceView* texture)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_MATERIAL, row);
+	if (!archetype || slot >= ENTITY_MAX_TEXTURES)
+		return;
+	MATERIAL_COMPONENT& material = archetype->materials[row];
+	material.textures[slot] = texture;
+	material.textureCount = max(material.textureCount, slot + 1);
+}
+
+void EntityStore::SetBoundingRadius(unsigned int entity, float radius)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_BOUNDS, row);
+	if (archetype)
+		archetype->boundingRadii[row] = radius;
+}
+
+void EntityStore::SetRenderFlags(unsigned int entity, uint32_t flags)
+{
+	unsigned int row;
+	ENTITY_ARCHETYPE* archetype = Find(entity, ENTITY_RENDER_FLAGS, row);
+	if (archetype)
+		archetype->renderFlags[row] = flags;
+}
+
+// Private Member Functions
+unsigned int EntityStore::FindArchetype(unsigned int components)
+{
+	for (unsigned int i = 0; i < archetypes.size(); ++i)
+	{
+		if (archetypes[i].components == components)
+			return i;
+	}
+	archetypes.push_back(ENTITY_ARCHETYPE());
+	archetypes.back().components = components;
+	return (unsigned int)archetypes.size() - 1;
+}
+
+unsigned int EntityStore::AppendRow(unsigned int archetype, unsigned int entity)
+{
+	ENTITY_ARCHETYPE& destination = archetypes[archetype];
+	unsigned int row = (unsigned int)destination.entities.size();
+	destination.entities.push_back(entity);
+	if (destination.components & ENTITY_TRANSFORM)
+		destination.transforms.push_back(0);
+	if (destination.components & ENTITY_MESH)
+	{
+		MESH_COMPONENT mesh = {};
+		destination.meshes.push_back(mesh);
+	}
+	if (destination.components & ENTITY_MATERIAL)
+	{
+		MATERIAL_COMPONENT material = {};
+		destination.materials.push_back(material);
+	}
+	if (destination.components & ENTITY_BOUNDS)
+		destination.boundingRadii.push_back(0.0f);
+	if (destination.components & ENTITY_RENDER_FLAGS)
+		destination.renderFlags.push_back(0);
+	return row;
+}
+
+void EntityStore::CopyRow(unsigned int fromArchetype, unsigned int fromRow, unsigned int toArchetype, unsigned int toRow)
+{
+	const ENTITY_ARCHETYPE& source = archetypes[fromArchetype];
+	ENTITY_ARCHETYPE& destination = archetypes[toArchetype];
+	unsigned int shared = source.components & destination.components;
+	if (shared & ENTITY_TRANSFORM)
+		destination.transforms[toRow] = source.transforms[fromRow];
+	if (shared & ENTITY_MESH)
+		destination.meshes[toRow] = source.meshes[fromRow];
+	if (shared & ENTITY_MATERIAL)
+		destination.materials[toRow] = source.materials[fromRow];
+	if (shared & ENTITY_BOUNDS)
+		destination.boundingRadii[toRow] = source.boundingRadii[fromRow];
+	if (shared & ENTITY_RENDER_FLAGS)
+		destination.renderFlags[toRow] = source.renderFlags[fromRow];
+}
+
+void EntityStore::RemoveRow(unsigned int archetype, unsigned int row)
+{
+	ENTITY_ARCHETYPE& source = archetypes[archetype];
+	unsigned int last = (unsigned int)source.entities.size() - 1;
+	if (row != last)
+		locations[source.entities[last]].row = row;
+	RemoveSwap(source.entities, row);
+	RemoveSwap(source.transforms, row);
+	RemoveSwap(source.meshes, row);
+	RemoveSwap(source.materials, row);
+	RemoveSwap(source.boundingRadii, row);
+	RemoveSwap(source.renderFlags, row);
+}
+
+ENTITY_ARCHETYPE* EntityStore::Find(unsigned int entity, unsigned int components, unsigned int& row)
+{
+	if (entity >= locations.size() || locations[entity].archetype == ENTITY_NONE)
+		return nullptr;
+	ENTITY_ARCHETYPE& archetype = archetypes[locations[entity].archetype];
+	if ((archetype.components & components) != components)
+		return nullptr;
+	row = locations[entity].row;
+	return &archetype;
+}
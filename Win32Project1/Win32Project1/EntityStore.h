@@ -0,0 +1,114 @@
+#pragma once
+#include "defines.h"
+
+#define ENTITY_MAX_TEXTURES 2
+#define ENTITY_NONE 0xFFFFFFFF
+
+// The components an entity can have. The set an entity has is its archetype.
+enum ENTITY_COMPONENT
+{
+	ENTITY_TRANSFORM = 0x1, // A node of a TransformHierarchy
+	ENTITY_MESH = 0x2,
+	ENTITY_MATERIAL = 0x4,
+	ENTITY_BOUNDS = 0x8, // Radius of a sphere about the transform's origin
+	ENTITY_RENDER_FLAGS = 0x10,
+};
+
+enum RENDER_FLAG
+{
+	RENDER_FLAG_HIDDEN = 0x1,
+	RENDER_FLAG_BLENDED = 0x2, // Alpha blended, back faces drawn before front faces
+};
+
+struct MESH_COMPONENT
+{
+	ID3D11Buffer* vertexBuffer;
+	unsigned int vertexStride;
+	ID3D11Buffer* indexBuffer;
+	unsigned int indexCount;
+	ID3D11InputLayout* layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+};
+
+struct MATERIAL_COMPONENT
+{
+	ID3D11VertexShader* vertexShader;
+	ID3D11PixelShader* pixelShader;
+	ID3D11ShaderResourceView* textures[ENTITY_MAX_TEXTURES]; // Pixel shader slots from 0
+	unsigned int textureCount;
+	ID3D11SamplerState* sampler;
+};
+
+// The entities that have one set of components. Each component has an array of its own
+// that holds a row per entity, and arrays of components the archetype lacks stay empty.
+struct ENTITY_ARCHETYPE
+{
+	unsigned int components;
+	vector<unsigned int> entities; // The entity in each row
+	vector<unsigned int> transforms;
+	vector<MESH_COMPONENT> meshes;
+	vector<MATERIAL_COMPONENT> materials;
+	vector<float> boundingRadii;
+	vector<uint32_t> renderFlags;
+};
+
+// Entities kept by archetype, so that code that runs over every entity with some set of
+// components walks the packed arrays of the archetypes that have them instead of visiting
+// objects one at a time. Rows stay packed: destroying an entity moves the last row of its
+// archetype into its place, and giving it other components moves it to another archetype.
+// Entities are handed out as indices that stay the same however their rows move.
+//
+// Nothing here is owned. Meshes and materials point at resources whoever made them keeps.
+class EntityStore
+{
+public:
+	EntityStore();
+	~EntityStore();
+
+	// A new entity with the given components, each zeroed until it is set
+	unsigned int Create(unsigned int components);
+	void Destroy(unsigned int entity);
+	void Clear();
+
+	// Accessors
+	unsigned int GetEntityCount() const;
+	unsigned int GetArchetypeCount() const;
+	// Archetypes are never removed, so an index stays good while the store lasts
+	const ENTITY_ARCHETYPE& GetArchetype(unsigned int index) const;
+	unsigned int GetComponents(unsigned int entity) const;
+	// Entities with all of the given components
+	unsigned int CountWith(unsigned int components) const;
+
+	// Mutators
+	// Moves the entity to the archetype of the new set, keeping the components it had before
+	// that the set still has
+	void SetComponents(unsigned int entity, unsigned int components);
+	// Each only applies to an entity that has the component
+	void SetTransform(unsigned int entity, unsigned int node);
+	void SetMesh(unsigned int entity, const MESH_COMPONENT& mesh);
+	void SetMaterial(unsigned int entity, const MATERIAL_COMPONENT& material);
+	void SetTexture(unsigned int entity, unsigned int slot, ID3D11ShaderResourceView* texture);
+	void SetBoundingRadius(unsigned int entity, float radius);
+	void SetRenderFlags(unsigned int entity, uint32_t flags);
+
+private:
+
+	struct ENTITY_LOCATION
+	{
+		unsigned int archetype; // ENTITY_NONE once destroyed
+		unsigned int row;
+	};
+
+	vector<ENTITY_ARCHETYPE> archetypes;
+	vector<ENTITY_LOCATION> locations;
+	vector<unsigned int> freeEntities;
+	unsigned int entityCount;
+
+	unsigned int FindArchetype(unsigned int components);
+	// Adds a zeroed row for the entity and returns it
+	unsigned int AppendRow(unsigned int archetype, unsigned int entity);
+	void CopyRow(unsigned int fromArchetype, unsigned int fromRow, unsigned int toArchetype, unsigned int toRow);
+	void RemoveRow(unsigned int archetype, unsigned int row);
+	// The entity's archetype and row when it has all of the components, otherwise nullptr
+	ENTITY_ARCHETYPE* Find(unsigned int entity, unsigned int components, unsigned int& row);
+};
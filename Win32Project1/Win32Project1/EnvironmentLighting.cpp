@@ -0,0 +1,601 @@
+#include "EnvironmentLighting.h"
+#include "MipChainGenerator.h"
+#include <atomic>
+#include <cmath>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+#define ENVIRONMENT_CACHE_MAGIC 0x31564E45 // "ENV1"
+#define ENVIRONMENT_CACHE_VERSION 2
+#define ENVIRONMENT_DIFFUSE_STRENGTH 0.5f
+#define ENVIRONMENT_SPECULAR_STRENGTH 0.5f
+
+struct ENVIRONMENT_CACHE_HEADER
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long hash;
+	unsigned int size;
+	unsigned int mipCount;
+	unsigned int dataSize;
+	unsigned int padding;
+	XMFLOAT4 irradiance[9];
+};
+
+// One level of the source cube decoded to linear RGBA, the six faces back to back
+struct CubeLevel
+{
+	unsigned int size;
+	vector<float> texels;
+};
+
+// A GGX sample around +Z; it is turned to face each output texel's direction
+struct GGXSample
+{
+	XMFLOAT3 direction;
+	float weight;
+	float lod;
+};
+
+static const float PI = 3.14159265f;
+
+static size_t SpecularDataSize()
+{
+	size_t total = 0;
+	for (unsigned int mip = 0; mip < ENVIRONMENT_SPECULAR_MIPS; ++mip)
+	{
+		size_t size = ENVIRONMENT_SPECULAR_SIZE >> mip;
+		total += size * size * 4;
+	}
+	return total * 6;
+}
+
+static float LinearToSRGB(float value)
+{
+	value = min(max(value, 0.0f), 1.0f);
+	return (value <= 0.0031308f) ? value * 12.92f : 1.055f * pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static XMFLOAT3 Normalize(const XMFLOAT3& v)
+{
+	float length = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	return XMFLOAT3(v.x / length, v.y / length, v.z / length);
+}
+
+// Direct3D face order and orientation: +X, -X, +Y, -Y, +Z, -Z with u right and v down
+static XMFLOAT3 FaceDirection(unsigned int face, float u, float v)
+{
+	switch (face)
+	{
+	case 0: return Normalize(XMFLOAT3(1, -v, -u));
+	case 1: return Normalize(XMFLOAT3(-1, -v, u));
+	case 2: return Normalize(XMFLOAT3(u, 1, v));
+	case 3: return Normalize(XMFLOAT3(u, -1, -v));
+	case 4: return Normalize(XMFLOAT3(u, -v, 1));
+	default: return Normalize(XMFLOAT3(-u, -v, -1));
+	}
+}
+
+static void DirectionToFace(const XMFLOAT3& direction, unsigned int& face, float& u, float& v)
+{
+	float x = fabs(direction.x), y = fabs(direction.y), z = fabs(direction.z);
+	if (x >= y && x >= z)
+	{
+		face = (direction.x > 0) ? 0 : 1;
+		u = ((direction.x > 0) ? -direction.z : direction.z) / x;
+		v = -direction.y / x;
+	}
+	else if (y >= z)
+	{
+		face = (direction.y > 0) ? 2 : 3;
+		u = direction.x / y;
+		v = ((direction.y > 0) ? direction.z : -direction.z) / y;
+	}
+	else
+	{
+		face = (direction.z > 0) ? 4 : 5;
+		u = ((direction.z > 0) ? direction.x : -direction.x) / z;
+		v = -direction.y / z;
+	}
+}
+
+// Bilinear within the face the direction lands on; texels are clamped at the face edges
+static void SampleLevel(const CubeLevel& level, const XMFLOAT3& direction, float color[4])
+{
+	unsigned int face;
+	float u, v;
+	DirectionToFace(direction, face, u, v);
+
+	float x = min(max((u + 1) * 0.5f * level.size - 0.5f, 0.0f), (float)(level.size - 1));
+	float y = min(max((v + 1) * 0.5f * level.size - 0.5f, 0.0f), (float)(level.size - 1));
+	unsigned int x0 = (unsigned int)x, y0 = (unsigned int)y;
+	unsigned int x1 = min(x0 + 1, level.size - 1), y1 = min(y0 + 1, level.size - 1);
+	float fx = x - x0, fy = y - y0;
+
+	const float* texels = &level.texels[face * level.size * level.size * 4];
+	const float* t00 = texels + (y0 * level.size + x0) * 4;
+	const float* t10 = texels + (y0 * level.size + x1) * 4;
+	const float* t01 = texels + (y1 * level.size + x0) * 4;
+	const float* t11 = texels + (y1 * level.size + x1) * 4;
+	for (unsigned int c = 0; c < 4; ++c)
+	{
+		float top = t00[c] + (t10[c] - t00[c]) * fx;
+		float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+		color[c] = top + (bottom - top) * fy;
+	}
+}
+
+static void SampleCube(const vector<CubeLevel>& levels, const XMFLOAT3& direction, float lod, float color[4])
+{
+	lod = min(max(lod, 0.0f), (float)(levels.size() - 1));
+	unsigned int lower = (unsigned int)lod;
+	unsigned int upper = min(lower + 1, (unsigned int)levels.size() - 1);
+	float blend = lod - lower;
+
+	float a[4], b[4];
+	SampleLevel(levels[lower], direction, a);
+	SampleLevel(levels[upper], direction, b);
+	for (unsigned int c = 0; c < 4; ++c)
+		color[c] = a[c] + (b[c] - a[c]) * blend;
+}
+
+// Hammersley points importance sampled for the GGX distribution, with the view taken along
+// the normal. Each sample also gets the source level whose texels cover about the same
+// solid angle as the sample does, which keeps a few hundred samples free of fireflies.
+static vector<GGXSample> BuildGGXSamples(float roughness, unsigned int sourceSize)
+{
+	vector<GGXSample> samples;
+	float alpha = roughness * roughness;
+	float alpha2 = alpha * alpha;
+	float texelSolidAngle = 4 * PI / (6.0f * sourceSize * sourceSize);
+
+	for (unsigned int i = 0; i < ENVIRONMENT_GGX_SAMPLES; ++i)
+	{
+		unsigned int bits = i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555) << 1) | ((bits & 0xAAAAAAAA) >> 1);
+		bits = ((bits & 0x33333333) << 2) | ((bits & 0xCCCCCCCC) >> 2);
+		bits = ((bits & 0x0F0F0F0F) << 4) | ((bits & 0xF0F0F0F0) >> 4);
+		bits = ((bits & 0x00FF00FF) << 8) | ((bits & 0xFF00FF00) >> 8);
+		float xi1 = (float)i / ENVIRONMENT_GGX_SAMPLES;
+		float xi2 = bits * 2.3283064365386963e-10f;
+
+		float phi = 2 * PI * xi1;
+		float cosTheta = sqrt((1 - xi2) / (1 + (alpha2 - 1) * xi2));
+		float sinTheta = sqrt(1 - cosTheta * cosTheta);
+
+		// Reflect the view (+Z) about the half vector
+		GGXSample sample;
+		sample.direction = XMFLOAT3(2 * cosTheta * sinTheta * cos(phi), 2 * cosTheta * sinTheta * sin(phi), 2 * cosTheta * cosTheta - 1);
+		sample.weight = sample.direction.z;
+		if (sample.weight <= 0)
+			continue;
+
+		float denominator = cosTheta * cosTheta * (alpha2 - 1) + 1;
+		float pdf = alpha2 / (PI * denominator * denominator) * 0.25f;
+		float sampleSolidAngle = 1.0f / (ENVIRONMENT_GGX_SAMPLES * pdf + 0.0001f);
+		sample.lod = 0.5f * log(sampleSolidAngle / texelSolidAngle) / log(2.0f) + 1.0f;
+		samples.push_back(sample);
+	}
+	return samples;
+}
+
+static void PrefilterFace(const vector<CubeLevel>& levels, unsigned int face, unsigned int mip, float* output)
+{
+	unsigned int size = ENVIRONMENT_SPECULAR_SIZE >> mip;
+	float roughness = (float)mip / (ENVIRONMENT_SPECULAR_MIPS - 1);
+	vector<GGXSample> samples;
+	if (mip > 0)
+		samples = BuildGGXSamples(roughness, levels[0].size);
+
+	// A mirror surface just needs the source at the output's resolution
+	float mirrorLod = log((float)levels[0].size / size) / log(2.0f);
+
+	for (unsigned int y = 0; y < size; ++y)
+	{
+		for (unsigned int x = 0; x < size; ++x)
+		{
+			float u = 2.0f * (x + 0.5f) / size - 1;
+			float v = 2.0f * (y + 0.5f) / size - 1;
+			XMFLOAT3 normal = FaceDirection(face, u, v);
+			float* texel = output + (y * size + x) * 4;
+
+			if (samples.empty())
+			{
+				SampleCube(levels, normal, mirrorLod, texel);
+				continue;
+			}
+
+			XMFLOAT3 up = (fabs(normal.z) < 0.999f) ? XMFLOAT3(0, 0, 1) : XMFLOAT3(1, 0, 0);
+			XMFLOAT3 tangent = Normalize(XMFLOAT3(up.y * normal.z - up.z * normal.y, up.z * normal.x - up.x * normal.z, up.x * normal.y - up.y * normal.x));
+			XMFLOAT3 bitangent(normal.y * tangent.z - normal.z * tangent.y, normal.z * tangent.x - normal.x * tangent.z, normal.x * tangent.y - normal.y * tangent.x);
+
+			float total[4] = { 0, 0, 0, 0 };
+			float totalWeight = 0;
+			for (unsigned int i = 0; i < samples.size(); ++i)
+			{
+				const XMFLOAT3& s = samples[i].direction;
+				XMFLOAT3 direction(tangent.x * s.x + bitangent.x * s.y + normal.x * s.z,
+					tangent.y * s.x + bitangent.y * s.y + normal.y * s.z,
+					tangent.z * s.x + bitangent.z * s.y + normal.z * s.z);
+
+				float color[4];
+				SampleCube(levels, direction, samples[i].lod, color);
+				for (unsigned int c = 0; c < 4; ++c)
+					total[c] += color[c] * samples[i].weight;
+				totalWeight += samples[i].weight;
+			}
+			for (unsigned int c = 0; c < 4; ++c)
+				texel[c] = total[c] / totalWeight;
+		}
+	}
+}
+
+// Projects one face onto the first 9 spherical harmonics, weighting each texel by the solid
+// angle it covers
+static void ProjectFace(const CubeLevel& level, unsigned int face, bool bgra, double coefficients[9][3], double& solidAngle)
+{
+	for (unsigned int y = 0; y < level.size; ++y)
+	{
+		for (unsigned int x = 0; x < level.size; ++x)
+		{
+			float u = 2.0f * (x + 0.5f) / level.size - 1;
+			float v = 2.0f * (y + 0.5f) / level.size - 1;
+			XMFLOAT3 n = FaceDirection(face, u, v);
+			float weight = 4.0f / (level.size * level.size * pow(1 + u * u + v * v, 1.5f));
+
+			const float* texel = &level.texels[((face * level.size + y) * level.size + x) * 4];
+			float rgb[3] = { texel[bgra ? 2 : 0], texel[1], texel[bgra ? 0 : 2] };
+			float basis[9] =
+			{
+				0.282095f,
+				0.488603f * n.y,
+				0.488603f * n.z,
+				0.488603f * n.x,
+				1.092548f * n.x * n.y,
+				1.092548f * n.y * n.z,
+				0.315392f * (3 * n.z * n.z - 1),
+				1.092548f * n.x * n.z,
+				0.546274f * (n.x * n.x - n.y * n.y),
+			};
+			for (unsigned int i = 0; i < 9; ++i)
+				for (unsigned int c = 0; c < 3; ++c)
+					coefficients[i][c] += basis[i] * rgb[c] * weight;
+			solidAngle += weight;
+		}
+	}
+}
+
+// Decodes the source, then projects and prefilters it with one job per face (and per level
+// for the specular chain) spread over every core
+static void ComputeEnvironment(const DDS_TEXTURE_INFO& info, const D3D11_SUBRESOURCE_DATA* surfaces, XMFLOAT4 irradiance[9], vector<uint8_t>& specular)
+{
+	float toLinear[256];
+	for (unsigned int i = 0; i < 256; ++i)
+	{
+		float value = i / 255.0f;
+		toLinear[i] = (value <= 0.04045f) ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// Only the top level is read from the file. The rest of the chain is built here, in linear
+	// light, so the per-sample LODs below always have every level to choose from even when the
+	// file holds a single one
+	vector<CubeLevel> levels(CountMipLevels(info.width, info.height));
+	levels[0].size = (unsigned int)info.width;
+	levels[0].texels.resize(levels[0].size * levels[0].size * 4 * 6);
+	for (unsigned int face = 0; face < 6; ++face)
+	{
+		const D3D11_SUBRESOURCE_DATA& surface = surfaces[face * info.mipCount];
+		for (unsigned int y = 0; y < levels[0].size; ++y)
+		{
+			const uint8_t* src = (const uint8_t*)surface.pSysMem + y * surface.SysMemPitch;
+			float* dst = &levels[0].texels[((face * levels[0].size + y) * levels[0].size) * 4];
+			for (unsigned int x = 0; x < levels[0].size * 4; x += 4)
+			{
+				dst[x] = toLinear[src[x]];
+				dst[x + 1] = toLinear[src[x + 1]];
+				dst[x + 2] = toLinear[src[x + 2]];
+				dst[x + 3] = src[x + 3] / 255.0f;
+			}
+		}
+	}
+	for (unsigned int mip = 1; mip < levels.size(); ++mip)
+	{
+		const CubeLevel& parent = levels[mip - 1];
+		CubeLevel& level = levels[mip];
+		level.size = max(parent.size / 2, 1u);
+		level.texels.resize(level.size * level.size * 4 * 6);
+		for (unsigned int face = 0; face < 6; ++face)
+		{
+			for (unsigned int y = 0; y < level.size; ++y)
+			{
+				unsigned int y0 = min(y * 2, parent.size - 1), y1 = min(y * 2 + 1, parent.size - 1);
+				for (unsigned int x = 0; x < level.size; ++x)
+				{
+					unsigned int x0 = min(x * 2, parent.size - 1), x1 = min(x * 2 + 1, parent.size - 1);
+					const float* t00 = &parent.texels[((face * parent.size + y0) * parent.size + x0) * 4];
+					const float* t10 = &parent.texels[((face * parent.size + y0) * parent.size + x1) * 4];
+					const float* t01 = &parent.texels[((face * parent.size + y1) * parent.size + x0) * 4];
+					const float* t11 = &parent.texels[((face * parent.size + y1) * parent.size + x1) * 4];
+					float* dst = &level.texels[((face * level.size + y) * level.size + x) * 4];
+					for (unsigned int c = 0; c < 4; ++c)
+						dst[c] = (t00[c] + t10[c] + t01[c] + t11[c]) * 0.25f;
+				}
+			}
+		}
+	}
+
+	bool bgra = (info.format != DXGI_FORMAT_R8G8B8A8_UNORM && info.format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+	double coefficients[6][9][3] = {};
+	double solidAngles[6] = {};
+
+	// Prefiltered levels are stored the way a DDS file lays out a cube: every mip of a face,
+	// then the next face
+	vector<float> prefiltered(SpecularDataSize());
+	size_t faceStride = prefiltered.size() / 6;
+	vector<size_t> mipOffsets(ENVIRONMENT_SPECULAR_MIPS, 0);
+	for (unsigned int mip = 1; mip < ENVIRONMENT_SPECULAR_MIPS; ++mip)
+		mipOffsets[mip] = mipOffsets[mip - 1] + (ENVIRONMENT_SPECULAR_SIZE >> (mip - 1)) * (ENVIRONMENT_SPECULAR_SIZE >> (mip - 1)) * 4;
+
+	// The sampled levels cost the most, so they go first
+	unsigned int numJobs = 6 + 6 * ENVIRONMENT_SPECULAR_MIPS;
+	atomic<unsigned int> nextJob(0);
+	auto worker = [&]()
+	{
+		for (unsigned int job = nextJob++; job < numJobs; job = nextJob++)
+		{
+			if (job < 6 * ENVIRONMENT_SPECULAR_MIPS)
+			{
+				unsigned int mip = (job / 6 + 1) % ENVIRONMENT_SPECULAR_MIPS;
+				unsigned int face = job % 6;
+				PrefilterFace(levels, face, mip, &prefiltered[face * faceStride + mipOffsets[mip]]);
+			}
+			else
+			{
+				unsigned int face = job - 6 * ENVIRONMENT_SPECULAR_MIPS;
+				ProjectFace(levels[0], face, bgra, coefficients[face], solidAngles[face]);
+			}
+		}
+	};
+
+	unsigned int numWorkers = min(max(thread::hardware_concurrency(), 1u), numJobs);
+	vector<thread> workers;
+	for (unsigned int i = 1; i < numWorkers; ++i)
+		workers.push_back(thread(worker));
+	worker();
+	for (unsigned int i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	// Convolve with the clamped cosine (pi, 2pi/3, pi/4 per band) and divide by pi so the
+	// shader gets the diffuse light directly, folding in the basis constants as well
+	const float bandScale[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	const float basisConstant[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+	double solidAngle = 0;
+	for (unsigned int face = 0; face < 6; ++face)
+		solidAngle += solidAngles[face];
+	for (unsigned int i = 0; i < 9; ++i)
+	{
+		double sum[3] = { 0, 0, 0 };
+		for (unsigned int face = 0; face < 6; ++face)
+			for (unsigned int c = 0; c < 3; ++c)
+				sum[c] += coefficients[face][i][c];
+		float scale = (float)(4 * PI / solidAngle) * bandScale[i] * basisConstant[i];
+		irradiance[i] = XMFLOAT4((float)sum[0] * scale, (float)sum[1] * scale, (float)sum[2] * scale, 0);
+	}
+
+	specular.resize(prefiltered.size());
+	for (size_t i = 0; i < prefiltered.size(); i += 4)
+	{
+		specular[i] = (uint8_t)(LinearToSRGB(prefiltered[i]) * 255 + 0.5f);
+		specular[i + 1] = (uint8_t)(LinearToSRGB(prefiltered[i + 1]) * 255 + 0.5f);
+		specular[i + 2] = (uint8_t)(LinearToSRGB(prefiltered[i + 2]) * 255 + 0.5f);
+		specular[i + 3] = 255;
+	}
+}
+
+// FNV-1a over the file contents and everything that changes the output
+static unsigned long long HashEnvironment(const uint8_t* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+
+	unsigned int settings[] = { ENVIRONMENT_CACHE_VERSION, ENVIRONMENT_SPECULAR_SIZE, ENVIRONMENT_SPECULAR_MIPS, ENVIRONMENT_GGX_SAMPLES };
+	const uint8_t* bytes = (const uint8_t*)settings;
+	for (size_t i = 0; i < sizeof(settings); ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+EnvironmentLighting::EnvironmentLighting()
+{
+	ZeroMemory(&constants, sizeof(constants));
+	constantBuffer = nullptr;
+	shaderResourceView = nullptr;
+	sampler = nullptr;
+	loadedFromCache = false;
+}
+
+
+EnvironmentLighting::~EnvironmentLighting()
+{
+	Release();
+}
+
+bool EnvironmentLighting::Initialize(ID3D11Device* device, const wchar_t* filename, AsyncFileReader* fileReader)
+{
+	unique_ptr<uint8_t[]> ddsData;
+	size_t ddsDataSize = 0;
+	DDS_TEXTURE_INFO info;
+	HRESULT result = E_FAIL;
+	if (!fileReader)
+		result = LoadDDSTextureDataFromFile(filename, ddsData, &ddsDataSize, &info);
+	else if (fileReader->Load(filename, ddsData, &ddsDataSize))
+		result = LoadDDSTextureDataFromMemory(ddsData, &ddsDataSize, &info);
+	if (FAILED(result) || !info.isCubeMap || info.arraySize != 6 || info.width != info.height || !CanGenerateMipChain(info.format))
+		return false;
+
+	unsigned long long hash = HashEnvironment(ddsData.get(), ddsDataSize);
+	wchar_t path[MAX_PATH];
+	swprintf_s(path, MAX_PATH, L"%s\\%016llx.env", ENVIRONMENT_CACHE_DIRECTORY, hash);
+
+	vector<uint8_t> specular;
+	loadedFromCache = ReadCache(path, hash, specular);
+	if (!loadedFromCache)
+	{
+		vector<D3D11_SUBRESOURCE_DATA> surfaces(info.mipCount * info.arraySize);
+		if (FAILED(GetDDSSubresourceData(ddsData.get(), ddsDataSize, info, &surfaces[0])))
+			return false;
+
+		ComputeEnvironment(info, &surfaces[0], constants.irradiance, specular);
+		WriteCache(path, hash, specular);
+	}
+
+	constants.ratios = XMFLOAT4(ENVIRONMENT_SPECULAR_MIPS - 1, ENVIRONMENT_DIFFUSE_STRENGTH, ENVIRONMENT_SPECULAR_STRENGTH, 1);
+	return CreateResources(device, info.format, specular);
+}
+
+void EnvironmentLighting::Bind(RenderContext* renderContext)
+{
+	if (!shaderResourceView)
+		return;
+
+	renderContext->SetConstantBuffers(RENDER_STAGE_PIXEL, 1, 1, &constantBuffer);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 2, 1, &shaderResourceView);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 1, 1, &sampler);
+}
+
+void EnvironmentLighting::Release()
+{
+	SAFE_RELEASE(constantBuffer);
+	SAFE_RELEASE(shaderResourceView);
+	SAFE_RELEASE(sampler);
+}
+
+bool EnvironmentLighting::ReadCache(const wchar_t* path, unsigned long long hash, vector<uint8_t>& specular)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	ENVIRONMENT_CACHE_HEADER header;
+	DWORD bytesRead = 0;
+	bool valid = ReadFile(file, &header, sizeof(header), &bytesRead, nullptr) && bytesRead == sizeof(header) &&
+		header.magic == ENVIRONMENT_CACHE_MAGIC && header.version == ENVIRONMENT_CACHE_VERSION && header.hash == hash &&
+		header.size == ENVIRONMENT_SPECULAR_SIZE && header.mipCount == ENVIRONMENT_SPECULAR_MIPS && header.dataSize == SpecularDataSize();
+	if (valid)
+	{
+		specular.resize(header.dataSize);
+		valid = ReadFile(file, &specular[0], header.dataSize, &bytesRead, nullptr) && bytesRead == header.dataSize;
+	}
+	CloseHandle(file);
+
+	if (valid)
+		memcpy(constants.irradiance, header.irradiance, sizeof(header.irradiance));
+	return valid;
+}
+
+void EnvironmentLighting::WriteCache(const wchar_t* path, unsigned long long hash, const vector<uint8_t>& specular)
+{
+	// A failed write only means the work is repeated next run
+	CreateDirectoryW(ENVIRONMENT_CACHE_DIRECTORY, nullptr);
+	HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	ENVIRONMENT_CACHE_HEADER header = {};
+	header.magic = ENVIRONMENT_CACHE_MAGIC;
+	header.version = ENVIRONMENT_CACHE_VERSION;
+	header.hash = hash;
+	header.size = ENVIRONMENT_SPECULAR_SIZE;
+	header.mipCount = ENVIRONMENT_SPECULAR_MIPS;
+	header.dataSize = (unsigned int)specular.size();
+	memcpy(header.irradiance, constants.irradiance, sizeof(header.irradiance));
+
+	DWORD bytesWritten = 0;
+	bool written = WriteFile(file, &header, sizeof(header), &bytesWritten, nullptr) && bytesWritten == sizeof(header) &&
+		WriteFile(file, &specular[0], header.dataSize, &bytesWritten, nullptr) && bytesWritten == header.dataSize;
+	CloseHandle(file);
+
+	// Never leave a partial file behind for the next run to trip over
+	if (!written)
+		DeleteFileW(path);
+}
+
+bool EnvironmentLighting::CreateResources(ID3D11Device* device, DXGI_FORMAT format, const vector<uint8_t>& specular)
+{
+	D3D11_SUBRESOURCE_DATA initData[6 * ENVIRONMENT_SPECULAR_MIPS];
+	size_t offset = 0;
+	for (unsigned int face = 0; face < 6; ++face)
+	{
+		for (unsigned int mip = 0; mip < ENVIRONMENT_SPECULAR_MIPS; ++mip)
+		{
+			unsigned int size = ENVIRONMENT_SPECULAR_SIZE >> mip;
+			initData[face * ENVIRONMENT_SPECULAR_MIPS + mip].pSysMem = &specular[offset];
+			initData[face * ENVIRONMENT_SPECULAR_MIPS + mip].SysMemPitch = size * 4;
+			initData[face * ENVIRONMENT_SPECULAR_MIPS + mip].SysMemSlicePitch = 0;
+			offset += size * size * 4;
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = ENVIRONMENT_SPECULAR_SIZE;
+	textureDesc.Height = ENVIRONMENT_SPECULAR_SIZE;
+	textureDesc.MipLevels = ENVIRONMENT_SPECULAR_MIPS;
+	textureDesc.ArraySize = 6;
+	textureDesc.Format = format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT result = device->CreateTexture2D(&textureDesc, initData, &texture);
+	if (FAILED(result))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	viewDesc.TextureCube.MipLevels = ENVIRONMENT_SPECULAR_MIPS;
+	result = device->CreateShaderResourceView(texture, &viewDesc, &shaderResourceView);
+	SAFE_RELEASE(texture);
+	if (FAILED(result))
+		return false;
+
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	result = device->CreateSamplerState(&samplerDesc, &sampler);
+	if (FAILED(result))
+		return false;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.ByteWidth = sizeof(ENVIRONMENT_CONSTANTS);
+
+	D3D11_SUBRESOURCE_DATA bufferData = {};
+	bufferData.pSysMem = &constants;
+	result = device->CreateBuffer(&bufferDesc, &bufferData, &constantBuffer);
+	return SUCCEEDED(result);
+}
+
+// Accessors
+bool EnvironmentLighting::WasLoadedFromCache() const
+{
+	return loadedFromCache;
+}
+
+const ENVIRONMENT_CONSTANTS& EnvironmentLighting::GetConstants() const
+{
+	return constants;
+}
+
+ID3D11ShaderResourceView* EnvironmentLighting::GetShaderResourceView() const
+{
+	return shaderResourceView;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "defines.h"
+#include "RenderContext.h"
+#include "DDSTextureLoader.h"
+#include "AsyncFileReader.h"
+
+#define ENVIRONMENT_SPECULAR_SIZE 64
+#define ENVIRONMENT_SPECULAR_MIPS 6 // 64 down to 2; roughness goes from 0 to 1 across them
+#define ENVIRONMENT_GGX_SAMPLES 256
+#define ENVIRONMENT_CACHE_DIRECTORY L"EnvironmentCache"
+
+// What the pixel shaders read from b1
+struct ENVIRONMENT_CONSTANTS
+{
+	XMFLOAT4 irradiance[9]; // SH9 of the diffuse light, basis constants and 1 / pi already folded in
+	XMFLOAT4 ratios; // Highest specular mip, diffuse strength, specular strength, on or off
+};
+
+// Image based lighting from the skybox. The cubemap is projected into 9 spherical harmonic
+// coefficients of irradiance and prefiltered with GGX into a mip chain where each level
+// stands for a rougher surface. Both are computed on the CPU across every core the first
+// time a cubemap is seen and saved under ENVIRONMENT_CACHE_DIRECTORY, named by a hash of
+// its contents, so later runs only read the file back.
+class EnvironmentLighting
+{
+public:
+	EnvironmentLighting();
+	~EnvironmentLighting();
+
+	// Safe to call from a loader thread. The cubemap is read through the fileReader when one
+	// is given.
+	bool Initialize(ID3D11Device* device, const wchar_t* filename, AsyncFileReader* fileReader);
+
+	// Binds the constants to b1, the prefiltered cube to t2 and its sampler to s1. Nothing is
+	// bound if Initialize failed, which leaves the environment term at zero.
+	void Bind(RenderContext* renderContext);
+
+	void Release();
+
+	// Accessors
+	bool WasLoadedFromCache() const;
+	const ENVIRONMENT_CONSTANTS& GetConstants() const;
+	ID3D11ShaderResourceView* GetShaderResourceView() const;
+
+private:
+
+	ENVIRONMENT_CONSTANTS constants;
+	ID3D11Buffer* constantBuffer;
+	ID3D11ShaderResourceView* shaderResourceView;
+	ID3D11SamplerState* sampler;
+	bool loadedFromCache;
+
+	bool ReadCache(const wchar_t* path, unsigned long long hash, vector<uint8_t>& specular);
+	void WriteCache(const wchar_t* path, unsigned long long hash, const vector<uint8_t>& specular);
+	bool CreateResources(ID3D11Device* device, DXGI_FORMAT format, const vector<uint8_t>& specular);
+};
@@ -0,0 +1,29 @@
+cbuffer ENVIRONMENT : register(b1)
+{
+	float4 irradiance[9]; // SH9 of the skybox's diffuse light
+	float4 environmentRatios; // Highest specular mip, diffuse strength, specular strength, on or off
+}
+
+textureCUBE environmentTexture : register(t2); // skybox prefiltered with GGX, rougher down the chain
+
+SamplerState environmentFilter : register(s1);
+
+#define ENVIRONMENT_ROUGHNESS 0.6f
+
+// Ambient light from the skybox. Everything here was computed ahead of time, so it costs
+// nine multiply-adds and one texture read; with nothing bound the buffer reads as zero and
+// so does the result.
+float3 ApplyEnvironmentLighting(float3 normal, float3 toCamera, float3 baseColor)
+{
+	float3 n = normalize(normal);
+	float3 diffuse = irradiance[0].xyz;
+	diffuse += irradiance[1].xyz * n.y + irradiance[2].xyz * n.z + irradiance[3].xyz * n.x;
+	diffuse += irradiance[4].xyz * (n.x * n.y) + irradiance[5].xyz * (n.y * n.z) + irradiance[7].xyz * (n.x * n.z);
+	diffuse += irradiance[6].xyz * (3.0f * n.z * n.z - 1.0f) + irradiance[8].xyz * (n.x * n.x - n.y * n.y);
+
+	float3 reflection = reflect(-toCamera, n);
+	float3 specular = environmentTexture.SampleLevel(environmentFilter, reflection, ENVIRONMENT_ROUGHNESS * environmentRatios.x).xyz;
+	float fresnel = 0.04f + 0.96f * pow(1.0f - saturate(dot(n, toCamera)), 5);
+
+	return environmentRatios.w * (max(diffuse, 0) * baseColor * environmentRatios.y + specular * fresnel * environmentRatios.z);
+}
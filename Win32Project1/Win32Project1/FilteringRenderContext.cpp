@@ -0,0 +1,307 @@
+#include "FilteringRenderContext.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// Records values as bound in [slot, slot + count) and narrows the range to the slots that
+// changed. False when none did. Ranges past the last slot are left for the target to refuse.
+template <typename T>
+static bool NarrowBindings(T* bound, bool* boundKnown, unsigned int slotCount, unsigned int& slot, unsigned int& count, T const*& values)
+{
+	if (!values || slot + count > slotCount)
+		return true;
+
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		if (boundKnown[slot + i] && bound[slot + i] == values[i])
+			continue;
+		first = min(first, i);
+		last = i;
+		bound[slot + i] = values[i];
+		boundKnown[slot + i] = true;
+	}
+	if (first == count)
+		return false;
+
+	slot += first;
+	values += first;
+	count = last - first + 1;
+	return true;
+}
+
+FilteringRenderContext::FilteringRenderContext()
+{
+	target = nullptr;
+	memset(filteredCounts, 0, sizeof(filteredCounts));
+	indexBuffer = nullptr;
+	indexFormat = DXGI_FORMAT_UNKNOWN;
+	indexOffset = 0;
+	vertexBuffer = nullptr;
+	vertexStride = 0;
+	vertexOffset = 0;
+	layout = nullptr;
+	topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	vertexShader = nullptr;
+	geometryShader = nullptr;
+	pixelShader = nullptr;
+	memset(constantBuffers, 0, sizeof(constantBuffers));
+	memset(shaderResources, 0, sizeof(shaderResources));
+	memset(samplers, 0, sizeof(samplers));
+	blendState = nullptr;
+	rasterizerState = nullptr;
+	renderTarget = nullptr;
+	depthStencil = nullptr;
+	memset(&viewport, 0, sizeof(viewport));
+	Invalidate();
+}
+
+FilteringRenderContext::~FilteringRenderContext()
+{
+}
+
+void FilteringRenderContext::Initialize(RenderContext* target)
+{
+	this->target = target;
+	Invalidate();
+}
+
+void FilteringRenderContext::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	if (Filter(RENDER_SET_INDEX_BUFFER, buffer == indexBuffer && format == indexFormat && offset == indexOffset))
+		return;
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	target->SetIndexBuffer(buffer, format, offset);
+}
+
+void FilteringRenderContext::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	if (Filter(RENDER_SET_VERTEX_BUFFER, buffer == vertexBuffer && stride == vertexStride && offset == vertexOffset))
+		return;
+	vertexBuffer = buffer;
+	vertexStride = stride;
+	vertexOffset = offset;
+	target->SetVertexBuffer(buffer, stride, offset);
+}
+
+void FilteringRenderContext::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Filter(RENDER_SET_INPUT_LAYOUT, layout == this->layout))
+		return;
+	this->layout = layout;
+	target->SetInputLayout(layout);
+}
+
+void FilteringRenderContext::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (Filter(RENDER_SET_PRIMITIVE_TOPOLOGY, topology == this->topology))
+		return;
+	this->topology = topology;
+	target->SetPrimitiveTopology(topology);
+}
+
+void FilteringRenderContext::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Filter(RENDER_SET_VERTEX_SHADER, shader == vertexShader))
+		return;
+	vertexShader = shader;
+	target->SetVertexShader(shader);
+}
+
+void FilteringRenderContext::SetGeometryShader(ID3D11GeometryShader* shader)
+{
+	if (Filter(RENDER_SET_GEOMETRY_SHADER, shader == geometryShader))
+		return;
+	geometryShader = shader;
+	target->SetGeometryShader(shader);
+}
+
+void FilteringRenderContext::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Filter(RENDER_SET_PIXEL_SHADER, shader == pixelShader))
+		return;
+	pixelShader = shader;
+	target->SetPixelShader(shader);
+}
+
+void FilteringRenderContext::SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+	if (!buffers || slot + count > D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+	{
+		target->SetConstantBuffers(stage, slot, count, buffers);
+		return;
+	}
+
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		CONSTANT_BINDING& binding = constantBuffers[stage][slot + i];
+		bool& bindingKnown = constantBuffersKnown[stage][slot + i];
+		if (bindingKnown && binding.buffer == buffers[i] && binding.constantCount == 0)
+			continue;
+		first = min(first, i);
+		last = i;
+		binding.buffer = buffers[i];
+		binding.firstConstant = 0;
+		binding.constantCount = 0;
+		bindingKnown = true;
+	}
+	if (Filter(RENDER_SET_CONSTANT_BUFFERS, first == count))
+		return;
+	target->SetConstantBuffers(stage, slot + first, last - first + 1, buffers + first);
+}
+
+void FilteringRenderContext::SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (slot >= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+	{
+		target->SetConstantBufferRange(stage, slot, buffer, firstConstant, constantCount);
+		return;
+	}
+
+	CONSTANT_BINDING& binding = constantBuffers[stage][slot];
+	bool& bindingKnown = constantBuffersKnown[stage][slot];
+	if (Filter(RENDER_SET_CONSTANT_BUFFER_RANGE, bindingKnown && binding.buffer == buffer && binding.firstConstant == firstConstant && binding.constantCount == constantCount))
+		return;
+	binding.buffer = buffer;
+	binding.firstConstant = firstConstant;
+	binding.constantCount = constantCount;
+	bindingKnown = true;
+	target->SetConstantBufferRange(stage, slot, buffer, firstConstant, constantCount);
+}
+
+void FilteringRenderContext::SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+	if (Filter(RENDER_SET_SHADER_RESOURCES, !NarrowBindings(shaderResources[stage], shaderResourcesKnown[stage], D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, slot, count, views)))
+		return;
+	target->SetShaderResources(stage, slot, count, views);
+}
+
+void FilteringRenderContext::SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (Filter(RENDER_SET_SAMPLERS, !NarrowBindings(this->samplers[stage], samplersKnown[stage], D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, slot, count, samplers)))
+		return;
+	target->SetSamplers(stage, slot, count, samplers);
+}
+
+void FilteringRenderContext::SetBlendState(ID3D11BlendState* state)
+{
+	if (Filter(RENDER_SET_BLEND_STATE, state == blendState))
+		return;
+	blendState = state;
+	target->SetBlendState(state);
+}
+
+void FilteringRenderContext::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (Filter(RENDER_SET_RASTERIZER_STATE, state == rasterizerState))
+		return;
+	rasterizerState = state;
+	target->SetRasterizerState(state);
+}
+
+void FilteringRenderContext::SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	if (Filter(RENDER_SET_RENDER_TARGETS, renderTarget == this->renderTarget && depthStencil == this->depthStencil))
+		return;
+	this->renderTarget = renderTarget;
+	this->depthStencil = depthStencil;
+	target->SetRenderTargets(renderTarget, depthStencil);
+}
+
+void FilteringRenderContext::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	if (Filter(RENDER_SET_VIEWPORT, memcmp(&viewport, &this->viewport, sizeof(viewport)) == 0))
+		return;
+	this->viewport = viewport;
+	target->SetViewport(viewport);
+}
+
+void FilteringRenderContext::ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4])
+{
+	target->ClearRenderTarget(renderTarget, color);
+}
+
+void FilteringRenderContext::ClearDepth(ID3D11DepthStencilView* depthStencil, float depth)
+{
+	target->ClearDepth(depthStencil, depth);
+}
+
+void FilteringRenderContext::WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	target->WriteConstants(buffer, data, size);
+}
+
+void FilteringRenderContext::UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	target->UploadConstants(buffer, offset, data, size);
+}
+
+void FilteringRenderContext::UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	target->UpdateBuffer(buffer, offset, data, size);
+}
+
+void FilteringRenderContext::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	target->Draw(vertexCount, startVertex);
+}
+
+void FilteringRenderContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	target->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void FilteringRenderContext::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	target->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void FilteringRenderContext::Invalidate()
+{
+	memset(known, 0, sizeof(known));
+	memset(constantBuffersKnown, 0, sizeof(constantBuffersKnown));
+	memset(shaderResourcesKnown, 0, sizeof(shaderResourcesKnown));
+	memset(samplersKnown, 0, sizeof(samplersKnown));
+}
+
+void FilteringRenderContext::ResetCounts()
+{
+	memset(filteredCounts, 0, sizeof(filteredCounts));
+}
+
+// Accessors
+unsigned int FilteringRenderContext::GetFilteredCount(RENDER_COMMAND_TYPE type) const
+{
+	return (type < RENDER_COMMAND_COUNT) ? filteredCounts[type] : 0;
+}
+
+unsigned int FilteringRenderContext::GetFilteredCount() const
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < RENDER_COMMAND_COUNT; ++i)
+		total += filteredCounts[i];
+	return total;
+}
+
+// Private Member Functions
+bool FilteringRenderContext::Filter(RENDER_COMMAND_TYPE type, bool unchanged)
+{
+	// The slot calls keep their own flags; for the rest one flag covers the whole call
+	bool slotCall = type == RENDER_SET_CONSTANT_BUFFERS || type == RENDER_SET_CONSTANT_BUFFER_RANGE ||
+		type == RENDER_SET_SHADER_RESOURCES || type == RENDER_SET_SAMPLERS;
+	if (!slotCall)
+	{
+		unchanged = unchanged && known[type];
+		known[type] = true;
+	}
+
+	if (unchanged)
+		++filteredCounts[type];
+	return unchanged;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "RenderContext.h"
+
+// Keeps a copy of the state bound through it and drops the calls that would bind what is
+// already there, before they reach the RenderContext behind it. Everything else goes
+// straight through.
+//
+// Nothing is known to be bound to begin with, so the first call for each piece of state
+// always goes through. Calls that bind several slots at once go through with only the
+// slots that changed. Whoever binds state on the device context directly has to call
+// Invalidate afterwards, and so does binding a texture as a render target that is also
+// bound as a shader resource, since Direct3D unbinds the resource without saying so.
+class FilteringRenderContext : public RenderContext
+{
+public:
+	FilteringRenderContext();
+	~FilteringRenderContext();
+
+	void Initialize(RenderContext* target);
+
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetGeometryShader(ID3D11GeometryShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers);
+	void SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+	void ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* depthStencil, float depth);
+	void WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size);
+	void UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	// Forgets everything bound, so the next call for each piece of state goes through
+	void Invalidate();
+	void ResetCounts();
+
+	// Accessors
+	// Calls of one type dropped since ResetCounts
+	unsigned int GetFilteredCount(RENDER_COMMAND_TYPE type) const;
+	unsigned int GetFilteredCount() const;
+
+private:
+
+	struct CONSTANT_BINDING
+	{
+		ID3D11Buffer* buffer;
+		unsigned int firstConstant;
+		unsigned int constantCount; // 0 for the whole buffer
+	};
+
+	RenderContext* target;
+	unsigned int filteredCounts[RENDER_COMMAND_COUNT];
+
+	// What the target has bound, where the matching known flag is set
+	bool known[RENDER_COMMAND_COUNT];
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	unsigned int indexOffset;
+	ID3D11Buffer* vertexBuffer;
+	unsigned int vertexStride;
+	unsigned int vertexOffset;
+	ID3D11InputLayout* layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	ID3D11VertexShader* vertexShader;
+	ID3D11GeometryShader* geometryShader;
+	ID3D11PixelShader* pixelShader;
+	CONSTANT_BINDING constantBuffers[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	bool constantBuffersKnown[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	ID3D11ShaderResourceView* shaderResources[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	bool shaderResourcesKnown[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	ID3D11SamplerState* samplers[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	bool samplersKnown[RENDER_STAGE_COUNT][D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	ID3D11BlendState* blendState;
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11RenderTargetView* renderTarget;
+	ID3D11DepthStencilView* depthStencil;
+	D3D11_VIEWPORT viewport;
+
+	// True when the call would change nothing, and counts it as filtered
+	bool Filter(RENDER_COMMAND_TYPE type, bool unchanged);
+};
@@ -0,0 +1,185 @@
+#include "FrustumCuller.h"
+#include <xmmintrin.h>
+#include <algorithm>
+
+FrustumCuller::FrustumCuller()
+{
+	count = 0;
+	viewCount = 0;
+	memset(planes, 0, sizeof(planes));
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
+
+unsigned int FrustumCuller::Add(const XMFLOAT3& center, float radius)
+{
+	unsigned int index = count++;
+	unsigned int padded = (count + 3) & ~3u;
+	centerX.resize(padded, 0.0f);
+	centerY.resize(padded, 0.0f);
+	centerZ.resize(padded, 0.0f);
+	this->radius.resize(padded, 0.0f);
+	visibleViews.resize(count, 0);
+	SetSphere(index, center, radius);
+	return index;
+}
+
+void FrustumCuller::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+	visibleViews.clear();
+	for (unsigned int i = 0; i < FRUSTUM_CULLER_MAX_VIEWS; ++i)
+		visible[i].clear();
+	count = 0;
+}
+
+void FrustumCuller::SetViewCount(unsigned int viewCount)
+{
+	this->viewCount = min(viewCount, (unsigned int)FRUSTUM_CULLER_MAX_VIEWS);
+}
+
+void FrustumCuller::SetView(unsigned int view, const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT])
+{
+	if (view >= FRUSTUM_CULLER_MAX_VIEWS)
+		return;
+	for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT; ++plane)
+	{
+		this->planes[view][plane][0] = planes[plane].x;
+		this->planes[view][plane][1] = planes[plane].y;
+		this->planes[view][plane][2] = planes[plane].z;
+		this->planes[view][plane][3] = planes[plane].w;
+	}
+}
+
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProjectionMatrix, XMFLOAT4 planes[FRUSTUM_PLANE_COUNT])
+{
+	// A point is inside when each clip coordinate is within w, and z above 0. With row
+	// vectors each clip coordinate is the point dotted with a column of the matrix.
+	XMMATRIX columns = XMMatrixTranspose(viewProjectionMatrix);
+	XMVECTOR viewPlanes[FRUSTUM_PLANE_COUNT] =
+	{
+		columns.r[3] + columns.r[0], // Left
+		columns.r[3] - columns.r[0], // Right
+		columns.r[3] + columns.r[1], // Bottom
+		columns.r[3] - columns.r[1], // Top
+		columns.r[2], // Near
+		columns.r[3] - columns.r[2], // Far
+	};
+	for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT; ++plane)
+		XMStoreFloat4(&planes[plane], XMPlaneNormalize(viewPlanes[plane]));
+}
+
+void FrustumCuller::Cull()
+{
+	for (unsigned int view = 0; view < FRUSTUM_CULLER_MAX_VIEWS; ++view)
+		visible[view].clear();
+
+	// Splatted once a frame, on the stack where they are sure to be aligned
+	__m128 splatted[FRUSTUM_CULLER_MAX_VIEWS][FRUSTUM_PLANE_COUNT][4];
+	for (unsigned int view = 0; view < viewCount; ++view)
+	{
+		for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT; ++plane)
+		{
+			for (unsigned int component = 0; component < 4; ++component)
+				splatted[view][plane][component] = _mm_set1_ps(planes[view][plane][component]);
+		}
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (unsigned int first = 0; first < count; first += 4)
+	{
+		__m128 x = _mm_loadu_ps(&centerX[first]);
+		__m128 y = _mm_loadu_ps(&centerY[first]);
+		__m128 z = _mm_loadu_ps(&centerZ[first]);
+		__m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&radius[first]));
+		unsigned int spheres = min(count - first, 4u);
+		unsigned int inRange = (1u << spheres) - 1;
+
+		uint8_t views[4] = { 0, 0, 0, 0 };
+		for (unsigned int view = 0; view < viewCount; ++view)
+		{
+			// Outside as soon as the center is further than the radius behind any plane
+			__m128 outside = zero;
+			for (unsigned int plane = 0; plane < FRUSTUM_PLANE_COUNT; ++plane)
+			{
+				const __m128* p = splatted[view][plane];
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, p[0]), _mm_mul_ps(y, p[1])), _mm_add_ps(_mm_mul_ps(z, p[2]), p[3]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+			}
+
+			unsigned int inside = ~(unsigned int)_mm_movemask_ps(outside) & inRange;
+			for (unsigned int i = 0; i < spheres; ++i)
+			{
+				if (inside & (1u << i))
+				{
+					visible[view].push_back(first + i);
+					views[i] |= (uint8_t)(1u << view);
+				}
+			}
+		}
+		for (unsigned int i = 0; i < spheres; ++i)
+			visibleViews[first + i] = views[i];
+	}
+}
+
+// Accessors
+unsigned int FrustumCuller::GetCount() const
+{
+	return count;
+}
+
+unsigned int FrustumCuller::GetViewCount() const
+{
+	return viewCount;
+}
+
+bool FrustumCuller::IsVisible(unsigned int view, unsigned int index) const
+{
+	return index < count && view < FRUSTUM_CULLER_MAX_VIEWS && (visibleViews[index] & (1u << view)) != 0;
+}
+
+XMFLOAT4 FrustumCuller::GetSphere(unsigned int index) const
+{
+	if (index >= count)
+		return XMFLOAT4(0, 0, 0, 0);
+	return XMFLOAT4(centerX[index], centerY[index], centerZ[index], radius[index]);
+}
+
+const vector<unsigned int>& FrustumCuller::GetVisible(unsigned int view) const
+{
+	return visible[min(view, (unsigned int)FRUSTUM_CULLER_MAX_VIEWS - 1)];
+}
+
+// Mutators
+void FrustumCuller::SetSphere(unsigned int index, const XMFLOAT3& center, float radius)
+{
+	if (index >= count)
+		return;
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	this->radius[index] = radius;
+}
+
+void FrustumCuller::SetSphere(unsigned int index, FXMMATRIX worldMatrix, float radius)
+{
+	float scale = max(max(XMVectorGetX(XMVector3Length(worldMatrix.r[0])), XMVectorGetX(XMVector3Length(worldMatrix.r[1]))), XMVectorGetX(XMVector3Length(worldMatrix.r[2])));
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, worldMatrix.r[3]);
+	SetSphere(index, center, radius * scale);
+}
+
+void FrustumCuller::Hide(unsigned int view, unsigned int index)
+{
+	if (!IsVisible(view, index))
+		return;
+	visibleViews[index] &= ~(1u << view);
+	// The list is in index order
+	vector<unsigned int>::iterator found = lower_bound(visible[view].begin(), visible[view].end(), index);
+	visible[view].erase(found);
+}
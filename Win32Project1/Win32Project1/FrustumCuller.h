@@ -0,0 +1,65 @@
+#pragma once
+#include "defines.h"
+
+#define FRUSTUM_CULLER_MAX_VIEWS 4
+#define FRUSTUM_PLANE_COUNT 6
+
+// Tests bounding spheres against the frustums of several views at once. The spheres are
+// kept one array per component, so Cull loads four of them into SSE registers at a time
+// and tests them against every plane of every view before moving on; each sphere is read
+// once a frame however many views there are.
+//
+// A sphere is kept in a view unless it is wholly behind one of the view's planes, so a few
+// spheres near the corners of a frustum are kept that a box test would drop.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	~FrustumCuller();
+
+	// Adds a sphere and returns the index Cull reports it by
+	unsigned int Add(const XMFLOAT3& center, float radius);
+	void Clear();
+
+	// Views past FRUSTUM_CULLER_MAX_VIEWS are ignored
+	void SetViewCount(unsigned int viewCount);
+	// Planes as ExtractPlanes gives them
+	void SetView(unsigned int view, const XMFLOAT4 planes[FRUSTUM_PLANE_COUNT]);
+	// The planes of the frustum a view-projection matrix sees, normalized and facing inwards:
+	// left, right, bottom, top, near, far
+	static void ExtractPlanes(FXMMATRIX viewProjectionMatrix, XMFLOAT4 planes[FRUSTUM_PLANE_COUNT]);
+
+	// Fills the visible list of every view
+	void Cull();
+
+	// Accessors
+	unsigned int GetCount() const;
+	unsigned int GetViewCount() const;
+	bool IsVisible(unsigned int view, unsigned int index) const;
+	// Center in xyz, radius in w
+	XMFLOAT4 GetSphere(unsigned int index) const;
+	// Indices of the spheres in a view, in the order they were added
+	const vector<unsigned int>& GetVisible(unsigned int view) const;
+
+	// Mutators
+	void SetSphere(unsigned int index, const XMFLOAT3& center, float radius);
+	// Centers the sphere on the matrix's translation and scales the radius by its largest axis
+	void SetSphere(unsigned int index, FXMMATRIX worldMatrix, float radius);
+	// Takes a sphere out of a view until the next Cull, for tests finer than the frustum's
+	void Hide(unsigned int view, unsigned int index);
+
+private:
+
+	// Padded to a multiple of four with empty spheres at the origin
+	vector<float> centerX;
+	vector<float> centerY;
+	vector<float> centerZ;
+	vector<float> radius;
+	unsigned int count;
+
+	// Normalized, facing into the frustum: a, b, c, d
+	float planes[FRUSTUM_CULLER_MAX_VIEWS][FRUSTUM_PLANE_COUNT][4];
+	unsigned int viewCount;
+	vector<unsigned int> visible[FRUSTUM_CULLER_MAX_VIEWS];
+	vector<uint8_t> visibleViews; // One bit per view for each sphere
+};
@@ -0,0 +1,49 @@
+#pragma pack_matrix(row_major)
+
+struct V_IN
+{
+	float4 posL : POSITION;
+	float4 uvsIn : TEXTPOS;
+	float4 nrmIn : NORMALS;
+};
+
+struct V_OUT
+{
+	float4 posH : SV_POSITION;
+	float4 uvsOut : TEXTPOS;
+	float4 nrmOut : NORMALS;
+	float4 posW : POSITION;
+};
+
+// The object constants of every draw the queue merged, in the order it merged them.
+// DRAW_QUEUE_INSTANCE_BUFFER_SIZE bytes.
+cbuffer OBJECTS : register( b0 )
+{
+	float4x4 worldMatrices[64];
+}
+
+cbuffer SCENE  : register( b1 )
+{
+	float4x4 viewMatrix;
+	float4x4 projectionMatrix;
+}
+
+V_OUT main( V_IN input, unsigned int instID : SV_InstanceID )
+{
+	V_OUT output = (V_OUT)0;
+	// ensures translation is preserved during matrix multiply  
+	float4 localH = float4(input.posL); 
+	// move local space vertex from vertex buffer into world space.
+	localH = mul(localH, worldMatrices[instID]);
+	output.posW = localH;
+
+	// Move into view space, then projection space
+	localH = mul(localH, viewMatrix);
+	localH = mul(localH, projectionMatrix);
+
+	output.posH = localH;
+	output.uvsOut = input.uvsIn;
+	output.nrmOut = mul(float4(input.nrmIn.xyz, 0), worldMatrices[instID]);
+
+	return output; // send projected vertex to the rasterizer stage
+}
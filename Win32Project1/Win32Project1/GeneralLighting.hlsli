@@ -0,0 +1,71 @@
+#include "EnvironmentLighting.hlsli"
+
+struct P_IN
+{
+	float4 posH : SV_POSITION;
+	float4 uvsOut : TEXTPOS;
+	float4 nrmOut : NORMALS;
+	float4 posW : POSITION;
+};
+
+cbuffer LIGHT : register(b0)
+{
+	float4 position;
+	float4 direction;
+	float4 ratios; // Inner, outer, radius, on or off
+	float3 color;
+	float padding;
+}
+
+// Directional, point and spot lighting shared by every pixel shader that draws with the
+// general vertex layout; only how the base color is fetched differs between them
+float4 ApplyLighting(P_IN input, float4 baseColor)
+{
+	// Directional Lighting
+	float4 lightDir = { 1, 0.5f, -0.5f, 0.5f };
+	float3 lightDirColor = { 1, 1, 1 };
+	float lightDirRatio = saturate(dot(lightDir, normalize(input.nrmOut)));
+	float3 lightDirFinalColor = lightDirRatio * lightDirColor * baseColor.xyz;
+
+	// Point Lighting
+	float3 pointLightPos = { -1, 0, 0 };
+	float pointLightRadius = 20.0f;
+	float3 pointLightDir = normalize(pointLightPos - input.posW.xyz);
+	float pointLightDirRatio = saturate(dot(pointLightDir, normalize(input.nrmOut.xyz)));
+	float3 pointLightDirColor = { 1, 0, 0 };
+	float pointLightDirAttenuation = 1.0f - saturate(length(pointLightPos - input.posW.xyz) / pointLightRadius);
+	float3 pointLightDirFinalColor = pointLightDirRatio * pointLightDirColor * pointLightDirAttenuation * baseColor.xyz;
+	float3 toPointLight = normalize(pointLightPos - input.posW.xyz);
+	float3 toCamera = normalize(position.xyz - input.posW.xyz);
+	float3 pointLightReflection = normalize(reflect(-toPointLight, normalize(input.nrmOut.xyz)));
+	float  pointLightSpecRatio = pow(dot(pointLightReflection, toCamera), 256);
+	float3 pointLightSpecColor = pointLightDirFinalColor * pointLightSpecRatio * 1.0f;
+
+	// Spotlight
+	float3 spotlightPos = position.xyz;
+	float3 spotlightColor = color;
+	float3 spotlightDir = normalize(spotlightPos - input.posW.xyz);
+	float3 coneDir = direction.xyz;
+	float coneRatio = ratios.y;
+	float spotlightRadius = ratios.z;
+	float surfaceRatio = saturate(dot(-spotlightDir, coneDir));
+	float spotFactor = (surfaceRatio > coneRatio) ? 1 : 0;
+	float spotlightRatio = saturate(dot(spotlightDir, normalize(input.nrmOut.xyz)));
+	
+	float spotlightDirAttenuation = 1.0f - saturate((ratios.x - surfaceRatio) / (ratios.x - ratios.y));
+	float3 spotlightFinalColor = spotFactor * spotlightRatio * spotlightColor * spotlightDirAttenuation * baseColor.xyz;
+	float3 toSpotlight = normalize(spotlightPos - input.posW.xyz);
+	float3 spotlightReflection = normalize(reflect(-toSpotlight, normalize(input.nrmOut.xyz)));
+	float spotlightSpecRatio = pow(dot(spotlightReflection, toCamera), 256);
+	float3 spotlightSpecColor = spotlightFinalColor * spotlightSpecRatio * 1.0f;
+
+	float3 lightColor = lightDirFinalColor;
+	lightColor += pointLightDirFinalColor + pointLightSpecColor;
+	if (ratios.w == 1)
+		lightColor += spotlightFinalColor + spotlightSpecColor;
+	lightColor += ApplyEnvironmentLighting(input.nrmOut.xyz, toCamera, baseColor.xyz);
+
+	float4 returnColor = saturate(float4(lightColor, baseColor.a));
+
+	return returnColor;
+}
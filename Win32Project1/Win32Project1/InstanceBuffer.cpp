@@ -0,0 +1,238 @@
+#include "InstanceBuffer.h"
+#include <algorithm>
+#include <float.h>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+InstanceBuffer::InstanceBuffer()
+{
+	device = nullptr;
+	buffer = nullptr;
+	shaderResourceView = nullptr;
+	count = 0;
+	capacity = 0;
+	uploadedInstances = 0;
+	uploadCallCount = 0;
+	boundingSphere = XMFLOAT4(0, 0, 0, 0);
+	boundingSphereMeshRadius = 0;
+	boundingSphereValid = false;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	Release();
+}
+
+bool InstanceBuffer::Resize(ID3D11Device* device, unsigned int count)
+{
+	positionX.resize(count, 0.0f);
+	positionY.resize(count, 0.0f);
+	positionZ.resize(count, 0.0f);
+	scale.resize(count, 1.0f);
+	rotationX.resize(count, 0.0f);
+	rotationY.resize(count, 0.0f);
+	rotationZ.resize(count, 0.0f);
+	rotationW.resize(count, 1.0f);
+	if (count > this->count)
+		MarkDirty(this->count, count);
+	this->count = count;
+	boundingSphereValid = false;
+	this->device = device;
+
+	if (!device || count <= capacity)
+		return true;
+
+	// Grown by half again so that adding a few instances at a time does not make a buffer each time
+	unsigned int newCapacity = max(count, capacity + capacity / 2);
+	SAFE_RELEASE(shaderResourceView);
+	SAFE_RELEASE(buffer);
+	capacity = 0;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(INSTANCE_DATA);
+	bufferDesc.ByteWidth = sizeof(INSTANCE_DATA) * newCapacity;
+	HRESULT result = device->CreateBuffer(&bufferDesc, NULL, &buffer);
+	if (FAILED(result))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = newCapacity;
+	result = device->CreateShaderResourceView(buffer, &viewDesc, &shaderResourceView);
+	if (FAILED(result))
+	{
+		SAFE_RELEASE(buffer);
+		return false;
+	}
+
+	// The new buffer holds nothing yet
+	capacity = newCapacity;
+	dirtyRanges.clear();
+	MarkDirty(0, count);
+	return true;
+}
+
+void InstanceBuffer::Upload(RenderContext* renderContext)
+{
+	uploadedInstances = 0;
+	uploadCallCount = 0;
+	// Kept for when a Resize manages to make the buffer
+	if (dirtyRanges.empty() || (device && !buffer))
+		return;
+
+	sort(dirtyRanges.begin(), dirtyRanges.end());
+	unsigned int range = 0;
+	while (range < dirtyRanges.size())
+	{
+		unsigned int first = dirtyRanges[range].first;
+		unsigned int last = dirtyRanges[range].second;
+		for (++range; range < dirtyRanges.size() && dirtyRanges[range].first <= last + INSTANCE_BUFFER_MERGE_GAP; ++range)
+			last = max(last, dirtyRanges[range].second);
+		last = min(last, count);
+		if (first >= last)
+			continue;
+
+		staging.resize(last - first);
+		for (unsigned int i = first; i < last; ++i)
+		{
+			INSTANCE_DATA& instance = staging[i - first];
+			instance.positionScale = XMFLOAT4(positionX[i], positionY[i], positionZ[i], scale[i]);
+			instance.rotation = XMFLOAT4(rotationX[i], rotationY[i], rotationZ[i], rotationW[i]);
+		}
+		renderContext->UpdateBuffer(buffer, first * sizeof(INSTANCE_DATA), &staging[0], (last - first) * sizeof(INSTANCE_DATA));
+		uploadedInstances += last - first;
+		++uploadCallCount;
+	}
+	dirtyRanges.clear();
+}
+
+void InstanceBuffer::Release()
+{
+	SAFE_RELEASE(shaderResourceView);
+	SAFE_RELEASE(buffer);
+	capacity = 0;
+}
+
+// Accessors
+unsigned int InstanceBuffer::GetCount() const
+{
+	return count;
+}
+
+XMMATRIX InstanceBuffer::GetWorldMatrix(unsigned int index) const
+{
+	XMVECTOR rotation = XMVectorSet(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+	XMVECTOR position = XMVectorSet(positionX[index], positionY[index], positionZ[index], 1.0f);
+	return XMMatrixScaling(scale[index], scale[index], scale[index]) * XMMatrixRotationQuaternion(rotation) * XMMatrixTranslationFromVector(position);
+}
+
+XMFLOAT4 InstanceBuffer::GetBoundingSphere(float meshRadius)
+{
+	if (boundingSphereValid && meshRadius == boundingSphereMeshRadius)
+		return boundingSphere;
+
+	// Around the box that holds every instance's own sphere
+	float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		float instanceRadius = meshRadius * scale[i];
+		minimum[0] = min(minimum[0], positionX[i] - instanceRadius);
+		minimum[1] = min(minimum[1], positionY[i] - instanceRadius);
+		minimum[2] = min(minimum[2], positionZ[i] - instanceRadius);
+		maximum[0] = max(maximum[0], positionX[i] + instanceRadius);
+		maximum[1] = max(maximum[1], positionY[i] + instanceRadius);
+		maximum[2] = max(maximum[2], positionZ[i] + instanceRadius);
+	}
+
+	boundingSphere = XMFLOAT4(0, 0, 0, 0);
+	if (count > 0)
+	{
+		float halfX = (maximum[0] - minimum[0]) * 0.5f;
+		float halfY = (maximum[1] - minimum[1]) * 0.5f;
+		float halfZ = (maximum[2] - minimum[2]) * 0.5f;
+		boundingSphere = XMFLOAT4(minimum[0] + halfX, minimum[1] + halfY, minimum[2] + halfZ, sqrtf(halfX * halfX + halfY * halfY + halfZ * halfZ));
+	}
+	boundingSphereMeshRadius = meshRadius;
+	boundingSphereValid = true;
+	return boundingSphere;
+}
+
+ID3D11ShaderResourceView* InstanceBuffer::GetShaderResourceView() const
+{
+	return shaderResourceView;
+}
+
+unsigned int InstanceBuffer::GetUploadedInstances() const
+{
+	return uploadedInstances;
+}
+
+unsigned int InstanceBuffer::GetUploadCallCount() const
+{
+	return uploadCallCount;
+}
+
+// Mutators
+void InstanceBuffer::SetTransform(unsigned int index, const XMFLOAT3& position, const XMFLOAT4& rotation, float scale)
+{
+	if (index >= count)
+		return;
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	this->scale[index] = scale;
+	rotationX[index] = rotation.x;
+	rotationY[index] = rotation.y;
+	rotationZ[index] = rotation.z;
+	rotationW[index] = rotation.w;
+	MarkDirty(index, index + 1);
+}
+
+void InstanceBuffer::SetPosition(unsigned int index, const XMFLOAT3& position)
+{
+	if (index >= count)
+		return;
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	MarkDirty(index, index + 1);
+}
+
+void InstanceBuffer::SetPositions(unsigned int first, unsigned int count, const float* x, const float* y, const float* z)
+{
+	if (first >= this->count)
+		return;
+	count = min(count, this->count - first);
+	memcpy(&positionX[first], x, count * sizeof(float));
+	memcpy(&positionY[first], y, count * sizeof(float));
+	memcpy(&positionZ[first], z, count * sizeof(float));
+	MarkDirty(first, first + count);
+}
+
+// Private Member Functions
+// Grows the last range when the new one touches it, which is what setting instances one
+// after another does; anything else is sorted out by Upload
+void InstanceBuffer::MarkDirty(unsigned int first, unsigned int last)
+{
+	if (first >= last)
+		return;
+	boundingSphereValid = false;
+
+	if (!dirtyRanges.empty())
+	{
+		pair<unsigned int, unsigned int>& previous = dirtyRanges.back();
+		if (first <= previous.second && last >= previous.first)
+		{
+			previous.first = min(previous.first, first);
+			previous.second = max(previous.second, last);
+			return;
+		}
+	}
+	dirtyRanges.push_back(make_pair(first, last));
+}
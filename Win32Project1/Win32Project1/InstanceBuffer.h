@@ -0,0 +1,79 @@
+#pragma once
+#include "defines.h"
+#include "RenderContext.h"
+
+#define INSTANCE_BUFFER_MERGE_GAP 64 // Unchanged instances between two changed ranges that are sent anyway, to save a call
+
+// One instance as the vertex shader reads it. Matches INSTANCE in InstancingVertexShader.hlsl.
+struct INSTANCE_DATA
+{
+	XMFLOAT4 positionScale; // Position in xyz, uniform scale in w
+	XMFLOAT4 rotation; // Quaternion
+};
+
+// The transforms of any number of copies of one mesh. On the CPU each component has an
+// array of its own, so code that moves every instance touches only the components it
+// changes. On the GPU they are a structured buffer of INSTANCE_DATA that the vertex shader
+// indexes with SV_InstanceID.
+//
+// Changes are tracked as ranges of instances and only those ranges are packed and sent by
+// Upload, one UpdateBuffer call each. Ranges closer together than INSTANCE_BUFFER_MERGE_GAP
+// go in one call. Without a device nothing is created and the ranges only go to the render
+// context.
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	// Room for count instances. Instances already set keep their transforms and new ones
+	// start at the origin, unrotated and unscaled. False if the buffer could not be created.
+	bool Resize(ID3D11Device* device, unsigned int count);
+
+	// Sends the instances changed since the last Upload
+	void Upload(RenderContext* renderContext);
+
+	void Release();
+
+	// Accessors
+	unsigned int GetCount() const;
+	XMMATRIX GetWorldMatrix(unsigned int index) const;
+	// A sphere holding every instance of a mesh of the given radius: center in xyz, radius in
+	// w. Worked out again only after instances change.
+	XMFLOAT4 GetBoundingSphere(float meshRadius);
+	ID3D11ShaderResourceView* GetShaderResourceView() const;
+	// What the last Upload sent
+	unsigned int GetUploadedInstances() const;
+	unsigned int GetUploadCallCount() const;
+
+	// Mutators
+	void SetTransform(unsigned int index, const XMFLOAT3& position, const XMFLOAT4& rotation, float scale);
+	void SetPosition(unsigned int index, const XMFLOAT3& position);
+	// Positions of count instances from first on, one array per axis
+	void SetPositions(unsigned int first, unsigned int count, const float* x, const float* y, const float* z);
+
+private:
+
+	ID3D11Device* device;
+	ID3D11Buffer* buffer;
+	ID3D11ShaderResourceView* shaderResourceView;
+	unsigned int count;
+	unsigned int capacity; // Instances the buffer has room for
+	vector<float> positionX;
+	vector<float> positionY;
+	vector<float> positionZ;
+	vector<float> scale;
+	vector<float> rotationX;
+	vector<float> rotationY;
+	vector<float> rotationZ;
+	vector<float> rotationW;
+	vector<pair<unsigned int, unsigned int> > dirtyRanges; // [first, last) instance
+	vector<INSTANCE_DATA> staging;
+	XMFLOAT4 boundingSphere;
+	float boundingSphereMeshRadius;
+	bool boundingSphereValid;
+	unsigned int uploadedInstances;
+	unsigned int uploadCallCount;
+
+	void MarkDirty(unsigned int first, unsigned int last);
+};
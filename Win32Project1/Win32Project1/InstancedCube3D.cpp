@@ -1,17 +1,27 @@
 #include "InstancedCube3D.h"
 #include "InstancingVertexShader.csh"
 #include "GeneralPixelShader.csh"
+#include "PackedPixelShader.csh"
 #include "DDSTextureLoader.h"
 
 #define NUMVERTICIES 24
 #define NUMINDICIES 36
+#define NUMINSTANCES 6
 
 #define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
 
 InstancedCube3D::InstancedCube3D()
 {
-	worldMatrix[0] = XMMatrixIdentity();
+	buffer = nullptr;
+	indexBuffer = nullptr;
+	numIndicies = 0;
+	vertexShader = nullptr;
+	pixelShader = nullptr;
+	layout = nullptr;
+	shaderResourceView = nullptr;
+	sampler = nullptr;
 	verticies = new Vertex[NUMVERTICIES];
+	boundingRadius = 0;
 }
 
 
@@ -29,11 +39,17 @@ InstancedCube3D::~InstancedCube3D()
 
 void InstancedCube3D::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename)
 {
+	instances.Resize(device, NUMINSTANCES);
 	SetWorldMatrix(&XMMatrixTranslation(initX, initY, initZ));
 	numIndicies = NUMINDICIES;
 	CreateVerticies();
+	boundingRadius = BoundingRadius(verticies, NUMVERTICIES);
 
-	HRESULT result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
+	// A null filename means the texture is supplied later through SetShaderResourceView
+	HRESULT result = S_OK;
+	shaderResourceView = nullptr;
+	if (filename)
+		result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
 
 	D3D11_BUFFER_DESC bufferDesc = {};
 	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -59,13 +75,12 @@ void InstancedCube3D::Initialize(ID3D11Device* device, float initX, float initY,
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
 
 	result = device->CreateInputLayout(inputLayout, 3, InstancingVertexShader, sizeof(InstancingVertexShader), &layout);
 
-	toObject.worldMatrix[0] = worldMatrix[0];
-
 	unsigned int tempIndicies[NUMINDICIES] =
 	{
 		0, 1, 2, 1, 3, 2,
@@ -87,31 +102,39 @@ void InstancedCube3D::Initialize(ID3D11Device* device, float initX, float initY,
 	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
 }
 
-void InstancedCube3D::Run(ID3D11DeviceContext* deviceContext)
+void InstancedCube3D::Upload(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);	
-	deviceContext->PSSetShaderResources(0, 1, &shaderResourceView);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->DrawIndexedInstanced(numIndicies, 6, 0, 0, 0);
+	instances.Upload(renderContext);
+}
+
+void InstancedCube3D::Run(RenderContext* renderContext)
+{
+	if (instances.GetCount() == 0)
+		return;
+
+	ID3D11ShaderResourceView* instanceView = instances.GetShaderResourceView();
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetGeometryShader(nullptr);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	renderContext->SetShaderResources(RENDER_STAGE_VERTEX, 0, 1, &instanceView);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 1, &shaderResourceView);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	renderContext->DrawIndexedInstanced(numIndicies, instances.GetCount(), 0, 0, 0);
 }
 
 void InstancedCube3D::Translate(float offsetX, float offsetY, float offsetZ)
 {
-	worldMatrix[0] = XMMatrixTranslation(offsetX, offsetY, offsetZ);
+	instances.SetTransform(0, XMFLOAT3(offsetX, offsetY, offsetZ), XMFLOAT4(0, 0, 0, 1), 1);
 }
 
 XMMATRIX InstancedCube3D::GetWorldMatrix(const unsigned int index)
 {
-	return worldMatrix[index];
+	return instances.GetWorldMatrix(index);
 }
 
 ID3D11Buffer* InstancedCube3D::GetBuffer() const
@@ -149,14 +172,78 @@ ID3D11SamplerState* InstancedCube3D::GetSampler() const
 	return sampler;
 }
 
+unsigned int InstancedCube3D::GetInstanceCount() const
+{
+	return instances.GetCount();
+}
+
+InstanceBuffer& InstancedCube3D::GetInstances()
+{
+	return instances;
+}
+
+XMFLOAT4 InstancedCube3D::GetBoundingSphere()
+{
+	return instances.GetBoundingSphere(boundingRadius);
+}
+
+// Places the first six instances: the first at the matrix, the rest one step out along each axis
 void InstancedCube3D::SetWorldMatrix(const XMMATRIX* matrix)
 {
-	worldMatrix[0] = *matrix;
-	worldMatrix[1] = XMMatrixTranslation(matrix->r[3].m128_f32[0] + 2, matrix->r[3].m128_f32[1], matrix->r[3].m128_f32[2]);
-	worldMatrix[2] = XMMatrixTranslation(matrix->r[3].m128_f32[0], matrix->r[3].m128_f32[1] + 2, matrix->r[3].m128_f32[2]);
-	worldMatrix[3] = XMMatrixTranslation(matrix->r[3].m128_f32[0], matrix->r[3].m128_f32[1], matrix->r[3].m128_f32[2] + 2);
-	worldMatrix[4] = XMMatrixTranslation(matrix->r[3].m128_f32[0] - 2, matrix->r[3].m128_f32[1], matrix->r[3].m128_f32[2]);
-	worldMatrix[5] = XMMatrixTranslation(matrix->r[3].m128_f32[0], matrix->r[3].m128_f32[1], matrix->r[3].m128_f32[2] - 2);
+	XMVECTOR scale, rotation, translation;
+	XMMatrixDecompose(&scale, &rotation, &translation, *matrix);
+	XMFLOAT4 instanceRotation;
+	XMStoreFloat4(&instanceRotation, rotation);
+	float x = matrix->r[3].m128_f32[0];
+	float y = matrix->r[3].m128_f32[1];
+	float z = matrix->r[3].m128_f32[2];
+
+	instances.SetTransform(0, XMFLOAT3(x, y, z), instanceRotation, XMVectorGetX(scale));
+	XMFLOAT4 unrotated(0, 0, 0, 1);
+	instances.SetTransform(1, XMFLOAT3(x + 2, y, z), unrotated, 1);
+	instances.SetTransform(2, XMFLOAT3(x, y + 2, z), unrotated, 1);
+	instances.SetTransform(3, XMFLOAT3(x, y, z + 2), unrotated, 1);
+	instances.SetTransform(4, XMFLOAT3(x - 2, y, z), unrotated, 1);
+	instances.SetTransform(5, XMFLOAT3(x, y, z - 2), unrotated, 1);
+}
+
+void InstancedCube3D::SetShaderResourceView(ID3D11ShaderResourceView* view)
+{
+	if (view == shaderResourceView)
+		return;
+
+	if (view)
+		view->AddRef();
+	SAFE_RELEASE(shaderResourceView);
+	shaderResourceView = view;
+}
+
+bool InstancedCube3D::SetInstanceCount(ID3D11Device* device, unsigned int count)
+{
+	return instances.Resize(device, count);
+}
+
+bool InstancedCube3D::UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement)
+{
+	if (!ApplyTexturePlacement(verticies, NUMVERTICIES, placement))
+		return false;
+
+	SAFE_RELEASE(buffer);
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = sizeof(Vertex)* NUMVERTICIES;
+
+	D3D11_SUBRESOURCE_DATA subresourceDesc;
+	subresourceDesc.pSysMem = verticies;
+
+	HRESULT result = device->CreateBuffer(&bufferDesc, &subresourceDesc, &buffer);
+
+	SAFE_RELEASE(pixelShader);
+	result = device->CreatePixelShader(PackedPixelShader, sizeof(PackedPixelShader), NULL, &pixelShader);
+
+	SetShaderResourceView(page);
+	return true;
 }
 
 // Private Member Functions
@@ -1,6 +1,11 @@
 #pragma once
 #include "defines.h"
+#include "RenderContext.h"
+#include "InstanceBuffer.h"
+#include "TexturePacker.h"
 
+// Draws any number of copies of a cube in one call. Initialize makes six, arranged around
+// the world matrix; SetInstanceCount and the instance transforms take it from there.
 class InstancedCube3D
 {
 public:
@@ -9,7 +14,10 @@ public:
 
 	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	// Sends the instances changed since the last call. Once a frame, before Run.
+	void Upload(RenderContext* renderContext);
+
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -23,14 +31,23 @@ public:
 	ID3D11InputLayout* GetLayout() const;
 	ID3D11ShaderResourceView* GetShaderResourceView() const;
 	ID3D11SamplerState* GetSampler() const;
+	unsigned int GetInstanceCount() const;
+	InstanceBuffer& GetInstances();
+	// A sphere holding every instance: center in xyz, radius in w
+	XMFLOAT4 GetBoundingSphere();
 
 	// Mutators
 
 	void SetWorldMatrix(const XMMATRIX* matrix);
+	void SetShaderResourceView(ID3D11ShaderResourceView* view);
+	// New instances start at the origin. False if there was no room for them.
+	bool SetInstanceCount(ID3D11Device* device, unsigned int count);
+	// Draws with a page from the TexturePacker from now on. Call once, after Initialize.
+	bool UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement);
 
 private:
 
-	XMMATRIX worldMatrix[6];
+	InstanceBuffer instances;
 	ID3D11Buffer* buffer;
 	ID3D11Buffer* indexBuffer;
 	unsigned int numIndicies;
@@ -40,12 +57,7 @@ private:
 	ID3D11ShaderResourceView* shaderResourceView;
 	ID3D11SamplerState* sampler;
 	Vertex* verticies;
-
-	struct SEND_TO_INST_OBJECT
-	{
-		XMMATRIX worldMatrix[6];
-	};
-	SEND_TO_INST_OBJECT toObject;
+	float boundingRadius;
 
 	void CreateVerticies();
 };
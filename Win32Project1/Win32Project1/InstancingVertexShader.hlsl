@@ -15,10 +15,14 @@ struct V_OUT
 	float4 posW : POSITION;
 };
 
-cbuffer OBJECT : register(b3)
+// One per instance, indexed by SV_InstanceID. Matches INSTANCE_DATA in InstanceBuffer.h.
+struct INSTANCE
 {
-	float4x4 worldMatrix[6];
-}
+	float4 positionScale;
+	float4 rotation;
+};
+
+StructuredBuffer<INSTANCE> instances : register(t0);
 
 cbuffer SCENE : register(b1)
 {
@@ -26,13 +30,18 @@ cbuffer SCENE : register(b1)
 	float4x4 projectionMatrix;
 }
 
+// Rotates v by the unit quaternion q
+float3 Rotate(float4 q, float3 v)
+{
+	return v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 V_OUT main(V_IN input, unsigned int instID : SV_InstanceID)
 {
 	V_OUT output = (V_OUT)0;
-	// ensures translation is preserved during matrix multiply  
-	float4 localH = float4(input.posL);
-		// move local space vertex from vertex buffer into world space.
-		localH = mul(localH, worldMatrix[instID]);
+	INSTANCE instance = instances[instID];
+	// move local space vertex from vertex buffer into world space.
+	float4 localH = float4(Rotate(instance.rotation, input.posL.xyz * instance.positionScale.w) + instance.positionScale.xyz, 1);
 	output.posW = localH;
 
 	// Move into view space, then projection space
@@ -41,7 +50,7 @@ V_OUT main(V_IN input, unsigned int instID : SV_InstanceID)
 
 	output.posH = localH;
 	output.uvsOut = input.uvsIn;
-	output.nrmOut = mul(float4(input.nrmIn.xyz, 0), worldMatrix[instID]);
+	output.nrmOut = float4(Rotate(instance.rotation, input.nrmIn.xyz), 0);
 
 	return output; // send projected vertex to the rasterizer stage
 }
@@ -0,0 +1,417 @@
+//--------------------------------------------------------------------------------------
+// File: LegacyFormatConverter.cpp
+//
+// Functions for expanding Direct3D 9 era pixel formats that have no DXGI equivalent
+// into a 32bpp format the device can sample directly
+//
+// Every expander works on a whole SSE register of source data at a time and writes
+// finished 32bpp pixels with unaligned stores, so a conversion runs at close to memory
+// speed. The vector loops stop before they would read past the end of a source row and
+// a scalar loop finishes the last few pixels.
+//--------------------------------------------------------------------------------------
+
+#include <dxgiformat.h>
+#include <assert.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <memory>
+#include <new>
+
+#include "LegacyFormatConverter.h"
+
+namespace
+{
+    //----------------------------------------------------------------------------------
+    inline __m128i LoadBytes( const uint8_t* src )
+    {
+        return _mm_loadu_si128( reinterpret_cast<const __m128i*>( src ) );
+    }
+
+    inline void StoreBytes( uint8_t* dst, __m128i v )
+    {
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst ), v );
+    }
+
+    // Widens each nibble already sitting in the low half of a byte to 8 bits (n * 17)
+    inline __m128i WidenNibbles( __m128i n )
+    {
+        return _mm_or_si128( n, _mm_slli_epi16( n, 4 ) );
+    }
+
+    // Widens 5-bit values held in 16-bit lanes to 8 bits
+    inline __m128i WidenFiveBits( __m128i n )
+    {
+        return _mm_or_si128( _mm_slli_epi16( n, 3 ), _mm_srli_epi16( n, 2 ) );
+    }
+
+    // Writes 16 pixels of L,L,L,A from 16 luminance and 16 alpha bytes
+    inline void StoreLuminanceAlpha( uint8_t* dst, __m128i l, __m128i a )
+    {
+        __m128i llLow = _mm_unpacklo_epi8( l, l );
+        __m128i llHigh = _mm_unpackhi_epi8( l, l );
+        __m128i laLow = _mm_unpacklo_epi8( l, a );
+        __m128i laHigh = _mm_unpackhi_epi8( l, a );
+
+        StoreBytes( dst,      _mm_unpacklo_epi16( llLow, laLow ) );
+        StoreBytes( dst + 16, _mm_unpackhi_epi16( llLow, laLow ) );
+        StoreBytes( dst + 32, _mm_unpacklo_epi16( llHigh, laHigh ) );
+        StoreBytes( dst + 48, _mm_unpackhi_epi16( llHigh, laHigh ) );
+    }
+
+    //----------------------------------------------------------------------------------
+    // 24bpp -> 32bpp keeping the byte order, alpha forced opaque
+    static void Expand24( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i alpha = _mm_set1_epi32( static_cast<int>( 0xff000000 ) );
+
+        // Four pixels come out of each 16 byte load, so stop while the load would still
+        // reach past the last pixel
+        size_t x = 0;
+        for( ; x + 6 <= width; x += 4 )
+        {
+            __m128i v = LoadBytes( src + x * 3 );
+            __m128i p01 = _mm_unpacklo_epi32( v, _mm_srli_si128( v, 3 ) );
+            __m128i p23 = _mm_unpacklo_epi32( _mm_srli_si128( v, 6 ), _mm_srli_si128( v, 9 ) );
+            StoreBytes( dst + x * 4, _mm_or_si128( _mm_unpacklo_epi64( p01, p23 ), alpha ) );
+        }
+
+        for( ; x < width; ++x )
+        {
+            dst[ x * 4 + 0 ] = src[ x * 3 + 0 ];
+            dst[ x * 4 + 1 ] = src[ x * 3 + 1 ];
+            dst[ x * 4 + 2 ] = src[ x * 3 + 2 ];
+            dst[ x * 4 + 3 ] = 0xff;
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // 32bpp with an unused fourth byte -> same layout, alpha forced opaque
+    static void ExpandX8( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i alpha = _mm_set1_epi32( static_cast<int>( 0xff000000 ) );
+
+        size_t x = 0;
+        for( ; x + 4 <= width; x += 4 )
+        {
+            StoreBytes( dst + x * 4, _mm_or_si128( LoadBytes( src + x * 4 ), alpha ) );
+        }
+
+        for( ; x < width; ++x )
+        {
+            memcpy( dst + x * 4, src + x * 4, 3 );
+            dst[ x * 4 + 3 ] = 0xff;
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // 0x7c00, 0x03e0, 0x001f -> B,G,R,A
+    static void Expand555( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i mask = _mm_set1_epi16( 0x1f );
+        const __m128i alpha = _mm_set1_epi16( static_cast<short>( 0xff00 ) );
+
+        size_t x = 0;
+        for( ; x + 8 <= width; x += 8 )
+        {
+            __m128i v = LoadBytes( src + x * 2 );
+            __m128i b = WidenFiveBits( _mm_and_si128( v, mask ) );
+            __m128i g = WidenFiveBits( _mm_and_si128( _mm_srli_epi16( v, 5 ), mask ) );
+            __m128i r = WidenFiveBits( _mm_and_si128( _mm_srli_epi16( v, 10 ), mask ) );
+
+            __m128i bg = _mm_or_si128( b, _mm_slli_epi16( g, 8 ) );
+            __m128i ra = _mm_or_si128( r, alpha );
+            StoreBytes( dst + x * 4,      _mm_unpacklo_epi16( bg, ra ) );
+            StoreBytes( dst + x * 4 + 16, _mm_unpackhi_epi16( bg, ra ) );
+        }
+
+        for( ; x < width; ++x )
+        {
+            uint32_t v = src[ x * 2 ] | ( src[ x * 2 + 1 ] << 8 );
+            uint32_t b = v & 0x1f;
+            uint32_t g = ( v >> 5 ) & 0x1f;
+            uint32_t r = ( v >> 10 ) & 0x1f;
+            dst[ x * 4 + 0 ] = static_cast<uint8_t>( ( b << 3 ) | ( b >> 2 ) );
+            dst[ x * 4 + 1 ] = static_cast<uint8_t>( ( g << 3 ) | ( g >> 2 ) );
+            dst[ x * 4 + 2 ] = static_cast<uint8_t>( ( r << 3 ) | ( r >> 2 ) );
+            dst[ x * 4 + 3 ] = 0xff;
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // 0x0f00, 0x00f0, 0x000f, 0xf000 -> B,G,R,A. The low byte of each pixel holds G:B and
+    // the high byte A:R, so splitting the nibbles of every byte and interleaving the two
+    // halves gives B,G,R,A directly.
+    static void Expand4444( const uint8_t* src, size_t width, uint8_t* dst, bool opaque )
+    {
+        const __m128i mask = _mm_set1_epi16( 0x0f0f );
+        const __m128i alpha = _mm_set1_epi16( opaque ? static_cast<short>( 0xff00 ) : 0 );
+
+        size_t x = 0;
+        for( ; x + 8 <= width; x += 8 )
+        {
+            __m128i v = LoadBytes( src + x * 2 );
+            __m128i br = WidenNibbles( _mm_and_si128( v, mask ) );
+            __m128i ga = _mm_or_si128( WidenNibbles( _mm_and_si128( _mm_srli_epi16( v, 4 ), mask ) ), alpha );
+
+            StoreBytes( dst + x * 4,      _mm_unpacklo_epi8( br, ga ) );
+            StoreBytes( dst + x * 4 + 16, _mm_unpackhi_epi8( br, ga ) );
+        }
+
+        for( ; x < width; ++x )
+        {
+            uint8_t low = src[ x * 2 ];
+            uint8_t high = src[ x * 2 + 1 ];
+            dst[ x * 4 + 0 ] = static_cast<uint8_t>( ( low & 0x0f ) * 17 );
+            dst[ x * 4 + 1 ] = static_cast<uint8_t>( ( low >> 4 ) * 17 );
+            dst[ x * 4 + 2 ] = static_cast<uint8_t>( ( high & 0x0f ) * 17 );
+            dst[ x * 4 + 3 ] = opaque ? 0xff : static_cast<uint8_t>( ( high >> 4 ) * 17 );
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // L -> L,L,L,255
+    static void ExpandL8( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i alpha = _mm_set1_epi8( static_cast<char>( 0xff ) );
+
+        size_t x = 0;
+        for( ; x + 16 <= width; x += 16 )
+        {
+            StoreLuminanceAlpha( dst + x * 4, LoadBytes( src + x ), alpha );
+        }
+
+        for( ; x < width; ++x )
+        {
+            dst[ x * 4 + 0 ] = dst[ x * 4 + 1 ] = dst[ x * 4 + 2 ] = src[ x ];
+            dst[ x * 4 + 3 ] = 0xff;
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // 0x00ff luminance, 0xff00 alpha -> L,L,L,A
+    static void ExpandA8L8( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i mask = _mm_set1_epi16( 0x00ff );
+
+        size_t x = 0;
+        for( ; x + 16 <= width; x += 16 )
+        {
+            __m128i v0 = LoadBytes( src + x * 2 );
+            __m128i v1 = LoadBytes( src + x * 2 + 16 );
+            __m128i l = _mm_packus_epi16( _mm_and_si128( v0, mask ), _mm_and_si128( v1, mask ) );
+            __m128i a = _mm_packus_epi16( _mm_srli_epi16( v0, 8 ), _mm_srli_epi16( v1, 8 ) );
+            StoreLuminanceAlpha( dst + x * 4, l, a );
+        }
+
+        for( ; x < width; ++x )
+        {
+            dst[ x * 4 + 0 ] = dst[ x * 4 + 1 ] = dst[ x * 4 + 2 ] = src[ x * 2 ];
+            dst[ x * 4 + 3 ] = src[ x * 2 + 1 ];
+        }
+    }
+
+    //----------------------------------------------------------------------------------
+    // 0x0f luminance, 0xf0 alpha -> L,L,L,A
+    static void ExpandA4L4( const uint8_t* src, size_t width, uint8_t* dst )
+    {
+        const __m128i mask = _mm_set1_epi8( 0x0f );
+
+        size_t x = 0;
+        for( ; x + 16 <= width; x += 16 )
+        {
+            __m128i v = LoadBytes( src + x );
+            __m128i l = WidenNibbles( _mm_and_si128( v, mask ) );
+            __m128i a = WidenNibbles( _mm_and_si128( _mm_srli_epi16( v, 4 ), mask ) );
+            StoreLuminanceAlpha( dst + x * 4, l, a );
+        }
+
+        for( ; x < width; ++x )
+        {
+            dst[ x * 4 + 0 ] = dst[ x * 4 + 1 ] = dst[ x * 4 + 2 ] = static_cast<uint8_t>( ( src[ x ] & 0x0f ) * 17 );
+            dst[ x * 4 + 3 ] = static_cast<uint8_t>( ( src[ x ] >> 4 ) * 17 );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t GetLegacyBitsPerPixel( _In_ LEGACY_FORMAT format )
+{
+    switch( format )
+    {
+    case LEGACY_FORMAT_X8B8G8R8:
+        return 32;
+
+    case LEGACY_FORMAT_R8G8B8:
+    case LEGACY_FORMAT_B8G8R8:
+        return 24;
+
+    case LEGACY_FORMAT_X1R5G5B5:
+    case LEGACY_FORMAT_A4R4G4B4:
+    case LEGACY_FORMAT_X4R4G4B4:
+    case LEGACY_FORMAT_A8L8:
+        return 16;
+
+    case LEGACY_FORMAT_L8:
+    case LEGACY_FORMAT_A4L4:
+        return 8;
+
+    default:
+        return 0;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+DXGI_FORMAT GetLegacyConversionFormat( _In_ LEGACY_FORMAT format )
+{
+    switch( format )
+    {
+    case LEGACY_FORMAT_R8G8B8:
+    case LEGACY_FORMAT_X1R5G5B5:
+    case LEGACY_FORMAT_A4R4G4B4:
+    case LEGACY_FORMAT_X4R4G4B4:
+        return DXGI_FORMAT_B8G8R8A8_UNORM;
+
+    case LEGACY_FORMAT_B8G8R8:
+    case LEGACY_FORMAT_X8B8G8R8:
+    case LEGACY_FORMAT_L8:
+    case LEGACY_FORMAT_A8L8:
+    case LEGACY_FORMAT_A4L4:
+        return DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    default:
+        return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+void ConvertLegacyScanline( _In_ LEGACY_FORMAT format,
+                            _In_reads_bytes_(width * GetLegacyBitsPerPixel(format) / 8) const uint8_t* src,
+                            _In_ size_t width,
+                            _Out_writes_bytes_(width * 4) uint8_t* dst
+                          )
+{
+    switch( format )
+    {
+    case LEGACY_FORMAT_R8G8B8:
+    case LEGACY_FORMAT_B8G8R8:
+        Expand24( src, width, dst );
+        break;
+
+    case LEGACY_FORMAT_X8B8G8R8:
+        ExpandX8( src, width, dst );
+        break;
+
+    case LEGACY_FORMAT_X1R5G5B5:
+        Expand555( src, width, dst );
+        break;
+
+    case LEGACY_FORMAT_A4R4G4B4:
+        Expand4444( src, width, dst, false );
+        break;
+
+    case LEGACY_FORMAT_X4R4G4B4:
+        Expand4444( src, width, dst, true );
+        break;
+
+    case LEGACY_FORMAT_L8:
+        ExpandL8( src, width, dst );
+        break;
+
+    case LEGACY_FORMAT_A8L8:
+        ExpandA8L8( src, width, dst );
+        break;
+
+    case LEGACY_FORMAT_A4L4:
+        ExpandA4L4( src, width, dst );
+        break;
+
+    default:
+        assert( false );
+        break;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT ConvertLegacySurfaces( _In_ LEGACY_FORMAT format,
+                               _In_ size_t width,
+                               _In_ size_t height,
+                               _In_ size_t depth,
+                               _In_ size_t mipCount,
+                               _In_ size_t arraySize,
+                               _In_reads_bytes_(bitSize) const uint8_t* bitData,
+                               _In_ size_t bitSize,
+                               std::unique_ptr<uint8_t[]>& convertedData,
+                               _Out_ size_t* convertedSize
+                             )
+{
+    if ( !bitData || !convertedSize )
+    {
+        return E_INVALIDARG;
+    }
+
+    *convertedSize = 0;
+
+    size_t bpp = GetLegacyBitsPerPixel( format );
+    if ( !bpp )
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+    }
+
+    // Sum up both sides first so the source can be bounds checked once
+    size_t srcTotal = 0;
+    size_t dstTotal = 0;
+    {
+        size_t w = width;
+        size_t h = height;
+        size_t d = depth;
+        for( size_t level = 0; level < mipCount; ++level )
+        {
+            srcTotal += ( ( w * bpp + 7 ) / 8 ) * h * d;
+            dstTotal += w * 4 * h * d;
+
+            w = ( w > 1 ) ? ( w >> 1 ) : 1;
+            h = ( h > 1 ) ? ( h >> 1 ) : 1;
+            d = ( d > 1 ) ? ( d >> 1 ) : 1;
+        }
+    }
+
+    srcTotal *= arraySize;
+    dstTotal *= arraySize;
+    if ( srcTotal > bitSize )
+    {
+        return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+    }
+
+    convertedData.reset( new (std::nothrow) uint8_t[ dstTotal ] );
+    if ( !convertedData )
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    const uint8_t* src = bitData;
+    uint8_t* dst = convertedData.get();
+    for( size_t slice = 0; slice < arraySize; ++slice )
+    {
+        size_t w = width;
+        size_t h = height;
+        size_t d = depth;
+        for( size_t level = 0; level < mipCount; ++level )
+        {
+            size_t srcRowBytes = ( w * bpp + 7 ) / 8;
+            for( size_t row = 0; row < h * d; ++row )
+            {
+                ConvertLegacyScanline( format, src, w, dst );
+                src += srcRowBytes;
+                dst += w * 4;
+            }
+
+            w = ( w > 1 ) ? ( w >> 1 ) : 1;
+            h = ( h > 1 ) ? ( h >> 1 ) : 1;
+            d = ( d > 1 ) ? ( d >> 1 ) : 1;
+        }
+    }
+
+    *convertedSize = dstTotal;
+    return S_OK;
+}
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: LegacyFormatConverter.h
+//
+// Functions for expanding Direct3D 9 era pixel formats that have no DXGI equivalent
+// into a 32bpp format the device can sample directly
+//
+// The DDS loader picks the legacy format from the file's pixel format masks and runs
+// the conversion over every surface before the data is handed to Direct3D, so the rest
+// of the loader (mip generation, streaming) only ever sees the converted format.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11.h>
+#include <memory>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+enum LEGACY_FORMAT
+{
+    LEGACY_FORMAT_UNKNOWN = 0,
+    LEGACY_FORMAT_R8G8B8,       // 24bpp stored B,G,R           -> B8G8R8A8
+    LEGACY_FORMAT_B8G8R8,       // 24bpp stored R,G,B           -> R8G8B8A8
+    LEGACY_FORMAT_X8B8G8R8,     // 32bpp with an unused alpha   -> R8G8B8A8
+    LEGACY_FORMAT_X1R5G5B5,     // 16bpp 5:5:5 with unused bit  -> B8G8R8A8
+    LEGACY_FORMAT_A4R4G4B4,     // 16bpp 4:4:4:4                -> B8G8R8A8
+    LEGACY_FORMAT_X4R4G4B4,     // 16bpp 4:4:4 with unused bits -> B8G8R8A8
+    LEGACY_FORMAT_L8,           // 8bpp luminance               -> R8G8B8A8
+    LEGACY_FORMAT_A8L8,         // 16bpp luminance + alpha      -> R8G8B8A8
+    LEGACY_FORMAT_A4L4,         // 8bpp 4-bit luminance + alpha -> R8G8B8A8
+};
+
+// Size of one source pixel
+size_t GetLegacyBitsPerPixel( _In_ LEGACY_FORMAT format );
+
+// The DXGI format the data is in after conversion; always 4 bytes per pixel
+DXGI_FORMAT GetLegacyConversionFormat( _In_ LEGACY_FORMAT format );
+
+// Converts 'width' pixels from 'src' into 'dst'. The two rows must not overlap.
+void ConvertLegacyScanline( _In_ LEGACY_FORMAT format,
+                            _In_reads_bytes_(width * GetLegacyBitsPerPixel(format) / 8) const uint8_t* src,
+                            _In_ size_t width,
+                            _Out_writes_bytes_(width * 4) uint8_t* dst
+                          );
+
+// Converts every mip of every array slice (and every depth slice of a volume) laid out
+// the way a DDS file stores them. Fails if 'bitData' is too small for the description.
+HRESULT ConvertLegacySurfaces( _In_ LEGACY_FORMAT format,
+                               _In_ size_t width,
+                               _In_ size_t height,
+                               _In_ size_t depth,
+                               _In_ size_t mipCount,
+                               _In_ size_t arraySize,
+                               _In_reads_bytes_(bitSize) const uint8_t* bitData,
+                               _In_ size_t bitSize,
+                               std::unique_ptr<uint8_t[]>& convertedData,
+                               _Out_ size_t* convertedSize
+                             );
@@ -1,22 +1,57 @@
 #include "LoadedModel3D.h"
 #include "GeneralVertexShader.csh"
+#include "GeneralInstancedVertexShader.csh"
 #include "GeneralPixelShader.csh"
+#include "PackedPixelShader.csh"
 #include "DDSTextureLoader.h"
+#include <sstream>
 
 #define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
 
+mutex LoadedModel3D::sharedMutex;
+unsigned int LoadedModel3D::sharedUsers = 0;
+ID3D11VertexShader* LoadedModel3D::sharedVertexShader = nullptr;
+ID3D11VertexShader* LoadedModel3D::sharedInstancedVertexShader = nullptr;
+ID3D11PixelShader* LoadedModel3D::sharedPixelShader = nullptr;
+ID3D11InputLayout* LoadedModel3D::sharedLayout = nullptr;
+vector<LoadedModel3D::SHARED_MESH> LoadedModel3D::sharedMeshes;
+
 LoadedModel3D::LoadedModel3D()
 {
 	worldMatrix = XMMatrixIdentity();
+	buffer = nullptr;
+	indexBuffer = nullptr;
+	vertexShader = nullptr;
+	pixelShader = nullptr;
+	layout = nullptr;
+	boundingRadius = 0;
 }
 
 
 LoadedModel3D::~LoadedModel3D()
 {
+	bool initialized = vertexShader != nullptr;
 	SAFE_RELEASE(buffer);
 	SAFE_RELEASE(vertexShader);
 	SAFE_RELEASE(pixelShader);
 	SAFE_RELEASE(layout);
+	if (initialized)
+	{
+		lock_guard<mutex> lock(sharedMutex);
+		if (--sharedUsers == 0)
+		{
+			SAFE_RELEASE(sharedVertexShader);
+			SAFE_RELEASE(sharedInstancedVertexShader);
+			SAFE_RELEASE(sharedPixelShader);
+			SAFE_RELEASE(sharedLayout);
+			for (unsigned int i = 0; i < sharedMeshes.size(); ++i)
+			{
+				SAFE_RELEASE(sharedMeshes[i].buffer);
+				SAFE_RELEASE(sharedMeshes[i].indexBuffer);
+			}
+			sharedMeshes.clear();
+		}
+	}
 	SAFE_RELEASE(indexBuffer);
 	SAFE_RELEASE(shaderResourceView);
 	SAFE_RELEASE(sampler);
@@ -27,27 +62,26 @@ LoadedModel3D::~LoadedModel3D()
 	delete[] indicies;
 }
 
-void LoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const char* modelFilename)
+void LoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const char* modelFilename, AsyncFileReader* fileReader)
 {
 	worldMatrix = XMMatrixIdentity();
 	worldMatrix = XMMatrixTranslation(initX, initY, initZ);
 
-	HRESULT result = CreateDDSTextureFromFile(device, textureFilename, nullptr, &shaderResourceView);
-
-	loadOBJ(modelFilename);
-
-	D3D11_BUFFER_DESC bufferDesc = {};
-	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
-	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bufferDesc.ByteWidth = sizeof(Vertex)* numVerticies;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc;
-	subresourceDesc.pSysMem = verticies;
-
-	result = device->CreateBuffer(&bufferDesc, &subresourceDesc, &buffer);
+	// A null filename means the texture is supplied later through SetShaderResourceView
+	HRESULT result = S_OK;
+	shaderResourceView = nullptr;
+	if (textureFilename && !fileReader)
+		result = CreateDDSTextureFromFile(device, textureFilename, nullptr, &shaderResourceView);
+	else if (textureFilename)
+	{
+		unique_ptr<uint8_t[]> ddsData;
+		size_t ddsDataSize = 0;
+		result = E_FAIL;
+		if (fileReader->Load(textureFilename, ddsData, &ddsDataSize))
+			result = CreateDDSTextureFromMemory(device, ddsData.get(), ddsDataSize, nullptr, &shaderResourceView);
+	}
 
-	result = device->CreateVertexShader(GeneralVertexShader, sizeof(GeneralVertexShader), NULL, &vertexShader);
-	result = device->CreatePixelShader(GeneralPixelShader, sizeof(GeneralPixelShader), NULL, &pixelShader);
+	loadOBJ(modelFilename, fileReader);
 
 	D3D11_INPUT_ELEMENT_DESC inputLayout[] =
 	{
@@ -56,27 +90,50 @@ void LoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, f
 		{ "NORMALS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	};
 
+	// The models are loaded on several threads at once
+	{
+		lock_guard<mutex> lock(sharedMutex);
+		if (!sharedVertexShader)
+		{
+			result = device->CreateVertexShader(GeneralVertexShader, sizeof(GeneralVertexShader), NULL, &sharedVertexShader);
+			result = device->CreateVertexShader(GeneralInstancedVertexShader, sizeof(GeneralInstancedVertexShader), NULL, &sharedInstancedVertexShader);
+			result = device->CreatePixelShader(GeneralPixelShader, sizeof(GeneralPixelShader), NULL, &sharedPixelShader);
+			result = device->CreateInputLayout(inputLayout, ARRAYSIZE(inputLayout), GeneralVertexShader, sizeof(GeneralVertexShader), &sharedLayout);
+		}
+		if (sharedVertexShader && sharedPixelShader && sharedLayout)
+		{
+			++sharedUsers;
+			vertexShader = sharedVertexShader;
+			pixelShader = sharedPixelShader;
+			layout = sharedLayout;
+			vertexShader->AddRef();
+			pixelShader->AddRef();
+			layout->AddRef();
+
+			for (unsigned int i = 0; i < sharedMeshes.size() && !buffer; ++i)
+			{
+				if (sharedMeshes[i].filename != modelFilename)
+					continue;
+				buffer = sharedMeshes[i].buffer;
+				indexBuffer = sharedMeshes[i].indexBuffer;
+				buffer->AddRef();
+				indexBuffer->AddRef();
+			}
+			if (!buffer)
+				CreateBuffers(device, modelFilename);
+		}
+	}
+
 	D3D11_SAMPLER_DESC samplerDesc = {};
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
 
-	result = device->CreateInputLayout(inputLayout, ARRAYSIZE(inputLayout), GeneralVertexShader, sizeof(GeneralVertexShader), &layout);
-
 	toObject.worldMatrix = worldMatrix;
 
-	D3D11_BUFFER_DESC indexBufferDesc = {};
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
-	indexBufferDesc.ByteWidth = sizeof(unsigned int) * numIndicies;
-
-	D3D11_SUBRESOURCE_DATA indexInitData;
-	indexInitData.pSysMem = indicies;
-
-	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
-
 	D3D11_BLEND_DESC blendDesc = {};
 	blendDesc.AlphaToCoverageEnable = true;
 	blendDesc.RenderTarget[0].BlendEnable = true;
@@ -99,29 +156,25 @@ void LoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, f
 	result = device->CreateRasterizerState(&rasterDesc1, &rasterizerStates[1]);
 }
 
-void LoadedModel3D::Run(ID3D11DeviceContext* deviceContext)
+void LoadedModel3D::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-
-
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	deviceContext->PSSetShaderResources(0, 1, &shaderResourceView);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->OMSetBlendState(blendState, NULL, 0xffffffff);
-	deviceContext->RSSetState(rasterizerStates[1]);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
-	deviceContext->RSSetState(rasterizerStates[0]);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
-	deviceContext->RSSetState(nullptr);
-	deviceContext->OMSetBlendState(NULL, NULL, 0xffffffff);
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 1, &shaderResourceView);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	renderContext->SetGeometryShader(nullptr);
+	renderContext->SetBlendState(blendState);
+	renderContext->SetRasterizerState(rasterizerStates[1]);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetRasterizerState(rasterizerStates[0]);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetRasterizerState(nullptr);
+	renderContext->SetBlendState(NULL);
 }
 
 void LoadedModel3D::Translate(float offsetX, float offsetY, float offsetZ)
@@ -154,6 +207,11 @@ ID3D11VertexShader* LoadedModel3D::GetVertexShader() const
 	return vertexShader;
 }
 
+ID3D11VertexShader* LoadedModel3D::GetInstancedVertexShader() const
+{
+	return sharedInstancedVertexShader;
+}
+
 ID3D11PixelShader* LoadedModel3D::GetPixelShader() const
 {
 	return pixelShader;
@@ -164,17 +222,96 @@ ID3D11InputLayout* LoadedModel3D::GetLayout() const
 	return layout;
 }
 
+ID3D11ShaderResourceView* LoadedModel3D::GetShaderResourceView() const
+{
+	return shaderResourceView;
+}
+
 ID3D11SamplerState* LoadedModel3D::GetSampler() const
 {
 	return sampler;
 }
 
+float LoadedModel3D::GetBoundingRadius() const
+{
+	return boundingRadius;
+}
+
 void LoadedModel3D::SetWorldMatrix(const XMMATRIX* matrix)
 {
 	worldMatrix = *matrix;
 }
 
-bool LoadedModel3D::loadOBJ(const char * filename)
+void LoadedModel3D::SetShaderResourceView(ID3D11ShaderResourceView* view)
+{
+	if (view == shaderResourceView)
+		return;
+
+	if (view)
+		view->AddRef();
+	SAFE_RELEASE(shaderResourceView);
+	shaderResourceView = view;
+}
+
+bool LoadedModel3D::UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement)
+{
+	if (!ApplyTexturePlacement(verticies, numVerticies, placement))
+		return false;
+
+	SAFE_RELEASE(buffer);
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = sizeof(Vertex)* numVerticies;
+
+	D3D11_SUBRESOURCE_DATA subresourceDesc;
+	subresourceDesc.pSysMem = verticies;
+
+	HRESULT result = device->CreateBuffer(&bufferDesc, &subresourceDesc, &buffer);
+
+	SAFE_RELEASE(pixelShader);
+	result = device->CreatePixelShader(PackedPixelShader, sizeof(PackedPixelShader), NULL, &pixelShader);
+
+	SetShaderResourceView(page);
+	return true;
+}
+
+// Under sharedMutex. Makes this model's buffers the ones every later model from the file uses.
+void LoadedModel3D::CreateBuffers(ID3D11Device* device, const char* filename)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = sizeof(Vertex)* numVerticies;
+
+	D3D11_SUBRESOURCE_DATA subresourceDesc;
+	subresourceDesc.pSysMem = verticies;
+
+	HRESULT result = device->CreateBuffer(&bufferDesc, &subresourceDesc, &buffer);
+
+	D3D11_BUFFER_DESC indexBufferDesc = {};
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	indexBufferDesc.ByteWidth = sizeof(unsigned int) * numIndicies;
+
+	D3D11_SUBRESOURCE_DATA indexInitData;
+	indexInitData.pSysMem = indicies;
+
+	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
+
+	if (buffer && indexBuffer)
+	{
+		SHARED_MESH mesh;
+		mesh.filename = filename;
+		mesh.buffer = buffer;
+		mesh.indexBuffer = indexBuffer;
+		buffer->AddRef();
+		indexBuffer->AddRef();
+		sharedMeshes.push_back(mesh);
+	}
+}
+
+bool LoadedModel3D::loadOBJ(const char * filename, AsyncFileReader* fileReader)
 {
 	vector<XMFLOAT3> pos;
 	vector<XMFLOAT2> uvs;
@@ -184,16 +321,30 @@ bool LoadedModel3D::loadOBJ(const char * filename)
 	vector<unsigned int> uv_ind;
 	vector<unsigned int> nrm_ind;
 
-	ifstream infile;
+	ifstream diskFile;
+	istringstream readerFile;
 	char input, input2;
 	ofstream fout;
 
-	// Open the file.
-	infile.open(filename);
+	// Open the file, or parse the reader's copy of it when there is a reader.
+	if (fileReader)
+	{
+		unique_ptr<uint8_t[]> data;
+		size_t dataSize = 0;
+		wstring wideFilename(filename, filename + strlen(filename));
+		if (!fileReader->Load(wideFilename.c_str(), data, &dataSize))
+			return false;
+		readerFile.str(string((const char*)data.get(), dataSize));
+	}
+	else
+	{
+		diskFile.open(filename);
 
-	// Check if it was successful in opening the file.
-	if (!infile.is_open())
-		return false;
+		// Check if it was successful in opening the file.
+		if (!diskFile.is_open())
+			return false;
+	}
+	istream& infile = fileReader ? (istream&)readerFile : diskFile;
 
 	// Read in the vertices, texture coordinates, and normals into the data structures.
 	// Important: Also convert to left hand coordinate system since Maya uses right hand coordinate system.
@@ -273,9 +424,6 @@ bool LoadedModel3D::loadOBJ(const char * filename)
 		infile.get(input);
 	}
 
-	// Close the file.
-	infile.close();
-
 	numVerticies = (unsigned int)pos_ind.size();
 	verticies = new Vertex[numVerticies];
 	numIndicies = (unsigned int)numVerticies;
@@ -290,6 +438,7 @@ bool LoadedModel3D::loadOBJ(const char * filename)
 		verticies[i].nrm = nrms[nrm_ind[i] - 1];
 		indicies[i] = i;
 	}
+	boundingRadius = BoundingRadius(verticies, numVerticies);
 
 	return true;
 }
\ No newline at end of file
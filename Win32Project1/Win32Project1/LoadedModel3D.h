@@ -1,5 +1,8 @@
 #pragma once
 #include "defines.h"
+#include "RenderContext.h"
+#include "AsyncFileReader.h"
+#include "TexturePacker.h"
 #define NUM_RASTER_STATES 2
 
 class LoadedModel3D
@@ -8,9 +11,9 @@ public:
 	LoadedModel3D();
 	~LoadedModel3D();
 
-	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const char * modelFilename);
+	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const char * modelFilename, AsyncFileReader* fileReader);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -20,14 +23,21 @@ public:
 	ID3D11Buffer* GetIndexBuffer() const;
 	unsigned int GetNumIndicies() const;
 	ID3D11VertexShader* GetVertexShader() const;
+	// Reads the world matrix of each instance from an array in the object slot
+	ID3D11VertexShader* GetInstancedVertexShader() const;
 	ID3D11PixelShader* GetPixelShader() const;
 	ID3D11InputLayout* GetLayout() const;
 	ID3D11ShaderResourceView* GetShaderResourceView() const;
 	ID3D11SamplerState* GetSampler() const;
+	// Radius of a sphere about the origin of the model that holds all of it
+	float GetBoundingRadius() const;
 
 	// Mutators
 
 	void SetWorldMatrix(const XMMATRIX* matrix);
+	void SetShaderResourceView(ID3D11ShaderResourceView* view);
+	// Draws with a page from the TexturePacker from now on. Call once, after Initialize.
+	bool UsePackedTexture(ID3D11Device* device, ID3D11ShaderResourceView* page, const TEXTURE_PLACEMENT& placement);
 
 private:
 
@@ -44,6 +54,7 @@ private:
 	ID3D11BlendState* blendState;
 	ID3D11RasterizerState* rasterizerStates[NUM_RASTER_STATES];
 	Vertex* verticies;
+	float boundingRadius;
 	unsigned int* indicies;
 
 	struct SEND_TO_OBJECT
@@ -52,6 +63,25 @@ private:
 	};
 	SEND_TO_OBJECT toObject;
 
-	bool loadOBJ(const char * filename);
+	struct SHARED_MESH
+	{
+		string filename;
+		ID3D11Buffer* buffer;
+		ID3D11Buffer* indexBuffer;
+	};
+
+	// Every model draws with the same shaders and layout, so they share one of each and
+	// models drawn one after another bind identical state. Models loaded from the same file
+	// share its buffers too, so the draw queue can draw them instanced.
+	static mutex sharedMutex;
+	static unsigned int sharedUsers;
+	static ID3D11VertexShader* sharedVertexShader;
+	static ID3D11VertexShader* sharedInstancedVertexShader;
+	static ID3D11PixelShader* sharedPixelShader;
+	static ID3D11InputLayout* sharedLayout;
+	static vector<SHARED_MESH> sharedMeshes;
+
+	void CreateBuffers(ID3D11Device* device, const char* filename);
+	bool loadOBJ(const char * filename, AsyncFileReader* fileReader);
 };
 
@@ -0,0 +1,472 @@
+//--------------------------------------------------------------------------------------
+// File: MipChainGenerator.cpp
+//
+// Functions for building a full mip chain on the CPU for textures that ship with only
+// their top level
+//
+// Each level is filtered from the one above it in 32-bit float, one RGBA pixel per SSE
+// register, and only quantized back to 8 bits when it is written out. Colour channels are
+// decoded to linear light first when gamma correction is on so that the averages do not
+// darken; alpha is always filtered as stored.
+//--------------------------------------------------------------------------------------
+
+#include <dxgiformat.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "MipChainGenerator.h"
+
+//--------------------------------------------------------------------------------------
+// Lookup tables
+//--------------------------------------------------------------------------------------
+#define SRGB_ENCODE_TABLE_SIZE 16384
+#define KAISER_TAPS 6
+
+namespace
+{
+    struct MIP_TABLES
+    {
+        float toLinear[256];
+        uint8_t toSRGB[SRGB_ENCODE_TABLE_SIZE];
+
+        // Tap t samples source texel (2 * x - 2 + t) for destination texel x
+        float kaiserWeights[KAISER_TAPS];
+
+        MIP_TABLES();
+    };
+
+    //----------------------------------------------------------------------------------
+    static double BesselI0( double x )
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for( int k = 1; k < 32; ++k )
+        {
+            double q = x / ( 2.0 * k );
+            term *= q * q;
+            sum += term;
+            if ( term < sum * 1e-12 )
+                break;
+        }
+        return sum;
+    }
+
+    //----------------------------------------------------------------------------------
+    MIP_TABLES::MIP_TABLES()
+    {
+        for( int i = 0; i < 256; ++i )
+        {
+            float s = float( i ) / 255.f;
+            toLinear[ i ] = ( s <= 0.04045f ) ? s / 12.92f : powf( ( s + 0.055f ) / 1.055f, 2.4f );
+        }
+
+        for( int i = 0; i < SRGB_ENCODE_TABLE_SIZE; ++i )
+        {
+            float l = float( i ) / float( SRGB_ENCODE_TABLE_SIZE - 1 );
+            float s = ( l <= 0.0031308f ) ? l * 12.92f : 1.055f * powf( l, 1.f / 2.4f ) - 0.055f;
+            toSRGB[ i ] = static_cast<uint8_t>( std::min<float>( 255.f, s * 255.f + 0.5f ) );
+        }
+
+        // Windowed sinc for a 2:1 reduction; the taps sit half a texel either side of the
+        // destination centre out to a radius of three source texels
+        const double alpha = 4.0;
+        const double radius = 3.0;
+        const double pi = 3.14159265358979323846;
+        double total = 0.0;
+        double w[ KAISER_TAPS ];
+        for( int t = 0; t < KAISER_TAPS; ++t )
+        {
+            double x = double( t ) - 2.5;
+            double u = x * 0.5;
+            double sinc = ( u == 0.0 ) ? 1.0 : sin( pi * u ) / ( pi * u );
+            double r = x / radius;
+            double window = BesselI0( alpha * sqrt( std::max<double>( 0.0, 1.0 - r * r ) ) ) / BesselI0( alpha );
+            w[ t ] = sinc * window;
+            total += w[ t ];
+        }
+        for( int t = 0; t < KAISER_TAPS; ++t )
+        {
+            kaiserWeights[ t ] = static_cast<float>( w[ t ] / total );
+        }
+    }
+
+    // Built during static initialization so the loader threads never race on it
+    static const MIP_TABLES s_tables;
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool IsSRGB( _In_ DXGI_FORMAT format )
+{
+    switch( format )
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CanGenerateMipChain( _In_ DXGI_FORMAT format )
+{
+    // All of these keep alpha (or the unused X) in the fourth byte, which is all the
+    // filter needs to know
+    switch( format )
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t CountMipLevels( _In_ size_t width, _In_ size_t height )
+{
+    size_t mipCount = 1;
+    while ( width > 1 || height > 1 )
+    {
+        width = std::max<size_t>( width >> 1, 1 );
+        height = std::max<size_t>( height >> 1, 1 );
+        ++mipCount;
+    }
+    return mipCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Row conversion between 8-bit storage and linear float
+//--------------------------------------------------------------------------------------
+static void DecodeRow( _In_reads_bytes_(width*4) const uint8_t* src,
+                       _In_ size_t width,
+                       _In_ bool gammaCorrect,
+                       _Out_writes_(width*4) float* dst )
+{
+    if ( gammaCorrect )
+    {
+        for( size_t x = 0; x < width; ++x, src += 4, dst += 4 )
+        {
+            _mm_storeu_ps( dst, _mm_setr_ps( s_tables.toLinear[ src[0] ],
+                                             s_tables.toLinear[ src[1] ],
+                                             s_tables.toLinear[ src[2] ],
+                                             float( src[3] ) * ( 1.f / 255.f ) ) );
+        }
+    }
+    else
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps( 1.f / 255.f );
+        for( size_t x = 0; x < width; ++x, src += 4, dst += 4 )
+        {
+            int packed;
+            memcpy( &packed, src, sizeof(int) );
+            __m128i v = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( packed ), zero ), zero );
+            _mm_storeu_ps( dst, _mm_mul_ps( _mm_cvtepi32_ps( v ), scale ) );
+        }
+    }
+}
+
+static void EncodeRow( _In_reads_(width*4) const float* src,
+                       _In_ size_t width,
+                       _In_ bool gammaCorrect,
+                       _Out_writes_bytes_(width*4) uint8_t* dst )
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.f );
+
+    if ( gammaCorrect )
+    {
+        const float tableScale = float( SRGB_ENCODE_TABLE_SIZE - 1 );
+        const __m128 scale = _mm_setr_ps( tableScale, tableScale, tableScale, 255.f );
+        for( size_t x = 0; x < width; ++x, src += 4, dst += 4 )
+        {
+            __m128 v = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( src ), zero ), one );
+            __m128i index = _mm_cvtps_epi32( _mm_mul_ps( v, scale ) );
+
+            int32_t lanes[4];
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes ), index );
+            dst[0] = s_tables.toSRGB[ lanes[0] ];
+            dst[1] = s_tables.toSRGB[ lanes[1] ];
+            dst[2] = s_tables.toSRGB[ lanes[2] ];
+            dst[3] = static_cast<uint8_t>( lanes[3] );
+        }
+    }
+    else
+    {
+        const __m128 scale = _mm_set1_ps( 255.f );
+        for( size_t x = 0; x < width; ++x, src += 4, dst += 4 )
+        {
+            __m128 v = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( src ), zero ), one );
+            __m128i i32 = _mm_cvtps_epi32( _mm_mul_ps( v, scale ) );
+            __m128i i16 = _mm_packs_epi32( i32, i32 );
+            int packed = _mm_cvtsi128_si32( _mm_packus_epi16( i16, i16 ) );
+            memcpy( dst, &packed, sizeof(int) );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reductions. A dimension that is already 1 is carried through unchanged because every
+// tap clamps onto the same texel.
+//--------------------------------------------------------------------------------------
+static void ReduceBox( _In_reads_(srcWidth*srcHeight*4) const float* src,
+                       _In_ size_t srcWidth,
+                       _In_ size_t srcHeight,
+                       _Out_writes_(dstWidth*dstHeight*4) float* dst,
+                       _In_ size_t dstWidth,
+                       _In_ size_t dstHeight )
+{
+    const __m128 quarter = _mm_set1_ps( 0.25f );
+
+    for( size_t y = 0; y < dstHeight; ++y )
+    {
+        const float* row0 = src + std::min<size_t>( 2 * y, srcHeight - 1 ) * srcWidth * 4;
+        const float* row1 = src + std::min<size_t>( 2 * y + 1, srcHeight - 1 ) * srcWidth * 4;
+        float* out = dst + y * dstWidth * 4;
+
+        for( size_t x = 0; x < dstWidth; ++x, out += 4 )
+        {
+            size_t x0 = std::min<size_t>( 2 * x, srcWidth - 1 ) * 4;
+            size_t x1 = std::min<size_t>( 2 * x + 1, srcWidth - 1 ) * 4;
+
+            __m128 sum = _mm_add_ps( _mm_add_ps( _mm_loadu_ps( row0 + x0 ), _mm_loadu_ps( row0 + x1 ) ),
+                                     _mm_add_ps( _mm_loadu_ps( row1 + x0 ), _mm_loadu_ps( row1 + x1 ) ) );
+            _mm_storeu_ps( out, _mm_mul_ps( sum, quarter ) );
+        }
+    }
+}
+
+static void ReduceKaiser( _In_reads_(srcWidth*srcHeight*4) const float* src,
+                          _In_ size_t srcWidth,
+                          _In_ size_t srcHeight,
+                          _Out_writes_(dstWidth*srcHeight*4) float* scratch,
+                          _Out_writes_(dstWidth*dstHeight*4) float* dst,
+                          _In_ size_t dstWidth,
+                          _In_ size_t dstHeight )
+{
+    __m128 weights[ KAISER_TAPS ];
+    for( int t = 0; t < KAISER_TAPS; ++t )
+    {
+        weights[ t ] = _mm_set1_ps( s_tables.kaiserWeights[ t ] );
+    }
+
+    // Horizontal pass into scratch (dstWidth x srcHeight)
+    for( size_t y = 0; y < srcHeight; ++y )
+    {
+        const float* row = src + y * srcWidth * 4;
+        float* out = scratch + y * dstWidth * 4;
+
+        for( size_t x = 0; x < dstWidth; ++x, out += 4 )
+        {
+            __m128 sum = _mm_setzero_ps();
+            for( int t = 0; t < KAISER_TAPS; ++t )
+            {
+                ptrdiff_t sx = ptrdiff_t( 2 * x ) - 2 + t;
+                sx = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( sx, ptrdiff_t( srcWidth ) - 1 ) );
+                sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( row + sx * 4 ), weights[ t ] ) );
+            }
+            _mm_storeu_ps( out, sum );
+        }
+    }
+
+    // Vertical pass, whole rows at a time
+    const size_t rowFloats = dstWidth * 4;
+    for( size_t y = 0; y < dstHeight; ++y )
+    {
+        const float* rows[ KAISER_TAPS ];
+        for( int t = 0; t < KAISER_TAPS; ++t )
+        {
+            ptrdiff_t sy = ptrdiff_t( 2 * y ) - 2 + t;
+            sy = std::max<ptrdiff_t>( 0, std::min<ptrdiff_t>( sy, ptrdiff_t( srcHeight ) - 1 ) );
+            rows[ t ] = scratch + sy * rowFloats;
+        }
+
+        float* out = dst + y * rowFloats;
+        for( size_t i = 0; i < rowFloats; i += 4 )
+        {
+            __m128 sum = _mm_mul_ps( _mm_loadu_ps( rows[0] + i ), weights[0] );
+            for( int t = 1; t < KAISER_TAPS; ++t )
+            {
+                sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( rows[ t ] + i ), weights[ t ] ) );
+            }
+            _mm_storeu_ps( out + i, sum );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT GenerateSliceMips( _In_ size_t width,
+                                  _In_ size_t height,
+                                  _In_ size_t mipCount,
+                                  _In_ MIP_FILTER filter,
+                                  _In_ bool gammaCorrect,
+                                  _In_reads_bytes_(width*height*4) const uint8_t* srcBits,
+                                  _Out_ uint8_t* dstBits )
+{
+    // Level 1 is the largest target and the horizontal Kaiser pass the largest scratch;
+    // every later level fits in whichever buffer the level before it used
+    const size_t levelFloats = width * height * 4;
+    const size_t halfWidth = std::max<size_t>( width >> 1, 1 );
+    const size_t halfHeight = std::max<size_t>( height >> 1, 1 );
+    std::unique_ptr<float[]> current( new (std::nothrow) float[ levelFloats ] );
+    std::unique_ptr<float[]> next( new (std::nothrow) float[ halfWidth * halfHeight * 4 ] );
+    std::unique_ptr<float[]> scratch;
+    if ( filter == MIP_FILTER_KAISER )
+    {
+        scratch.reset( new (std::nothrow) float[ halfWidth * height * 4 ] );
+        if ( !scratch )
+            return E_OUTOFMEMORY;
+    }
+
+    if ( !current || !next )
+        return E_OUTOFMEMORY;
+
+    // The top level is copied through untouched
+    memcpy( dstBits, srcBits, width * height * 4 );
+    dstBits += width * height * 4;
+
+    for( size_t y = 0; y < height; ++y )
+    {
+        DecodeRow( srcBits + y * width * 4, width, gammaCorrect, current.get() + y * width * 4 );
+    }
+
+    size_t w = width;
+    size_t h = height;
+    for( size_t level = 1; level < mipCount; ++level )
+    {
+        size_t nw = std::max<size_t>( w >> 1, 1 );
+        size_t nh = std::max<size_t>( h >> 1, 1 );
+
+        if ( filter == MIP_FILTER_KAISER )
+        {
+            ReduceKaiser( current.get(), w, h, scratch.get(), next.get(), nw, nh );
+        }
+        else
+        {
+            ReduceBox( current.get(), w, h, next.get(), nw, nh );
+        }
+
+        for( size_t y = 0; y < nh; ++y )
+        {
+            EncodeRow( next.get() + y * nw * 4, nw, gammaCorrect, dstBits + y * nw * 4 );
+        }
+        dstBits += nw * nh * 4;
+
+        std::swap( current, next );
+        w = nw;
+        h = nh;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT GenerateMipChain( _In_ size_t width,
+                          _In_ size_t height,
+                          _In_ size_t arraySize,
+                          _In_ DXGI_FORMAT format,
+                          _In_ MIP_FILTER filter,
+                          _In_ bool gammaCorrect,
+                          _In_reads_bytes_(bitSize) const uint8_t* bitData,
+                          _In_ size_t bitSize,
+                          std::unique_ptr<uint8_t[]>& mipData,
+                          _Out_ size_t* mipDataSize,
+                          _Out_ size_t* mipCount )
+{
+    if ( !bitData || !mipDataSize || !mipCount )
+        return E_POINTER;
+
+    *mipDataSize = 0;
+    *mipCount = 0;
+
+    if ( !width || !height || !arraySize || !CanGenerateMipChain( format ) )
+        return E_INVALIDARG;
+
+    const size_t topLevelSize = width * height * 4;
+    if ( bitSize < topLevelSize * arraySize )
+        return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+
+    if ( IsSRGB( format ) )
+        gammaCorrect = true;
+
+    const size_t levels = CountMipLevels( width, height );
+    size_t sliceSize = 0;
+    for( size_t level = 0; level < levels; ++level )
+    {
+        sliceSize += std::max<size_t>( width >> level, 1 ) * std::max<size_t>( height >> level, 1 ) * 4;
+    }
+
+    mipData.reset( new (std::nothrow) uint8_t[ sliceSize * arraySize ] );
+    if ( !mipData )
+        return E_OUTOFMEMORY;
+
+    uint8_t* dstBits = mipData.get();
+
+    // Faces and array slices are independent, so they are spread over the available cores
+    size_t workerCount = std::min<size_t>( arraySize, std::max<unsigned>( std::thread::hardware_concurrency(), 1u ) );
+    std::atomic<size_t> nextSlice( 0 );
+    std::atomic<HRESULT> result( S_OK );
+
+    auto worker = [&]()
+    {
+        for( size_t slice = nextSlice++; slice < arraySize; slice = nextSlice++ )
+        {
+            HRESULT hr = GenerateSliceMips( width, height, levels, filter, gammaCorrect,
+                                            bitData + slice * topLevelSize,
+                                            dstBits + slice * sliceSize );
+            if ( FAILED(hr) )
+                result = hr;
+        }
+    };
+
+    if ( workerCount <= 1 )
+    {
+        worker();
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        for( size_t i = 1; i < workerCount; ++i )
+        {
+            workers.push_back( std::thread( worker ) );
+        }
+        worker();
+        for( size_t i = 0; i < workers.size(); ++i )
+        {
+            workers[ i ].join();
+        }
+    }
+
+    if ( FAILED( result.load() ) )
+    {
+        mipData.reset();
+        return result.load();
+    }
+
+    *mipDataSize = sliceSize * arraySize;
+    *mipCount = levels;
+    return S_OK;
+}
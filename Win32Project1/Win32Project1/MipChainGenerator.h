@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// File: MipChainGenerator.h
+//
+// Functions for building a full mip chain on the CPU for textures that ship with only
+// their top level
+//
+// The generated chain is written in the same layout a DDS file stores its surfaces in
+// (every mip of array slice 0, then every mip of slice 1, ...), so the result can be
+// handed straight to the DDS loader's FillInitData.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11.h>
+#include <memory>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+enum MIP_FILTER
+{
+    MIP_FILTER_BOX = 0,     // 2x2 average, cheapest
+    MIP_FILTER_KAISER,      // Separable 6-tap Kaiser-windowed sinc, keeps more detail
+};
+
+// True for the uncompressed 32bpp colour formats the generator can filter
+bool CanGenerateMipChain( _In_ DXGI_FORMAT format );
+
+// Returns the number of levels in a full chain down to 1x1
+size_t CountMipLevels( _In_ size_t width, _In_ size_t height );
+
+// Builds the full chain for every array slice (cube faces count as slices). 'bitData'
+// holds the top level of each slice, tightly packed. When 'gammaCorrect' is set the colour
+// channels are filtered in linear space; _SRGB formats are always treated that way. Slices
+// are filtered in parallel.
+HRESULT GenerateMipChain( _In_ size_t width,
+                          _In_ size_t height,
+                          _In_ size_t arraySize,
+                          _In_ DXGI_FORMAT format,
+                          _In_ MIP_FILTER filter,
+                          _In_ bool gammaCorrect,
+                          _In_reads_bytes_(bitSize) const uint8_t* bitData,
+                          _In_ size_t bitSize,
+                          std::unique_ptr<uint8_t[]>& mipData,
+                          _Out_ size_t* mipDataSize,
+                          _Out_ size_t* mipCount
+                        );
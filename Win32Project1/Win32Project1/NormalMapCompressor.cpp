@@ -0,0 +1,847 @@
+//--------------------------------------------------------------------------------------
+// File: NormalMapCompressor.cpp
+//
+// Functions for cooking tangent space normal maps into two channel block compressed DDS
+// data and creating a Direct3D 11 runtime resource for them
+//
+// Each 4x4 block is encoded one channel at a time. A channel starts from the endpoints
+// spanning its values and moves each by up to two steps for as long as the error goes
+// down; the error is that of the whole normal, with the other channel as already encoded
+// and Z rebuilt the way the shader does it, so a channel spends its precision where the
+// rebuilt Z is most sensitive. X is encoded, then Y against it, then X again against Y.
+// BC4 blocks also try the six value mode with explicit 0 and 1.
+//--------------------------------------------------------------------------------------
+
+#include <dxgiformat.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "NormalMapCompressor.h"
+#include "DDSTextureLoader.h"
+#include "PNGTextureLoader.h"
+
+//--------------------------------------------------------------------------------------
+// DDS file structure definitions for the files written here
+//--------------------------------------------------------------------------------------
+#define NORMAL_MAP_FOURCC( ch0, ch1, ch2, ch3 ) \
+            ( (uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | \
+              ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24) )
+
+#define NORMAL_MAP_DDS_MAGIC        NORMAL_MAP_FOURCC( 'D', 'D', 'S', ' ' )
+#define NORMAL_MAP_COOK_TAG         NORMAL_MAP_FOURCC( 'N', 'M', 'A', 'P' )
+#define NORMAL_MAP_COOK_VERSION     1
+
+#define NORMAL_MAP_SEARCH_RADIUS    2
+#define NORMAL_MAP_SEARCH_PASSES    8
+#define NORMAL_MAP_FLAT_ERROR       ( 16.f * ( 0.25f / 127.5f ) * ( 0.25f / 127.5f ) )
+
+namespace
+{
+#pragma pack(push,1)
+    struct NORMAL_MAP_DDS_PIXELFORMAT
+    {
+        uint32_t    size;
+        uint32_t    flags;
+        uint32_t    fourCC;
+        uint32_t    RGBBitCount;
+        uint32_t    RBitMask;
+        uint32_t    GBitMask;
+        uint32_t    BBitMask;
+        uint32_t    ABitMask;
+    };
+
+    struct NORMAL_MAP_DDS_HEADER
+    {
+        uint32_t    size;
+        uint32_t    flags;
+        uint32_t    height;
+        uint32_t    width;
+        uint32_t    pitchOrLinearSize;
+        uint32_t    depth;
+        uint32_t    mipMapCount;
+        uint32_t    reserved1[11];  // [0] tag, [1] version, [2] and [3] the error in degrees as floats
+        NORMAL_MAP_DDS_PIXELFORMAT ddspf;
+        uint32_t    caps;
+        uint32_t    caps2;
+        uint32_t    caps3;
+        uint32_t    caps4;
+        uint32_t    reserved2;
+    };
+#pragma pack(pop)
+
+    // One 4x4 block of unit normals with z >= 0. Texels past the edge of a small mip repeat
+    // the last row or column and do not count towards the error.
+    struct NORMAL_BLOCK
+    {
+        float n[16][3];
+        bool inside[16];
+    };
+
+    enum CHANNEL_MODE
+    {
+        CHANNEL_BC4_EIGHT = 0,  // e0 > e1, eight interpolated values
+        CHANNEL_BC4_SIX,        // e0 <= e1, six interpolated values plus 0 and 1
+        CHANNEL_565_GREEN,      // Six bit endpoints, four values
+    };
+
+    struct CHANNEL_ENCODING
+    {
+        CHANNEL_MODE mode;
+        int e0;
+        int e1;
+        int count;
+        float palette[8];       // Decoded values in [-1, 1], by index code
+        uint8_t codes[16];
+        float error;
+    };
+}
+
+//--------------------------------------------------------------------------------------
+static void BuildPalette( _Inout_ CHANNEL_ENCODING& enc )
+{
+    float unorm[8];
+    if ( enc.mode == CHANNEL_565_GREEN )
+    {
+        float g0 = float( enc.e0 ) / 63.f;
+        float g1 = float( enc.e1 ) / 63.f;
+        unorm[ 0 ] = g0;
+        unorm[ 1 ] = g1;
+        unorm[ 2 ] = ( 2.f * g0 + g1 ) / 3.f;
+        unorm[ 3 ] = ( g0 + 2.f * g1 ) / 3.f;
+        enc.count = 4;
+    }
+    else
+    {
+        float v0 = float( enc.e0 ) / 255.f;
+        float v1 = float( enc.e1 ) / 255.f;
+        unorm[ 0 ] = v0;
+        unorm[ 1 ] = v1;
+        if ( enc.mode == CHANNEL_BC4_EIGHT )
+        {
+            for( int k = 2; k < 8; ++k )
+            {
+                unorm[ k ] = ( float( 8 - k ) * v0 + float( k - 1 ) * v1 ) / 7.f;
+            }
+        }
+        else
+        {
+            for( int k = 2; k < 6; ++k )
+            {
+                unorm[ k ] = ( float( 6 - k ) * v0 + float( k - 1 ) * v1 ) / 5.f;
+            }
+            unorm[ 6 ] = 0.f;
+            unorm[ 7 ] = 1.f;
+        }
+        enc.count = 8;
+    }
+
+    for( int k = 0; k < enc.count; ++k )
+    {
+        enc.palette[ k ] = unorm[ k ] * 2.f - 1.f;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Error of one texel once 'value' is decoded for 'channel' and 'other' for the other one.
+// The other channel's own error does not depend on this choice and is left out.
+static inline float TexelError( _In_ const float* n, _In_ int channel, _In_ float value, _In_ float other )
+{
+    float z = sqrtf( std::max<float>( 0.f, 1.f - value * value - other * other ) );
+    float dc = n[ channel ] - value;
+    float dz = n[ 2 ] - z;
+    return dc * dc + dz * dz;
+}
+
+//--------------------------------------------------------------------------------------
+// Picks codes by the nearest value in the channel, which is cheap enough for the endpoint
+// search, and returns the error that leaves. Stops early once the error reaches 'limit'.
+static float EvaluateChannel( _In_ const NORMAL_BLOCK& block,
+                              _In_ int channel,
+                              _In_reads_(16) const float* other,
+                              _In_ const CHANNEL_ENCODING& enc,
+                              _In_ float limit )
+{
+    float error = 0.f;
+    for( int i = 0; i < 16; ++i )
+    {
+        float t = block.n[ i ][ channel ];
+        int best = 0;
+        float bestDistance = fabsf( enc.palette[ 0 ] - t );
+        for( int k = 1; k < enc.count; ++k )
+        {
+            float distance = fabsf( enc.palette[ k ] - t );
+            if ( distance < bestDistance )
+            {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        error += TexelError( block.n[ i ], channel, enc.palette[ best ], other[ i ] );
+        if ( error >= limit )
+            break;
+    }
+    return error;
+}
+
+//--------------------------------------------------------------------------------------
+// Final codes are picked against the whole normal
+static void PickCodes( _In_ const NORMAL_BLOCK& block,
+                       _In_ int channel,
+                       _In_reads_(16) const float* other,
+                       _Inout_ CHANNEL_ENCODING& enc )
+{
+    enc.error = 0.f;
+    for( int i = 0; i < 16; ++i )
+    {
+        int best = 0;
+        float bestError = TexelError( block.n[ i ], channel, enc.palette[ 0 ], other[ i ] );
+        for( int k = 1; k < enc.count; ++k )
+        {
+            float error = TexelError( block.n[ i ], channel, enc.palette[ k ], other[ i ] );
+            if ( error < bestError )
+            {
+                bestError = error;
+                best = k;
+            }
+        }
+        enc.codes[ i ] = static_cast<uint8_t>( best );
+        enc.error += bestError;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+static inline bool EndpointsAllowed( _In_ CHANNEL_MODE mode, _In_ int e0, _In_ int e1, _In_ int maxValue )
+{
+    if ( e0 < 0 || e1 < 0 || e0 > maxValue || e1 > maxValue )
+        return false;
+    if ( mode == CHANNEL_BC4_EIGHT )
+        return e0 > e1;
+    if ( mode == CHANNEL_BC4_SIX )
+        return e0 <= e1;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+static CHANNEL_ENCODING SearchChannel( _In_ const NORMAL_BLOCK& block,
+                                       _In_ int channel,
+                                       _In_reads_(16) const float* other,
+                                       _In_ CHANNEL_MODE mode,
+                                       _In_ int e0,
+                                       _In_ int e1 )
+{
+    const int maxValue = ( mode == CHANNEL_565_GREEN ) ? 63 : 255;
+
+    CHANNEL_ENCODING best;
+    best.mode = mode;
+    best.e0 = e0;
+    best.e1 = e1;
+    BuildPalette( best );
+    best.error = EvaluateChannel( block, channel, other, best, FLT_MAX );
+
+    // Flat blocks already land within a quarter step of every texel
+    const int passes = ( best.error < NORMAL_MAP_FLAT_ERROR ) ? 0 : NORMAL_MAP_SEARCH_PASSES;
+
+    CHANNEL_ENCODING candidate = best;
+    for( int pass = 0; pass < passes; ++pass )
+    {
+        const int center0 = best.e0;
+        const int center1 = best.e1;
+        bool improved = false;
+        for( int d0 = -NORMAL_MAP_SEARCH_RADIUS; d0 <= NORMAL_MAP_SEARCH_RADIUS; ++d0 )
+        {
+            for( int d1 = -NORMAL_MAP_SEARCH_RADIUS; d1 <= NORMAL_MAP_SEARCH_RADIUS; ++d1 )
+            {
+                candidate.e0 = center0 + d0;
+                candidate.e1 = center1 + d1;
+                if ( ( !d0 && !d1 ) || !EndpointsAllowed( mode, candidate.e0, candidate.e1, maxValue ) )
+                    continue;
+
+                BuildPalette( candidate );
+                candidate.error = EvaluateChannel( block, channel, other, candidate, best.error );
+                if ( candidate.error < best.error )
+                {
+                    best = candidate;
+                    improved = true;
+                }
+            }
+        }
+        if ( !improved )
+            break;
+    }
+
+    PickCodes( block, channel, other, best );
+    return best;
+}
+
+//--------------------------------------------------------------------------------------
+static CHANNEL_ENCODING EncodeChannel( _In_ const NORMAL_BLOCK& block,
+                                       _In_ int channel,
+                                       _In_reads_(16) const float* other,
+                                       _In_ bool green565 )
+{
+    // Everything below works on the channel as the unorm it is stored as, 0 to 255
+    float lo = 255.f;
+    float hi = 0.f;
+    float innerLo = 255.f;
+    float innerHi = 0.f;
+    for( int i = 0; i < 16; ++i )
+    {
+        float u = ( block.n[ i ][ channel ] + 1.f ) * 127.5f;
+        lo = std::min<float>( lo, u );
+        hi = std::max<float>( hi, u );
+        if ( u > 2.f && u < 253.f )
+        {
+            innerLo = std::min<float>( innerLo, u );
+            innerHi = std::max<float>( innerHi, u );
+        }
+    }
+
+    if ( green565 )
+    {
+        int g0 = static_cast<int>( hi * 63.f / 255.f + 0.5f );
+        int g1 = static_cast<int>( lo * 63.f / 255.f + 0.5f );
+        return SearchChannel( block, channel, other, CHANNEL_565_GREEN, g0, g1 );
+    }
+
+    int e0 = static_cast<int>( hi + 0.5f );
+    int e1 = static_cast<int>( lo + 0.5f );
+    if ( e0 == e1 )
+    {
+        if ( e0 < 255 )
+            ++e0;
+        else
+            --e1;
+    }
+    CHANNEL_ENCODING eight = SearchChannel( block, channel, other, CHANNEL_BC4_EIGHT, e0, e1 );
+
+    // The six value mode only helps a block that reaches one of the extremes, and only
+    // with endpoints spanning the values between them
+    if ( lo > 2.f && hi < 253.f )
+        return eight;
+
+    if ( innerLo > innerHi )
+    {
+        innerLo = lo;
+        innerHi = lo;
+    }
+    CHANNEL_ENCODING six = SearchChannel( block, channel, other, CHANNEL_BC4_SIX,
+                                          static_cast<int>( innerLo + 0.5f ),
+                                          static_cast<int>( innerHi + 0.5f ) );
+    return ( six.error < eight.error ) ? six : eight;
+}
+
+//--------------------------------------------------------------------------------------
+static void WriteBC4Block( _In_ const CHANNEL_ENCODING& enc, _Out_writes_bytes_(8) uint8_t* dst )
+{
+    dst[ 0 ] = static_cast<uint8_t>( enc.e0 );
+    dst[ 1 ] = static_cast<uint8_t>( enc.e1 );
+    uint64_t bits = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+        bits |= uint64_t( enc.codes[ i ] ) << ( 3 * i );
+    }
+    for( int b = 0; b < 6; ++b )
+    {
+        dst[ 2 + b ] = static_cast<uint8_t>( bits >> ( 8 * b ) );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Red at 31 and blue at 0 on both endpoints, so the colour block only carries Y
+static void WriteGreenBlock( _In_ const CHANNEL_ENCODING& enc, _Out_writes_bytes_(8) uint8_t* dst )
+{
+    // BC3 colour blocks always decode as four colours, but keeping color0 above color1
+    // reads the same on anything that treats them like BC1
+    static const uint8_t swapped[ 4 ] = { 1, 0, 3, 2 };
+    bool swap = enc.e0 < enc.e1;
+    int g0 = swap ? enc.e1 : enc.e0;
+    int g1 = swap ? enc.e0 : enc.e1;
+
+    uint16_t color0 = static_cast<uint16_t>( 0xF800 | ( g0 << 5 ) );
+    uint16_t color1 = static_cast<uint16_t>( 0xF800 | ( g1 << 5 ) );
+    uint32_t bits = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+        uint32_t code = ( g0 == g1 ) ? 0 : ( swap ? swapped[ enc.codes[ i ] ] : enc.codes[ i ] );
+        bits |= code << ( 2 * i );
+    }
+
+    memcpy( dst, &color0, 2 );
+    memcpy( dst + 2, &color1, 2 );
+    memcpy( dst + 4, &bits, 4 );
+}
+
+//--------------------------------------------------------------------------------------
+// Encodes one block into 16 bytes and adds its angular error to 'sumDegrees'/'maxDegrees'
+static void EncodeBlock( _In_ const NORMAL_BLOCK& block,
+                         _In_ bool bc5,
+                         _Out_writes_bytes_(16) uint8_t* dst,
+                         _Inout_ double& sumDegrees,
+                         _Inout_ float& maxDegrees )
+{
+    float decodedX[ 16 ];
+    float decodedY[ 16 ];
+    for( int i = 0; i < 16; ++i )
+    {
+        decodedY[ i ] = block.n[ i ][ 1 ];
+    }
+
+    CHANNEL_ENCODING x = EncodeChannel( block, 0, decodedY, false );
+    for( int i = 0; i < 16; ++i )
+    {
+        decodedX[ i ] = x.palette[ x.codes[ i ] ];
+    }
+
+    CHANNEL_ENCODING y = EncodeChannel( block, 1, decodedX, !bc5 );
+    for( int i = 0; i < 16; ++i )
+    {
+        decodedY[ i ] = y.palette[ y.codes[ i ] ];
+    }
+
+    x = EncodeChannel( block, 0, decodedY, false );
+    for( int i = 0; i < 16; ++i )
+    {
+        decodedX[ i ] = x.palette[ x.codes[ i ] ];
+    }
+    PickCodes( block, 1, decodedX, y );
+
+    if ( bc5 )
+    {
+        WriteBC4Block( x, dst );
+        WriteBC4Block( y, dst + 8 );
+    }
+    else
+    {
+        WriteBC4Block( x, dst );
+        WriteGreenBlock( y, dst + 8 );
+    }
+
+    const float toDegrees = 57.2957795f;
+    for( int i = 0; i < 16; ++i )
+    {
+        if ( !block.inside[ i ] )
+            continue;
+
+        float dx = x.palette[ x.codes[ i ] ];
+        float dy = y.palette[ y.codes[ i ] ];
+        float dz = sqrtf( std::max<float>( 0.f, 1.f - dx * dx - dy * dy ) );
+        float length = sqrtf( dx * dx + dy * dy + dz * dz );
+        float cosine = ( block.n[ i ][ 0 ] * dx + block.n[ i ][ 1 ] * dy + block.n[ i ][ 2 ] * dz ) / std::max<float>( length, 1e-6f );
+        float degrees = acosf( std::min<float>( std::max<float>( cosine, -1.f ), 1.f ) ) * toDegrees;
+        sumDegrees += degrees;
+        maxDegrees = std::max<float>( maxDegrees, degrees );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+static inline void Normalize( _Inout_updates_(3) float* n )
+{
+    float length = sqrtf( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ] );
+    if ( length < 1e-6f )
+    {
+        n[ 0 ] = 0.f;
+        n[ 1 ] = 0.f;
+        n[ 2 ] = 1.f;
+        return;
+    }
+    n[ 0 ] /= length;
+    n[ 1 ] /= length;
+    n[ 2 ] /= length;
+}
+
+//--------------------------------------------------------------------------------------
+static size_t BlockLevelSize( _In_ size_t width, _In_ size_t height )
+{
+    return std::max<size_t>( 1, ( width + 3 ) / 4 ) * std::max<size_t>( 1, ( height + 3 ) / 4 ) * 16;
+}
+
+
+//--------------------------------------------------------------------------------------
+DXGI_FORMAT ChooseNormalMapFormat( _In_ ID3D11Device* d3dDevice )
+{
+    UINT support = 0;
+    if ( d3dDevice
+         && d3dDevice->GetFeatureLevel() >= D3D_FEATURE_LEVEL_10_0
+         && SUCCEEDED( d3dDevice->CheckFormatSupport( DXGI_FORMAT_BC5_UNORM, &support ) )
+         && ( support & D3D11_FORMAT_SUPPORT_SHADER_SAMPLE ) )
+    {
+        return DXGI_FORMAT_BC5_UNORM;
+    }
+    return DXGI_FORMAT_BC3_UNORM;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT CompressNormalMap( _In_ size_t width,
+                           _In_ size_t height,
+                           _In_reads_bytes_(rowPitch * height) const uint8_t* pixels,
+                           _In_ size_t rowPitch,
+                           _In_ DXGI_FORMAT format,
+                           std::unique_ptr<uint8_t[]>& ddsData,
+                           _Out_ size_t* ddsDataSize,
+                           _Out_opt_ NORMAL_MAP_ERROR* error )
+{
+    if ( !pixels || !ddsDataSize )
+        return E_POINTER;
+
+    *ddsDataSize = 0;
+    if ( error )
+    {
+        memset( error, 0, sizeof( NORMAL_MAP_ERROR ) );
+    }
+
+    if ( !width || !height || width > 16384 || height > 16384 || rowPitch < width * 4 )
+        return E_INVALIDARG;
+    if ( format != DXGI_FORMAT_BC5_UNORM && format != DXGI_FORMAT_BC3_UNORM )
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+
+    // Every level as unit vectors. Z is forced non-negative since the shader can only
+    // rebuild the positive root.
+    size_t levels = 1;
+    while( ( width >> levels ) || ( height >> levels ) )
+    {
+        ++levels;
+    }
+
+    std::vector< std::vector<float> > normals( levels );
+    normals[ 0 ].resize( width * height * 3 );
+    for( size_t y = 0; y < height; ++y )
+    {
+        const uint8_t* src = pixels + y * rowPitch;
+        float* dst = &normals[ 0 ][ y * width * 3 ];
+        for( size_t x = 0; x < width; ++x, src += 4, dst += 3 )
+        {
+            dst[ 0 ] = float( src[ 0 ] ) / 127.5f - 1.f;
+            dst[ 1 ] = float( src[ 1 ] ) / 127.5f - 1.f;
+            dst[ 2 ] = std::max<float>( float( src[ 2 ] ) / 127.5f - 1.f, 0.f );
+            Normalize( dst );
+        }
+    }
+
+    for( size_t level = 1; level < levels; ++level )
+    {
+        const size_t srcWidth = std::max<size_t>( width >> ( level - 1 ), 1 );
+        const size_t srcHeight = std::max<size_t>( height >> ( level - 1 ), 1 );
+        const size_t dstWidth = std::max<size_t>( width >> level, 1 );
+        const size_t dstHeight = std::max<size_t>( height >> level, 1 );
+        const std::vector<float>& src = normals[ level - 1 ];
+        std::vector<float>& dst = normals[ level ];
+        dst.resize( dstWidth * dstHeight * 3 );
+
+        for( size_t y = 0; y < dstHeight; ++y )
+        {
+            size_t y0 = std::min<size_t>( y * 2, srcHeight - 1 );
+            size_t y1 = std::min<size_t>( y * 2 + 1, srcHeight - 1 );
+            for( size_t x = 0; x < dstWidth; ++x )
+            {
+                size_t x0 = std::min<size_t>( x * 2, srcWidth - 1 );
+                size_t x1 = std::min<size_t>( x * 2 + 1, srcWidth - 1 );
+                float* n = &dst[ ( y * dstWidth + x ) * 3 ];
+                for( int c = 0; c < 3; ++c )
+                {
+                    n[ c ] = src[ ( y0 * srcWidth + x0 ) * 3 + c ] + src[ ( y0 * srcWidth + x1 ) * 3 + c ]
+                           + src[ ( y1 * srcWidth + x0 ) * 3 + c ] + src[ ( y1 * srcWidth + x1 ) * 3 + c ];
+                }
+                Normalize( n );
+            }
+        }
+    }
+
+    // Lay out the file: magic, header, then every level's blocks in order
+    std::vector<size_t> levelOffsets( levels );
+    size_t totalSize = sizeof( uint32_t ) + sizeof( NORMAL_MAP_DDS_HEADER );
+    for( size_t level = 0; level < levels; ++level )
+    {
+        levelOffsets[ level ] = totalSize;
+        totalSize += BlockLevelSize( std::max<size_t>( width >> level, 1 ), std::max<size_t>( height >> level, 1 ) );
+    }
+
+    std::unique_ptr<uint8_t[]> data( new (std::nothrow) uint8_t[ totalSize ] );
+    if ( !data )
+        return E_OUTOFMEMORY;
+
+    // One job per row of blocks across every level; the top level's rows keep their error
+    struct BLOCK_ROW_JOB
+    {
+        size_t level;
+        size_t blockRow;
+    };
+    std::vector<BLOCK_ROW_JOB> jobs;
+    for( size_t level = 0; level < levels; ++level )
+    {
+        size_t blockRows = ( std::max<size_t>( height >> level, 1 ) + 3 ) / 4;
+        for( size_t row = 0; row < blockRows; ++row )
+        {
+            BLOCK_ROW_JOB job = { level, row };
+            jobs.push_back( job );
+        }
+    }
+    const size_t topRows = ( height + 3 ) / 4;
+    std::vector<double> rowSums( topRows, 0.0 );
+    std::vector<float> rowMaxes( topRows, 0.f );
+
+    const bool bc5 = ( format == DXGI_FORMAT_BC5_UNORM );
+    std::atomic<size_t> nextJob( 0 );
+    auto worker = [&]()
+    {
+        for( size_t j = nextJob++; j < jobs.size(); j = nextJob++ )
+        {
+            const size_t level = jobs[ j ].level;
+            const size_t levelWidth = std::max<size_t>( width >> level, 1 );
+            const size_t levelHeight = std::max<size_t>( height >> level, 1 );
+            const size_t blocksWide = ( levelWidth + 3 ) / 4;
+            const std::vector<float>& src = normals[ level ];
+            uint8_t* dst = data.get() + levelOffsets[ level ] + jobs[ j ].blockRow * blocksWide * 16;
+
+            double sumDegrees = 0.0;
+            float maxDegrees = 0.f;
+            for( size_t bx = 0; bx < blocksWide; ++bx, dst += 16 )
+            {
+                NORMAL_BLOCK block;
+                for( size_t i = 0; i < 16; ++i )
+                {
+                    size_t x = bx * 4 + ( i & 3 );
+                    size_t y = jobs[ j ].blockRow * 4 + ( i >> 2 );
+                    block.inside[ i ] = ( x < levelWidth && y < levelHeight );
+                    const float* n = &src[ ( std::min<size_t>( y, levelHeight - 1 ) * levelWidth + std::min<size_t>( x, levelWidth - 1 ) ) * 3 ];
+                    block.n[ i ][ 0 ] = n[ 0 ];
+                    block.n[ i ][ 1 ] = n[ 1 ];
+                    block.n[ i ][ 2 ] = n[ 2 ];
+                }
+                EncodeBlock( block, bc5, dst, sumDegrees, maxDegrees );
+            }
+
+            if ( level == 0 )
+            {
+                rowSums[ jobs[ j ].blockRow ] = sumDegrees;
+                rowMaxes[ jobs[ j ].blockRow ] = maxDegrees;
+            }
+        }
+    };
+
+    size_t workerCount = std::min<size_t>( jobs.size(), std::max<unsigned>( std::thread::hardware_concurrency(), 1u ) );
+    std::vector<std::thread> workers;
+    for( size_t i = 1; i < workerCount; ++i )
+    {
+        workers.push_back( std::thread( worker ) );
+    }
+    worker();
+    for( size_t i = 0; i < workers.size(); ++i )
+    {
+        workers[ i ].join();
+    }
+
+    NORMAL_MAP_ERROR cookError = { 0.f, 0.f };
+    double totalDegrees = 0.0;
+    for( size_t row = 0; row < topRows; ++row )
+    {
+        totalDegrees += rowSums[ row ];
+        cookError.maxDegrees = std::max<float>( cookError.maxDegrees, rowMaxes[ row ] );
+    }
+    cookError.meanDegrees = static_cast<float>( totalDegrees / double( width * height ) );
+
+    uint32_t magic = NORMAL_MAP_DDS_MAGIC;
+    memcpy( data.get(), &magic, sizeof( magic ) );
+
+    NORMAL_MAP_DDS_HEADER header;
+    memset( &header, 0, sizeof( header ) );
+    header.size = sizeof( NORMAL_MAP_DDS_HEADER );
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;   // caps, height, width, pixel format, mip count, linear size
+    header.height = static_cast<uint32_t>( height );
+    header.width = static_cast<uint32_t>( width );
+    header.pitchOrLinearSize = static_cast<uint32_t>( BlockLevelSize( width, height ) );
+    header.mipMapCount = static_cast<uint32_t>( levels );
+    header.reserved1[ 0 ] = NORMAL_MAP_COOK_TAG;
+    header.reserved1[ 1 ] = NORMAL_MAP_COOK_VERSION;
+    memcpy( &header.reserved1[ 2 ], &cookError.meanDegrees, sizeof( float ) );
+    memcpy( &header.reserved1[ 3 ], &cookError.maxDegrees, sizeof( float ) );
+    header.ddspf.size = sizeof( NORMAL_MAP_DDS_PIXELFORMAT );
+    header.ddspf.flags = 0x4;   // DDPF_FOURCC
+    header.ddspf.fourCC = bc5 ? NORMAL_MAP_FOURCC( 'A', 'T', 'I', '2' ) : NORMAL_MAP_FOURCC( 'D', 'X', 'T', '5' );
+    header.caps = 0x1000 | 0x8 | 0x400000;  // texture, complex, mipmap
+    memcpy( data.get() + sizeof( magic ), &header, sizeof( header ) );
+
+    ddsData.swap( data );
+    *ddsDataSize = totalSize;
+    if ( error )
+    {
+        *error = cookError;
+    }
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+static bool ReadCookedError( _In_reads_bytes_(dataSize) const uint8_t* data, _In_ size_t dataSize, _Out_ NORMAL_MAP_ERROR* error )
+{
+    memset( error, 0, sizeof( NORMAL_MAP_ERROR ) );
+    if ( dataSize < sizeof( uint32_t ) + sizeof( NORMAL_MAP_DDS_HEADER ) )
+        return false;
+
+    uint32_t magic;
+    NORMAL_MAP_DDS_HEADER header;
+    memcpy( &magic, data, sizeof( magic ) );
+    memcpy( &header, data + sizeof( magic ), sizeof( header ) );
+    if ( magic != NORMAL_MAP_DDS_MAGIC || header.reserved1[ 0 ] != NORMAL_MAP_COOK_TAG || header.reserved1[ 1 ] != NORMAL_MAP_COOK_VERSION )
+        return false;
+
+    memcpy( &error->meanDegrees, &header.reserved1[ 2 ], sizeof( float ) );
+    memcpy( &error->maxDegrees, &header.reserved1[ 3 ], sizeof( float ) );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+static unsigned long long HashNormalMap( _In_reads_bytes_(dataSize) const uint8_t* data, _In_ size_t dataSize, _In_ DXGI_FORMAT format )
+{
+    // FNV-1a over the source file, then the format and cooker version it was cooked with
+    unsigned long long hash = 14695981039346656037ULL;
+    for( size_t i = 0; i < dataSize; ++i )
+    {
+        hash = ( hash ^ data[ i ] ) * 1099511628211ULL;
+    }
+    hash = ( hash ^ static_cast<unsigned long long>( format ) ) * 1099511628211ULL;
+    hash = ( hash ^ NORMAL_MAP_COOK_VERSION ) * 1099511628211ULL;
+    return hash;
+}
+
+//--------------------------------------------------------------------------------------
+static bool ReadWholeFile( _In_z_ const wchar_t* fileName, std::unique_ptr<uint8_t[]>& data, _Out_ size_t* dataSize )
+{
+    *dataSize = 0;
+    HANDLE file = CreateFileW( fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER fileSize = { 0 };
+    DWORD bytesRead = 0;
+    bool read = GetFileSizeEx( file, &fileSize ) && fileSize.HighPart == 0;
+    if ( read )
+    {
+        data.reset( new (std::nothrow) uint8_t[ std::max<DWORD>( fileSize.LowPart, 1 ) ] );
+        read = data && ReadFile( file, data.get(), fileSize.LowPart, &bytesRead, nullptr ) && bytesRead == fileSize.LowPart;
+    }
+    CloseHandle( file );
+
+    if ( read )
+        *dataSize = fileSize.LowPart;
+    return read;
+}
+
+//--------------------------------------------------------------------------------------
+static void WriteCookedFile( _In_z_ const wchar_t* cacheDirectory, _In_z_ const wchar_t* fileName, _In_reads_bytes_(dataSize) const uint8_t* data, _In_ size_t dataSize )
+{
+    // A failed write only means the map is cooked again next run
+    CreateDirectoryW( cacheDirectory, nullptr );
+    HANDLE file = CreateFileW( fileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+        return;
+
+    DWORD bytesWritten = 0;
+    bool written = WriteFile( file, data, static_cast<DWORD>( dataSize ), &bytesWritten, nullptr ) && bytesWritten == dataSize;
+    CloseHandle( file );
+
+    if ( !written )
+        DeleteFileW( fileName );
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT CreateNormalMapTextureFromMemory( _In_ ID3D11Device* d3dDevice,
+                                          _In_reads_bytes_(dataSize) const uint8_t* data,
+                                          _In_ size_t dataSize,
+                                          _In_opt_z_ const wchar_t* cacheDirectory,
+                                          _Out_opt_ ID3D11Resource** texture,
+                                          _Out_opt_ ID3D11ShaderResourceView** textureView,
+                                          _Out_opt_ NORMAL_MAP_ERROR* error )
+{
+    if ( !d3dDevice || !data || ( !texture && !textureView ) )
+    {
+        return E_INVALIDARG;
+    }
+
+    NORMAL_MAP_ERROR cookError;
+    uint32_t magic = 0;
+    if ( dataSize >= sizeof( magic ) )
+    {
+        memcpy( &magic, data, sizeof( magic ) );
+    }
+
+    // Already cooked
+    if ( magic == NORMAL_MAP_DDS_MAGIC )
+    {
+        ReadCookedError( data, dataSize, &cookError );
+        if ( error )
+        {
+            *error = cookError;
+        }
+        return CreateDDSTextureFromMemory( d3dDevice, data, dataSize, texture, textureView );
+    }
+
+    const DXGI_FORMAT format = ChooseNormalMapFormat( d3dDevice );
+    wchar_t cookedName[ MAX_PATH ] = {};
+    if ( cacheDirectory )
+    {
+        swprintf_s( cookedName, MAX_PATH, L"%s\\%016llx.dds", cacheDirectory, HashNormalMap( data, dataSize, format ) );
+    }
+
+    std::unique_ptr<uint8_t[]> ddsData;
+    size_t ddsDataSize = 0;
+    bool cached = cacheDirectory && ReadWholeFile( cookedName, ddsData, &ddsDataSize ) && ReadCookedError( ddsData.get(), ddsDataSize, &cookError );
+    if ( !cached )
+    {
+        std::unique_ptr<uint8_t[]> pixels;
+        size_t width = 0;
+        size_t height = 0;
+        D3D11_SUBRESOURCE_DATA initData;
+        HRESULT hr = DecodePNGFromMemory( data, dataSize, pixels, &width, &height, &initData );
+        if ( FAILED(hr) )
+        {
+            return hr;
+        }
+
+        hr = CompressNormalMap( width, height, pixels.get(), initData.SysMemPitch, format, ddsData, &ddsDataSize, &cookError );
+        if ( FAILED(hr) )
+        {
+            return hr;
+        }
+
+        if ( cacheDirectory )
+        {
+            WriteCookedFile( cacheDirectory, cookedName, ddsData.get(), ddsDataSize );
+        }
+    }
+
+    if ( error )
+    {
+        *error = cookError;
+    }
+    return CreateDDSTextureFromMemory( d3dDevice, ddsData.get(), ddsDataSize, texture, textureView );
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT CreateNormalMapTextureFromFile( _In_ ID3D11Device* d3dDevice,
+                                        _In_z_ const wchar_t* fileName,
+                                        _In_opt_z_ const wchar_t* cacheDirectory,
+                                        _Out_opt_ ID3D11Resource** texture,
+                                        _Out_opt_ ID3D11ShaderResourceView** textureView,
+                                        _Out_opt_ NORMAL_MAP_ERROR* error )
+{
+    if ( !d3dDevice || !fileName || ( !texture && !textureView ) )
+    {
+        return E_INVALIDARG;
+    }
+
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+    if ( !ReadWholeFile( fileName, data, &dataSize ) )
+    {
+        return E_FAIL;
+    }
+
+    return CreateNormalMapTextureFromMemory( d3dDevice, data.get(), dataSize, cacheDirectory, texture, textureView, error );
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// File: NormalMapCompressor.h
+//
+// Functions for cooking tangent space normal maps into two channel block compressed DDS
+// data and creating a Direct3D 11 runtime resource for them
+//
+// Only X and Y are stored and the pixel shader rebuilds Z as sqrt(1 - x*x - y*y). BC5
+// keeps each of them in its own BC4 block. Where BC5 cannot be sampled the map is cooked
+// as BC3n instead: X in the alpha block, Y in green and red held at one, so the shader
+// reads X as red * alpha for either format. Both are a byte per texel, a quarter of the
+// RGBA8 a decoded PNG takes.
+//
+// The encoder searches endpoints per block against the error of the rebuilt normal
+// rather than of each channel on its own, and reports what it lost in degrees.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11.h>
+#include <memory>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+struct NORMAL_MAP_ERROR
+{
+    float meanDegrees;      // Average angle between the source and decoded normals of the top level
+    float maxDegrees;       // Largest angle on the top level
+};
+
+// BC5 when the device can sample it, BC3 (holding BC3n) otherwise
+DXGI_FORMAT ChooseNormalMapFormat( _In_ ID3D11Device* d3dDevice );
+
+// Cooks an RGBA8 normal map into a complete DDS file in memory with a full mip chain, each
+// level averaged from the one above and renormalized. 'format' is DXGI_FORMAT_BC5_UNORM or
+// DXGI_FORMAT_BC3_UNORM. Blocks are encoded in parallel.
+HRESULT CompressNormalMap( _In_ size_t width,
+                           _In_ size_t height,
+                           _In_reads_bytes_(rowPitch * height) const uint8_t* pixels,
+                           _In_ size_t rowPitch,
+                           _In_ DXGI_FORMAT format,
+                           std::unique_ptr<uint8_t[]>& ddsData,
+                           _Out_ size_t* ddsDataSize,
+                           _Out_opt_ NORMAL_MAP_ERROR* error
+                         );
+
+// Takes a PNG or a DDS file held in memory. A DDS is used as it is, so maps cooked offline
+// load directly. A PNG is cooked on the spot; with a 'cacheDirectory' the result is saved
+// there as a DDS named by a hash of the PNG and read back on later runs. 'error' comes
+// from the cooked file, or is zero for a DDS that this code did not write.
+HRESULT CreateNormalMapTextureFromMemory( _In_ ID3D11Device* d3dDevice,
+                                          _In_reads_bytes_(dataSize) const uint8_t* data,
+                                          _In_ size_t dataSize,
+                                          _In_opt_z_ const wchar_t* cacheDirectory,
+                                          _Out_opt_ ID3D11Resource** texture,
+                                          _Out_opt_ ID3D11ShaderResourceView** textureView,
+                                          _Out_opt_ NORMAL_MAP_ERROR* error
+                                        );
+
+HRESULT CreateNormalMapTextureFromFile( _In_ ID3D11Device* d3dDevice,
+                                        _In_z_ const wchar_t* szFileName,
+                                        _In_opt_z_ const wchar_t* cacheDirectory,
+                                        _Out_opt_ ID3D11Resource** texture,
+                                        _Out_opt_ ID3D11ShaderResourceView** textureView,
+                                        _Out_opt_ NORMAL_MAP_ERROR* error
+                                      );
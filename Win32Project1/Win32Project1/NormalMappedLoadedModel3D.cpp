@@ -3,12 +3,16 @@
 #include "NormalMappedPixelShader.csh"
 #include "SkyBoxPixelShader.csh"
 #include "DDSTextureLoader.h"
+#include <sstream>
 
 #define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
 
 NormalMappedLoadedModel3D::NormalMappedLoadedModel3D()
 {
 	worldMatrix = XMMatrixIdentity();
+	normalMapError.meanDegrees = 0;
+	normalMapError.maxDegrees = 0;
+	boundingRadius = 0;
 }
 
 
@@ -29,15 +33,30 @@ NormalMappedLoadedModel3D::~NormalMappedLoadedModel3D()
 	delete[] indicies;
 }
 
-void NormalMappedLoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const wchar_t* normalMapFilename, const char* modelFilename)
+void NormalMappedLoadedModel3D::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const wchar_t* normalMapFilename, const char* modelFilename, AsyncFileReader* fileReader)
 {
 	worldMatrix = XMMatrixIdentity();
 	worldMatrix = XMMatrixTranslation(initX, initY, initZ);
 
-	HRESULT result = CreateDDSTextureFromFile(device, textureFilename, nullptr, &shaderResourceViews[0]);
-	result = CreateDDSTextureFromFile(device, normalMapFilename, nullptr, &shaderResourceViews[1]);
+	// The normal map can be a cooked DDS or its source PNG, which is cooked to two channels
+	// the first time it is seen
+	HRESULT result = S_OK;
+	if (!fileReader)
+	{
+		result = CreateDDSTextureFromFile(device, textureFilename, nullptr, &shaderResourceViews[0]);
+		result = CreateNormalMapTextureFromFile(device, normalMapFilename, NORMAL_MAP_CACHE_DIRECTORY, nullptr, &shaderResourceViews[1], &normalMapError);
+	}
+	else
+	{
+		unique_ptr<uint8_t[]> data;
+		size_t dataSize = 0;
+		if (fileReader->Load(textureFilename, data, &dataSize))
+			result = CreateDDSTextureFromMemory(device, data.get(), dataSize, nullptr, &shaderResourceViews[0]);
+		if (fileReader->Load(normalMapFilename, data, &dataSize))
+			result = CreateNormalMapTextureFromMemory(device, data.get(), dataSize, NORMAL_MAP_CACHE_DIRECTORY, nullptr, &shaderResourceViews[1], &normalMapError);
+	}
 
-	loadOBJ(modelFilename);
+	loadOBJ(modelFilename, fileReader);
 
 	D3D11_BUFFER_DESC bufferDesc = {};
 	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -64,6 +83,7 @@ void NormalMappedLoadedModel3D::Initialize(ID3D11Device* device, float initX, fl
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
 
@@ -103,29 +123,25 @@ void NormalMappedLoadedModel3D::Initialize(ID3D11Device* device, float initX, fl
 	result = device->CreateRasterizerState(&rasterDesc1, &rasterizerStates[1]);
 }
 
-void NormalMappedLoadedModel3D::Run(ID3D11DeviceContext* deviceContext)
+void NormalMappedLoadedModel3D::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-
-
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	deviceContext->PSSetShaderResources(0, ARRAYSIZE(shaderResourceViews), shaderResourceViews);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->OMSetBlendState(blendState, NULL, 0xffffffff);
-	deviceContext->RSSetState(rasterizerStates[1]);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
-	deviceContext->RSSetState(rasterizerStates[0]);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
-	deviceContext->RSSetState(nullptr);
-	deviceContext->OMSetBlendState(NULL, NULL, 0xffffffff);
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, ARRAYSIZE(shaderResourceViews), shaderResourceViews);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	renderContext->SetGeometryShader(nullptr);
+	renderContext->SetBlendState(blendState);
+	renderContext->SetRasterizerState(rasterizerStates[1]);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetRasterizerState(rasterizerStates[0]);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetRasterizerState(nullptr);
+	renderContext->SetBlendState(NULL);
 }
 
 void NormalMappedLoadedModel3D::Translate(float offsetX, float offsetY, float offsetZ)
@@ -153,6 +169,21 @@ unsigned int NormalMappedLoadedModel3D::GetNumIndicies() const
 	return numIndicies;
 }
 
+const Vertex* NormalMappedLoadedModel3D::GetVerticies() const
+{
+	return verticies;
+}
+
+unsigned int NormalMappedLoadedModel3D::GetNumVerticies() const
+{
+	return numVerticies;
+}
+
+const unsigned int* NormalMappedLoadedModel3D::GetIndicies() const
+{
+	return indicies;
+}
+
 ID3D11VertexShader* NormalMappedLoadedModel3D::GetVertexShader() const
 {
 	return vertexShader;
@@ -168,17 +199,37 @@ ID3D11InputLayout* NormalMappedLoadedModel3D::GetLayout() const
 	return layout;
 }
 
+ID3D11ShaderResourceView* NormalMappedLoadedModel3D::GetShaderResourceView() const
+{
+	return shaderResourceViews[0];
+}
+
+ID3D11ShaderResourceView* NormalMappedLoadedModel3D::GetNormalMapShaderResourceView() const
+{
+	return shaderResourceViews[1];
+}
+
 ID3D11SamplerState* NormalMappedLoadedModel3D::GetSampler() const
 {
 	return sampler;
 }
 
+float NormalMappedLoadedModel3D::GetBoundingRadius() const
+{
+	return boundingRadius;
+}
+
+const NORMAL_MAP_ERROR& NormalMappedLoadedModel3D::GetNormalMapError() const
+{
+	return normalMapError;
+}
+
 void NormalMappedLoadedModel3D::SetWorldMatrix(const XMMATRIX* matrix)
 {
 	worldMatrix = *matrix;
 }
 
-bool NormalMappedLoadedModel3D::loadOBJ(const char * filename)
+bool NormalMappedLoadedModel3D::loadOBJ(const char * filename, AsyncFileReader* fileReader)
 {
 	vector<XMFLOAT3> pos;
 	vector<XMFLOAT2> uvs;
@@ -188,16 +239,30 @@ bool NormalMappedLoadedModel3D::loadOBJ(const char * filename)
 	vector<unsigned int> uv_ind;
 	vector<unsigned int> nrm_ind;
 
-	ifstream infile;
+	ifstream diskFile;
+	istringstream readerFile;
 	char input, input2;
 	ofstream fout;
 
-	// Open the file.
-	infile.open(filename);
+	// Open the file, or parse the reader's copy of it when there is a reader.
+	if (fileReader)
+	{
+		unique_ptr<uint8_t[]> data;
+		size_t dataSize = 0;
+		wstring wideFilename(filename, filename + strlen(filename));
+		if (!fileReader->Load(wideFilename.c_str(), data, &dataSize))
+			return false;
+		readerFile.str(string((const char*)data.get(), dataSize));
+	}
+	else
+	{
+		diskFile.open(filename);
 
-	// Check if it was successful in opening the file.
-	if (!infile.is_open())
-		return false;
+		// Check if it was successful in opening the file.
+		if (!diskFile.is_open())
+			return false;
+	}
+	istream& infile = fileReader ? (istream&)readerFile : diskFile;
 
 	// Read in the vertices, texture coordinates, and normals into the data structures.
 	// Important: Also convert to left hand coordinate system since Maya uses right hand coordinate system.
@@ -277,9 +342,6 @@ bool NormalMappedLoadedModel3D::loadOBJ(const char * filename)
 		infile.get(input);
 	}
 
-	// Close the file.
-	infile.close();
-
 	numVerticies = (unsigned int)pos_ind.size();
 	verticies = new Vertex[numVerticies];
 	numIndicies = (unsigned int)numVerticies;
@@ -294,6 +356,7 @@ bool NormalMappedLoadedModel3D::loadOBJ(const char * filename)
 		verticies[i].nrm = nrms[nrm_ind[i] - 1];
 		indicies[i] = i;
 	}
+	boundingRadius = BoundingRadius(verticies, numVerticies);
 
 
 	for (int i = 0; i < numVerticies; i += 3)
@@ -1,7 +1,11 @@
 #pragma once
 #include "defines.h"
+#include "RenderContext.h"
+#include "AsyncFileReader.h"
+#include "NormalMapCompressor.h"
 #define NUM_RASTER_STATES 2
 #define NUM_SHADER_RESOURCE_VIEWS 2
+#define NORMAL_MAP_CACHE_DIRECTORY L"NormalMapCache"
 
 class NormalMappedLoadedModel3D
 {
@@ -9,9 +13,9 @@ public:
 	NormalMappedLoadedModel3D();
 	~NormalMappedLoadedModel3D();
 
-	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const wchar_t* normalMapFilename, const char * modelFilename);
+	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* textureFilename, const wchar_t* normalMapFilename, const char * modelFilename, AsyncFileReader* fileReader);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -20,11 +24,20 @@ public:
 	ID3D11Buffer* GetBuffer() const;
 	ID3D11Buffer* GetIndexBuffer() const;
 	unsigned int GetNumIndicies() const;
+	// The mesh as loaded, kept on the CPU
+	const Vertex* GetVerticies() const;
+	unsigned int GetNumVerticies() const;
+	const unsigned int* GetIndicies() const;
 	ID3D11VertexShader* GetVertexShader() const;
 	ID3D11PixelShader* GetPixelShader() const;
 	ID3D11InputLayout* GetLayout() const;
 	ID3D11ShaderResourceView* GetShaderResourceView() const;
+	ID3D11ShaderResourceView* GetNormalMapShaderResourceView() const;
 	ID3D11SamplerState* GetSampler() const;
+	// Radius of a sphere about the origin of the model that holds all of it
+	float GetBoundingRadius() const;
+	// How far the cooked normal map strays from its source, in degrees
+	const NORMAL_MAP_ERROR& GetNormalMapError() const;
 
 	// Mutators
 
@@ -44,7 +57,9 @@ private:
 	ID3D11SamplerState* sampler;
 	ID3D11BlendState* blendState;
 	ID3D11RasterizerState* rasterizerStates[NUM_RASTER_STATES];
+	NORMAL_MAP_ERROR normalMapError;
 	Vertex* verticies;
+	float boundingRadius;
 	unsigned int* indicies;
 
 	struct SEND_TO_OBJECT
@@ -53,6 +68,6 @@ private:
 	};
 	SEND_TO_OBJECT toObject;
 
-	bool loadOBJ(const char * filename);
+	bool loadOBJ(const char * filename, AsyncFileReader* fileReader);
 };
 
@@ -1,5 +1,7 @@
 #pragma pack_matrix(row_major)
 
+#include "EnvironmentLighting.hlsli"
+
 struct P_IN
 {
 	float4 posH : SV_POSITION;
@@ -30,9 +32,13 @@ float4 main(P_IN input) : SV_TARGET
 {
 	float2 uvs = float2(input.uvsOut.x, input.uvsOut.y);
 	float4 baseColor = baseTexture.Sample(filter, uvs); // get base color
-	float3 newNormal = normalTexture.Sample(filter, uvs);
 
-	newNormal = (newNormal * 2.0f) - 1.0f;
+	// BC5 samples as (x, y, 0, 1) and BC3n as (1, y, 0, x), so X is red times alpha for
+	// either; Z is rebuilt from the other two
+	float4 packedNormal = normalTexture.Sample(filter, uvs);
+	float3 newNormal;
+	newNormal.xy = float2(packedNormal.r * packedNormal.a, packedNormal.g) * 2.0f - 1.0f;
+	newNormal.z = sqrt(saturate(1.0f - dot(newNormal.xy, newNormal.xy)));
 
 	float3x3 TBNMatrix;
 	TBNMatrix[0] = normalize(input.tanOut.xyz);
@@ -83,6 +89,7 @@ float4 main(P_IN input) : SV_TARGET
 	lightColor += pointLightDirFinalColor + pointLightSpecColor;
 	if (ratios.w == 1)
 		lightColor += spotlightFinalColor + spotlightSpecColor;
+	lightColor += ApplyEnvironmentLighting(newNormal, toCamera, baseColor.xyz);
 
 	float4 returnColor = saturate(float4(lightColor, baseColor.a));
 
@@ -0,0 +1,380 @@
+#include "OcclusionCuller.h"
+#include <xmmintrin.h>
+#include <float.h>
+
+// Where a clip space edge crosses the near plane, z = 0
+static XMFLOAT4 NearPlaneCrossing(const XMFLOAT4& inside, const XMFLOAT4& outside)
+{
+	float t = inside.z / (inside.z - outside.z);
+	return XMFLOAT4(inside.x + (outside.x - inside.x) * t, inside.y + (outside.y - inside.y) * t, 0.0f, inside.w + (outside.w - inside.w) * t);
+}
+
+OcclusionCuller::OcclusionCuller()
+{
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+	depth.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+	tileDepths.assign(OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 1.0f);
+	nextJob = 0;
+	jobGeneration = 0;
+	busyWorkers = 0;
+	shuttingDown = false;
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	{
+		lock_guard<mutex> lock(jobMutex);
+		shuttingDown = true;
+	}
+	jobsQueued.notify_all();
+
+	for (unsigned int i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+unsigned int OcclusionCuller::AddOccluderMesh(const Vertex* verticies, unsigned int numVerticies, const unsigned int* indicies, unsigned int numIndicies)
+{
+	OCCLUDER_MESH mesh;
+	mesh.positions.resize(numVerticies);
+	for (unsigned int i = 0; i < numVerticies; ++i)
+		mesh.positions[i] = verticies[i].pos;
+	// Triangles with an index past the verticies are dropped
+	for (unsigned int i = 0; i + 2 < numIndicies; i += 3)
+	{
+		if (indicies[i] < numVerticies && indicies[i + 1] < numVerticies && indicies[i + 2] < numVerticies)
+			mesh.indicies.insert(mesh.indicies.end(), indicies + i, indicies + i + 3);
+	}
+	meshes.push_back(mesh);
+	return (unsigned int)meshes.size() - 1;
+}
+
+void OcclusionCuller::Begin(FXMMATRIX viewProjectionMatrix)
+{
+	XMStoreFloat4x4(&viewProjection, viewProjectionMatrix);
+	occluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(unsigned int mesh, FXMMATRIX worldMatrix)
+{
+	if (mesh >= meshes.size())
+		return;
+	OCCLUDER occluder;
+	occluder.mesh = mesh;
+	XMStoreFloat4x4(&occluder.worldMatrix, worldMatrix);
+	occluders.push_back(occluder);
+}
+
+void OcclusionCuller::Finish()
+{
+	SetUpTriangles();
+	nextJob = 0;
+	if (triangles.size() < OCCLUSION_THREADED_TRIANGLES)
+	{
+		RasterizeBins();
+		return;
+	}
+
+	// The calling thread is one of the pool, so it makes one fewer
+	if (workers.empty())
+	{
+		unsigned int numWorkers = min(max(thread::hardware_concurrency(), 1u), (unsigned int)(OCCLUSION_BINS_X * OCCLUSION_BINS_Y));
+		for (unsigned int i = 1; i < numWorkers; ++i)
+			workers.push_back(thread(&OcclusionCuller::Worker, this));
+	}
+
+	{
+		lock_guard<mutex> lock(jobMutex);
+		++jobGeneration;
+		busyWorkers = (unsigned int)workers.size();
+	}
+	jobsQueued.notify_all();
+	RasterizeBins();
+
+	// Every worker has to be done before the next Finish resets the bins
+	unique_lock<mutex> lock(jobMutex);
+	while (busyWorkers > 0)
+		jobsFinished.wait(lock);
+}
+
+bool OcclusionCuller::IsVisible(const XMFLOAT3& center, float radius) const
+{
+	// The corners of the box around the sphere give a rectangle and a nearest depth that
+	// hold all of it. The center is transformed once and each corner is a step along the
+	// matrix's rows from it.
+	XMMATRIX matrix = XMLoadFloat4x4(&viewProjection);
+	XMVECTOR centerClip = XMVector4Transform(XMVectorSet(center.x, center.y, center.z, 1.0f), matrix);
+	XMVECTOR stepX = XMVectorScale(matrix.r[0], radius);
+	XMVECTOR stepY = XMVectorScale(matrix.r[1], radius);
+	XMVECTOR stepZ = XMVectorScale(matrix.r[2], radius);
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (unsigned int corner = 0; corner < 8; ++corner)
+	{
+		XMVECTOR position = centerClip;
+		position = (corner & 1) ? XMVectorAdd(position, stepX) : XMVectorSubtract(position, stepX);
+		position = (corner & 2) ? XMVectorAdd(position, stepY) : XMVectorSubtract(position, stepY);
+		position = (corner & 4) ? XMVectorAdd(position, stepZ) : XMVectorSubtract(position, stepZ);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, position);
+		if (clip.z <= 0 || clip.w <= 0)
+			return true;
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (0.5f - clip.y / clip.w * 0.5f) * OCCLUSION_HEIGHT;
+		minX = min(minX, x);
+		maxX = max(maxX, x);
+		minY = min(minY, y);
+		maxY = max(maxY, y);
+		nearest = min(nearest, clip.z / clip.w);
+	}
+	if (maxX < 0 || maxY < 0 || minX >= OCCLUSION_WIDTH || minY >= OCCLUSION_HEIGHT)
+		return true;
+
+	unsigned int firstTileX = (unsigned int)max(minX, 0.0f) / OCCLUSION_TILE_SIZE;
+	unsigned int firstTileY = (unsigned int)max(minY, 0.0f) / OCCLUSION_TILE_SIZE;
+	unsigned int lastTileX = (unsigned int)min(maxX, OCCLUSION_WIDTH - 1.0f) / OCCLUSION_TILE_SIZE;
+	unsigned int lastTileY = (unsigned int)min(maxY, OCCLUSION_HEIGHT - 1.0f) / OCCLUSION_TILE_SIZE;
+	for (unsigned int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+	{
+		for (unsigned int tileX = firstTileX; tileX <= lastTileX; ++tileX)
+		{
+			if (tileDepths[tileY * OCCLUSION_TILES_X + tileX] >= nearest)
+				return true;
+		}
+	}
+	return false;
+}
+
+// Accessors
+float OcclusionCuller::GetDepth(unsigned int x, unsigned int y) const
+{
+	if (x >= OCCLUSION_WIDTH || y >= OCCLUSION_HEIGHT)
+		return 1.0f;
+	return depth[y * OCCLUSION_WIDTH + x];
+}
+
+float OcclusionCuller::GetTileDepth(unsigned int tileX, unsigned int tileY) const
+{
+	if (tileX >= OCCLUSION_TILES_X || tileY >= OCCLUSION_TILES_Y)
+		return 1.0f;
+	return tileDepths[tileY * OCCLUSION_TILES_X + tileX];
+}
+
+unsigned int OcclusionCuller::GetTriangleCount() const
+{
+	return (unsigned int)triangles.size();
+}
+
+// Private Member Functions
+void OcclusionCuller::SetUpTriangles()
+{
+	triangles.clear();
+	for (unsigned int bin = 0; bin < OCCLUSION_BINS_X * OCCLUSION_BINS_Y; ++bin)
+		bins[bin].clear();
+
+	XMMATRIX matrix = XMLoadFloat4x4(&viewProjection);
+	for (unsigned int o = 0; o < occluders.size(); ++o)
+	{
+		const OCCLUDER_MESH& mesh = meshes[occluders[o].mesh];
+		XMMATRIX toClip = XMMatrixMultiply(XMLoadFloat4x4(&occluders[o].worldMatrix), matrix);
+		clipPositions.resize(mesh.positions.size());
+		for (unsigned int i = 0; i < mesh.positions.size(); ++i)
+			XMStoreFloat4(&clipPositions[i], XMVector4Transform(XMVectorSet(mesh.positions[i].x, mesh.positions[i].y, mesh.positions[i].z, 1.0f), toClip));
+
+		for (unsigned int i = 0; i < mesh.indicies.size(); i += 3)
+		{
+			const XMFLOAT4* v[3] = { &clipPositions[mesh.indicies[i]], &clipPositions[mesh.indicies[i + 1]], &clipPositions[mesh.indicies[i + 2]] };
+
+			// Wholly outside one side of the frustum
+			if ((v[0]->x > v[0]->w && v[1]->x > v[1]->w && v[2]->x > v[2]->w) || (v[0]->x < -v[0]->w && v[1]->x < -v[1]->w && v[2]->x < -v[2]->w) ||
+				(v[0]->y > v[0]->w && v[1]->y > v[1]->w && v[2]->y > v[2]->w) || (v[0]->y < -v[0]->w && v[1]->y < -v[1]->w && v[2]->y < -v[2]->w) ||
+				(v[0]->z < 0 && v[1]->z < 0 && v[2]->z < 0))
+				continue;
+
+			unsigned int behind = (v[0]->z < 0 ? 1 : 0) + (v[1]->z < 0 ? 1 : 0) + (v[2]->z < 0 ? 1 : 0);
+			if (behind == 0)
+			{
+				AddTriangle(*v[0], *v[1], *v[2]);
+				continue;
+			}
+
+			// Rotated so that the odd one out comes first, keeping the winding
+			unsigned int first = 0;
+			for (unsigned int j = 0; j < 3; ++j)
+			{
+				if ((v[j]->z < 0) == (behind == 1))
+					first = j;
+			}
+			const XMFLOAT4& a = *v[first];
+			const XMFLOAT4& b = *v[(first + 1) % 3];
+			const XMFLOAT4& c = *v[(first + 2) % 3];
+			if (behind == 1)
+			{
+				// Cutting off the corner behind leaves a quad
+				XMFLOAT4 ab = NearPlaneCrossing(b, a);
+				XMFLOAT4 ac = NearPlaneCrossing(c, a);
+				AddTriangle(ab, b, c);
+				AddTriangle(ab, c, ac);
+			}
+			else
+				AddTriangle(a, NearPlaneCrossing(a, b), NearPlaneCrossing(a, c));
+		}
+	}
+}
+
+void OcclusionCuller::AddTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c)
+{
+	// Into pixels, with y down the screen
+	float x[3], y[3], z[3];
+	const XMFLOAT4* v[3] = { &a, &b, &c };
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		x[i] = (v[i]->x / v[i]->w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[i] = (0.5f - v[i]->y / v[i]->w * 0.5f) * OCCLUSION_HEIGHT;
+		z[i] = v[i]->z / v[i]->w;
+	}
+
+	// Both sides are drawn, so one facing the other way has two corners swapped
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (area < 0)
+	{
+		swap(x[1], x[2]);
+		swap(y[1], y[2]);
+		swap(z[1], z[2]);
+		area = -area;
+	}
+	if (!(area > 1e-6f))
+		return;
+
+	// Pixels whose centers are inside the bounds, kept near the screen before they become integers
+	OCCLUDER_TRIANGLE triangle;
+	triangle.minX = (int)floorf(min(max(min(min(x[0], x[1]), x[2]) - 0.5f, 0.0f), (float)OCCLUSION_WIDTH));
+	triangle.minY = (int)floorf(min(max(min(min(y[0], y[1]), y[2]) - 0.5f, 0.0f), (float)OCCLUSION_HEIGHT));
+	triangle.maxX = (int)ceilf(max(min(max(max(x[0], x[1]), x[2]) - 0.5f, OCCLUSION_WIDTH - 1.0f), -1.0f));
+	triangle.maxY = (int)ceilf(max(min(max(max(y[0], y[1]), y[2]) - 0.5f, OCCLUSION_HEIGHT - 1.0f), -1.0f));
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		unsigned int j = (i + 1) % 3;
+		triangle.edges[i][0] = y[i] - y[j];
+		triangle.edges[i][1] = x[j] - x[i];
+		triangle.edges[i][2] = x[i] * y[j] - y[i] * x[j];
+	}
+	float depthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float depthY = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	triangle.depth[0] = depthX;
+	triangle.depth[1] = depthY;
+	triangle.depth[2] = z[0] - depthX * x[0] - depthY * y[0];
+
+	unsigned int index = (unsigned int)triangles.size();
+	triangles.push_back(triangle);
+	for (int binY = triangle.minY / OCCLUSION_BIN_HEIGHT; binY <= triangle.maxY / OCCLUSION_BIN_HEIGHT; ++binY)
+	{
+		for (int binX = triangle.minX / OCCLUSION_BIN_WIDTH; binX <= triangle.maxX / OCCLUSION_BIN_WIDTH; ++binX)
+			bins[binY * OCCLUSION_BINS_X + binX].push_back(index);
+	}
+}
+
+void OcclusionCuller::RasterizeBins()
+{
+	// Each bin only touches its own pixels and tiles, so they need nothing between them
+	for (unsigned int job = nextJob++; job < OCCLUSION_BINS_X * OCCLUSION_BINS_Y; job = nextJob++)
+		RasterizeBin(job);
+}
+
+void OcclusionCuller::RasterizeBin(unsigned int bin)
+{
+	int binLeft = (bin % OCCLUSION_BINS_X) * OCCLUSION_BIN_WIDTH;
+	int binTop = (bin / OCCLUSION_BINS_X) * OCCLUSION_BIN_HEIGHT;
+	for (int y = binTop; y < binTop + OCCLUSION_BIN_HEIGHT; ++y)
+		fill(depth.begin() + y * OCCLUSION_WIDTH + binLeft, depth.begin() + y * OCCLUSION_WIDTH + binLeft + OCCLUSION_BIN_WIDTH, 1.0f);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const vector<unsigned int>& binned = bins[bin];
+	for (unsigned int t = 0; t < binned.size(); ++t)
+	{
+		const OCCLUDER_TRIANGLE& triangle = triangles[binned[t]];
+		// Bins are a multiple of four pixels wide, so starting on a multiple of four stays in the bin
+		int left = max(triangle.minX, binLeft) & ~3;
+		int right = min(triangle.maxX, binLeft + OCCLUSION_BIN_WIDTH - 1);
+		int top = max(triangle.minY, binTop);
+		int bottom = min(triangle.maxY, binTop + OCCLUSION_BIN_HEIGHT - 1);
+
+		__m128 edgeX[3], edgeY[3], edgeC[3];
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			edgeX[i] = _mm_set1_ps(triangle.edges[i][0]);
+			edgeY[i] = _mm_set1_ps(triangle.edges[i][1]);
+			edgeC[i] = _mm_set1_ps(triangle.edges[i][2]);
+		}
+		__m128 depthX = _mm_set1_ps(triangle.depth[0]);
+		__m128 depthY = _mm_set1_ps(triangle.depth[1]);
+		__m128 depthC = _mm_set1_ps(triangle.depth[2]);
+
+		for (int y = top; y <= bottom; ++y)
+		{
+			__m128 centerY = _mm_set1_ps((float)y + 0.5f);
+			__m128 rowEdges[3];
+			for (unsigned int i = 0; i < 3; ++i)
+				rowEdges[i] = _mm_add_ps(_mm_mul_ps(edgeY[i], centerY), edgeC[i]);
+			__m128 rowDepth = _mm_add_ps(_mm_mul_ps(depthY, centerY), depthC);
+
+			float* row = &depth[y * OCCLUSION_WIDTH];
+			for (int x = left; x <= right; x += 4)
+			{
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[0], centerX), rowEdges[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[1], centerX), rowEdges[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[2], centerX), rowEdges[2]), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthX, centerX), rowDepth);
+				__m128 previous = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(previous, pixelDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, previous)));
+			}
+		}
+	}
+
+	// The farthest depth of each tile in the bin
+	for (int tileTop = binTop; tileTop < binTop + OCCLUSION_BIN_HEIGHT; tileTop += OCCLUSION_TILE_SIZE)
+	{
+		for (int tileLeft = binLeft; tileLeft < binLeft + OCCLUSION_BIN_WIDTH; tileLeft += OCCLUSION_TILE_SIZE)
+		{
+			__m128 farthest = zero;
+			for (int y = tileTop; y < tileTop + OCCLUSION_TILE_SIZE; ++y)
+			{
+				for (int x = tileLeft; x < tileLeft + OCCLUSION_TILE_SIZE; x += 4)
+					farthest = _mm_max_ps(farthest, _mm_loadu_ps(&depth[y * OCCLUSION_WIDTH + x]));
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, farthest);
+			tileDepths[(tileTop / OCCLUSION_TILE_SIZE) * OCCLUSION_TILES_X + tileLeft / OCCLUSION_TILE_SIZE] = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+		}
+	}
+}
+
+void OcclusionCuller::Worker()
+{
+	unsigned int doneGeneration = 0;
+	for (;;)
+	{
+		unique_lock<mutex> lock(jobMutex);
+		while (!shuttingDown && jobGeneration == doneGeneration)
+			jobsQueued.wait(lock);
+
+		if (shuttingDown)
+			return;
+
+		doneGeneration = jobGeneration;
+		lock.unlock();
+		RasterizeBins();
+
+		lock.lock();
+		if (--busyWorkers == 0)
+			jobsFinished.notify_one();
+	}
+}
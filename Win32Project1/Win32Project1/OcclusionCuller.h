@@ -0,0 +1,104 @@
+#pragma once
+#include "defines.h"
+#include <atomic>
+#include <condition_variable>
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_BIN_WIDTH 64 // The screen is split into bins this size, each rasterized as one job
+#define OCCLUSION_BIN_HEIGHT 32
+#define OCCLUSION_TILE_SIZE 8 // Pixels across a hierarchical Z tile
+#define OCCLUSION_THREADED_TRIANGLES 1024 // Fewer triangles than this are rasterized on the calling thread
+#define OCCLUSION_BINS_X (OCCLUSION_WIDTH / OCCLUSION_BIN_WIDTH)
+#define OCCLUSION_BINS_Y (OCCLUSION_HEIGHT / OCCLUSION_BIN_HEIGHT)
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE)
+
+// Finds what large meshes hide, on the CPU. A few occluders are drawn each frame into a
+// small depth buffer, and bounding spheres are then tested against it.
+//
+// Occluder triangles are clipped to the near plane, set up once as three edge functions and
+// a depth plane, and put in the bins their bounds touch. Each bin is then a job for a pool of
+// threads, started by the first Finish with enough triangles and kept waiting between frames
+// after that: four pixels at a time are tested against the edge functions in SSE registers and
+// keep the nearest depth. Both sides of a triangle are drawn. Once a bin is done the farthest
+// depth of each OCCLUSION_TILE_SIZE square in it goes into the hierarchical Z, which is all
+// the sphere tests read: a sphere is hidden when the nearest point of the box around it is
+// behind the farthest depth of every tile its screen rectangle covers.
+//
+// Depth is as Direct3D has it, 0 at the near plane and 1 at the far one. Everything is on the
+// CPU, so it works without a device.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	// Keeps the positions and triangles of a mesh, and returns the index occluders draw it by
+	unsigned int AddOccluderMesh(const Vertex* verticies, unsigned int numVerticies, const unsigned int* indicies, unsigned int numIndicies);
+
+	// Starts a frame seen through the matrix, with no occluders yet
+	void Begin(FXMMATRIX viewProjectionMatrix);
+	void AddOccluder(unsigned int mesh, FXMMATRIX worldMatrix);
+	// Rasterizes the occluders added since Begin
+	void Finish();
+
+	// False when the sphere is wholly behind the occluders of the last Finish. Spheres that
+	// reach the near plane or leave the screen are kept; the frustum culler handles them.
+	bool IsVisible(const XMFLOAT3& center, float radius) const;
+
+	// Accessors
+	// 1 where no occluder was drawn
+	float GetDepth(unsigned int x, unsigned int y) const;
+	float GetTileDepth(unsigned int tileX, unsigned int tileY) const;
+	// Occluder triangles the last Finish rasterized, after clipping
+	unsigned int GetTriangleCount() const;
+
+private:
+
+	struct OCCLUDER_MESH
+	{
+		vector<XMFLOAT3> positions;
+		vector<unsigned int> indicies;
+	};
+
+	struct OCCLUDER
+	{
+		unsigned int mesh;
+		XMFLOAT4X4 worldMatrix;
+	};
+
+	// A triangle in pixels, inside where every edge function is at least 0
+	struct OCCLUDER_TRIANGLE
+	{
+		float edges[3][3]; // a * x + b * y + c
+		float depth[3]; // Likewise
+		int minX, minY, maxX, maxY;
+	};
+
+	XMFLOAT4X4 viewProjection;
+	vector<OCCLUDER_MESH> meshes;
+	vector<OCCLUDER> occluders;
+	vector<XMFLOAT4> clipPositions;
+	vector<OCCLUDER_TRIANGLE> triangles;
+	vector<unsigned int> bins[OCCLUSION_BINS_X * OCCLUSION_BINS_Y];
+	vector<float> depth;
+	vector<float> tileDepths; // The farthest depth in each tile
+
+	vector<thread> workers;
+	mutex jobMutex;
+	condition_variable jobsQueued;
+	condition_variable jobsFinished;
+	atomic<unsigned int> nextJob;
+	unsigned int jobGeneration; // Counts the Finishes handed to the workers
+	unsigned int busyWorkers;
+	bool shuttingDown;
+
+	// Clips, sets up and bins every occluder triangle
+	void SetUpTriangles();
+	void AddTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c);
+	// Takes bins until there are none left
+	void RasterizeBins();
+	void RasterizeBin(unsigned int bin);
+	void Worker();
+};
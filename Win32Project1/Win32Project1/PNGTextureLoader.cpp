@@ -0,0 +1,1234 @@
+//--------------------------------------------------------------------------------------
+// File: PNGTextureLoader.cpp
+//
+// Functions for decoding a PNG image and creating a Direct3D 11 runtime resource for it
+//
+// The decoder is self contained: a table driven inflate for the zlib stream and SSE2
+// versions of the Sub, Up, Average and Paeth unfilters for 24 and 32 bit pixels (the
+// layouts all of the shipped PNGs use). Other bit depths fall back to scalar unfilters.
+// Interlaced (Adam7) images are rejected.
+//
+// A single deflate stream cannot be split between threads, so the decoder keeps all of
+// its state on the stack and is instead parallel across files; the objects already load
+// their textures on separate threads in DEMO_APP::DEMO_APP.
+//--------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <emmintrin.h>
+
+#include "PNGTextureLoader.h"
+
+//--------------------------------------------------------------------------------------
+// PNG file structure definitions
+//--------------------------------------------------------------------------------------
+#define PNG_COLOR_GRAY          0
+#define PNG_COLOR_RGB           2
+#define PNG_COLOR_PALETTE       3
+#define PNG_COLOR_GRAY_ALPHA    4
+#define PNG_COLOR_RGBA          6
+
+#define PNG_CHUNK( ch0, ch1, ch2, ch3 ) \
+            ( ((uint32_t)(uint8_t)(ch0) << 24) | ((uint32_t)(uint8_t)(ch1) << 16) | \
+              ((uint32_t)(uint8_t)(ch2) << 8) | ((uint32_t)(uint8_t)(ch3)) )
+
+static const uint8_t PNG_SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+struct PNG_INFO
+{
+    uint32_t    width;
+    uint32_t    height;
+    uint8_t     bitDepth;
+    uint8_t     colorType;
+    uint8_t     interlace;
+    size_t      channels;
+    size_t      bytesPerPixel;  // filter distance, at least 1
+    size_t      rowBytes;       // excluding the filter type byte
+    uint8_t     palette[256][4];
+    bool        hasColorKey;
+    uint16_t    colorKey[3];
+};
+
+static inline uint32_t ReadBigEndian32( const uint8_t* p )
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint16_t ReadBigEndian16( const uint8_t* p )
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+//---------------------------------------------------------------------------------
+struct handle_closer { void operator()(HANDLE h) { if (h) CloseHandle(h); } };
+
+typedef std::unique_ptr<void, handle_closer> ScopedHandle;
+
+inline HANDLE safe_handle( HANDLE h ) { return (h == INVALID_HANDLE_VALUE) ? 0 : h; }
+
+
+//--------------------------------------------------------------------------------------
+// Inflate (RFC 1950 / RFC 1951)
+//--------------------------------------------------------------------------------------
+#define INFLATE_FAST_BITS   10
+#define INFLATE_FAST_MASK   ((1 << INFLATE_FAST_BITS) - 1)
+
+// Huffman table: codes up to INFLATE_FAST_BITS long resolve with a single lookup, longer
+// ones walk the canonical code ranges
+struct INFLATE_HUFFMAN
+{
+    uint16_t    fast[1 << INFLATE_FAST_BITS];   // (length << 9) | symbol, 0 if not a fast code
+    uint16_t    firstCode[16];
+    uint16_t    firstSymbol[16];
+    int         maxCode[17];
+    uint8_t     size[288];
+    uint16_t    value[288];
+};
+
+struct INFLATE_STATE
+{
+    const uint8_t*  in;
+    const uint8_t*  inEnd;
+    uint64_t        bitBuffer;
+    unsigned int    bitCount;
+    size_t          overrun;    // zero bytes fed in past the end of the input
+    uint8_t*        outStart;
+    uint8_t*        out;
+    uint8_t*        outEnd;
+};
+
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                        8193, 12289, 16385, 24577 };
+static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static inline int BitReverse16( int n )
+{
+    n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
+    n = ((n & 0xCCCC) >> 2) | ((n & 0x3333) << 2);
+    n = ((n & 0xF0F0) >> 4) | ((n & 0x0F0F) << 4);
+    n = ((n & 0xFF00) >> 8) | ((n & 0x00FF) << 8);
+    return n;
+}
+
+static inline int BitReverse( int n, int bits )
+{
+    return BitReverse16( n ) >> (16 - bits);
+}
+
+//--------------------------------------------------------------------------------------
+static bool BuildHuffman( _Out_ INFLATE_HUFFMAN& table, _In_reads_(count) const uint8_t* codeLengths, _In_ int count )
+{
+    int sizes[17] = { 0 };
+    int nextCode[16] = { 0 };
+
+    memset( table.fast, 0, sizeof(table.fast) );
+    for (int i = 0; i < count; ++i)
+    {
+        ++sizes[codeLengths[i]];
+    }
+    sizes[0] = 0;
+    for (int i = 1; i < 16; ++i)
+    {
+        if (sizes[i] > (1 << i))
+        {
+            return false;
+        }
+    }
+
+    int code = 0;
+    int symbol = 0;
+    for (int i = 1; i < 16; ++i)
+    {
+        nextCode[i] = code;
+        table.firstCode[i] = static_cast<uint16_t>( code );
+        table.firstSymbol[i] = static_cast<uint16_t>( symbol );
+        code += sizes[i];
+        if (sizes[i] && (code - 1 >= (1 << i)))
+        {
+            return false; // over-subscribed
+        }
+        table.maxCode[i] = code << (16 - i);
+        code <<= 1;
+        symbol += sizes[i];
+    }
+    table.maxCode[16] = 0x10000;
+
+    for (int i = 0; i < count; ++i)
+    {
+        int length = codeLengths[i];
+        if (length)
+        {
+            int slot = nextCode[length] - table.firstCode[length] + table.firstSymbol[length];
+            table.size[slot] = static_cast<uint8_t>( length );
+            table.value[slot] = static_cast<uint16_t>( i );
+            if (length <= INFLATE_FAST_BITS)
+            {
+                uint16_t entry = static_cast<uint16_t>( (length << 9) | i );
+                for (int j = BitReverse( nextCode[length], length ); j < (1 << INFLATE_FAST_BITS); j += (1 << length))
+                {
+                    table.fast[j] = entry;
+                }
+            }
+            ++nextCode[length];
+        }
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Tops the bit buffer up to at least 56 bits, which covers the longest literal/length
+// plus distance sequence (15 + 5 + 15 + 13 bits) without checking again
+static inline void Refill( INFLATE_STATE& state )
+{
+    if (state.inEnd - state.in >= 8)
+    {
+        uint64_t word;
+        memcpy( &word, state.in, sizeof(word) );
+        state.bitBuffer |= word << state.bitCount;
+        state.in += (63 - state.bitCount) >> 3;
+        state.bitCount |= 56;
+    }
+    else
+    {
+        while (state.bitCount < 56)
+        {
+            uint64_t byte = 0;
+            if (state.in < state.inEnd)
+            {
+                byte = *state.in++;
+            }
+            else
+            {
+                ++state.overrun;
+            }
+            state.bitBuffer |= byte << state.bitCount;
+            state.bitCount += 8;
+        }
+    }
+}
+
+static inline unsigned int GetBits( INFLATE_STATE& state, unsigned int count )
+{
+    unsigned int bits = static_cast<unsigned int>( state.bitBuffer & ((1ull << count) - 1) );
+    state.bitBuffer >>= count;
+    state.bitCount -= count;
+    return bits;
+}
+
+static inline int DecodeSymbol( INFLATE_STATE& state, const INFLATE_HUFFMAN& table )
+{
+    int entry = table.fast[state.bitBuffer & INFLATE_FAST_MASK];
+    if (entry)
+    {
+        GetBits( state, entry >> 9 );
+        return entry & 511;
+    }
+
+    int code = BitReverse16( static_cast<int>( state.bitBuffer & 0xffff ) );
+    int length;
+    for (length = INFLATE_FAST_BITS + 1; length < 16; ++length)
+    {
+        if (code < table.maxCode[length])
+        {
+            break;
+        }
+    }
+    if (length >= 16)
+    {
+        return -1;
+    }
+
+    int slot = (code >> (16 - length)) - table.firstCode[length] + table.firstSymbol[length];
+    if (slot >= 288 || table.size[slot] != length)
+    {
+        return -1;
+    }
+
+    GetBits( state, length );
+    return table.value[slot];
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT InflateStored( INFLATE_STATE& state )
+{
+    // Discard up to the next byte boundary; whole bytes may still be sitting in the bit buffer
+    GetBits( state, state.bitCount & 7 );
+    Refill( state );
+
+    unsigned int length = GetBits( state, 16 );
+    unsigned int complement = GetBits( state, 16 );
+    if ((length ^ 0xffff) != complement)
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+    if (length > static_cast<size_t>( state.outEnd - state.out ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    while (length && state.bitCount >= 8)
+    {
+        *state.out++ = static_cast<uint8_t>( GetBits( state, 8 ) );
+        --length;
+    }
+
+    // The rest comes straight from the input. Refill's fast path leaves a copy of the byte at
+    // 'in' above bitCount, which must not be ORed into the next block header once 'in' moves.
+    if (length)
+    {
+        state.bitBuffer = 0;
+        if (length > static_cast<size_t>( state.inEnd - state.in ))
+        {
+            return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+        }
+        memcpy( state.out, state.in, length );
+        state.out += length;
+        state.in += length;
+    }
+
+    // Refill pads with zeros past the end of the input; none of them may have been used
+    return (state.overrun * 8 > state.bitCount) ? HRESULT_FROM_WIN32( ERROR_HANDLE_EOF ) : S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT InflateCodes( INFLATE_STATE& state, const INFLATE_HUFFMAN& lengths, const INFLATE_HUFFMAN& distances )
+{
+    uint8_t* out = state.out;
+    uint8_t* outEnd = state.outEnd;
+
+    for (;;)
+    {
+        if (state.bitCount < 48)
+        {
+            Refill( state );
+        }
+        if (state.overrun > 8)
+        {
+            return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+        }
+
+        int symbol = DecodeSymbol( state, lengths );
+        if (symbol < 256)
+        {
+            if (symbol < 0 || out >= outEnd)
+            {
+                return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            }
+            *out++ = static_cast<uint8_t>( symbol );
+            continue;
+        }
+        if (symbol == 256)
+        {
+            break;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29)
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+        size_t length = LENGTH_BASE[symbol] + GetBits( state, LENGTH_EXTRA[symbol] );
+
+        symbol = DecodeSymbol( state, distances );
+        if (symbol < 0 || symbol >= 30)
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+        size_t distance = DIST_BASE[symbol] + GetBits( state, DIST_EXTRA[symbol] );
+
+        if (distance > static_cast<size_t>( out - state.outStart ) || length > static_cast<size_t>( outEnd - out ))
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+
+        const uint8_t* src = out - distance;
+        if (distance >= 8)
+        {
+            // The output buffer has 8 bytes of slack, so whole words can be copied even when
+            // the match ends partway through one
+            uint8_t* end = out + length;
+            do
+            {
+                memcpy( out, src, 8 );
+                out += 8;
+                src += 8;
+            } while (out < end);
+            out = end;
+        }
+        else if (distance == 1)
+        {
+            memset( out, *src, length );
+            out += length;
+        }
+        else
+        {
+            while (length--)
+            {
+                *out++ = *src++;
+            }
+        }
+    }
+
+    state.out = out;
+    return (state.overrun * 8 > state.bitCount) ? HRESULT_FROM_WIN32( ERROR_HANDLE_EOF ) : S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT InflateDynamicTables( INFLATE_STATE& state, INFLATE_HUFFMAN& lengths, INFLATE_HUFFMAN& distances )
+{
+    Refill( state );
+    int numLengths = GetBits( state, 5 ) + 257;
+    int numDistances = GetBits( state, 5 ) + 1;
+    int numCodeLengths = GetBits( state, 4 ) + 4;
+
+    uint8_t codeLengthSizes[19] = { 0 };
+    for (int i = 0; i < numCodeLengths; ++i)
+    {
+        Refill( state );
+        codeLengthSizes[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>( GetBits( state, 3 ) );
+    }
+
+    INFLATE_HUFFMAN codeLengths;
+    if (!BuildHuffman( codeLengths, codeLengthSizes, 19 ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    uint8_t sizes[286 + 32];
+    int total = numLengths + numDistances;
+    int n = 0;
+    while (n < total)
+    {
+        Refill( state );
+        int symbol = DecodeSymbol( state, codeLengths );
+        if (symbol < 0 || symbol >= 19)
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+
+        if (symbol < 16)
+        {
+            sizes[n++] = static_cast<uint8_t>( symbol );
+            continue;
+        }
+
+        uint8_t fill = 0;
+        int repeat;
+        if (symbol == 16)
+        {
+            if (n == 0)
+            {
+                return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            }
+            repeat = GetBits( state, 2 ) + 3;
+            fill = sizes[n - 1];
+        }
+        else if (symbol == 17)
+        {
+            repeat = GetBits( state, 3 ) + 3;
+        }
+        else
+        {
+            repeat = GetBits( state, 7 ) + 11;
+        }
+
+        if (total - n < repeat)
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+        memset( sizes + n, fill, repeat );
+        n += repeat;
+    }
+
+    if (!BuildHuffman( lengths, sizes, numLengths ) ||
+        !BuildHuffman( distances, sizes + numLengths, numDistances ))
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+// Inflates a zlib stream into a buffer that must hold exactly outSize bytes plus 8 bytes
+// of slack for the match copier
+static HRESULT ZlibInflate( _In_reads_bytes_(inSize) const uint8_t* in,
+                            _In_ size_t inSize,
+                            _Out_writes_bytes_(outSize) uint8_t* out,
+                            _In_ size_t outSize )
+{
+    if (inSize < 2)
+    {
+        return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+    }
+
+    // CM must be deflate, the header must pass its check and preset dictionaries are not used by PNG
+    unsigned int cmf = in[0];
+    unsigned int flg = in[1];
+    if ((cmf & 15) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 32))
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    INFLATE_STATE state;
+    state.in = in + 2;
+    state.inEnd = in + inSize;
+    state.bitBuffer = 0;
+    state.bitCount = 0;
+    state.overrun = 0;
+    state.outStart = out;
+    state.out = out;
+    state.outEnd = out + outSize;
+
+    std::unique_ptr<INFLATE_HUFFMAN[]> tables( new INFLATE_HUFFMAN[2] );
+
+    bool finalBlock = false;
+    while (!finalBlock)
+    {
+        Refill( state );
+        finalBlock = GetBits( state, 1 ) != 0;
+        unsigned int type = GetBits( state, 2 );
+
+        HRESULT hr;
+        switch (type)
+        {
+        case 0:
+            hr = InflateStored( state );
+            break;
+
+        case 1:
+            {
+                uint8_t sizes[288 + 32];
+                memset( sizes, 8, 144 );
+                memset( sizes + 144, 9, 112 );
+                memset( sizes + 256, 7, 24 );
+                memset( sizes + 280, 8, 8 );
+                memset( sizes + 288, 5, 32 );
+                BuildHuffman( tables[0], sizes, 288 );
+                BuildHuffman( tables[1], sizes + 288, 32 );
+                hr = InflateCodes( state, tables[0], tables[1] );
+            }
+            break;
+
+        case 2:
+            hr = InflateDynamicTables( state, tables[0], tables[1] );
+            if (SUCCEEDED(hr))
+            {
+                hr = InflateCodes( state, tables[0], tables[1] );
+            }
+            break;
+
+        default:
+            hr = HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            break;
+        }
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    return (state.out == state.outEnd) ? S_OK : HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Unfiltering
+//
+// src and dst may alias. Each pixel is read before it is written, so rows can be
+// unfiltered in place. prior is the already unfiltered row above (all zero for row 0).
+//--------------------------------------------------------------------------------------
+static inline int PaethPredictor( int a, int b, int c )
+{
+    int pa = abs( b - c );
+    int pb = abs( a - c );
+    int pc = abs( a + b - 2 * c );
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return (pb <= pc) ? b : c;
+}
+
+static void UnfilterRowScalar( uint8_t filter, const uint8_t* src, uint8_t* dst, const uint8_t* prior, size_t rowBytes, size_t bpp )
+{
+    size_t i;
+    switch (filter)
+    {
+    case 0:
+        if (src != dst)
+        {
+            memcpy( dst, src, rowBytes );
+        }
+        break;
+
+    case 1:
+        for (i = 0; i < bpp; ++i)
+        {
+            dst[i] = src[i];
+        }
+        for (; i < rowBytes; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + dst[i - bpp] );
+        }
+        break;
+
+    case 2:
+        for (i = 0; i < rowBytes; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + prior[i] );
+        }
+        break;
+
+    case 3:
+        for (i = 0; i < bpp; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + (prior[i] >> 1) );
+        }
+        for (; i < rowBytes; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + ((dst[i - bpp] + prior[i]) >> 1) );
+        }
+        break;
+
+    case 4:
+        for (i = 0; i < bpp; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + prior[i] );
+        }
+        for (; i < rowBytes; ++i)
+        {
+            dst[i] = static_cast<uint8_t>( src[i] + PaethPredictor( dst[i - bpp], prior[i], prior[i - bpp] ) );
+        }
+        break;
+    }
+}
+
+static inline __m128i LoadPixel( const uint8_t* p, size_t bpp )
+{
+    int value = 0;
+    memcpy( &value, p, bpp );
+    return _mm_cvtsi32_si128( value );
+}
+
+static inline void StorePixel( uint8_t* p, __m128i value, size_t bpp )
+{
+    int packed = _mm_cvtsi128_si32( value );
+    memcpy( p, &packed, bpp );
+}
+
+static inline __m128i IfThenElse( __m128i condition, __m128i t, __m128i e )
+{
+    return _mm_or_si128( _mm_and_si128( condition, t ), _mm_andnot_si128( condition, e ) );
+}
+
+static inline __m128i Abs16( __m128i x )
+{
+    return _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) );
+}
+
+static void UnfilterUpSSE2( const uint8_t* src, uint8_t* dst, const uint8_t* prior, size_t rowBytes )
+{
+    size_t i = 0;
+    for (; i + 16 <= rowBytes; i += 16)
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( prior + i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ), _mm_add_epi8( x, b ) );
+    }
+    for (; i < rowBytes; ++i)
+    {
+        dst[i] = static_cast<uint8_t>( src[i] + prior[i] );
+    }
+}
+
+// Sub, Average and Paeth carry a dependency from one pixel to the next, so these work
+// one 3 or 4 byte pixel at a time with all channels in a single register
+static void UnfilterSubSSE2( const uint8_t* src, uint8_t* dst, size_t rowBytes, size_t bpp )
+{
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < rowBytes; i += bpp)
+    {
+        a = _mm_add_epi8( a, LoadPixel( src + i, bpp ) );
+        StorePixel( dst + i, a, bpp );
+    }
+}
+
+static void UnfilterAverageSSE2( const uint8_t* src, uint8_t* dst, const uint8_t* prior, size_t rowBytes, size_t bpp )
+{
+    const __m128i ones = _mm_set1_epi8( 1 );
+    __m128i a = _mm_setzero_si128();
+    for (size_t i = 0; i < rowBytes; i += bpp)
+    {
+        __m128i b = LoadPixel( prior + i, bpp );
+
+        // _mm_avg_epu8 rounds up, PNG rounds down
+        __m128i average = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), ones ) );
+        a = _mm_add_epi8( LoadPixel( src + i, bpp ), average );
+        StorePixel( dst + i, a, bpp );
+    }
+}
+
+static void UnfilterPaethSSE2( const uint8_t* src, uint8_t* dst, const uint8_t* prior, size_t rowBytes, size_t bpp )
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i b = zero;
+    __m128i c;
+    for (size_t i = 0; i < rowBytes; i += bpp)
+    {
+        // Widen to 16 bits so the predictor distances cannot overflow
+        c = b;
+        b = _mm_unpacklo_epi8( LoadPixel( prior + i, bpp ), zero );
+
+        __m128i pa = _mm_sub_epi16( b, c );
+        __m128i pb = _mm_sub_epi16( a, c );
+        __m128i pc = _mm_add_epi16( pa, pb );
+        pa = Abs16( pa );
+        pb = Abs16( pb );
+        pc = Abs16( pc );
+
+        // Ties favour a, then b, then c
+        __m128i smallest = _mm_min_epi16( pc, _mm_min_epi16( pa, pb ) );
+        __m128i nearest = IfThenElse( _mm_cmpeq_epi16( smallest, pa ), a,
+                          IfThenElse( _mm_cmpeq_epi16( smallest, pb ), b, c ) );
+
+        // Both high bytes are zero, so a byte add gives the sum modulo 256 in each lane
+        a = _mm_add_epi8( _mm_unpacklo_epi8( LoadPixel( src + i, bpp ), zero ), nearest );
+        StorePixel( dst + i, _mm_packus_epi16( a, a ), bpp );
+    }
+}
+
+static void UnfilterRow( uint8_t filter, const uint8_t* src, uint8_t* dst, const uint8_t* prior, size_t rowBytes, size_t bpp )
+{
+    if (filter == 2)
+    {
+        UnfilterUpSSE2( src, dst, prior, rowBytes );
+        return;
+    }
+
+    if (bpp == 3 || bpp == 4)
+    {
+        switch (filter)
+        {
+        case 1:
+            UnfilterSubSSE2( src, dst, rowBytes, bpp );
+            return;
+
+        case 3:
+            UnfilterAverageSSE2( src, dst, prior, rowBytes, bpp );
+            return;
+
+        case 4:
+            UnfilterPaethSSE2( src, dst, prior, rowBytes, bpp );
+            return;
+        }
+    }
+
+    UnfilterRowScalar( filter, src, dst, prior, rowBytes, bpp );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Expands one unfiltered row of any supported layout to RGBA8
+//--------------------------------------------------------------------------------------
+static inline uint16_t GetSample( const uint8_t* row, size_t index, uint8_t bitDepth )
+{
+    switch (bitDepth)
+    {
+    case 16:
+        return ReadBigEndian16( row + index * 2 );
+
+    case 8:
+        return row[index];
+
+    default:
+        {
+            size_t bit = index * bitDepth;
+            unsigned int shift = 8 - bitDepth - static_cast<unsigned int>( bit & 7 );
+            return static_cast<uint16_t>( (row[bit >> 3] >> shift) & ((1 << bitDepth) - 1) );
+        }
+    }
+}
+
+static inline uint8_t ScaleSample( uint16_t sample, uint8_t bitDepth )
+{
+    switch (bitDepth)
+    {
+    case 16:    return static_cast<uint8_t>( sample >> 8 );
+    case 8:     return static_cast<uint8_t>( sample );
+    case 4:     return static_cast<uint8_t>( sample * 0x11 );
+    case 2:     return static_cast<uint8_t>( sample * 0x55 );
+    default:    return static_cast<uint8_t>( sample * 0xff );
+    }
+}
+
+static void ExpandRow( const PNG_INFO& info, const uint8_t* row, uint8_t* dst )
+{
+    const uint8_t depth = info.bitDepth;
+
+    switch (info.colorType)
+    {
+    case PNG_COLOR_GRAY:
+        for (size_t x = 0; x < info.width; ++x, dst += 4)
+        {
+            uint16_t gray = GetSample( row, x, depth );
+            dst[0] = dst[1] = dst[2] = ScaleSample( gray, depth );
+            dst[3] = (info.hasColorKey && gray == info.colorKey[0]) ? 0 : 255;
+        }
+        break;
+
+    case PNG_COLOR_RGB:
+        if (depth == 8 && !info.hasColorKey)
+        {
+            for (size_t x = 0; x < info.width; ++x, row += 3, dst += 4)
+            {
+                dst[0] = row[0];
+                dst[1] = row[1];
+                dst[2] = row[2];
+                dst[3] = 255;
+            }
+        }
+        else
+        {
+            for (size_t x = 0; x < info.width; ++x, dst += 4)
+            {
+                uint16_t r = GetSample( row, x * 3, depth );
+                uint16_t g = GetSample( row, x * 3 + 1, depth );
+                uint16_t b = GetSample( row, x * 3 + 2, depth );
+                dst[0] = ScaleSample( r, depth );
+                dst[1] = ScaleSample( g, depth );
+                dst[2] = ScaleSample( b, depth );
+                dst[3] = (info.hasColorKey && r == info.colorKey[0] && g == info.colorKey[1] && b == info.colorKey[2]) ? 0 : 255;
+            }
+        }
+        break;
+
+    case PNG_COLOR_PALETTE:
+        for (size_t x = 0; x < info.width; ++x, dst += 4)
+        {
+            memcpy( dst, info.palette[GetSample( row, x, depth )], 4 );
+        }
+        break;
+
+    case PNG_COLOR_GRAY_ALPHA:
+        for (size_t x = 0; x < info.width; ++x, dst += 4)
+        {
+            dst[0] = dst[1] = dst[2] = ScaleSample( GetSample( row, x * 2, depth ), depth );
+            dst[3] = ScaleSample( GetSample( row, x * 2 + 1, depth ), depth );
+        }
+        break;
+
+    case PNG_COLOR_RGBA:
+        // 8 bit RGBA never gets here, it is unfiltered straight into the destination
+        for (size_t x = 0; x < info.width * 4; ++x)
+        {
+            dst[x] = ScaleSample( GetSample( row, x, depth ), depth );
+        }
+        break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ReadHeader( _In_ const uint8_t* data, _In_ uint32_t length, _Out_ PNG_INFO& info )
+{
+    if (length != 13)
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    info.width = ReadBigEndian32( data );
+    info.height = ReadBigEndian32( data + 4 );
+    info.bitDepth = data[8];
+    info.colorType = data[9];
+    info.interlace = data[12];
+
+    // Compression and filter method have only ever had one defined value
+    if (data[10] != 0 || data[11] != 0)
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    if (info.interlace != 0)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+    }
+
+    if (!info.width || !info.height ||
+        info.width > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+        info.height > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+    {
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+    }
+
+    bool validDepth = false;
+    switch (info.colorType)
+    {
+    case PNG_COLOR_GRAY:
+        info.channels = 1;
+        validDepth = (info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 || info.bitDepth == 8 || info.bitDepth == 16);
+        break;
+
+    case PNG_COLOR_PALETTE:
+        info.channels = 1;
+        validDepth = (info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 || info.bitDepth == 8);
+        break;
+
+    case PNG_COLOR_RGB:
+        info.channels = 3;
+        validDepth = (info.bitDepth == 8 || info.bitDepth == 16);
+        break;
+
+    case PNG_COLOR_GRAY_ALPHA:
+        info.channels = 2;
+        validDepth = (info.bitDepth == 8 || info.bitDepth == 16);
+        break;
+
+    case PNG_COLOR_RGBA:
+        info.channels = 4;
+        validDepth = (info.bitDepth == 8 || info.bitDepth == 16);
+        break;
+    }
+
+    if (!validDepth)
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    size_t bitsPerPixel = info.channels * info.bitDepth;
+    info.bytesPerPixel = std::max<size_t>( 1, bitsPerPixel / 8 );
+    info.rowBytes = (info.width * bitsPerPixel + 7) / 8;
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DecodePNGFromMemory( _In_reads_bytes_(pngDataSize) const uint8_t* pngData,
+                             _In_ size_t pngDataSize,
+                             std::unique_ptr<uint8_t[]>& pixels,
+                             _Out_ size_t* width,
+                             _Out_ size_t* height,
+                             _Out_ D3D11_SUBRESOURCE_DATA* initData )
+{
+    if (!pngData || !width || !height || !initData)
+    {
+        return E_POINTER;
+    }
+
+    if (pngDataSize < sizeof(PNG_SIGNATURE) || memcmp( pngData, PNG_SIGNATURE, sizeof(PNG_SIGNATURE) ) != 0)
+    {
+        return E_FAIL;
+    }
+
+    PNG_INFO info;
+    memset( &info, 0, sizeof(info) );
+    bool haveHeader = false;
+    size_t paletteSize = 0;
+
+    // Walk the chunks. Image data is usually split over several IDATs, which are
+    // concatenated only when there is more than one.
+    std::vector<const uint8_t*> dataChunks;
+    std::vector<uint32_t> dataLengths;
+    size_t dataSize = 0;
+
+    const uint8_t* p = pngData + sizeof(PNG_SIGNATURE);
+    const uint8_t* end = pngData + pngDataSize;
+    for (;;)
+    {
+        if (end - p < 12)
+        {
+            return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+        }
+
+        uint32_t length = ReadBigEndian32( p );
+        uint32_t type = ReadBigEndian32( p + 4 );
+        const uint8_t* chunk = p + 8;
+        if (length > static_cast<size_t>( end - chunk ) - 4)
+        {
+            return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+        }
+        p = chunk + length + 4; // skip the CRC
+
+        if (!haveHeader && type != PNG_CHUNK( 'I', 'H', 'D', 'R' ))
+        {
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+        }
+
+        if (type == PNG_CHUNK( 'I', 'H', 'D', 'R' ))
+        {
+            HRESULT hr = ReadHeader( chunk, length, info );
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            haveHeader = true;
+        }
+        else if (type == PNG_CHUNK( 'P', 'L', 'T', 'E' ))
+        {
+            if (length % 3 || length > 256 * 3)
+            {
+                return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            }
+            paletteSize = length / 3;
+            for (size_t i = 0; i < paletteSize; ++i)
+            {
+                info.palette[i][0] = chunk[i * 3];
+                info.palette[i][1] = chunk[i * 3 + 1];
+                info.palette[i][2] = chunk[i * 3 + 2];
+                info.palette[i][3] = 255;
+            }
+        }
+        else if (type == PNG_CHUNK( 't', 'R', 'N', 'S' ))
+        {
+            if (info.colorType == PNG_COLOR_PALETTE)
+            {
+                for (size_t i = 0; i < length && i < 256; ++i)
+                {
+                    info.palette[i][3] = chunk[i];
+                }
+            }
+            else if (info.colorType == PNG_COLOR_GRAY && length == 2)
+            {
+                info.hasColorKey = true;
+                info.colorKey[0] = ReadBigEndian16( chunk );
+            }
+            else if (info.colorType == PNG_COLOR_RGB && length == 6)
+            {
+                info.hasColorKey = true;
+                info.colorKey[0] = ReadBigEndian16( chunk );
+                info.colorKey[1] = ReadBigEndian16( chunk + 2 );
+                info.colorKey[2] = ReadBigEndian16( chunk + 4 );
+            }
+        }
+        else if (type == PNG_CHUNK( 'I', 'D', 'A', 'T' ))
+        {
+            dataChunks.push_back( chunk );
+            dataLengths.push_back( length );
+            dataSize += length;
+        }
+        else if (type == PNG_CHUNK( 'I', 'E', 'N', 'D' ))
+        {
+            break;
+        }
+        else if (!(type & PNG_CHUNK( 32, 0, 0, 0 )))
+        {
+            // Unknown critical chunk
+            return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+        }
+    }
+
+    if (dataChunks.empty() || (info.colorType == PNG_COLOR_PALETTE && !paletteSize))
+    {
+        return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+    }
+
+    std::unique_ptr<uint8_t[]> joined;
+    const uint8_t* compressed = dataChunks[0];
+    if (dataChunks.size() > 1)
+    {
+        joined.reset( new uint8_t[ dataSize ] );
+        size_t offset = 0;
+        for (size_t i = 0; i < dataChunks.size(); ++i)
+        {
+            memcpy( joined.get() + offset, dataChunks[i], dataLengths[i] );
+            offset += dataLengths[i];
+        }
+        compressed = joined.get();
+    }
+
+    // Every row is prefixed with its filter type byte
+    const size_t stride = info.rowBytes + 1;
+    const size_t rawSize = stride * info.height;
+    std::unique_ptr<uint8_t[]> raw( new uint8_t[ rawSize + 8 ] );
+    HRESULT hr = ZlibInflate( compressed, dataSize, raw.get(), rawSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    joined.reset();
+
+    const size_t pitch = static_cast<size_t>( info.width ) * 4;
+    pixels.reset( new uint8_t[ pitch * info.height ] );
+
+    std::unique_ptr<uint8_t[]> zeroRow( new uint8_t[ info.rowBytes ] );
+    memset( zeroRow.get(), 0, info.rowBytes );
+
+    if (info.colorType == PNG_COLOR_RGBA && info.bitDepth == 8)
+    {
+        // Already in the destination layout, so unfilter directly into the texture rows
+        const uint8_t* prior = zeroRow.get();
+        for (size_t y = 0; y < info.height; ++y)
+        {
+            const uint8_t* row = raw.get() + y * stride;
+            uint8_t* dst = pixels.get() + y * pitch;
+            if (row[0] > 4)
+            {
+                return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            }
+            UnfilterRow( row[0], row + 1, dst, prior, info.rowBytes, info.bytesPerPixel );
+            prior = dst;
+        }
+    }
+    else
+    {
+        const uint8_t* prior = zeroRow.get();
+        for (size_t y = 0; y < info.height; ++y)
+        {
+            uint8_t* row = raw.get() + y * stride;
+            if (row[0] > 4)
+            {
+                return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+            }
+            UnfilterRow( row[0], row + 1, row + 1, prior, info.rowBytes, info.bytesPerPixel );
+            ExpandRow( info, row + 1, pixels.get() + y * pitch );
+            prior = row + 1;
+        }
+    }
+
+    *width = info.width;
+    *height = info.height;
+    initData->pSysMem = pixels.get();
+    initData->SysMemPitch = static_cast<UINT>( pitch );
+    initData->SysMemSlicePitch = static_cast<UINT>( pitch * info.height );
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT CreatePNGTextureFromMemory( _In_ ID3D11Device* d3dDevice,
+                                    _In_reads_bytes_(pngDataSize) const uint8_t* pngData,
+                                    _In_ size_t pngDataSize,
+                                    _Out_opt_ ID3D11Resource** texture,
+                                    _Out_opt_ ID3D11ShaderResourceView** textureView )
+{
+    if (!d3dDevice || !pngData || (!texture && !textureView))
+    {
+        return E_INVALIDARG;
+    }
+
+    std::unique_ptr<uint8_t[]> pixels;
+    size_t width = 0;
+    size_t height = 0;
+    D3D11_SUBRESOURCE_DATA initData;
+    HRESULT hr = DecodePNGFromMemory( pngData, pngDataSize, pixels, &width, &height, &initData );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width = static_cast<UINT>( width );
+    desc.Height = static_cast<UINT>( height );
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+
+    ID3D11Texture2D* tex = nullptr;
+    hr = d3dDevice->CreateTexture2D( &desc, &initData, &tex );
+    if (FAILED(hr) || !tex)
+    {
+        return hr;
+    }
+
+    if (textureView != 0)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
+        memset( &SRVDesc, 0, sizeof( SRVDesc ) );
+        SRVDesc.Format = desc.Format;
+        SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        SRVDesc.Texture2D.MipLevels = 1;
+
+        hr = d3dDevice->CreateShaderResourceView( tex, &SRVDesc, textureView );
+        if ( FAILED(hr) )
+        {
+            tex->Release();
+            return hr;
+        }
+    }
+
+    if (texture != 0)
+    {
+        *texture = tex;
+    }
+    else
+    {
+#if defined(DEBUG) || defined(PROFILE)
+        tex->SetPrivateData( WKPDID_D3DDebugObjectName,
+                             sizeof("PNGTextureLoader")-1,
+                             "PNGTextureLoader"
+                           );
+#endif
+        tex->Release();
+    }
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT CreatePNGTextureFromFile( _In_ ID3D11Device* d3dDevice,
+                                  _In_z_ const wchar_t* fileName,
+                                  _Out_opt_ ID3D11Resource** texture,
+                                  _Out_opt_ ID3D11ShaderResourceView** textureView )
+{
+    if (!d3dDevice || !fileName || (!texture && !textureView))
+    {
+        return E_INVALIDARG;
+    }
+
+    ScopedHandle hFile( safe_handle( CreateFileW( fileName,
+                                                  GENERIC_READ,
+                                                  FILE_SHARE_READ,
+                                                  nullptr,
+                                                  OPEN_EXISTING,
+                                                  FILE_FLAG_SEQUENTIAL_SCAN,
+                                                  nullptr ) ) );
+    if ( !hFile )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    LARGE_INTEGER FileSize = { 0 };
+    if (!GetFileSizeEx( hFile.get(), &FileSize ))
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    // File is too big for 32-bit allocation, so reject read
+    if (FileSize.HighPart > 0)
+    {
+        return E_FAIL;
+    }
+
+    std::unique_ptr<uint8_t[]> pngData( new uint8_t[ FileSize.LowPart ] );
+
+    DWORD BytesRead = 0;
+    if (!ReadFile( hFile.get(), pngData.get(), FileSize.LowPart, &BytesRead, nullptr ))
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    if (BytesRead < FileSize.LowPart)
+    {
+        return E_FAIL;
+    }
+
+    return CreatePNGTextureFromMemory( d3dDevice, pngData.get(), BytesRead, texture, textureView );
+}
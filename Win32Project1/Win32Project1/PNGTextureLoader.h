@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// File: PNGTextureLoader.h
+//
+// Functions for decoding a PNG image and creating a Direct3D 11 runtime resource for it
+//
+// This is meant for development builds so the source PNGs can be loaded directly
+// without an offline conversion to DDS. Every image is expanded to
+// DXGI_FORMAT_R8G8B8A8_UNORM and written straight into the row layout that
+// D3D11_SUBRESOURCE_DATA expects, so no further copy is needed before upload.
+//--------------------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#include <d3d11.h>
+#include <memory>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+// Decodes a PNG held in memory without touching the device. On success 'pixels' owns the
+// RGBA8 image and 'initData' points into it with the pitches filled in. Safe to call from
+// several loader threads at once.
+HRESULT DecodePNGFromMemory( _In_reads_bytes_(pngDataSize) const uint8_t* pngData,
+                             _In_ size_t pngDataSize,
+                             std::unique_ptr<uint8_t[]>& pixels,
+                             _Out_ size_t* width,
+                             _Out_ size_t* height,
+                             _Out_ D3D11_SUBRESOURCE_DATA* initData
+                           );
+
+HRESULT CreatePNGTextureFromMemory( _In_ ID3D11Device* d3dDevice,
+                                    _In_reads_bytes_(pngDataSize) const uint8_t* pngData,
+                                    _In_ size_t pngDataSize,
+                                    _Out_opt_ ID3D11Resource** texture,
+                                    _Out_opt_ ID3D11ShaderResourceView** textureView
+                                  );
+
+HRESULT CreatePNGTextureFromFile( _In_ ID3D11Device* d3dDevice,
+                                  _In_z_ const wchar_t* szFileName,
+                                  _Out_opt_ ID3D11Resource** texture,
+                                  _Out_opt_ ID3D11ShaderResourceView** textureView
+                                );
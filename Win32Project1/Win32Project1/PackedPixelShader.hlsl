@@ -0,0 +1,15 @@
+#include "GeneralLighting.hlsli"
+
+Texture2DArray baseTexture : register(t0); // page built by the texture packer
+
+SamplerState filter : register(s0);
+
+// Same lighting as the general pixel shader, for objects whose texture was packed into an
+// array or atlas page. The UVs were already moved into the atlas rectangle on the CPU and
+// the slice index rides along in the third texture coordinate.
+float4 main(P_IN input) : SV_TARGET
+{
+	float4 baseColor = baseTexture.Sample(filter, input.uvsOut.xyz);
+
+	return ApplyLighting(input, baseColor);
+}
@@ -1,6 +1,7 @@
 #include "Plane.h"
 #include "GeneralVertexShader.csh"
 #include "GeneralPixelShader.csh"
+#include "VirtualTexturePixelShader.csh"
 #include "DDSTextureLoader.h"
 
 #define NUMVERTICIES 24
@@ -11,7 +12,10 @@
 Plane::Plane()
 {
 	worldMatrix = XMMatrixIdentity();
+	virtualTexture = nullptr;
+	virtualTexturePixelShader = nullptr;
 	verticies = new Vertex[NUMVERTICIES];
+	boundingRadius = 0;
 }
 
 
@@ -24,17 +28,26 @@ Plane::~Plane()
 	SAFE_RELEASE(indexBuffer);
 	SAFE_RELEASE(shaderResourceView);
 	SAFE_RELEASE(sampler);
+	SAFE_RELEASE(virtualTexturePixelShader);
 	delete[] verticies;
 }
 
-void Plane::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename)
+void Plane::Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename, VirtualTexture* virtualTexture)
 {
 	worldMatrix = XMMatrixIdentity();
 	worldMatrix = XMMatrixTranslation(initX, initY, initZ);
 	numIndicies = NUMINDICIES;
 	CreateVerticies();
+	// Only the four corners are set
+	boundingRadius = BoundingRadius(verticies, 4);
 
-	HRESULT result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
+	HRESULT result;
+	this->virtualTexture = virtualTexture;
+	shaderResourceView = nullptr;
+	if (virtualTexture)
+		result = device->CreatePixelShader(VirtualTexturePixelShader, sizeof(VirtualTexturePixelShader), NULL, &virtualTexturePixelShader);
+	else
+		result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
 
 	D3D11_BUFFER_DESC bufferDesc = {};
 	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -60,6 +73,7 @@ void Plane::Initialize(ID3D11Device* device, float initX, float initY, float ini
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_MIRROR;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_MIRROR;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_MIRROR;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
 
@@ -84,20 +98,37 @@ void Plane::Initialize(ID3D11Device* device, float initX, float initY, float ini
 	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
 }
 
-void Plane::Run(ID3D11DeviceContext* deviceContext)
+void Plane::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	deviceContext->PSSetShaderResources(0, 1, &shaderResourceView);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	if (virtualTexture && virtualTexture->IsLoaded())
+	{
+		renderContext->SetPixelShader(virtualTexturePixelShader);
+		virtualTexture->Bind(renderContext);
+	}
+	else
+	{
+		renderContext->SetPixelShader(pixelShader);
+		renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 1, &shaderResourceView);
+		renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	}
+	renderContext->DrawIndexed(numIndicies, 0, 0);
+}
+
+void Plane::RunFeedback(RenderContext* renderContext)
+{
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
 }
 
 void Plane::Translate(float offsetX, float offsetY, float offsetZ)
@@ -125,6 +156,11 @@ unsigned int Plane::GetNumIndicies() const
 	return numIndicies;
 }
 
+const Vertex* Plane::GetVerticies() const
+{
+	return verticies;
+}
+
 ID3D11VertexShader* Plane::GetVertexShader() const
 {
 	return vertexShader;
@@ -145,6 +181,11 @@ ID3D11SamplerState* Plane::GetSampler() const
 	return sampler;
 }
 
+float Plane::GetBoundingRadius() const
+{
+	return boundingRadius;
+}
+
 void Plane::SetWorldMatrix(const XMMATRIX* matrix)
 {
 	worldMatrix = *matrix;
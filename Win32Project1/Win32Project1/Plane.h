@@ -1,6 +1,8 @@
 #pragma once
 
 #include "defines.h"
+#include "RenderContext.h"
+#include "VirtualTexture.h"
 
 class Plane
 {
@@ -8,9 +10,14 @@ public:
 	Plane();
 	~Plane();
 
-	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename);
+	// With a virtualTexture the plane does not load filename itself and draws through the
+	// virtual texture instead, once it has loaded
+	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename, VirtualTexture* virtualTexture);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
+
+	// Draws the plane for the virtual texture's feedback pass, with the pixel shader it set
+	void RunFeedback(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -19,11 +26,15 @@ public:
 	ID3D11Buffer* GetBuffer() const;
 	ID3D11Buffer* GetIndexBuffer() const;
 	unsigned int GetNumIndicies() const;
+	// The first four are the corners of the quad
+	const Vertex* GetVerticies() const;
 	ID3D11VertexShader* GetVertexShader() const;
 	ID3D11PixelShader* GetPixelShader() const;
 	ID3D11InputLayout* GetLayout() const;
 	ID3D11ShaderResourceView* GetShaderResourceView() const;
 	ID3D11SamplerState* GetSampler() const;
+	// Radius of a sphere about the origin of the model that holds all of it
+	float GetBoundingRadius() const;
 
 	// Mutators
 
@@ -40,7 +51,10 @@ private:
 	ID3D11InputLayout* layout;
 	ID3D11ShaderResourceView* shaderResourceView;
 	ID3D11SamplerState* sampler;
+	VirtualTexture* virtualTexture;
+	ID3D11PixelShader* virtualTexturePixelShader;
 	Vertex* verticies;
+	float boundingRadius;
 
 	struct SEND_TO_OBJECT
 	{
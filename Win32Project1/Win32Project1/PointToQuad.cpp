@@ -54,19 +54,17 @@ void PointToQuad::Initialize(ID3D11Device* device, float initX, float initY, flo
 	toObject.worldMatrix = worldMatrix;
 }
 
-void PointToQuad::Run(ID3D11DeviceContext* deviceContext)
+void PointToQuad::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(nullptr, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(SIMPLE_VERTEX);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->GSSetShader(geometryShader, nullptr, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-	deviceContext->Draw(NUMVERTICIES, 0);
+	renderContext->SetIndexBuffer(nullptr, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(SIMPLE_VERTEX), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetGeometryShader(geometryShader);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+	renderContext->Draw(NUMVERTICIES, 0);
 }
 
 void PointToQuad::Translate(float offsetX, float offsetY, float offsetZ)
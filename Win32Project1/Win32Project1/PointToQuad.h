@@ -1,6 +1,7 @@
 #pragma once
 
 #include "defines.h"
+#include "RenderContext.h"
 
 class PointToQuad
 {
@@ -10,7 +11,7 @@ public:
 
 	void Initialize(ID3D11Device* device, float initX, float initY, float initZ);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -0,0 +1,76 @@
+#include "RadixSort.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+#define RADIX_SORT_PASSES 8
+
+void RadixSort(vector<RADIX_SORT_ITEM>& items, vector<RADIX_SORT_ITEM>& scratch)
+{
+	size_t count = items.size();
+	if (count < 2)
+		return;
+	scratch.resize(count);
+
+	// Every pass's histogram in one walk over the keys
+	size_t histograms[RADIX_SORT_PASSES][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t key = items[i].key;
+		for (unsigned int pass = 0; pass < RADIX_SORT_PASSES; ++pass)
+			++histograms[pass][(key >> (pass * 8)) & 0xff];
+	}
+
+	RADIX_SORT_ITEM* source = &items[0];
+	RADIX_SORT_ITEM* destination = &scratch[0];
+	for (unsigned int pass = 0; pass < RADIX_SORT_PASSES; ++pass)
+	{
+		unsigned int shift = pass * 8;
+		size_t* histogram = histograms[pass];
+		if (histogram[(source[0].key >> shift) & 0xff] == count)
+			continue;
+
+		size_t offsets[256];
+		size_t total = 0;
+		for (unsigned int digit = 0; digit < 256; ++digit)
+		{
+			offsets[digit] = total;
+			total += histogram[digit];
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+		swap(source, destination);
+	}
+
+	if (source != &items[0])
+		items.swap(scratch);
+}
+
+bool ReuseSortOrder(const vector<RADIX_SORT_ITEM>& order, vector<RADIX_SORT_ITEM>& items, vector<RADIX_SORT_ITEM>& scratch)
+{
+	size_t count = items.size();
+	if (order.size() != count)
+		return false;
+	if (count < 2)
+		return true;
+	scratch.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		unsigned int index = order[i].index;
+		if (index >= count)
+			return false;
+		scratch[i] = items[index];
+		if (i > 0)
+		{
+			const RADIX_SORT_ITEM& previous = scratch[i - 1];
+			if (scratch[i].key < previous.key || (scratch[i].key == previous.key && scratch[i].index <= previous.index))
+				return false;
+		}
+	}
+	items.swap(scratch);
+	return true;
+}
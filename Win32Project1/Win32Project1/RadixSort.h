@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// A key and where the thing it was made for lives, so the items can be sorted without
+// moving what they describe
+struct RADIX_SORT_ITEM
+{
+	uint64_t key;
+	unsigned int index;
+};
+
+// Sorts by key, smallest first, keeping items with equal keys in the order they came in.
+// Eight passes of eight bits; a pass is skipped when every key has the same byte there,
+// so keys that only use their top or bottom bits cost what they use. scratch is resized to
+// match and can be kept between calls to avoid allocating.
+void RadixSort(std::vector<RADIX_SORT_ITEM>& items, std::vector<RADIX_SORT_ITEM>& scratch);
+
+// Puts items in the order a previous RadixSort left them, when that order still sorts them
+// exactly as RadixSort would: keys rising and equal keys in the order they came in. The
+// items have to be numbered 0 up in the order they came in, as order's were. False, with
+// items untouched, when the count differs or the order no longer holds. A check is one
+// pass instead of eight, so draws made the same way frame after frame skip their sort.
+bool ReuseSortOrder(const std::vector<RADIX_SORT_ITEM>& order, std::vector<RADIX_SORT_ITEM>& items, std::vector<RADIX_SORT_ITEM>& scratch);
@@ -0,0 +1,311 @@
+#include "RecordingRenderContext.h"
+#include <string.h>
+
+using namespace std;
+
+RecordingRenderContext::RecordingRenderContext(bool keepCommands)
+{
+	this->keepCommands = keepCommands;
+	Reset();
+}
+
+RecordingRenderContext::~RecordingRenderContext()
+{
+}
+
+void RecordingRenderContext::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_INDEX_BUFFER);
+	if (!command)
+		return;
+	command->objects[0] = buffer;
+	command->arguments[0] = (unsigned int)format;
+	command->arguments[1] = offset;
+}
+
+void RecordingRenderContext::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_VERTEX_BUFFER);
+	if (!command)
+		return;
+	command->objects[0] = buffer;
+	command->arguments[0] = stride;
+	command->arguments[1] = offset;
+}
+
+void RecordingRenderContext::SetInputLayout(ID3D11InputLayout* layout)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_INPUT_LAYOUT);
+	if (command)
+		command->objects[0] = layout;
+}
+
+void RecordingRenderContext::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_PRIMITIVE_TOPOLOGY);
+	if (command)
+		command->arguments[0] = (unsigned int)topology;
+}
+
+void RecordingRenderContext::SetVertexShader(ID3D11VertexShader* shader)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_VERTEX_SHADER);
+	if (command)
+		command->objects[0] = shader;
+}
+
+void RecordingRenderContext::SetGeometryShader(ID3D11GeometryShader* shader)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_GEOMETRY_SHADER);
+	if (command)
+		command->objects[0] = shader;
+}
+
+void RecordingRenderContext::SetPixelShader(ID3D11PixelShader* shader)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_PIXEL_SHADER);
+	if (command)
+		command->objects[0] = shader;
+}
+
+void RecordingRenderContext::SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+	RecordBindings(RENDER_SET_CONSTANT_BUFFERS, stage, slot, count, (const void* const*)buffers);
+}
+
+void RecordingRenderContext::SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_CONSTANT_BUFFER_RANGE);
+	if (!command)
+		return;
+	command->stage = stage;
+	command->objects[0] = buffer;
+	command->arguments[0] = slot;
+	command->arguments[1] = firstConstant;
+	command->arguments[2] = constantCount;
+}
+
+void RecordingRenderContext::SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+	RecordBindings(RENDER_SET_SHADER_RESOURCES, stage, slot, count, (const void* const*)views);
+}
+
+void RecordingRenderContext::SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	RecordBindings(RENDER_SET_SAMPLERS, stage, slot, count, (const void* const*)samplers);
+}
+
+void RecordingRenderContext::SetBlendState(ID3D11BlendState* state)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_BLEND_STATE);
+	if (command)
+		command->objects[0] = state;
+}
+
+void RecordingRenderContext::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_RASTERIZER_STATE);
+	if (command)
+		command->objects[0] = state;
+}
+
+void RecordingRenderContext::SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_RENDER_TARGETS);
+	if (!command)
+		return;
+	command->objects[0] = renderTarget;
+	command->objects[1] = depthStencil;
+}
+
+void RecordingRenderContext::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	RENDER_COMMAND* command = Record(RENDER_SET_VIEWPORT);
+	if (!command)
+		return;
+	command->arguments[0] = (unsigned int)viewport.TopLeftX;
+	command->arguments[1] = (unsigned int)viewport.TopLeftY;
+	command->arguments[2] = (unsigned int)viewport.Width;
+	command->arguments[3] = (unsigned int)viewport.Height;
+}
+
+void RecordingRenderContext::ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4])
+{
+	RENDER_COMMAND* command = Record(RENDER_CLEAR_RENDER_TARGET);
+	if (!command)
+		return;
+	command->objects[0] = renderTarget;
+	memcpy(command->arguments, color, 4 * sizeof(float));
+}
+
+void RecordingRenderContext::ClearDepth(ID3D11DepthStencilView* depthStencil, float depth)
+{
+	RENDER_COMMAND* command = Record(RENDER_CLEAR_DEPTH);
+	if (!command)
+		return;
+	command->objects[0] = depthStencil;
+	memcpy(command->arguments, &depth, sizeof(float));
+}
+
+void RecordingRenderContext::WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	constantBytes += size;
+	RENDER_COMMAND* command = Record(RENDER_WRITE_CONSTANTS);
+	if (!command)
+		return;
+	command->objects[0] = buffer;
+	command->arguments[0] = size;
+	command->constantsOffset = constantData.size();
+	constantData.insert(constantData.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+void RecordingRenderContext::UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	constantBytes += size;
+	RENDER_COMMAND* command = Record(RENDER_UPLOAD_CONSTANTS);
+	if (!command)
+		return;
+	command->objects[0] = buffer;
+	command->arguments[0] = size;
+	command->arguments[1] = offset;
+	command->constantsOffset = constantData.size();
+	constantData.insert(constantData.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+void RecordingRenderContext::UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+	bufferBytes += size;
+	RENDER_COMMAND* command = Record(RENDER_UPDATE_BUFFER);
+	if (!command)
+		return;
+	command->objects[0] = buffer;
+	command->arguments[0] = size;
+	command->arguments[1] = offset;
+	command->constantsOffset = constantData.size();
+	constantData.insert(constantData.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+void RecordingRenderContext::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	++instanceCount;
+	RENDER_COMMAND* command = Record(RENDER_DRAW);
+	if (!command)
+		return;
+	command->arguments[0] = vertexCount;
+	command->arguments[1] = startVertex;
+}
+
+void RecordingRenderContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	++instanceCount;
+	RENDER_COMMAND* command = Record(RENDER_DRAW_INDEXED);
+	if (!command)
+		return;
+	command->arguments[0] = indexCount;
+	command->arguments[1] = startIndex;
+	command->arguments[2] = (unsigned int)baseVertex;
+}
+
+void RecordingRenderContext::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	this->instanceCount += instanceCount;
+	RENDER_COMMAND* command = Record(RENDER_DRAW_INDEXED_INSTANCED);
+	if (!command)
+		return;
+	command->arguments[0] = indexCount;
+	command->arguments[1] = instanceCount;
+	command->arguments[2] = startIndex;
+	command->arguments[3] = (unsigned int)baseVertex;
+	command->arguments[4] = startInstance;
+}
+
+void RecordingRenderContext::Reset()
+{
+	commands.clear();
+	constantData.clear();
+	memset(counts, 0, sizeof(counts));
+	instanceCount = 0;
+	constantBytes = 0;
+	bufferBytes = 0;
+}
+
+// Accessors
+const vector<RENDER_COMMAND>& RecordingRenderContext::GetCommands() const
+{
+	return commands;
+}
+
+const uint8_t* RecordingRenderContext::GetConstantData(const RENDER_COMMAND& command) const
+{
+	bool hasData = command.type == RENDER_WRITE_CONSTANTS || command.type == RENDER_UPLOAD_CONSTANTS || command.type == RENDER_UPDATE_BUFFER;
+	if (!hasData || command.constantsOffset >= constantData.size())
+		return nullptr;
+	return &constantData[command.constantsOffset];
+}
+
+unsigned int RecordingRenderContext::GetCount(RENDER_COMMAND_TYPE type) const
+{
+	return (type < RENDER_COMMAND_COUNT) ? counts[type] : 0;
+}
+
+unsigned int RecordingRenderContext::GetCommandCount() const
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < RENDER_COMMAND_COUNT; ++i)
+		total += counts[i];
+	return total;
+}
+
+unsigned int RecordingRenderContext::GetStateChangeCount() const
+{
+	unsigned int total = 0;
+	for (unsigned int i = RENDER_SET_INDEX_BUFFER; i <= RENDER_SET_VIEWPORT; ++i)
+		total += counts[i];
+	return total;
+}
+
+unsigned int RecordingRenderContext::GetDrawCount() const
+{
+	return counts[RENDER_DRAW] + counts[RENDER_DRAW_INDEXED] + counts[RENDER_DRAW_INDEXED_INSTANCED];
+}
+
+unsigned int RecordingRenderContext::GetInstanceCount() const
+{
+	return instanceCount;
+}
+
+size_t RecordingRenderContext::GetConstantBytes() const
+{
+	return constantBytes;
+}
+
+size_t RecordingRenderContext::GetBufferBytes() const
+{
+	return bufferBytes;
+}
+
+// Private Member Functions
+RENDER_COMMAND* RecordingRenderContext::Record(RENDER_COMMAND_TYPE type)
+{
+	++counts[type];
+	if (!keepCommands)
+		return nullptr;
+
+	RENDER_COMMAND command = {};
+	command.type = type;
+	command.stage = RENDER_STAGE_PIXEL;
+	commands.push_back(command);
+	return &commands.back();
+}
+
+void RecordingRenderContext::RecordBindings(RENDER_COMMAND_TYPE type, RENDER_STAGE stage, unsigned int slot, unsigned int count, const void* const* objects)
+{
+	RENDER_COMMAND* command = Record(type);
+	if (!command)
+		return;
+	command->stage = stage;
+	command->arguments[0] = slot;
+	command->arguments[1] = count;
+	for (unsigned int i = 0; i < count && i < RENDER_COMMAND_MAX_OBJECTS; ++i)
+		command->objects[i] = objects ? objects[i] : nullptr;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "RenderContext.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define RENDER_COMMAND_MAX_OBJECTS 4 // Buffers, views or samplers kept per call; the count is always the real one
+
+// One call as it was made. Which fields mean something depends on the type: objects holds
+// the buffer, shader, state or views bound, arguments the numbers passed after them in the
+// order RenderContext declares them.
+struct RENDER_COMMAND
+{
+	RENDER_COMMAND_TYPE type;
+	RENDER_STAGE stage;
+	const void* objects[RENDER_COMMAND_MAX_OBJECTS];
+	unsigned int arguments[5];
+	size_t constantsOffset; // Where the data of WriteConstants, UploadConstants or UpdateBuffer starts in GetConstantData
+};
+
+// Counts every call and, unless told not to, keeps them in order along with the constants
+// written, without a device. Meant for measuring what a frame costs on the CPU and checking
+// what it would have sent to the GPU, on machines that have no GPU.
+class RecordingRenderContext : public RenderContext
+{
+public:
+	// Only the counts are kept when keepCommands is false
+	RecordingRenderContext(bool keepCommands = true);
+	~RecordingRenderContext();
+
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetGeometryShader(ID3D11GeometryShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers);
+	void SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+	void ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* depthStencil, float depth);
+	void WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size);
+	void UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size);
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+
+	// Forgets every call and count, keeping the memory for the next frame
+	void Reset();
+
+	// Accessors
+	const std::vector<RENDER_COMMAND>& GetCommands() const;
+	const uint8_t* GetConstantData(const RENDER_COMMAND& command) const;
+	unsigned int GetCount(RENDER_COMMAND_TYPE type) const;
+	unsigned int GetCommandCount() const;
+	// Every Set call, whether or not it changed anything
+	unsigned int GetStateChangeCount() const;
+	unsigned int GetDrawCount() const;
+	unsigned int GetInstanceCount() const;
+	size_t GetConstantBytes() const;
+	size_t GetBufferBytes() const;
+
+private:
+
+	bool keepCommands;
+	std::vector<RENDER_COMMAND> commands;
+	std::vector<uint8_t> constantData;
+	unsigned int counts[RENDER_COMMAND_COUNT];
+	unsigned int instanceCount;
+	size_t constantBytes;
+	size_t bufferBytes;
+
+	RENDER_COMMAND* Record(RENDER_COMMAND_TYPE type);
+	void RecordBindings(RENDER_COMMAND_TYPE type, RENDER_STAGE stage, unsigned int slot, unsigned int count, const void* const* objects);
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include "RenderTypes.h"
+
+enum RENDER_STAGE
+{
+	RENDER_STAGE_VERTEX,
+	RENDER_STAGE_GEOMETRY,
+	RENDER_STAGE_PIXEL,
+	RENDER_STAGE_COUNT
+};
+
+// One per call on RenderContext, in the order they are declared there
+enum RENDER_COMMAND_TYPE
+{
+	RENDER_SET_INDEX_BUFFER,
+	RENDER_SET_VERTEX_BUFFER,
+	RENDER_SET_INPUT_LAYOUT,
+	RENDER_SET_PRIMITIVE_TOPOLOGY,
+	RENDER_SET_VERTEX_SHADER,
+	RENDER_SET_GEOMETRY_SHADER,
+	RENDER_SET_PIXEL_SHADER,
+	RENDER_SET_CONSTANT_BUFFERS,
+	RENDER_SET_CONSTANT_BUFFER_RANGE,
+	RENDER_SET_SHADER_RESOURCES,
+	RENDER_SET_SAMPLERS,
+	RENDER_SET_BLEND_STATE,
+	RENDER_SET_RASTERIZER_STATE,
+	RENDER_SET_RENDER_TARGETS,
+	RENDER_SET_VIEWPORT,
+	RENDER_CLEAR_RENDER_TARGET,
+	RENDER_CLEAR_DEPTH,
+	RENDER_WRITE_CONSTANTS,
+	RENDER_UPLOAD_CONSTANTS,
+	RENDER_UPDATE_BUFFER,
+	RENDER_DRAW,
+	RENDER_DRAW_INDEXED,
+	RENDER_DRAW_INDEXED_INSTANCED,
+	RENDER_COMMAND_COUNT
+};
+
+// The calls the objects make to draw themselves each frame, and nothing else. Run methods
+// take one of these instead of the device context, so a frame can be sent to the GPU through
+// D3D11RenderContext or recorded without one through RecordingRenderContext, which never
+// calls into Direct3D and needs only the types in RenderTypes.h, so it builds off Windows.
+//
+// Creating resources and copying into them still goes through the device and device
+// context directly; only drawing and the data sent every frame are covered. Every call has the meaning of the device
+// context call of the same name, with the arguments the objects never vary left out: one
+// vertex buffer in slot 0, one render target, one viewport, no blend factor.
+class RenderContext
+{
+public:
+	virtual ~RenderContext() {}
+
+	virtual void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) = 0;
+	virtual void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride, unsigned int offset) = 0;
+	virtual void SetInputLayout(ID3D11InputLayout* layout) = 0;
+	virtual void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void SetVertexShader(ID3D11VertexShader* shader) = 0;
+	virtual void SetGeometryShader(ID3D11GeometryShader* shader) = 0;
+	virtual void SetPixelShader(ID3D11PixelShader* shader) = 0;
+	virtual void SetConstantBuffers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) = 0;
+	// Binds constantCount constants of a buffer starting at firstConstant, through the
+	// Direct3D 11.1 *SetConstantBuffers1 calls. Both are in 16 byte constants and have to be
+	// multiples of 16.
+	virtual void SetConstantBufferRange(RENDER_STAGE stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) = 0;
+	virtual void SetShaderResources(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views) = 0;
+	virtual void SetSamplers(RENDER_STAGE stage, unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers) = 0;
+	virtual void SetBlendState(ID3D11BlendState* state) = 0;
+	virtual void SetRasterizerState(ID3D11RasterizerState* state) = 0;
+	virtual void SetRenderTargets(ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil) = 0;
+	virtual void SetViewport(const D3D11_VIEWPORT& viewport) = 0;
+	virtual void ClearRenderTarget(ID3D11RenderTargetView* renderTarget, const float color[4]) = 0;
+	virtual void ClearDepth(ID3D11DepthStencilView* depthStencil, float depth) = 0;
+
+	// Replaces the whole of a dynamic constant buffer with size bytes of data
+	virtual void WriteConstants(ID3D11Buffer* buffer, const void* data, unsigned int size) = 0;
+	// Writes size bytes at offset without touching the rest of the buffer, so draws already
+	// sent keep reading what they were given. The caller makes sure the GPU is done with
+	// that part of the buffer.
+	virtual void UploadConstants(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) = 0;
+	// Copies size bytes into a default usage buffer at offset, through UpdateSubresource
+	virtual void UpdateBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) = 0;
+
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+	virtual void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance) = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+// The Direct3D types RenderContext's calls take, and nothing more, so the interface and the
+// recording backend build wherever there is a C++ compiler. On Windows they come from
+// d3d11.h. Elsewhere the interfaces are only declared, since nothing off Windows ever calls
+// them, and the enums and the viewport are laid out the way d3d11.h lays them out, with the
+// values the tests use.
+#ifdef _WIN32
+#include <d3d11.h>
+#else
+struct ID3D11Buffer;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11GeometryShader;
+struct ID3D11PixelShader;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11BlendState;
+struct ID3D11RasterizerState;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32_UINT = 42,
+	DXGI_FORMAT_R16_UINT = 57
+};
+
+enum D3D11_PRIMITIVE_TOPOLOGY
+{
+	D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	D3D11_PRIMITIVE_TOPOLOGY_POINTLIST = 1,
+	D3D11_PRIMITIVE_TOPOLOGY_LINELIST = 2,
+	D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP = 3,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5
+};
+
+struct D3D11_VIEWPORT
+{
+	float TopLeftX;
+	float TopLeftY;
+	float Width;
+	float Height;
+	float MinDepth;
+	float MaxDepth;
+};
+#endif
@@ -34,7 +34,11 @@ void SkyBox::Initialize(ID3D11Device* device, float initX, float initY, float in
 	numIndicies = NUMINDICIES;
 	CreateVerticies();
 
-	HRESULT result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
+	// A null filename means the texture is supplied later through SetShaderResourceView
+	HRESULT result = S_OK;
+	shaderResourceView = nullptr;
+	if (filename)
+		result = CreateDDSTextureFromFile(device, filename, nullptr, &shaderResourceView);
 
 	D3D11_BUFFER_DESC bufferDesc = {};
 	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -61,6 +65,7 @@ void SkyBox::Initialize(ID3D11Device* device, float initX, float initY, float in
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 
 	result = device->CreateSamplerState(&samplerDesc, &sampler);
@@ -90,21 +95,19 @@ void SkyBox::Initialize(ID3D11Device* device, float initX, float initY, float in
 	result = device->CreateBuffer(&indexBufferDesc, &indexInitData, &indexBuffer);
 }
 
-void SkyBox::Run(ID3D11DeviceContext* deviceContext)
+void SkyBox::Run(RenderContext* renderContext)
 {
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-	unsigned int vertexSize = sizeof(Vertex);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &buffer, &vertexSize, &offset);
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->IASetInputLayout(layout);
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	deviceContext->PSSetShaderResources(0, 1, &shaderResourceView);
-	deviceContext->PSSetSamplers(0, 1, &sampler);
-	deviceContext->DrawIndexed(numIndicies, 0, 0);
+	renderContext->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	renderContext->SetVertexBuffer(buffer, sizeof(Vertex), 0);
+	renderContext->SetVertexShader(vertexShader);
+	renderContext->SetGeometryShader(nullptr);
+	renderContext->SetPixelShader(pixelShader);
+	renderContext->SetInputLayout(layout);
+	renderContext->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 1, &shaderResourceView);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &sampler);
+	renderContext->DrawIndexed(numIndicies, 0, 0);
 }
 
 void SkyBox::Translate(float offsetX, float offsetY, float offsetZ)
@@ -157,6 +160,17 @@ void SkyBox::SetWorldMatrix(const XMMATRIX* matrix)
 	worldMatrix = *matrix;
 }
 
+void SkyBox::SetShaderResourceView(ID3D11ShaderResourceView* view)
+{
+	if (view == shaderResourceView)
+		return;
+
+	if (view)
+		view->AddRef();
+	SAFE_RELEASE(shaderResourceView);
+	shaderResourceView = view;
+}
+
 // Private Member Functions
 void SkyBox::CreateVerticies()
 {
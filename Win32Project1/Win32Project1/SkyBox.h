@@ -1,6 +1,7 @@
 #pragma once
 
 #include "defines.h"
+#include "RenderContext.h"
 
 class SkyBox
 {
@@ -10,7 +11,7 @@ public:
 
 	void Initialize(ID3D11Device* device, float initX, float initY, float initZ, const wchar_t* filename, bool isSkyBox = false);
 
-	void Run(ID3D11DeviceContext* deviceContext);
+	void Run(RenderContext* renderContext);
 
 	void Translate(float offsetX, float offsetY, float offsetZ);
 
@@ -28,6 +29,7 @@ public:
 	// Mutators
 
 	void SetWorldMatrix(const XMMATRIX* matrix);
+	void SetShaderResourceView(ID3D11ShaderResourceView* view);
 
 private:
 
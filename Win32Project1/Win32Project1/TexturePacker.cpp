@@ -0,0 +1,347 @@
+#include "TexturePacker.h"
+#include "MipChainGenerator.h"
+#include <algorithm>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+TexturePacker::TexturePacker()
+{
+}
+
+
+TexturePacker::~TexturePacker()
+{
+	Release();
+}
+
+unsigned int TexturePacker::Add(const wchar_t* filename, bool allowAtlas)
+{
+	PackerEntry* entry = new PackerEntry();
+	entry->filename = filename;
+	entry->allowAtlas = allowAtlas;
+	entry->ddsDataSize = 0;
+	entry->packed = false;
+
+	entries.push_back(entry);
+	return (unsigned int)entries.size() - 1;
+}
+
+bool TexturePacker::Build(ID3D11Device* device, AsyncFileReader* fileReader)
+{
+	vector<bool> grouped(entries.size(), false);
+	for (unsigned int i = 0; i < entries.size(); ++i)
+	{
+		PackerEntry* entry = entries[i];
+		HRESULT result = E_FAIL;
+		if (!fileReader)
+			result = LoadDDSTextureDataFromFile(entry->filename.c_str(), entry->ddsData, &entry->ddsDataSize, &entry->info);
+		else if (fileReader->Load(entry->filename.c_str(), entry->ddsData, &entry->ddsDataSize))
+			result = LoadDDSTextureDataFromMemory(entry->ddsData, &entry->ddsDataSize, &entry->info);
+
+		// Only plain 2D textures can become a slice
+		if (FAILED(result) || entry->info.dimension != D3D11_RESOURCE_DIMENSION_TEXTURE2D || entry->info.arraySize != 1)
+			grouped[i] = true;
+	}
+
+	// Textures that match in everything a Texture2DArray requires share one
+	vector<unsigned int> atlasCandidates;
+	for (unsigned int i = 0; i < entries.size(); ++i)
+	{
+		if (grouped[i])
+			continue;
+
+		const DDS_TEXTURE_INFO& info = entries[i]->info;
+		vector<unsigned int> members(1, i);
+		grouped[i] = true;
+		for (unsigned int j = i + 1; j < entries.size(); ++j)
+		{
+			const DDS_TEXTURE_INFO& other = entries[j]->info;
+			if (!grouped[j] && other.format == info.format && other.width == info.width &&
+				other.height == info.height && other.mipCount == info.mipCount)
+			{
+				members.push_back(j);
+				grouped[j] = true;
+			}
+		}
+
+		if (members.size() == 1 && entries[i]->allowAtlas && CanGenerateMipChain(info.format) &&
+			info.width <= PACKER_MAX_ATLAS_ENTRY && info.height <= PACKER_MAX_ATLAS_ENTRY)
+			atlasCandidates.push_back(i);
+		else
+			BuildArrayPage(device, members);
+	}
+
+	// The leftovers share an atlas with others of their format; one on its own gains nothing
+	// from the gutter and keeps its full chain as a single slice instead
+	vector<bool> atlased(atlasCandidates.size(), false);
+	for (unsigned int i = 0; i < atlasCandidates.size(); ++i)
+	{
+		if (atlased[i])
+			continue;
+
+		vector<unsigned int> members(1, atlasCandidates[i]);
+		atlased[i] = true;
+		for (unsigned int j = i + 1; j < atlasCandidates.size(); ++j)
+		{
+			if (!atlased[j] && entries[atlasCandidates[j]]->info.format == entries[atlasCandidates[i]]->info.format)
+			{
+				members.push_back(atlasCandidates[j]);
+				atlased[j] = true;
+			}
+		}
+
+		if (members.size() == 1)
+			BuildArrayPage(device, members);
+		else
+			BuildAtlasPage(device, members);
+	}
+
+	// Everything lives on the GPU now
+	bool allPacked = true;
+	for (unsigned int i = 0; i < entries.size(); ++i)
+	{
+		entries[i]->ddsData.reset();
+		entries[i]->ddsDataSize = 0;
+		allPacked = allPacked && entries[i]->packed;
+	}
+
+	return allPacked;
+}
+
+void TexturePacker::BuildArrayPage(ID3D11Device* device, const vector<unsigned int>& members)
+{
+	const DDS_TEXTURE_INFO& info = entries[members[0]]->info;
+	size_t mipCount = info.mipCount;
+
+	vector<D3D11_SUBRESOURCE_DATA> initData(mipCount * members.size());
+	for (unsigned int i = 0; i < members.size(); ++i)
+	{
+		PackerEntry* entry = entries[members[i]];
+		if (FAILED(GetDDSSubresourceData(entry->ddsData.get(), entry->ddsDataSize, entry->info, &initData[i * mipCount])))
+			return;
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = (UINT)info.width;
+	desc.Height = (UINT)info.height;
+	desc.MipLevels = (UINT)mipCount;
+	desc.ArraySize = (UINT)members.size();
+	desc.Format = info.format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	if (!CreatePage(device, desc, initData.data()))
+		return;
+
+	for (unsigned int i = 0; i < members.size(); ++i)
+	{
+		PackerEntry* entry = entries[members[i]];
+		entry->placement.page = (unsigned int)pages.size() - 1;
+		entry->placement.scale = XMFLOAT2(1, 1);
+		entry->placement.offset = XMFLOAT2(0, 0);
+		entry->placement.slice = (float)i;
+		entry->packed = true;
+	}
+}
+
+void TexturePacker::BuildAtlasPage(ID3D11Device* device, const vector<unsigned int>& members)
+{
+	const unsigned int atlasSize = PACKER_ATLAS_SIZE;
+	const unsigned int padding = PACKER_ATLAS_PADDING;
+
+	// Shelf packing, tallest first so each shelf wastes as little height as possible. Cells
+	// are whole multiples of the padding, which keeps every 2x2 block of the first few levels
+	// inside one cell.
+	vector<unsigned int> order(members);
+	sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+	{
+		return entries[a]->info.height > entries[b]->info.height;
+	});
+
+	vector<unsigned int> cellX(order.size()), cellY(order.size()), cellSlice(order.size());
+	unsigned int shelfX = 0, shelfY = 0, shelfHeight = 0, slice = 0;
+	for (unsigned int i = 0; i < order.size(); ++i)
+	{
+		const DDS_TEXTURE_INFO& info = entries[order[i]]->info;
+		unsigned int cellWidth = ((unsigned int)info.width + 2 * padding + padding - 1) / padding * padding;
+		unsigned int cellHeight = ((unsigned int)info.height + 2 * padding + padding - 1) / padding * padding;
+
+		if (shelfX + cellWidth > atlasSize)
+		{
+			shelfY += shelfHeight;
+			shelfX = 0;
+			shelfHeight = 0;
+		}
+		if (shelfY + cellHeight > atlasSize)
+		{
+			++slice;
+			shelfX = 0;
+			shelfY = 0;
+			shelfHeight = 0;
+		}
+
+		cellX[i] = shelfX;
+		cellY[i] = shelfY;
+		cellSlice[i] = slice;
+		shelfX += cellWidth;
+		shelfHeight = max(shelfHeight, cellHeight);
+	}
+
+	unsigned int numSlices = slice + 1;
+	size_t sliceBytes = (size_t)atlasSize * atlasSize * 4;
+	unique_ptr<uint8_t[]> atlas(new uint8_t[sliceBytes * numSlices]);
+	memset(atlas.get(), 0, sliceBytes * numSlices);
+
+	// Copy each top level into its cell and stretch its edges out over the gutter, the same
+	// as clamp addressing would
+	for (unsigned int i = 0; i < order.size(); ++i)
+	{
+		PackerEntry* entry = entries[order[i]];
+		vector<D3D11_SUBRESOURCE_DATA> initData(entry->info.mipCount);
+		if (FAILED(GetDDSSubresourceData(entry->ddsData.get(), entry->ddsDataSize, entry->info, initData.data())))
+			return;
+
+		const uint8_t* source = (const uint8_t*)initData[0].pSysMem;
+		int width = (int)entry->info.width;
+		int height = (int)entry->info.height;
+		int cellWidth = (width + 2 * padding + padding - 1) / padding * padding;
+		int cellHeight = (height + 2 * padding + padding - 1) / padding * padding;
+		uint8_t* cell = atlas.get() + cellSlice[i] * sliceBytes + ((size_t)cellY[i] * atlasSize + cellX[i]) * 4;
+
+		for (int y = 0; y < cellHeight; ++y)
+		{
+			int sourceY = min(max(y - (int)padding, 0), height - 1);
+			const uint8_t* sourceRow = source + sourceY * initData[0].SysMemPitch;
+			uint8_t* row = cell + (size_t)y * atlasSize * 4;
+			for (int x = 0; x < cellWidth; ++x)
+			{
+				int sourceX = min(max(x - (int)padding, 0), width - 1);
+				memcpy(row + x * 4, sourceRow + sourceX * 4, 4);
+			}
+		}
+
+		entry->placement.scale = XMFLOAT2((float)width / atlasSize, (float)height / atlasSize);
+		entry->placement.offset = XMFLOAT2((float)(cellX[i] + padding) / atlasSize, (float)(cellY[i] + padding) / atlasSize);
+		entry->placement.slice = (float)cellSlice[i];
+	}
+
+	DXGI_FORMAT format = entries[members[0]]->info.format;
+	unique_ptr<uint8_t[]> mipData;
+	size_t mipDataSize = 0, mipCount = 0;
+	if (FAILED(GenerateMipChain(atlasSize, atlasSize, numSlices, format, MIP_FILTER_BOX, true,
+		atlas.get(), sliceBytes * numSlices, mipData, &mipDataSize, &mipCount)))
+		return;
+
+	// The chain goes all the way down, but only the levels with a gutter left are used
+	vector<D3D11_SUBRESOURCE_DATA> initData(PACKER_ATLAS_MIPS * numSlices);
+	size_t sliceChainBytes = mipDataSize / numSlices;
+	for (unsigned int s = 0; s < numSlices; ++s)
+	{
+		const uint8_t* level = mipData.get() + s * sliceChainBytes;
+		for (unsigned int m = 0; m < PACKER_ATLAS_MIPS; ++m)
+		{
+			unsigned int levelSize = max(atlasSize >> m, 1u);
+			initData[s * PACKER_ATLAS_MIPS + m].pSysMem = level;
+			initData[s * PACKER_ATLAS_MIPS + m].SysMemPitch = levelSize * 4;
+			initData[s * PACKER_ATLAS_MIPS + m].SysMemSlicePitch = levelSize * levelSize * 4;
+			level += levelSize * levelSize * 4;
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = atlasSize;
+	desc.Height = atlasSize;
+	desc.MipLevels = PACKER_ATLAS_MIPS;
+	desc.ArraySize = numSlices;
+	desc.Format = format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	if (!CreatePage(device, desc, initData.data()))
+		return;
+
+	for (unsigned int i = 0; i < members.size(); ++i)
+	{
+		entries[members[i]]->placement.page = (unsigned int)pages.size() - 1;
+		entries[members[i]]->packed = true;
+	}
+}
+
+bool TexturePacker::CreatePage(ID3D11Device* device, const D3D11_TEXTURE2D_DESC& desc, const D3D11_SUBRESOURCE_DATA* initData)
+{
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT result = device->CreateTexture2D(&desc, initData, &texture);
+	if (FAILED(result))
+		return false;
+
+	// Always an array view, even for a single slice, so one shader samples every page
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = desc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	viewDesc.Texture2DArray.MipLevels = desc.MipLevels;
+	viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+
+	ID3D11ShaderResourceView* view = nullptr;
+	result = device->CreateShaderResourceView(texture, &viewDesc, &view);
+	SAFE_RELEASE(texture);
+	if (FAILED(result))
+		return false;
+
+	pages.push_back(view);
+	return true;
+}
+
+void TexturePacker::Release()
+{
+	for (unsigned int i = 0; i < pages.size(); ++i)
+		SAFE_RELEASE(pages[i]);
+	pages.clear();
+
+	for (unsigned int i = 0; i < entries.size(); ++i)
+		delete entries[i];
+	entries.clear();
+}
+
+// Accessors
+bool TexturePacker::GetPlacement(unsigned int handle, TEXTURE_PLACEMENT* placement) const
+{
+	if (handle >= entries.size() || !entries[handle]->packed)
+		return false;
+
+	*placement = entries[handle]->placement;
+	return true;
+}
+
+ID3D11ShaderResourceView* TexturePacker::GetShaderResourceView(unsigned int page) const
+{
+	return (page < pages.size()) ? pages[page] : nullptr;
+}
+
+unsigned int TexturePacker::GetNumPages() const
+{
+	return (unsigned int)pages.size();
+}
+
+bool ApplyTexturePlacement(Vertex verticies[], unsigned int numVerticies, const TEXTURE_PLACEMENT& placement)
+{
+	bool atlas = placement.scale.x != 1 || placement.scale.y != 1;
+	if (atlas)
+	{
+		for (unsigned int i = 0; i < numVerticies; ++i)
+		{
+			if (verticies[i].uvw.x < 0 || verticies[i].uvw.x > 1 || verticies[i].uvw.y < 0 || verticies[i].uvw.y > 1)
+				return false;
+		}
+	}
+
+	for (unsigned int i = 0; i < numVerticies; ++i)
+	{
+		verticies[i].uvw.x = verticies[i].uvw.x * placement.scale.x + placement.offset.x;
+		verticies[i].uvw.y = verticies[i].uvw.y * placement.scale.y + placement.offset.y;
+		verticies[i].uvw.z = placement.slice;
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "defines.h"
+#include "DDSTextureLoader.h"
+#include "AsyncFileReader.h"
+#include <string>
+
+#define PACKER_ATLAS_SIZE 1024
+#define PACKER_ATLAS_PADDING 8
+#define PACKER_ATLAS_MIPS 4 // Levels whose gutter is still at least one texel wide
+#define PACKER_MAX_ATLAS_ENTRY 256
+
+// Where a texture ended up. The UVs of anything drawn with it are moved into the atlas
+// rectangle (uv * scale + offset) and the slice goes in the third texture coordinate.
+struct TEXTURE_PLACEMENT
+{
+	unsigned int page;
+	XMFLOAT2 scale;
+	XMFLOAT2 offset;
+	float slice;
+};
+
+// Moves the UVs of a mesh into a placement. Atlas rectangles only hold UVs in [0, 1], so
+// this leaves the verticies untouched and returns false for a mesh that tiles its texture.
+bool ApplyTexturePlacement(Vertex verticies[], unsigned int numVerticies, const TEXTURE_PLACEMENT& placement);
+
+// Collects textures so objects that share a material can share one shader resource view.
+// Textures with the same format, size and mip count become slices of one Texture2DArray;
+// smaller 32bpp textures that are not tiled are packed into atlas slices with a padded
+// gutter around each so the first PACKER_ATLAS_MIPS levels do not bleed into each other.
+// Every page is a Texture2DArray, so there is a single shader path for both.
+class TexturePacker
+{
+public:
+	TexturePacker();
+	~TexturePacker();
+
+	// Queue a texture for the next Build. Pass false for allowAtlas when anything samples it
+	// with UVs outside [0, 1].
+	unsigned int Add(const wchar_t* filename, bool allowAtlas);
+
+	// Loads everything queued and creates the pages. Files come through the fileReader when
+	// one is given, so prefetching them there lets the reads overlap.
+	bool Build(ID3D11Device* device, AsyncFileReader* fileReader);
+
+	void Release();
+
+	// Accessors
+	// False if the texture failed to load or could not be packed
+	bool GetPlacement(unsigned int handle, TEXTURE_PLACEMENT* placement) const;
+	ID3D11ShaderResourceView* GetShaderResourceView(unsigned int page) const;
+	unsigned int GetNumPages() const;
+
+private:
+
+	struct PackerEntry
+	{
+		wstring filename;
+		bool allowAtlas;
+		unique_ptr<uint8_t[]> ddsData;
+		size_t ddsDataSize;
+		DDS_TEXTURE_INFO info;
+		bool packed;
+		TEXTURE_PLACEMENT placement;
+	};
+
+	vector<PackerEntry*> entries;
+	vector<ID3D11ShaderResourceView*> pages;
+
+	void BuildArrayPage(ID3D11Device* device, const vector<unsigned int>& members);
+	void BuildAtlasPage(ID3D11Device* device, const vector<unsigned int>& members);
+	bool CreatePage(ID3D11Device* device, const D3D11_TEXTURE2D_DESC& desc, const D3D11_SUBRESOURCE_DATA* initData);
+};
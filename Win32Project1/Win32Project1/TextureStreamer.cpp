@@ -0,0 +1,342 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+TextureStreamer::TextureStreamer()
+{
+	device = nullptr;
+	fileReader = nullptr;
+	budget = STREAMING_DEFAULT_BUDGET;
+	shuttingDown = false;
+	frame = 0;
+	currentBytes = 0;
+	peakBytes = 0;
+	evictionCount = 0;
+}
+
+
+TextureStreamer::~TextureStreamer()
+{
+	Shutdown();
+}
+
+void TextureStreamer::Initialize(ID3D11Device* device, size_t budgetBytes, AsyncFileReader* fileReader)
+{
+	this->device = device;
+	this->fileReader = fileReader;
+	budget = budgetBytes;
+	shuttingDown = false;
+
+	for (int i = 0; i < STREAMING_NUM_WORKERS; ++i)
+		workers.push_back(thread(&TextureStreamer::Worker, this));
+}
+
+unsigned int TextureStreamer::Load(const wchar_t* filename)
+{
+	{
+		lock_guard<mutex> lock(streamMutex);
+		map<wstring, unsigned int>::iterator found = handles.find(filename);
+		if (found != handles.end())
+			return found->second;
+	}
+
+	// Reading the file and building its chain happens outside the lock so several loader
+	// threads can do it at once
+	StreamedTexture* texture = new StreamedTexture();
+	texture->ddsDataSize = 0;
+	texture->fullSize = 0;
+	texture->shaderResourceView = nullptr;
+	texture->residentSize = 0;
+	texture->residentBytes = 0;
+	texture->pendingView = nullptr;
+	texture->pendingSize = 0;
+	texture->requestInFlight = false;
+	texture->requestedSize = 0;
+	texture->targetSize = 0;
+	texture->lastUsedFrame = 0;
+
+	HRESULT result = E_FAIL;
+	if (!fileReader)
+		result = LoadDDSTextureDataFromFile(filename, texture->ddsData, &texture->ddsDataSize, &texture->info);
+	else if (fileReader->Load(filename, texture->ddsData, &texture->ddsDataSize))
+		result = LoadDDSTextureDataFromMemory(texture->ddsData, &texture->ddsDataSize, &texture->info);
+	if (SUCCEEDED(result))
+	{
+		texture->fullSize = max(texture->info.width, texture->info.height);
+		texture->residentSize = min((size_t)STREAMING_INITIAL_SIZE, texture->fullSize);
+		result = CreateDDSTextureFromMemory(device, texture->ddsData.get(), texture->ddsDataSize, nullptr, &texture->shaderResourceView, texture->residentSize);
+	}
+
+	if (SUCCEEDED(result))
+	{
+		texture->residentBytes = GetDDSTextureMemorySize(texture->info, texture->residentSize);
+		texture->targetSize = texture->residentSize;
+	}
+	else
+	{
+		// Keep the handle valid but never stream anything for it
+		texture->ddsData.reset();
+		texture->fullSize = 0;
+		texture->residentSize = 0;
+	}
+
+	lock_guard<mutex> lock(streamMutex);
+
+	// Another thread may have loaded the same file in the meantime
+	map<wstring, unsigned int>::iterator found = handles.find(filename);
+	if (found != handles.end())
+	{
+		SAFE_RELEASE(texture->shaderResourceView);
+		delete texture;
+		return found->second;
+	}
+
+	texture->lastUsedFrame = frame;
+	currentBytes += texture->residentBytes;
+	peakBytes = max(peakBytes, currentBytes);
+
+	unsigned int handle = (unsigned int)textures.size();
+	textures.push_back(texture);
+	handles[filename] = handle;
+	return handle;
+}
+
+void TextureStreamer::RequestFootprint(unsigned int handle, float screenSize)
+{
+	lock_guard<mutex> lock(streamMutex);
+	if (handle < textures.size())
+	{
+		textures[handle]->requestedSize = max(textures[handle]->requestedSize, screenSize);
+		textures[handle]->lastUsedFrame = frame;
+	}
+}
+
+void TextureStreamer::Run()
+{
+	lock_guard<mutex> lock(streamMutex);
+
+	// Swap in whatever the workers finished since last frame
+	for (unsigned int i = 0; i < textures.size(); ++i)
+	{
+		StreamedTexture* texture = textures[i];
+		if (texture->pendingView)
+		{
+			currentBytes -= texture->residentBytes;
+			SAFE_RELEASE(texture->shaderResourceView);
+			texture->shaderResourceView = texture->pendingView;
+			texture->pendingView = nullptr;
+			texture->residentSize = texture->pendingSize;
+			texture->residentBytes = GetDDSTextureMemorySize(texture->info, texture->residentSize);
+			texture->requestInFlight = false;
+		}
+	}
+
+	// The smallest power of two that covers the footprint, up to the full size. Textures
+	// nobody sampled last frame keep what they have until the budget needs it back.
+	for (unsigned int i = 0; i < textures.size(); ++i)
+	{
+		StreamedTexture* texture = textures[i];
+		if (!texture->fullSize)
+			continue;
+
+		if (texture->lastUsedFrame != frame)
+		{
+			texture->targetSize = texture->residentSize;
+			continue;
+		}
+
+		size_t target = min((size_t)STREAMING_INITIAL_SIZE, texture->fullSize);
+		while (target < texture->fullSize && (float)target < texture->requestedSize)
+			target <<= 1;
+		target = min(target, texture->fullSize);
+
+		// Only drop a level once the need has fallen well below it so an object near the
+		// boundary does not flip back and forth every frame
+		if (target < texture->residentSize && target * 2 >= texture->residentSize)
+			target = texture->residentSize;
+
+		texture->targetSize = target;
+		texture->requestedSize = 0;
+	}
+
+	ApplyBudget();
+
+	bool queued = false;
+	for (unsigned int i = 0; i < textures.size(); ++i)
+	{
+		StreamedTexture* texture = textures[i];
+		if (!texture->fullSize || texture->requestInFlight || texture->targetSize == texture->residentSize)
+			continue;
+
+		StreamRequest request;
+		request.handle = i;
+		request.size = texture->targetSize;
+		requests.push_back(request);
+		texture->requestInFlight = true;
+		queued = true;
+	}
+
+	if (queued)
+		requestAvailable.notify_all();
+
+	++frame;
+}
+
+void TextureStreamer::ApplyBudget()
+{
+	size_t total = 0;
+	vector<unsigned int> leastRecentlyUsed;
+	for (unsigned int i = 0; i < textures.size(); ++i)
+	{
+		if (!textures[i]->fullSize)
+			continue;
+
+		total += GetDDSTextureMemorySize(textures[i]->info, textures[i]->targetSize);
+		if (textures[i]->lastUsedFrame != frame)
+			leastRecentlyUsed.push_back(i);
+	}
+
+	if (total <= budget)
+		return;
+
+	// Textures out of view go first, oldest first, straight down to their smallest size
+	sort(leastRecentlyUsed.begin(), leastRecentlyUsed.end(), [this](unsigned int a, unsigned int b)
+	{
+		return textures[a]->lastUsedFrame < textures[b]->lastUsedFrame;
+	});
+
+	for (unsigned int i = 0; i < leastRecentlyUsed.size() && total > budget; ++i)
+	{
+		StreamedTexture* texture = textures[leastRecentlyUsed[i]];
+		size_t smallest = min((size_t)STREAMING_INITIAL_SIZE, texture->fullSize);
+		if (texture->targetSize <= smallest)
+			continue;
+
+		total -= GetDDSTextureMemorySize(texture->info, texture->targetSize);
+		texture->targetSize = smallest;
+		total += GetDDSTextureMemorySize(texture->info, texture->targetSize);
+		++evictionCount;
+	}
+
+	// Then take a level off whichever visible texture is asking for the most until it fits
+	while (total > budget)
+	{
+		StreamedTexture* largest = nullptr;
+		for (unsigned int i = 0; i < textures.size(); ++i)
+		{
+			StreamedTexture* texture = textures[i];
+			if (texture->fullSize && texture->targetSize > STREAMING_INITIAL_SIZE &&
+				(!largest || texture->targetSize > largest->targetSize))
+				largest = texture;
+		}
+
+		if (!largest)
+			break;
+
+		total -= GetDDSTextureMemorySize(largest->info, largest->targetSize);
+		largest->targetSize >>= 1;
+		total += GetDDSTextureMemorySize(largest->info, largest->targetSize);
+	}
+}
+
+void TextureStreamer::Worker()
+{
+	for (;;)
+	{
+		unique_lock<mutex> lock(streamMutex);
+		while (!shuttingDown && requests.empty())
+			requestAvailable.wait(lock);
+
+		if (shuttingDown)
+			return;
+
+		StreamRequest request = requests.front();
+		requests.pop_front();
+		StreamedTexture* texture = textures[request.handle];
+		lock.unlock();
+
+		// Resource creation is free-threaded, so the upload happens here rather than on the
+		// render thread
+		ID3D11ShaderResourceView* view = nullptr;
+		HRESULT result = CreateDDSTextureFromMemory(device, texture->ddsData.get(), texture->ddsDataSize, nullptr, &view, request.size);
+
+		lock.lock();
+		if (SUCCEEDED(result))
+		{
+			texture->pendingView = view;
+			texture->pendingSize = request.size;
+
+			// Both versions are alive until the swap, so the peak includes the overlap
+			currentBytes += GetDDSTextureMemorySize(texture->info, request.size);
+			peakBytes = max(peakBytes, currentBytes);
+		}
+		else
+		{
+			// Stop asking for a size the device will not take
+			texture->fullSize = texture->residentSize;
+			texture->requestInFlight = false;
+		}
+	}
+}
+
+void TextureStreamer::Shutdown()
+{
+	{
+		lock_guard<mutex> lock(streamMutex);
+		shuttingDown = true;
+	}
+	requestAvailable.notify_all();
+
+	for (unsigned int i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+
+	for (unsigned int i = 0; i < textures.size(); ++i)
+	{
+		SAFE_RELEASE(textures[i]->shaderResourceView);
+		SAFE_RELEASE(textures[i]->pendingView);
+		delete textures[i];
+	}
+	textures.clear();
+	handles.clear();
+	requests.clear();
+	currentBytes = 0;
+}
+
+// Accessors
+ID3D11ShaderResourceView* TextureStreamer::GetShaderResourceView(unsigned int handle)
+{
+	lock_guard<mutex> lock(streamMutex);
+	return (handle < textures.size()) ? textures[handle]->shaderResourceView : nullptr;
+}
+
+size_t TextureStreamer::GetCurrentBytes()
+{
+	lock_guard<mutex> lock(streamMutex);
+	return currentBytes;
+}
+
+size_t TextureStreamer::GetPeakBytes()
+{
+	lock_guard<mutex> lock(streamMutex);
+	return peakBytes;
+}
+
+unsigned int TextureStreamer::GetEvictionCount()
+{
+	lock_guard<mutex> lock(streamMutex);
+	return evictionCount;
+}
+
+size_t TextureStreamer::GetBudget() const
+{
+	return budget;
+}
+
+// Mutators
+void TextureStreamer::SetBudget(size_t budgetBytes)
+{
+	lock_guard<mutex> lock(streamMutex);
+	budget = budgetBytes;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "defines.h"
+#include "DDSTextureLoader.h"
+#include "AsyncFileReader.h"
+#include <map>
+#include <string>
+#include <deque>
+#include <condition_variable>
+
+#define STREAMING_INITIAL_SIZE 32
+#define STREAMING_NUM_WORKERS 2
+#define STREAMING_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+// Uploads only the smallest levels of a texture when it is loaded so the first frame comes
+// up quickly, then recreates it with more levels on worker threads as it is seen larger on
+// screen. Finished textures are swapped in at the start of the next frame.
+//
+// Textures that drop out of view keep their levels until the budget is exceeded; then the
+// least recently sampled ones are evicted back to their smallest size first.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	~TextureStreamer();
+
+	// Files are read through the fileReader when one is given, from disk directly otherwise
+	void Initialize(ID3D11Device* device, size_t budgetBytes, AsyncFileReader* fileReader);
+
+	// Safe to call from the loader threads. Loading the same file twice returns the same handle.
+	unsigned int Load(const wchar_t* filename);
+
+	// How many pixels across the texture covers on screen; the largest request in a frame wins.
+	// This also marks the texture as sampled this frame.
+	void RequestFootprint(unsigned int handle, float screenSize);
+
+	// Once per frame on the render thread
+	void Run();
+
+	void Shutdown();
+
+	// Accessors
+	ID3D11ShaderResourceView* GetShaderResourceView(unsigned int handle);
+	// Bytes of every texture currently created, including replacements not yet swapped in
+	size_t GetCurrentBytes();
+	size_t GetPeakBytes();
+	unsigned int GetEvictionCount();
+	size_t GetBudget() const;
+
+	// Mutators
+	void SetBudget(size_t budgetBytes);
+
+private:
+
+	struct StreamedTexture
+	{
+		unique_ptr<uint8_t[]> ddsData;
+		size_t ddsDataSize;
+		DDS_TEXTURE_INFO info;
+		size_t fullSize;
+		ID3D11ShaderResourceView* shaderResourceView;
+		size_t residentSize;
+		size_t residentBytes;
+		ID3D11ShaderResourceView* pendingView;
+		size_t pendingSize;
+		bool requestInFlight;
+		float requestedSize;
+		size_t targetSize;
+		unsigned int lastUsedFrame;
+	};
+
+	struct StreamRequest
+	{
+		unsigned int handle;
+		size_t size;
+	};
+
+	ID3D11Device* device;
+	AsyncFileReader* fileReader;
+	size_t budget;
+	vector<StreamedTexture*> textures;
+	map<wstring, unsigned int> handles;
+	deque<StreamRequest> requests;
+	vector<thread> workers;
+	mutex streamMutex;
+	condition_variable requestAvailable;
+	bool shuttingDown;
+	unsigned int frame;
+	size_t currentBytes;
+	size_t peakBytes;
+	unsigned int evictionCount;
+
+	void Worker();
+	void ApplyBudget();
+};
+
@@ -0,0 +1,258 @@
+#include "TransformHierarchy.h"
+#include <xmmintrin.h>
+
+TransformHierarchy::TransformHierarchy()
+{
+	firstDirty = 0;
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+}
+
+unsigned int TransformHierarchy::Add(unsigned int parent)
+{
+	unsigned int index = (unsigned int)parents.size();
+	if (parent >= index)
+		parent = TRANSFORM_HIERARCHY_NO_PARENT;
+
+	parents.push_back(parent);
+	positionX.push_back(0.0f);
+	positionY.push_back(0.0f);
+	positionZ.push_back(0.0f);
+	rotationX.push_back(0.0f);
+	rotationY.push_back(0.0f);
+	rotationZ.push_back(0.0f);
+	rotationW.push_back(1.0f);
+	scaleX.push_back(1.0f);
+	scaleY.push_back(1.0f);
+	scaleZ.push_back(1.0f);
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	worldMatrices.push_back(identity);
+	dirty.push_back(0);
+	MarkDirty(index);
+	return index;
+}
+
+void TransformHierarchy::Reserve(unsigned int count)
+{
+	parents.reserve(count);
+	positionX.reserve(count);
+	positionY.reserve(count);
+	positionZ.reserve(count);
+	rotationX.reserve(count);
+	rotationY.reserve(count);
+	rotationZ.reserve(count);
+	rotationW.reserve(count);
+	scaleX.reserve(count);
+	scaleY.reserve(count);
+	scaleZ.reserve(count);
+	worldMatrices.reserve(count);
+	dirty.reserve(count);
+}
+
+void TransformHierarchy::Clear()
+{
+	parents.clear();
+	positionX.clear();
+	positionY.clear();
+	positionZ.clear();
+	rotationX.clear();
+	rotationY.clear();
+	rotationZ.clear();
+	rotationW.clear();
+	scaleX.clear();
+	scaleY.clear();
+	scaleZ.clear();
+	worldMatrices.clear();
+	dirty.clear();
+	updated.clear();
+	firstDirty = 0;
+}
+
+void TransformHierarchy::Update()
+{
+	updated.clear();
+	unsigned int count = (unsigned int)parents.size();
+	for (unsigned int i = firstDirty; i < count; ++i)
+	{
+		unsigned int parent = parents[i];
+		if (!dirty[i] && (parent == TRANSFORM_HIERARCHY_NO_PARENT || !dirty[parent]))
+			continue;
+		dirty[i] = 1;
+		updated.push_back(i);
+	}
+
+	for (unsigned int first = 0; first < updated.size(); first += 4)
+		ComposeLocalMatrices(first);
+
+	// A parent's world matrix is done before any of its children come up
+	for (unsigned int i = 0; i < updated.size(); ++i)
+	{
+		unsigned int index = updated[i];
+		unsigned int parent = parents[index];
+		if (parent != TRANSFORM_HIERARCHY_NO_PARENT)
+			XMStoreFloat4x4(&worldMatrices[index], XMMatrixMultiply(XMLoadFloat4x4(&worldMatrices[index]), XMLoadFloat4x4(&worldMatrices[parent])));
+		dirty[index] = 0;
+	}
+	firstDirty = count;
+}
+
+// Accessors
+unsigned int TransformHierarchy::GetCount() const
+{
+	return (unsigned int)parents.size();
+}
+
+unsigned int TransformHierarchy::GetParent(unsigned int index) const
+{
+	return parents[index];
+}
+
+XMMATRIX TransformHierarchy::GetWorldMatrix(unsigned int index) const
+{
+	return XMLoadFloat4x4(&worldMatrices[index]);
+}
+
+unsigned int TransformHierarchy::GetUpdatedCount() const
+{
+	return (unsigned int)updated.size();
+}
+
+// Mutators
+void TransformHierarchy::SetLocalTransform(unsigned int index, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale)
+{
+	if (index >= parents.size())
+		return;
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	rotationX[index] = rotation.x;
+	rotationY[index] = rotation.y;
+	rotationZ[index] = rotation.z;
+	rotationW[index] = rotation.w;
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+	MarkDirty(index);
+}
+
+void TransformHierarchy::SetLocalPosition(unsigned int index, const XMFLOAT3& position)
+{
+	if (index >= parents.size())
+		return;
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	MarkDirty(index);
+}
+
+void TransformHierarchy::SetLocalRotation(unsigned int index, const XMFLOAT4& rotation)
+{
+	if (index >= parents.size())
+		return;
+	rotationX[index] = rotation.x;
+	rotationY[index] = rotation.y;
+	rotationZ[index] = rotation.z;
+	rotationW[index] = rotation.w;
+	MarkDirty(index);
+}
+
+void TransformHierarchy::SetLocalMatrix(unsigned int index, FXMMATRIX matrix)
+{
+	XMVECTOR scale, rotation, position;
+	if (!XMMatrixDecompose(&scale, &rotation, &position, matrix))
+		return;
+	XMFLOAT3 localPosition, localScale;
+	XMFLOAT4 localRotation;
+	XMStoreFloat3(&localPosition, position);
+	XMStoreFloat4(&localRotation, rotation);
+	XMStoreFloat3(&localScale, scale);
+	SetLocalTransform(index, localPosition, localRotation, localScale);
+}
+
+// Private Member Functions
+void TransformHierarchy::MarkDirty(unsigned int index)
+{
+	dirty[index] = 1;
+	firstDirty = min(firstDirty, index);
+}
+
+void TransformHierarchy::ComposeLocalMatrices(unsigned int first)
+{
+	// Short groups repeat their last node, which is written more than once to the same place
+	unsigned int lanes = min((unsigned int)updated.size() - first, 4u);
+	unsigned int index[4];
+	for (unsigned int lane = 0; lane < 4; ++lane)
+		index[lane] = updated[first + min(lane, lanes - 1)];
+
+	__m128 x, y, z, w, sx, sy, sz, tx, ty, tz;
+	if (index[3] == index[0] + 3)
+	{
+		// Side by side, which is every group when everything moved
+		unsigned int i = index[0];
+		x = _mm_loadu_ps(&rotationX[i]);
+		y = _mm_loadu_ps(&rotationY[i]);
+		z = _mm_loadu_ps(&rotationZ[i]);
+		w = _mm_loadu_ps(&rotationW[i]);
+		sx = _mm_loadu_ps(&scaleX[i]);
+		sy = _mm_loadu_ps(&scaleY[i]);
+		sz = _mm_loadu_ps(&scaleZ[i]);
+		tx = _mm_loadu_ps(&positionX[i]);
+		ty = _mm_loadu_ps(&positionY[i]);
+		tz = _mm_loadu_ps(&positionZ[i]);
+	}
+	else
+	{
+		x = _mm_setr_ps(rotationX[index[0]], rotationX[index[1]], rotationX[index[2]], rotationX[index[3]]);
+		y = _mm_setr_ps(rotationY[index[0]], rotationY[index[1]], rotationY[index[2]], rotationY[index[3]]);
+		z = _mm_setr_ps(rotationZ[index[0]], rotationZ[index[1]], rotationZ[index[2]], rotationZ[index[3]]);
+		w = _mm_setr_ps(rotationW[index[0]], rotationW[index[1]], rotationW[index[2]], rotationW[index[3]]);
+		sx = _mm_setr_ps(scaleX[index[0]], scaleX[index[1]], scaleX[index[2]], scaleX[index[3]]);
+		sy = _mm_setr_ps(scaleY[index[0]], scaleY[index[1]], scaleY[index[2]], scaleY[index[3]]);
+		sz = _mm_setr_ps(scaleZ[index[0]], scaleZ[index[1]], scaleZ[index[2]], scaleZ[index[3]]);
+		tx = _mm_setr_ps(positionX[index[0]], positionX[index[1]], positionX[index[2]], positionX[index[3]]);
+		ty = _mm_setr_ps(positionY[index[0]], positionY[index[1]], positionY[index[2]], positionY[index[3]]);
+		tz = _mm_setr_ps(positionZ[index[0]], positionZ[index[1]], positionZ[index[2]], positionZ[index[3]]);
+	}
+
+	// Scale, then the rotation of the quaternion, then the position, as XMMatrixAffineTransformation
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	__m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+	__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+	__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+	__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+	__m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+	__m128 m01 = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+	__m128 m02 = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+	__m128 m10 = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+	__m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+	__m128 m12 = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+	__m128 m20 = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+	__m128 m21 = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+	__m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+	__m128 zero0 = _mm_setzero_ps(), zero1 = _mm_setzero_ps(), zero2 = _mm_setzero_ps();
+	__m128 one3 = one;
+
+	// Each register holds one element of four matrices; turned around, one row of each
+	_MM_TRANSPOSE4_PS(m00, m01, m02, zero0);
+	_MM_TRANSPOSE4_PS(m10, m11, m12, zero1);
+	_MM_TRANSPOSE4_PS(m20, m21, m22, zero2);
+	_MM_TRANSPOSE4_PS(tx, ty, tz, one3);
+	__m128 rows[4][4] =
+	{
+		{ m00, m10, m20, tx },
+		{ m01, m11, m21, ty },
+		{ m02, m12, m22, tz },
+		{ zero0, zero1, zero2, one3 },
+	};
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		XMFLOAT4X4& matrix = worldMatrices[index[lane]];
+		for (unsigned int row = 0; row < 4; ++row)
+			_mm_storeu_ps(matrix.m[row], rows[lane][row]);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "defines.h"
+
+#define TRANSFORM_HIERARCHY_NO_PARENT 0xFFFFFFFF
+
+// The local and world transforms of a tree of nodes. Local transforms are kept one array
+// per component: position, rotation quaternion and scale. World matrices are kept in one
+// array beside them. Nodes are added after their parents, so every parent comes before its
+// children and one pass in order puts a parent's world matrix in place before any child
+// reads it.
+//
+// Changing a node's local transform only marks it. Update works out the world matrices of
+// the marked nodes and everything below them. The nodes it skips cost one flag test each.
+// Their local matrices are composed four at a time in SSE registers, straight from the
+// component arrays, and each is then multiplied by its parent's world matrix.
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+	~TransformHierarchy();
+
+	// Adds a node at the origin, unrotated and unscaled, under a node already added or under
+	// nothing with TRANSFORM_HIERARCHY_NO_PARENT, and returns its index
+	unsigned int Add(unsigned int parent);
+	void Reserve(unsigned int count);
+	void Clear();
+
+	// Brings the world matrices of the nodes changed since the last Update, and of their
+	// children, up to date
+	void Update();
+
+	// Accessors
+	unsigned int GetCount() const;
+	unsigned int GetParent(unsigned int index) const;
+	// As of the last Update
+	XMMATRIX GetWorldMatrix(unsigned int index) const;
+	// Nodes the last Update worked out
+	unsigned int GetUpdatedCount() const;
+
+	// Mutators
+	void SetLocalTransform(unsigned int index, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale);
+	void SetLocalPosition(unsigned int index, const XMFLOAT3& position);
+	void SetLocalRotation(unsigned int index, const XMFLOAT4& rotation);
+	// Split into position, rotation and scale; shear is lost
+	void SetLocalMatrix(unsigned int index, FXMMATRIX matrix);
+
+private:
+
+	vector<unsigned int> parents;
+	vector<float> positionX;
+	vector<float> positionY;
+	vector<float> positionZ;
+	vector<float> rotationX;
+	vector<float> rotationY;
+	vector<float> rotationZ;
+	vector<float> rotationW;
+	vector<float> scaleX;
+	vector<float> scaleY;
+	vector<float> scaleZ;
+	vector<XMFLOAT4X4> worldMatrices;
+	// Set for a changed node, and by Update for everything below it until it is done
+	vector<uint8_t> dirty;
+	unsigned int firstDirty; // Nothing before this node is marked
+	vector<unsigned int> updated; // In order, so parents come first
+
+	void MarkDirty(unsigned int index);
+	// Writes the local matrices of the updated nodes from first on, up to four, into their
+	// world matrices
+	void ComposeLocalMatrices(unsigned int first);
+};
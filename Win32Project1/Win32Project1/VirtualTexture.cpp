@@ -0,0 +1,682 @@
+#include "VirtualTexture.h"
+#include "VirtualTextureFeedbackPixelShader.csh"
+#include <algorithm>
+#include <functional>
+
+#define SAFE_RELEASE(p) { if(p) {p->Release(); p = nullptr;}}
+
+#define VT_MAX_TILES_WIDE 4096 // Twelve bits of a feedback entry each way
+
+// How the tiles are cut: by texel, or by 4x4 block for the compressed formats
+static bool GetElementLayout(DXGI_FORMAT format, unsigned int* blockSize, unsigned int* elementBytes)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		*blockSize = 1;
+		*elementBytes = 4;
+		return true;
+
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		*blockSize = 4;
+		*elementBytes = 8;
+		return true;
+
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		*blockSize = 4;
+		*elementBytes = 16;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static bool IsPowerOfTwo(size_t value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+static unsigned int Wrap(int value, unsigned int size)
+{
+	int wrapped = value % (int)size;
+	return (unsigned int)(wrapped < 0 ? wrapped + (int)size : wrapped);
+}
+
+VirtualTexture::VirtualTexture()
+{
+	blockSize = 1;
+	elementBytes = 4;
+	levelCount = 0;
+	cacheTilesWide = 0;
+	pageTableDirty = false;
+	frame = 0;
+	residentCount = 0;
+	requestCount = 0;
+	uploadCount = 0;
+	evictionCount = 0;
+	loaded = false;
+
+	cacheTexture = nullptr;
+	cacheView = nullptr;
+	cacheSampler = nullptr;
+	pageTableBuffer = nullptr;
+	pageTableView = nullptr;
+	constantBuffer = nullptr;
+	feedbackConstantBuffer = nullptr;
+	feedbackTexture = nullptr;
+	feedbackView = nullptr;
+	for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; ++i)
+	{
+		feedbackStaging[i] = nullptr;
+		feedbackPending[i] = false;
+	}
+	feedbackWriteIndex = 0;
+	feedbackReadIndex = 0;
+	feedbackScaleX = 0;
+	feedbackScaleY = 0;
+	feedbackShader = nullptr;
+}
+
+
+VirtualTexture::~VirtualTexture()
+{
+	Release();
+}
+
+bool VirtualTexture::Initialize(ID3D11Device* device, const wchar_t* filename, AsyncFileReader* fileReader)
+{
+	unique_ptr<uint8_t[]> data;
+	size_t dataSize = 0;
+	DDS_TEXTURE_INFO textureInfo;
+	HRESULT result = E_FAIL;
+	if (!fileReader)
+		result = LoadDDSTextureDataFromFile(filename, data, &dataSize, &textureInfo);
+	else if (fileReader->Load(filename, data, &dataSize))
+		result = LoadDDSTextureDataFromMemory(data, &dataSize, &textureInfo);
+	if (FAILED(result) || !Prepare(data, dataSize, textureInfo, VT_CACHE_TILES_WIDE))
+		return false;
+
+	if (!CreateResources(device))
+	{
+		Release();
+		return false;
+	}
+
+	loaded = true;
+	return true;
+}
+
+bool VirtualTexture::Prepare(unique_ptr<uint8_t[]>& data, size_t dataSize, const DDS_TEXTURE_INFO& textureInfo, unsigned int tilesWide)
+{
+	loaded = false;
+	if (textureInfo.dimension != D3D11_RESOURCE_DIMENSION_TEXTURE2D || textureInfo.arraySize != 1 || textureInfo.isCubeMap)
+		return false;
+	if (!IsPowerOfTwo(textureInfo.width) || !IsPowerOfTwo(textureInfo.height) || textureInfo.width > VT_MAX_TILES_WIDE * VT_TILE_SIZE || textureInfo.height > VT_MAX_TILES_WIDE * VT_TILE_SIZE)
+		return false;
+	if (!GetElementLayout(textureInfo.format, &blockSize, &elementBytes) || tilesWide == 0 || tilesWide > 256)
+		return false;
+
+	vector<D3D11_SUBRESOURCE_DATA> surfaces(textureInfo.mipCount);
+	if (FAILED(GetDDSSubresourceData(data.get(), dataSize, textureInfo, &surfaces[0])))
+		return false;
+
+	// Levels are cut down to the first one that fits in a single tile; the ones below it are
+	// never sampled, as the cache holds no mips
+	unsigned int pageCount = 0;
+	unsigned int width = (unsigned int)textureInfo.width;
+	unsigned int height = (unsigned int)textureInfo.height;
+	levelCount = 0;
+	for (;;)
+	{
+		if (levelCount == VT_MAX_LEVELS || levelCount == textureInfo.mipCount)
+			return false;
+
+		Level& level = levels[levelCount];
+		level.width = width;
+		level.height = height;
+		level.tilesWide = (width + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+		level.tilesHigh = (height + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+		level.firstPage = pageCount;
+		level.texels = (const uint8_t*)surfaces[levelCount].pSysMem;
+		level.rowPitch = surfaces[levelCount].SysMemPitch;
+		pageCount += level.tilesWide * level.tilesHigh;
+		++levelCount;
+
+		if (level.tilesWide == 1 && level.tilesHigh == 1)
+			break;
+		width = max(width / 2, 1u);
+		height = max(height / 2, 1u);
+	}
+
+	// The level pointers stay good; only the owner of the buffer changes
+	ddsData.swap(data);
+	info = textureInfo;
+	cacheTilesWide = tilesWide;
+
+	CacheSlot empty = { -1, 0, false, false };
+	slots.assign(cacheTilesWide * cacheTilesWide, empty);
+	pageSlots.assign(pageCount, -1);
+	pageTable.assign(pageCount, 0);
+	pageRequestFrames.assign(pageCount, 0);
+	requests.clear();
+	uploads.clear();
+	frame = 0;
+	residentCount = 0;
+	requestCount = 0;
+	uploadCount = 0;
+	evictionCount = 0;
+
+	// Everything falls back to the coarsest tile, so it never leaves
+	MakeResident(PageIndex(levelCount - 1, 0, 0), 0);
+	slots[0].pinned = true;
+	return true;
+}
+
+void VirtualTexture::Run(ID3D11DeviceContext* deviceContext)
+{
+	if (!loaded)
+		return;
+
+	// Only the oldest copy is looked at, and only if the GPU is already done with it
+	if (feedbackPending[feedbackReadIndex])
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (SUCCEEDED(deviceContext->Map(feedbackStaging[feedbackReadIndex], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+		{
+			ProcessFeedback((const uint32_t*)mapped.pData, VT_FEEDBACK_WIDTH, VT_FEEDBACK_HEIGHT, mapped.RowPitch);
+			deviceContext->Unmap(feedbackStaging[feedbackReadIndex], 0);
+			feedbackPending[feedbackReadIndex] = false;
+			feedbackReadIndex = (feedbackReadIndex + 1) % VT_FEEDBACK_FRAMES;
+		}
+	}
+
+	Service(VT_UPLOADS_PER_FRAME);
+
+	size_t rowPitch = GetTileRowPitch();
+	for (unsigned int i = 0; i < uploads.size(); ++i)
+	{
+		CacheSlot& slot = slots[uploads[i]];
+		slot.uploadPending = false;
+		if (slot.page < 0)
+			continue;
+
+		unsigned int level, x, y;
+		PageLocation(slot.page, &level, &x, &y);
+		CookTile(level, x, y, &cookedTile[0], rowPitch);
+
+		D3D11_BOX box;
+		box.left = (uploads[i] % cacheTilesWide) * VT_PADDED_TILE_SIZE;
+		box.top = (uploads[i] / cacheTilesWide) * VT_PADDED_TILE_SIZE;
+		box.right = box.left + VT_PADDED_TILE_SIZE;
+		box.bottom = box.top + VT_PADDED_TILE_SIZE;
+		box.front = 0;
+		box.back = 1;
+		deviceContext->UpdateSubresource(cacheTexture, 0, &box, &cookedTile[0], (UINT)rowPitch, 0);
+		++uploadCount;
+	}
+	uploads.clear();
+
+	if (pageTableDirty)
+	{
+		deviceContext->UpdateSubresource(pageTableBuffer, 0, nullptr, &pageTable[0], 0, 0);
+		pageTableDirty = false;
+	}
+}
+
+void VirtualTexture::ProcessFeedback(const uint32_t* feedback, unsigned int width, unsigned int height, unsigned int rowPitch)
+{
+	++frame;
+	requests.clear();
+
+	uint32_t previous = 0;
+	for (unsigned int row = 0; row < height; ++row)
+	{
+		const uint32_t* entries = (const uint32_t*)((const uint8_t*)feedback + row * rowPitch);
+		for (unsigned int column = 0; column < width; ++column)
+		{
+			// Neighbouring pixels mostly want the same tile
+			uint32_t entry = entries[column];
+			if (!(entry & VT_FEEDBACK_VALID) || entry == previous)
+				continue;
+			previous = entry;
+
+			unsigned int level = (entry >> 24) & 0x7F;
+			unsigned int x = entry & 0xFFF;
+			unsigned int y = (entry >> 12) & 0xFFF;
+			if (level >= levelCount || x >= levels[level].tilesWide || y >= levels[level].tilesHigh)
+				continue;
+
+			// Up the chain until a tile that is resident, or that another pixel already went through
+			for (; level < levelCount; ++level, x >>= 1, y >>= 1)
+			{
+				unsigned int page = PageIndex(level, x, y);
+				if (pageRequestFrames[page] == frame)
+					break;
+				pageRequestFrames[page] = frame;
+
+				if (pageSlots[page] >= 0)
+				{
+					slots[pageSlots[page]].lastUsedFrame = frame;
+					break;
+				}
+				requests.push_back(page);
+			}
+		}
+	}
+
+	requestCount = (unsigned int)requests.size();
+}
+
+unsigned int VirtualTexture::Service(unsigned int maxTiles)
+{
+	// Pages are numbered from the top level down, so the highest numbers are the coarsest
+	// tiles. Those come first: a region that just came into view gets a blurry tile at once
+	// and sharpens over the next frames.
+	sort(requests.begin(), requests.end(), greater<unsigned int>());
+
+	unsigned int made = 0;
+	for (unsigned int i = 0; i < requests.size() && made < maxTiles; ++i)
+	{
+		if (pageSlots[requests[i]] >= 0)
+			continue;
+
+		int slot = FindSlot();
+		if (slot < 0)
+			break;
+
+		MakeResident(requests[i], slot);
+		++made;
+	}
+	requests.clear();
+
+	return made;
+}
+
+void VirtualTexture::CookTile(unsigned int level, unsigned int x, unsigned int y, uint8_t* destination, size_t rowPitch) const
+{
+	const Level& source = levels[level];
+	unsigned int columns = (source.width + blockSize - 1) / blockSize;
+	unsigned int rows = (source.height + blockSize - 1) / blockSize;
+	unsigned int tileElements = VT_TILE_SIZE / blockSize;
+	unsigned int paddedElements = VT_PADDED_TILE_SIZE / blockSize;
+	int border = VT_TILE_BORDER / blockSize;
+	int originX = (int)(x * tileElements) - border;
+	int originY = (int)(y * tileElements) - border;
+
+	for (unsigned int row = 0; row < paddedElements; ++row)
+	{
+		const uint8_t* sourceRow = source.texels + Wrap(originY + (int)row, rows) * source.rowPitch;
+		uint8_t* destinationRow = destination + row * rowPitch;
+
+		// Runs of the source row, broken wherever the tile wraps past the edge of the level
+		unsigned int column = 0;
+		while (column < paddedElements)
+		{
+			unsigned int sourceColumn = Wrap(originX + (int)column, columns);
+			unsigned int run = min(paddedElements - column, columns - sourceColumn);
+			memcpy(destinationRow + column * elementBytes, sourceRow + sourceColumn * elementBytes, run * elementBytes);
+			column += run;
+		}
+	}
+}
+
+void VirtualTexture::Bind(RenderContext* renderContext)
+{
+	if (!loaded)
+		return;
+
+	ID3D11ShaderResourceView* views[2] = { cacheView, pageTableView };
+	renderContext->SetConstantBuffers(RENDER_STAGE_PIXEL, 2, 1, &constantBuffer);
+	renderContext->SetShaderResources(RENDER_STAGE_PIXEL, 0, 2, views);
+	renderContext->SetSamplers(RENDER_STAGE_PIXEL, 0, 1, &cacheSampler);
+}
+
+void VirtualTexture::BeginFeedback(ID3D11DeviceContext* deviceContext, const D3D11_VIEWPORT& viewport)
+{
+	if (!loaded)
+		return;
+
+	// The feedback target is smaller than the screen, so the derivatives there are scaled
+	// back down to pick the level a pixel on screen will sample
+	float scaleX = VT_FEEDBACK_WIDTH / viewport.Width;
+	float scaleY = VT_FEEDBACK_HEIGHT / viewport.Height;
+	if (scaleX != feedbackScaleX || scaleY != feedbackScaleY)
+	{
+		VIRTUAL_TEXTURE_CONSTANTS feedbackConstants = constants;
+		feedbackConstants.cacheSize.z = scaleX;
+		feedbackConstants.cacheSize.w = scaleY;
+		deviceContext->UpdateSubresource(feedbackConstantBuffer, 0, nullptr, &feedbackConstants, 0, 0);
+		feedbackScaleX = scaleX;
+		feedbackScaleY = scaleY;
+	}
+
+	D3D11_VIEWPORT feedbackViewport = {};
+	feedbackViewport.Width = VT_FEEDBACK_WIDTH;
+	feedbackViewport.Height = VT_FEEDBACK_HEIGHT;
+	feedbackViewport.MaxDepth = 1;
+
+	float clear[4] = { 0, 0, 0, 0 };
+	deviceContext->OMSetRenderTargets(1, &feedbackView, nullptr);
+	deviceContext->RSSetViewports(1, &feedbackViewport);
+	deviceContext->ClearRenderTargetView(feedbackView, clear);
+	deviceContext->PSSetShader(feedbackShader, NULL, 0);
+	deviceContext->PSSetConstantBuffers(2, 1, &feedbackConstantBuffer);
+}
+
+void VirtualTexture::EndFeedback(ID3D11DeviceContext* deviceContext)
+{
+	// With every copy still waiting to be read the GPU is too far behind; this frame's is dropped
+	if (!loaded || feedbackPending[feedbackWriteIndex])
+		return;
+
+	deviceContext->CopyResource(feedbackStaging[feedbackWriteIndex], feedbackTexture);
+	feedbackPending[feedbackWriteIndex] = true;
+	feedbackWriteIndex = (feedbackWriteIndex + 1) % VT_FEEDBACK_FRAMES;
+}
+
+void VirtualTexture::Release()
+{
+	SAFE_RELEASE(cacheTexture);
+	SAFE_RELEASE(cacheView);
+	SAFE_RELEASE(cacheSampler);
+	SAFE_RELEASE(pageTableBuffer);
+	SAFE_RELEASE(pageTableView);
+	SAFE_RELEASE(constantBuffer);
+	SAFE_RELEASE(feedbackConstantBuffer);
+	SAFE_RELEASE(feedbackTexture);
+	SAFE_RELEASE(feedbackView);
+	for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; ++i)
+	{
+		SAFE_RELEASE(feedbackStaging[i]);
+		feedbackPending[i] = false;
+	}
+	SAFE_RELEASE(feedbackShader);
+	loaded = false;
+}
+
+// Accessors
+bool VirtualTexture::IsLoaded() const
+{
+	return loaded;
+}
+
+unsigned int VirtualTexture::GetWidth() const
+{
+	return levelCount ? levels[0].width : 0;
+}
+
+unsigned int VirtualTexture::GetHeight() const
+{
+	return levelCount ? levels[0].height : 0;
+}
+
+unsigned int VirtualTexture::GetLevelCount() const
+{
+	return levelCount;
+}
+
+unsigned int VirtualTexture::GetTilesWide(unsigned int level) const
+{
+	return levels[level].tilesWide;
+}
+
+unsigned int VirtualTexture::GetTilesHigh(unsigned int level) const
+{
+	return levels[level].tilesHigh;
+}
+
+void VirtualTexture::GetPageTableEntry(unsigned int level, unsigned int x, unsigned int y, unsigned int* slotX, unsigned int* slotY, unsigned int* residentLevel) const
+{
+	uint32_t entry = pageTable[PageIndex(level, x, y)];
+	*slotX = entry & 0xFF;
+	*slotY = (entry >> 8) & 0xFF;
+	*residentLevel = (entry >> 16) & 0xFF;
+}
+
+bool VirtualTexture::IsResident(unsigned int level, unsigned int x, unsigned int y) const
+{
+	return pageSlots[PageIndex(level, x, y)] >= 0;
+}
+
+unsigned int VirtualTexture::GetResidentCount() const
+{
+	return residentCount;
+}
+
+unsigned int VirtualTexture::GetRequestCount() const
+{
+	return requestCount;
+}
+
+unsigned int VirtualTexture::GetUploadCount() const
+{
+	return uploadCount;
+}
+
+unsigned int VirtualTexture::GetEvictionCount() const
+{
+	return evictionCount;
+}
+
+size_t VirtualTexture::GetTileRowPitch() const
+{
+	return (VT_PADDED_TILE_SIZE / blockSize) * elementBytes;
+}
+
+// Private Member Functions
+unsigned int VirtualTexture::PageIndex(unsigned int level, unsigned int x, unsigned int y) const
+{
+	return levels[level].firstPage + y * levels[level].tilesWide + x;
+}
+
+void VirtualTexture::PageLocation(unsigned int page, unsigned int* level, unsigned int* x, unsigned int* y) const
+{
+	unsigned int found = levelCount - 1;
+	while (found > 0 && page < levels[found].firstPage)
+		--found;
+
+	unsigned int offset = page - levels[found].firstPage;
+	*level = found;
+	*x = offset % levels[found].tilesWide;
+	*y = offset / levels[found].tilesWide;
+}
+
+// An empty slot if there is one, otherwise the least recently seen tile that was not seen
+// this frame. -1 if every tile in the cache is still on screen.
+int VirtualTexture::FindSlot()
+{
+	int victim = -1;
+	for (unsigned int i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].pinned)
+			continue;
+		if (slots[i].page < 0)
+			return i;
+		if (slots[i].lastUsedFrame < frame && (victim < 0 || slots[i].lastUsedFrame < slots[victim].lastUsedFrame))
+			victim = i;
+	}
+	return victim;
+}
+
+void VirtualTexture::MakeResident(unsigned int page, unsigned int slot)
+{
+	CacheSlot& cacheSlot = slots[slot];
+	if (cacheSlot.page >= 0)
+	{
+		unsigned int evicted = cacheSlot.page;
+		pageSlots[evicted] = -1;
+		cacheSlot.page = -1;
+		--residentCount;
+		++evictionCount;
+		UpdatePageTable(evicted);
+	}
+
+	cacheSlot.page = page;
+	cacheSlot.lastUsedFrame = frame;
+	pageSlots[page] = slot;
+	++residentCount;
+	UpdatePageTable(page);
+
+	if (!cacheSlot.uploadPending)
+	{
+		cacheSlot.uploadPending = true;
+		uploads.push_back(slot);
+	}
+}
+
+// Rewrites the entries of the page and every finer tile under it, each pointing at the
+// nearest resident tile at or above it
+void VirtualTexture::UpdatePageTable(unsigned int page)
+{
+	unsigned int pageLevel, pageX, pageY;
+	PageLocation(page, &pageLevel, &pageX, &pageY);
+
+	for (int level = (int)pageLevel; level >= 0; --level)
+	{
+		unsigned int shift = pageLevel - level;
+		unsigned int right = min((pageX + 1) << shift, levels[level].tilesWide);
+		unsigned int bottom = min((pageY + 1) << shift, levels[level].tilesHigh);
+		for (unsigned int y = pageY << shift; y < bottom; ++y)
+		{
+			for (unsigned int x = pageX << shift; x < right; ++x)
+			{
+				unsigned int residentLevel = level;
+				unsigned int residentX = x;
+				unsigned int residentY = y;
+				int slot = pageSlots[PageIndex(residentLevel, residentX, residentY)];
+				while (slot < 0 && residentLevel + 1 < levelCount)
+				{
+					++residentLevel;
+					residentX >>= 1;
+					residentY >>= 1;
+					slot = pageSlots[PageIndex(residentLevel, residentX, residentY)];
+				}
+
+				uint32_t entry = 0;
+				if (slot >= 0)
+					entry = (slot % cacheTilesWide) | ((slot / cacheTilesWide) << 8) | (residentLevel << 16);
+				pageTable[PageIndex(level, x, y)] = entry;
+			}
+		}
+	}
+
+	pageTableDirty = true;
+}
+
+bool VirtualTexture::CreateResources(ID3D11Device* device)
+{
+	unsigned int cacheSize = cacheTilesWide * VT_PADDED_TILE_SIZE;
+
+	// The cache starts out undefined; a slot is only ever sampled after Run has uploaded it
+	D3D11_TEXTURE2D_DESC cacheDesc = {};
+	cacheDesc.Width = cacheSize;
+	cacheDesc.Height = cacheSize;
+	cacheDesc.MipLevels = 1;
+	cacheDesc.ArraySize = 1;
+	cacheDesc.Format = info.format;
+	cacheDesc.SampleDesc.Count = 1;
+	cacheDesc.Usage = D3D11_USAGE_DEFAULT;
+	cacheDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	if (FAILED(device->CreateTexture2D(&cacheDesc, nullptr, &cacheTexture)) ||
+		FAILED(device->CreateShaderResourceView(cacheTexture, nullptr, &cacheView)))
+		return false;
+
+	// The borders are there for bilinear filtering; mips are picked by the page table
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	if (FAILED(device->CreateSamplerState(&samplerDesc, &cacheSampler)))
+		return false;
+
+	D3D11_BUFFER_DESC pageTableDesc = {};
+	pageTableDesc.ByteWidth = (UINT)(pageTable.size() * sizeof(uint32_t));
+	pageTableDesc.Usage = D3D11_USAGE_DEFAULT;
+	pageTableDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA pageTableData = {};
+	pageTableData.pSysMem = &pageTable[0];
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC pageTableViewDesc = {};
+	pageTableViewDesc.Format = DXGI_FORMAT_R32_UINT;
+	pageTableViewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	pageTableViewDesc.Buffer.FirstElement = 0;
+	pageTableViewDesc.Buffer.NumElements = (UINT)pageTable.size();
+	if (FAILED(device->CreateBuffer(&pageTableDesc, &pageTableData, &pageTableBuffer)) ||
+		FAILED(device->CreateShaderResourceView(pageTableBuffer, &pageTableViewDesc, &pageTableView)))
+		return false;
+	pageTableDirty = false;
+
+	constants.virtualSize = XMFLOAT4((float)levels[0].width, (float)levels[0].height, (float)(levelCount - 1), 0);
+	constants.cacheSize = XMFLOAT4((float)cacheSize, (float)cacheSize, 1, 1);
+	for (unsigned int i = 0; i < VT_MAX_LEVELS; ++i)
+	{
+		if (i < levelCount)
+			constants.levels[i] = XMUINT4(levels[i].tilesWide, levels[i].tilesHigh, levels[i].firstPage, 0);
+		else
+			constants.levels[i] = XMUINT4(1, 1, 0, 0);
+	}
+
+	D3D11_BUFFER_DESC constantDesc = {};
+	constantDesc.ByteWidth = sizeof(VIRTUAL_TEXTURE_CONSTANTS);
+	constantDesc.Usage = D3D11_USAGE_DEFAULT;
+	constantDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA constantData = {};
+	constantData.pSysMem = &constants;
+	if (FAILED(device->CreateBuffer(&constantDesc, &constantData, &constantBuffer)) ||
+		FAILED(device->CreateBuffer(&constantDesc, &constantData, &feedbackConstantBuffer)))
+		return false;
+	feedbackScaleX = 1;
+	feedbackScaleY = 1;
+
+	D3D11_TEXTURE2D_DESC feedbackDesc = {};
+	feedbackDesc.Width = VT_FEEDBACK_WIDTH;
+	feedbackDesc.Height = VT_FEEDBACK_HEIGHT;
+	feedbackDesc.MipLevels = 1;
+	feedbackDesc.ArraySize = 1;
+	feedbackDesc.Format = DXGI_FORMAT_R32_UINT;
+	feedbackDesc.SampleDesc.Count = 1;
+	feedbackDesc.Usage = D3D11_USAGE_DEFAULT;
+	feedbackDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	if (FAILED(device->CreateTexture2D(&feedbackDesc, nullptr, &feedbackTexture)) ||
+		FAILED(device->CreateRenderTargetView(feedbackTexture, nullptr, &feedbackView)))
+		return false;
+
+	feedbackDesc.Usage = D3D11_USAGE_STAGING;
+	feedbackDesc.BindFlags = 0;
+	feedbackDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; ++i)
+	{
+		if (FAILED(device->CreateTexture2D(&feedbackDesc, nullptr, &feedbackStaging[i])))
+			return false;
+	}
+	feedbackWriteIndex = 0;
+	feedbackReadIndex = 0;
+
+	if (FAILED(device->CreatePixelShader(VirtualTextureFeedbackPixelShader, sizeof(VirtualTextureFeedbackPixelShader), NULL, &feedbackShader)))
+		return false;
+
+	cookedTile.resize(GetTileRowPitch() * (VT_PADDED_TILE_SIZE / blockSize));
+	return true;
+}
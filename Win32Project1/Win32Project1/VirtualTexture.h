@@ -0,0 +1,172 @@
+#pragma once
+#include "defines.h"
+#include "RenderContext.h"
+#include "DDSTextureLoader.h"
+#include "AsyncFileReader.h"
+
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4 // Texels copied in from the neighbouring tiles on every side, so filtering never reads past a tile
+#define VT_PADDED_TILE_SIZE (VT_TILE_SIZE + 2 * VT_TILE_BORDER)
+#define VT_CACHE_TILES_WIDE 8 // The physical cache is 8x8 tiles, 1088 texels across
+#define VT_MAX_LEVELS 16
+#define VT_UPLOADS_PER_FRAME 8
+#define VT_FEEDBACK_WIDTH 160
+#define VT_FEEDBACK_HEIGHT 120
+#define VT_FEEDBACK_FRAMES 3 // Staging copies in flight, so reading one back never waits on the GPU
+
+// What the feedback pass writes per pixel: the tile it wanted at the level it wanted. Zero,
+// the clear value, means the pixel did not see the texture.
+#define VT_FEEDBACK_VALID 0x80000000
+#define VT_PACK_FEEDBACK(level, x, y) (VT_FEEDBACK_VALID | ((level) << 24) | ((y) << 12) | (x))
+
+// What the pixel shader reads from b2
+struct VIRTUAL_TEXTURE_CONSTANTS
+{
+	XMFLOAT4 virtualSize; // Width and height of the top level in texels, coarsest level, unused
+	XMFLOAT4 cacheSize; // Width and height of the tile cache in texels, then the size of a pixel drawn over one on screen, across and down
+	XMUINT4 levels[VT_MAX_LEVELS]; // Tiles across, tiles down, first page table entry, unused
+};
+
+// A software virtual texture for large textures like the floor. Every level is cut into
+// VT_TILE_SIZE tiles and only the tiles that were seen are kept on the GPU, in a fixed cache
+// of padded tiles. A page table with one entry per tile of every level says where each tile
+// sits in the cache; a tile that is not there points at the nearest coarser one that is, so
+// the coarsest tile is loaded up front and never evicted.
+//
+// Which tiles were seen comes from a feedback pass: the textured geometry is drawn again into
+// a small target that records the tile and level every pixel wanted. It is copied back a few
+// frames later without waiting, the missing tiles are cooked from the texture held in memory,
+// coarsest first and a few per frame, and when the cache is full the least recently seen
+// tile makes room.
+//
+// Levels have to be powers of two so a tile's parent is always the tile at half its
+// coordinates. Uncompressed 32 bit and block compressed formats work; a block compressed
+// tile is cut along block boundaries, which the tile size and border are multiples of.
+//
+// Prepare, ProcessFeedback, Service and CookTile only touch memory, so the paging can be
+// driven without a device.
+class VirtualTexture
+{
+public:
+	VirtualTexture();
+	~VirtualTexture();
+
+	// Safe to call from a loader thread. The file is read through the fileReader when one is given.
+	bool Initialize(ID3D11Device* device, const wchar_t* filename, AsyncFileReader* fileReader);
+
+	// Takes over prepared DDS data (from LoadDDSTextureDataFromMemory) and sets up the page
+	// table for a cache of cacheTilesWide * cacheTilesWide tiles, with only the coarsest tile
+	// resident. False if the texture cannot be paged.
+	bool Prepare(unique_ptr<uint8_t[]>& ddsData, size_t ddsDataSize, const DDS_TEXTURE_INFO& info, unsigned int cacheTilesWide);
+
+	// Once per frame on the render thread, before drawing: reads back the oldest feedback that
+	// is ready, streams in the tiles it asked for and uploads the changes
+	void Run(ID3D11DeviceContext* deviceContext);
+
+	// Takes one frame of feedback. Every tile that was seen, and every coarser tile above it
+	// down to one that is resident, is marked as used this frame; the ones that are missing
+	// are requested.
+	void ProcessFeedback(const uint32_t* feedback, unsigned int width, unsigned int height, unsigned int rowPitch);
+
+	// Makes up to maxTiles of the requested tiles resident, coarsest first, and returns how
+	// many. Stops early rather than evict a tile that was seen this frame.
+	unsigned int Service(unsigned int maxTiles);
+
+	// Copies a tile with its border into destination, VT_PADDED_TILE_SIZE texels square.
+	// Borders wrap around the edges of the level.
+	void CookTile(unsigned int level, unsigned int x, unsigned int y, uint8_t* destination, size_t rowPitch) const;
+
+	// Binds the constants to b2, the tile cache to t0, the page table to t1 and the cache sampler to s0
+	void Bind(RenderContext* renderContext);
+
+	// Sets the feedback target, its viewport and pixel shader. The caller draws the geometry
+	// with the same constants as the main pass and restores its own target afterwards.
+	void BeginFeedback(ID3D11DeviceContext* deviceContext, const D3D11_VIEWPORT& viewport);
+	void EndFeedback(ID3D11DeviceContext* deviceContext);
+
+	void Release();
+
+	// Accessors
+	bool IsLoaded() const;
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	unsigned int GetLevelCount() const;
+	unsigned int GetTilesWide(unsigned int level) const;
+	unsigned int GetTilesHigh(unsigned int level) const;
+	// Cache slot across, slot down and level of the tile the page table sends this tile to
+	void GetPageTableEntry(unsigned int level, unsigned int x, unsigned int y, unsigned int* slotX, unsigned int* slotY, unsigned int* residentLevel) const;
+	bool IsResident(unsigned int level, unsigned int x, unsigned int y) const;
+	unsigned int GetResidentCount() const;
+	unsigned int GetRequestCount() const;
+	unsigned int GetUploadCount() const;
+	unsigned int GetEvictionCount() const;
+	size_t GetTileRowPitch() const;
+
+private:
+
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+		unsigned int tilesWide;
+		unsigned int tilesHigh;
+		unsigned int firstPage;
+		const uint8_t* texels;
+		size_t rowPitch;
+	};
+
+	struct CacheSlot
+	{
+		int page;
+		unsigned int lastUsedFrame;
+		bool pinned;
+		bool uploadPending;
+	};
+
+	unique_ptr<uint8_t[]> ddsData;
+	DDS_TEXTURE_INFO info;
+	unsigned int blockSize; // Texels across a block, or 1 for uncompressed formats
+	unsigned int elementBytes; // Bytes per block or texel
+	unsigned int levelCount;
+	Level levels[VT_MAX_LEVELS];
+	unsigned int cacheTilesWide;
+	vector<CacheSlot> slots;
+	vector<int> pageSlots; // Slot holding each page, -1 if it is not resident
+	vector<uint32_t> pageTable; // What the shader reads: slot across, slot down and level of the tile to sample
+	vector<unsigned int> pageRequestFrames;
+	vector<unsigned int> requests;
+	vector<unsigned int> uploads;
+	bool pageTableDirty;
+	unsigned int frame;
+	unsigned int residentCount;
+	unsigned int requestCount;
+	unsigned int uploadCount;
+	unsigned int evictionCount;
+	bool loaded;
+
+	ID3D11Texture2D* cacheTexture;
+	ID3D11ShaderResourceView* cacheView;
+	ID3D11SamplerState* cacheSampler;
+	ID3D11Buffer* pageTableBuffer;
+	ID3D11ShaderResourceView* pageTableView;
+	ID3D11Buffer* constantBuffer;
+	ID3D11Buffer* feedbackConstantBuffer;
+	VIRTUAL_TEXTURE_CONSTANTS constants;
+	ID3D11Texture2D* feedbackTexture;
+	ID3D11RenderTargetView* feedbackView;
+	ID3D11Texture2D* feedbackStaging[VT_FEEDBACK_FRAMES];
+	bool feedbackPending[VT_FEEDBACK_FRAMES];
+	unsigned int feedbackWriteIndex;
+	unsigned int feedbackReadIndex;
+	float feedbackScaleX;
+	float feedbackScaleY;
+	ID3D11PixelShader* feedbackShader;
+	vector<uint8_t> cookedTile;
+
+	unsigned int PageIndex(unsigned int level, unsigned int x, unsigned int y) const;
+	void PageLocation(unsigned int page, unsigned int* level, unsigned int* x, unsigned int* y) const;
+	int FindSlot();
+	void MakeResident(unsigned int page, unsigned int slot);
+	void UpdatePageTable(unsigned int page);
+	bool CreateResources(ID3D11Device* device);
+};
@@ -0,0 +1,50 @@
+// Shared by the virtual texture pixel shader and its feedback pass; mirrors VirtualTexture.h
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4
+#define VT_PADDED_TILE_SIZE (VT_TILE_SIZE + 2 * VT_TILE_BORDER)
+#define VT_MAX_LEVELS 16
+#define VT_FEEDBACK_VALID 0x80000000
+
+cbuffer VIRTUAL_TEXTURE : register(b2)
+{
+	float4 virtualSize; // Width and height of the top level in texels, coarsest level, unused
+	float4 cacheSize; // Width and height of the tile cache in texels, then the size of a pixel drawn over one on screen
+	uint4 levels[VT_MAX_LEVELS]; // Tiles across, tiles down, first page table entry, unused
+}
+
+texture2D tileCache : register(t0); // Padded tiles, VT_PADDED_TILE_SIZE texels each
+Buffer<uint> pageTable : register(t1); // Slot across, slot down and level of the tile to sample, a byte each
+
+SamplerState tileFilter : register(s0);
+
+// The level the hardware would pick here if the whole chain were resident. The texture
+// wraps, so the derivatives are taken before frac.
+uint VirtualTextureLevel(float2 uvs)
+{
+	float2 dx = ddx(uvs) * virtualSize.xy * cacheSize.z;
+	float2 dy = ddy(uvs) * virtualSize.xy * cacheSize.w;
+	float lod = 0.5f * log2(max(dot(dx, dx), dot(dy, dy)));
+	return (uint)clamp(lod + 0.5f, 0, virtualSize.z);
+}
+
+uint2 VirtualTextureTile(float2 uvs, uint level)
+{
+	float2 levelSize = max(floor(virtualSize.xy / exp2(level)), 1);
+	return min((uint2)(frac(uvs) * levelSize / VT_TILE_SIZE), levels[level].xy - 1);
+}
+
+float4 SampleVirtualTexture(float2 uvs)
+{
+	uint level = VirtualTextureLevel(uvs);
+	uint2 tile = VirtualTextureTile(uvs, level);
+	uint entry = pageTable[levels[level].z + tile.y * levels[level].x + tile.x];
+
+	// The entry may be for a coarser tile than the one asked for; find the texel in that one
+	uint residentLevel = (entry >> 16) & 0xFF;
+	float2 levelSize = max(floor(virtualSize.xy / exp2(residentLevel)), 1);
+	float2 inTile = frac(uvs) * levelSize - VirtualTextureTile(uvs, residentLevel) * VT_TILE_SIZE;
+	float2 slot = float2(entry & 0xFF, (entry >> 8) & 0xFF);
+	float2 cacheTexel = slot * VT_PADDED_TILE_SIZE + VT_TILE_BORDER + inTile;
+
+	return tileCache.SampleLevel(tileFilter, cacheTexel / cacheSize.xy, 0);
+}
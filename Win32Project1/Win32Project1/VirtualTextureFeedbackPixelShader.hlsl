@@ -0,0 +1,18 @@
+#include "VirtualTexture.hlsli"
+
+struct P_IN
+{
+	float4 posH : SV_POSITION;
+	float4 uvsOut : TEXTPOS;
+	float4 nrmOut : NORMALS;
+	float4 posW : POSITION;
+};
+
+// Writes the tile and level this pixel would sample, for the CPU to stream in
+uint main(P_IN input) : SV_TARGET
+{
+	uint level = VirtualTextureLevel(input.uvsOut.xy);
+	uint2 tile = VirtualTextureTile(input.uvsOut.xy, level);
+
+	return VT_FEEDBACK_VALID | (level << 24) | (tile.y << 12) | tile.x;
+}
@@ -0,0 +1,11 @@
+#include "GeneralLighting.hlsli"
+#include "VirtualTexture.hlsli"
+
+// Same lighting as the general pixel shader, with the base color read through the virtual
+// texture's page table from whichever tile is resident
+float4 main(P_IN input) : SV_TARGET
+{
+	float4 baseColor = SampleVirtualTexture(input.uvsOut.xy);
+
+	return ApplyLighting(input, baseColor);
+}
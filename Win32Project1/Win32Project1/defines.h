@@ -41,4 +41,6 @@ struct Vertex
 
 // Function Prototypes
 XMMATRIX Movement(float time);
-vector<int> SortByDepth(float distances[], int numItems);
\ No newline at end of file
+float CameraDistance(FXMMATRIX worldMatrix, FXMVECTOR cameraPosition);
+float ProjectedSize(FXMVECTOR position, float radius, FXMVECTOR cameraPosition, float projectionScale, float viewportHeight);
+float BoundingRadius(const Vertex verticies[], unsigned int numVerticies);
\ No newline at end of file
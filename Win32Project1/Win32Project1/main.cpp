@@ -15,6 +15,22 @@
 #include "PointToQuad.h"
 #include "Trivial_PS.csh"
 #include "NormalMappedLoadedModel3D.h"
+#include "TextureStreamer.h"
+#include "TexturePacker.h"
+#include "EnvironmentLighting.h"
+#include "AsyncFileReader.h"
+#include "VirtualTexture.h"
+#include "D3D11RenderContext.h"
+#include "ConstantBufferRing.h"
+#include "DrawQueue.h"
+#include "FilteringRenderContext.h"
+#include "FrustumCuller.h"
+#include "Camera.h"
+#include "TransformHierarchy.h"
+#include "EntityStore.h"
+#include "EntityRenderer.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
 
 IDXGISwapChain*					swapChain = nullptr;
 ID3D11DeviceContext*			deviceContext = nullptr;
@@ -36,17 +52,79 @@ class DEMO_APP
 	WNDPROC							appWndProc;
 	HWND							window;
 
-	XMMATRIX triangleWorldMatrix;
-	XMMATRIX ViewMatricies[2];
+	Camera cameras[NUMVIEWPORTS];
 
 	Cube3D cube1, cube2;
 	InstancedCube3D instCube;
 	SkyBox skyBox;
 	Plane floor;
+	VirtualTexture floorTexture;
 	LoadedModel3D brazier, willowTree[3];
 	NormalMappedLoadedModel3D turret;
 	PointToQuad pointToQuad;
 	vector<thread> threads;
+
+	TextureStreamer textureStreamer;
+	unsigned int glassTexture, skyBoxTexture;
+
+	TexturePacker texturePacker;
+	unsigned int boxTexture, brazierTexture;
+
+	EnvironmentLighting environmentLighting;
+	AsyncFileReader fileReader;
+	D3D11RenderContext renderContext;
+	ConstantBufferRing constantRing;
+	unsigned int reportedConstantBytes = 0;
+	FilteringRenderContext stateFilter;
+	DrawQueue drawQueue;
+	unsigned int reportedSubmittedStates = 0;
+	unsigned int reportedEmittedStates = 0;
+	unsigned int reportedFilteredStates = 0;
+	unsigned int reportedSubmittedDraws = 0;
+	unsigned int reportedEmittedDraws = 0;
+	unsigned int reportedReusedSorts = 0;
+
+	// Everything drawn by hand that can be out of view, by the index the culler reports it
+	// under. The entities' spheres follow.
+	enum CULLED_OBJECT
+	{
+		CULLED_INSTANCED_CUBES,
+		CULLED_STAR,
+		CULLED_FLOOR,
+		CULLED_OBJECT_COUNT
+	};
+	FrustumCuller frustumCuller;
+	unsigned int reportedVisible[NUMVIEWPORTS];
+	// The culler's spheres again, in a tree for finding things by ray
+	BoundingVolumeHierarchy sceneTree;
+	// Drops what the floor and the turret hide from what the frustums kept
+	OcclusionCuller occlusionCuller;
+	unsigned int floorOccluder;
+	unsigned int turretOccluder;
+	unsigned int reportedOccluded[NUMVIEWPORTS];
+
+	// Where everything is, by node. The turret spins under the node that places it, and each
+	// view has a sky box around its camera.
+	enum TRANSFORM_NODE
+	{
+		TRANSFORM_CUBE1,
+		TRANSFORM_CUBE2,
+		TRANSFORM_BRAZIER,
+		TRANSFORM_TURRET_BASE,
+		TRANSFORM_TURRET,
+		TRANSFORM_STAR,
+		TRANSFORM_POINT_TO_QUAD,
+		TRANSFORM_FLOOR,
+		TRANSFORM_WILLOW_TREE, // And one after it for each other tree
+		TRANSFORM_SKY_BOX = TRANSFORM_WILLOW_TREE + 3, // And one after it for each other view
+		TRANSFORM_NODE_COUNT = TRANSFORM_SKY_BOX + NUMVIEWPORTS
+	};
+	TransformHierarchy transforms;
+
+	// The models that draw with nothing but a mesh and a material
+	EntityStore entities;
+	EntityRenderer entityRenderer;
+	unsigned int willowTreeEntities[3];
 	
 	ID3D11Buffer* starBuffer = nullptr;
 	const unsigned int starNumVertices = 12;
@@ -58,9 +136,6 @@ class DEMO_APP
 	ID3D11RasterizerState* rasterizerStateDisabled = nullptr;
 	bool antialiasedEnabled = true;
 	
-	ID3D11Buffer* constantBuffer[4];
-	const unsigned int numConstantBuffers = 4;
-	ID3D11Buffer* lightConstantBuffer;
 	ID3D11Buffer* starIndexBuffer = nullptr;
 	unsigned int starNumIndicies = 60; 
 
@@ -71,11 +146,6 @@ class DEMO_APP
 		XMMATRIX worldMatrix;
 	};
 
-	struct SEND_TO_INST_OBJECT
-	{
-		XMMATRIX worldMatrix[6];
-	};
-
 	struct SEND_TO_SCENE
 	{
 		XMMATRIX viewMatrix;
@@ -93,7 +163,6 @@ class DEMO_APP
 	
 	SEND_TO_OBJECT toObject;
 	SEND_TO_OBJECT toStarObject;
-	SEND_TO_INST_OBJECT toInstObject;
 	SEND_TO_SCENE toScene;
 	SEND_TO_PS toPS;
 
@@ -104,8 +173,42 @@ public:
 	DEMO_APP(HINSTANCE hinst, WNDPROC proc);
 	bool Run();
 	bool ShutDown();
+
+private:
+
+	// Draws the model through the entity store from now on, placed by the node
+	template <typename MODEL>
+	unsigned int AddEntity(MODEL& model, unsigned int node, uint32_t renderFlags);
 };
 
+template <typename MODEL>
+unsigned int DEMO_APP::AddEntity(MODEL& model, unsigned int node, uint32_t renderFlags)
+{
+	unsigned int entity = entities.Create(ENTITY_TRANSFORM | ENTITY_MESH | ENTITY_MATERIAL | ENTITY_BOUNDS | ENTITY_RENDER_FLAGS);
+	entities.SetTransform(entity, node);
+
+	MESH_COMPONENT mesh = {};
+	mesh.vertexBuffer = model.GetBuffer();
+	mesh.vertexStride = sizeof(Vertex);
+	mesh.indexBuffer = model.GetIndexBuffer();
+	mesh.indexCount = model.GetNumIndicies();
+	mesh.layout = model.GetLayout();
+	mesh.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	entities.SetMesh(entity, mesh);
+
+	MATERIAL_COMPONENT material = {};
+	material.vertexShader = model.GetVertexShader();
+	material.pixelShader = model.GetPixelShader();
+	material.textures[0] = model.GetShaderResourceView();
+	material.textureCount = 1;
+	material.sampler = model.GetSampler();
+	entities.SetMaterial(entity, material);
+
+	entities.SetBoundingRadius(entity, model.GetBoundingRadius());
+	entities.SetRenderFlags(entity, renderFlags);
+	return entity;
+}
+
 //************************************************************
 //************ CREATION OF OBJECTS & RESOURCES ***************
 //************************************************************
@@ -115,6 +218,24 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	application = hinst; 
 	appWndProc = proc; 
 
+	// Every asset is queued for reading now so the disk works while the window and device are
+	// created; each one is prefetched once per object that loads it
+	fileReader.Initialize();
+	memset(reportedVisible, 0, sizeof(reportedVisible));
+	memset(reportedOccluded, 0, sizeof(reportedOccluded));
+	fileReader.Prefetch(L"Box_wood01.dds");
+	fileReader.Prefetch(L"SkyBoxCube.dds");
+	fileReader.Prefetch(L"SkyBoxCube.dds");
+	fileReader.Prefetch(L"Floor.dds");
+	fileReader.Prefetch(L"brazier.dds");
+	fileReader.Prefetch(L"brazier.obj");
+	fileReader.Prefetch(L"T_HeavyTurret_D.dds");
+	fileReader.Prefetch(L"T_HeavyTurret_N.png");
+	fileReader.Prefetch(L"turret.obj");
+	fileReader.Prefetch(L"glass.dds");
+	for (int i = 0; i < 3; ++i)
+		fileReader.Prefetch(L"cube.obj");
+
 	WNDCLASSEX  wndClass;
     ZeroMemory( &wndClass, sizeof( wndClass ) );
     wndClass.cbSize         = sizeof( WNDCLASSEX );             
@@ -151,6 +272,10 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
 	
 	HRESULT result = D3D11CreateDeviceAndSwapChain(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, D3D11_CREATE_DEVICE_DEBUG, NULL, 0, D3D11_SDK_VERSION, &swapChainDesc, &swapChain, &device, NULL, &deviceContext);
+	renderContext.Initialize(deviceContext);
+	stateFilter.Initialize(&renderContext);
+	drawQueue.Initialize(&stateFilter, device);
+	constantRing.Initialize(device, CONSTANT_RING_SIZE);
 	
 	ID3D11Resource* pBackBuffer;
 	swapChain->GetBuffer(0, __uuidof(pBackBuffer), reinterpret_cast<void**>(&pBackBuffer));
@@ -215,12 +340,8 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	triangle[11].rgba.y = 1;
 	triangle[11].rgba.z = 1;
 
-	triangleWorldMatrix = XMMatrixIdentity();
-	triangleWorldMatrix = XMMatrixTranslation(2, 2, 3);
-
-	ViewMatricies[0] = XMMatrixIdentity();
-	ViewMatricies[1] = XMMatrixRotationX(XMConvertToRadians(-90));
-	ViewMatricies[1] = XMMatrixMultiply(XMMatrixTranslation(0, -10, 0), ViewMatricies[1]);
+	// The second camera looks straight down from above the origin
+	cameras[1].SetWorldMatrix(XMMatrixMultiply(XMMatrixRotationX(XMConvertToRadians(90)), XMMatrixTranslation(0, 10, 0)));
 
 	ProjectionMatricies[0] = XMMatrixPerspectiveFovLH(XMConvertToRadians(65), ASPECTRATIO, NEARPLANE, FARPLANE);
 	ProjectionMatricies[1] = XMMatrixPerspectiveFovLH(XMConvertToRadians(90), ASPECTRATIO, NEARPLANE, FARPLANE);
@@ -262,54 +383,6 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	};
 	result = device->CreateInputLayout(inputLayout, 2, StarVertexShader, sizeof(StarVertexShader), &layout);
 
-	toStarObject.worldMatrix = triangleWorldMatrix;
-	toScene.viewMatrix = ViewMatricies[currentViewport];
-	toScene.projectionMatrix = ProjectionMatricies[currentViewport];
-
-	D3D11_BUFFER_DESC bufferDesc2 = {};
-	bufferDesc2.Usage = D3D11_USAGE_DYNAMIC;
-	bufferDesc2.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bufferDesc2.ByteWidth = sizeof(SEND_TO_OBJECT);
-	bufferDesc2.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc2;
-	(subresourceDesc2.pSysMem) = &toObject;
-
-	result = device->CreateBuffer(&bufferDesc2, &subresourceDesc2, &constantBuffer[0]);
-
-	D3D11_BUFFER_DESC bufferDesc3 = {};
-	bufferDesc3.Usage = D3D11_USAGE_DYNAMIC;
-	bufferDesc3.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bufferDesc3.ByteWidth = sizeof(SEND_TO_SCENE);
-	bufferDesc3.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc3;
-	(subresourceDesc3.pSysMem) = &toScene;
-
-	result = device->CreateBuffer(&bufferDesc3, &subresourceDesc3, &constantBuffer[1]);
-
-	D3D11_BUFFER_DESC bufferDesc5 = {};
-	bufferDesc5.Usage = D3D11_USAGE_DYNAMIC;
-	bufferDesc5.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bufferDesc5.ByteWidth = sizeof(SEND_TO_OBJECT);
-	bufferDesc5.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc5;
-	(subresourceDesc5.pSysMem) = &toStarObject;
-
-	result = device->CreateBuffer(&bufferDesc5, &subresourceDesc5, &constantBuffer[2]);
-
-	D3D11_BUFFER_DESC bufferDesc6 = {};
-	bufferDesc6.Usage = D3D11_USAGE_DYNAMIC;
-	bufferDesc6.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bufferDesc6.ByteWidth = sizeof(SEND_TO_PS);
-	bufferDesc6.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc6;
-	(subresourceDesc6.pSysMem) = &toPS;
-
-	result = device->CreateBuffer(&bufferDesc6, &subresourceDesc6, &lightConstantBuffer);
-
 	D3D11_BUFFER_DESC starIndexBufferDesc = {};
 	starIndexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	starIndexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -347,43 +420,103 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	DXGI_SAMPLE_DESC sampleDesc = {};
 	sampleDesc.Count = 1;
 
+	// Streamed textures start with only their smallest levels and are handed to the objects
+	// every frame in Run
+	textureStreamer.Initialize(device, STREAMING_DEFAULT_BUDGET, &fileReader);
+
+	// Textures that share a size and format are packed into one array so the objects using
+	// them draw from the same view
 	const wchar_t* filename1 = L"Box_wood01.dds";
-	threads.push_back(thread(&Cube3D::Initialize, &cube1, device, -2, 1, 5, filename1));
+	boxTexture = texturePacker.Add(filename1, true);
+	threads.push_back(thread(&Cube3D::Initialize, &cube1, device, -2, 1, 5, nullptr));
 
-	const wchar_t* filename2 = L"Box_wood01.dds";
-	threads.push_back(thread(&Cube3D::Initialize, &cube2, device, 0, 5, 10, filename2));
+	threads.push_back(thread(&Cube3D::Initialize, &cube2, device, 0, 5, 10, nullptr));
 
-	const wchar_t* filename3 = L"Box_wood01.dds";
-	threads.push_back(thread(&InstancedCube3D::Initialize, &instCube, device, 0, 0, 20, filename3));
+	threads.push_back(thread(&InstancedCube3D::Initialize, &instCube, device, 0, 0, 20, nullptr));
 
 	const wchar_t* skyBoxFilename = L"SkyBoxCube.dds";
-	threads.push_back(thread(&SkyBox::Initialize, &skyBox, device, 0, 0, 0, skyBoxFilename, true));
+	skyBoxTexture = textureStreamer.Load(skyBoxFilename);
+	threads.push_back(thread(&SkyBox::Initialize, &skyBox, device, 0, 0, 0, nullptr, true));
+
+	// Ambient light for the lit shaders, read back from the cache after the first run
+	threads.push_back(thread(&EnvironmentLighting::Initialize, &environmentLighting, device, skyBoxFilename, &fileReader));
 
+	// The floor only keeps the tiles of its texture that are on screen, streamed in by the
+	// feedback pass in Run
 	const wchar_t* floorFilename = L"Floor.dds";
-	threads.push_back(thread(&Plane::Initialize, &floor, device, 0, -1, 0, floorFilename));
+	threads.push_back(thread(&VirtualTexture::Initialize, &floorTexture, device, floorFilename, &fileReader));
+	threads.push_back(thread(&Plane::Initialize, &floor, device, 0, -1, 0, floorFilename, &floorTexture));
 
 	const wchar_t* brazierFilename = L"brazier.dds";
-	threads.push_back(thread(&LoadedModel3D::Initialize, &brazier, device, 7, -1, 10, brazierFilename, "brazier.obj"));
+	brazierTexture = texturePacker.Add(brazierFilename, false);
+	threads.push_back(thread(&LoadedModel3D::Initialize, &brazier, device, 7, -1, 10, nullptr, "brazier.obj", &fileReader));
 
 	const wchar_t* turretFilename = L"T_HeavyTurret_D.dds";
-	const wchar_t* turretNormalMapFilename = L"T_HeavyTurret_N.dds";
-	threads.push_back(thread(&NormalMappedLoadedModel3D::Initialize, &turret, device, -7, -1, 10, turretFilename, turretNormalMapFilename, "turret.obj"));
+	const wchar_t* turretNormalMapFilename = L"T_HeavyTurret_N.png";
+	threads.push_back(thread(&NormalMappedLoadedModel3D::Initialize, &turret, device, -7, -1, 10, turretFilename, turretNormalMapFilename, "turret.obj", &fileReader));
 
 	pointToQuad.Initialize(device, 0, 0, 10);
 
-	const wchar_t* treeFilename1 = L"glass.dds";
-	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[0], device, 0, 0, 30, treeFilename1, "cube.obj"));
+	const wchar_t* treeFilename = L"glass.dds";
+	glassTexture = textureStreamer.Load(treeFilename);
+	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[0], device, 0, 0, 30, nullptr, "cube.obj", &fileReader));
 
-	const wchar_t* treeFilename2 = L"glass.dds";
-	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[1], device, 0, 0, 32, treeFilename2, "cube.obj"));
+	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[1], device, 0, 0, 32, nullptr, "cube.obj", &fileReader));
 
-	const wchar_t* treeFilename3 = L"glass.dds";
-	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[2], device, 0, 0, 34, treeFilename3, "cube.obj"));
+	threads.push_back(thread(&LoadedModel3D::Initialize, &willowTree[2], device, 0, 0, 34, nullptr, "cube.obj", &fileReader));
 
 
+	texturePacker.Build(device, &fileReader);
+
 	for (int i = 0; i < threads.size(); ++i)
 		threads[i].join();
 
+	TEXTURE_PLACEMENT placement;
+	if (texturePacker.GetPlacement(boxTexture, &placement))
+	{
+		ID3D11ShaderResourceView* page = texturePacker.GetShaderResourceView(placement.page);
+		cube1.UsePackedTexture(device, page, placement);
+		cube2.UsePackedTexture(device, page, placement);
+		instCube.UsePackedTexture(device, page, placement);
+	}
+	if (texturePacker.GetPlacement(brazierTexture, &placement))
+		brazier.UsePackedTexture(device, texturePacker.GetShaderResourceView(placement.page), placement);
+
+	// Models loaded from the same file share a mesh, so the queue can merge their draws where the order allows
+	drawQueue.AddInstancedShader(willowTree[0].GetVertexShader(), willowTree[0].GetInstancedVertexShader(), sizeof(XMMATRIX));
+
+	// Added in CULLED_OBJECT order; Run moves the spheres to the objects every frame
+	for (unsigned int i = 0; i < CULLED_OBJECT_COUNT; ++i)
+		frustumCuller.Add(XMFLOAT3(0, 0, 0), 0);
+
+	// The floor's quad is its first four verticies, drawn as the plane draws them
+	unsigned int floorIndicies[6] = { 3, 2, 0, 0, 1, 3 };
+	floorOccluder = occlusionCuller.AddOccluderMesh(floor.GetVerticies(), 4, floorIndicies, 6);
+	turretOccluder = occlusionCuller.AddOccluderMesh(turret.GetVerticies(), turret.GetNumVerticies(), turret.GetIndicies(), turret.GetNumIndicies());
+
+	// Added in TRANSFORM_NODE order and placed where the objects put themselves
+	for (unsigned int i = 0; i < TRANSFORM_NODE_COUNT; ++i)
+		transforms.Add(i == TRANSFORM_TURRET ? TRANSFORM_TURRET_BASE : TRANSFORM_HIERARCHY_NO_PARENT);
+	transforms.SetLocalMatrix(TRANSFORM_CUBE1, cube1.GetWorldMatrix());
+	transforms.SetLocalMatrix(TRANSFORM_CUBE2, cube2.GetWorldMatrix());
+	transforms.SetLocalMatrix(TRANSFORM_BRAZIER, brazier.GetWorldMatrix());
+	transforms.SetLocalMatrix(TRANSFORM_TURRET_BASE, turret.GetWorldMatrix());
+	transforms.SetLocalPosition(TRANSFORM_STAR, XMFLOAT3(2, 2, 3));
+	transforms.SetLocalMatrix(TRANSFORM_POINT_TO_QUAD, pointToQuad.GetWorldMatrix());
+	transforms.SetLocalMatrix(TRANSFORM_FLOOR, floor.GetWorldMatrix());
+	for (int i = 0; i < 3; ++i)
+		transforms.SetLocalMatrix(TRANSFORM_WILLOW_TREE + i, willowTree[i].GetWorldMatrix());
+
+	// After the packed textures, which change the cubes' and the brazier's buffers and shaders
+	entityRenderer.Initialize(device);
+	AddEntity(cube1, TRANSFORM_CUBE1, 0);
+	AddEntity(cube2, TRANSFORM_CUBE2, 0);
+	AddEntity(brazier, TRANSFORM_BRAZIER, RENDER_FLAG_BLENDED);
+	unsigned int turretEntity = AddEntity(turret, TRANSFORM_TURRET, RENDER_FLAG_BLENDED);
+	entities.SetTexture(turretEntity, 1, turret.GetNormalMapShaderResourceView());
+	for (int i = 0; i < 3; ++i)
+		willowTreeEntities[i] = AddEntity(willowTree[i], TRANSFORM_WILLOW_TREE + i, RENDER_FLAG_BLENDED);
+
 	D3D11_RASTERIZER_DESC rasterDesc = {};
 	rasterDesc.AntialiasedLineEnable = true;
 	rasterDesc.FillMode = D3D11_FILL_SOLID;
@@ -397,20 +530,6 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 	rasterDesc2.CullMode = D3D11_CULL_BACK;
 	result = device->CreateRasterizerState(&rasterDesc2, &rasterizerStateDisabled);
 
-	for (int i = 0; i < 6; ++i)
-		toInstObject.worldMatrix[i] = instCube.GetWorldMatrix(i);
-
-	D3D11_BUFFER_DESC bufferDesc7 = {};
-	bufferDesc7.Usage = D3D11_USAGE_DYNAMIC;
-	bufferDesc7.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bufferDesc7.ByteWidth = sizeof(SEND_TO_INST_OBJECT);
-	bufferDesc7.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-	D3D11_SUBRESOURCE_DATA subresourceDesc7;
-	(subresourceDesc7.pSysMem) = &toInstObject;
-
-	result = device->CreateBuffer(&bufferDesc7, &subresourceDesc7, &constantBuffer[3]);
-
 	timer.Restart();
 
 }
@@ -422,61 +541,40 @@ DEMO_APP::DEMO_APP(HINSTANCE hinst, WNDPROC proc)
 bool DEMO_APP::Run()
 {
 	timer.Signal();
-	ViewMatricies[0] = XMMatrixInverse(nullptr, ViewMatricies[0]);
-	ViewMatricies[1] = XMMatrixInverse(nullptr, ViewMatricies[1]);
+	// Resizing the window replaces the projections; the cameras keep what they worked out
+	// from them until one does change
+	for (unsigned int i = 0; i < NUMVIEWPORTS; ++i)
+		cameras[i].SetProjectionMatrix(ProjectionMatricies[i]);
 
 	if (GetAsyncKeyState('W'))
 	{
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixTranslation(0, 0, 3.5f * (float)timer.Delta()), ViewMatricies[0]);
-		ViewMatricies[1] = XMMatrixMultiply(XMMatrixTranslation(0, 3.5f * (float)timer.Delta(), 0), ViewMatricies[1]);
+		cameras[0].Translate(0, 0, 3.5f * (float)timer.Delta());
+		cameras[1].Translate(0, 3.5f * (float)timer.Delta(), 0);
 	}
 	if (GetAsyncKeyState('S'))
 	{
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixTranslation(0, 0, -3.5f * (float)timer.Delta()), ViewMatricies[0]);
-		ViewMatricies[1] = XMMatrixMultiply(XMMatrixTranslation(0, -3.5f * (float)timer.Delta(), 0), ViewMatricies[1]);
+		cameras[0].Translate(0, 0, -3.5f * (float)timer.Delta());
+		cameras[1].Translate(0, -3.5f * (float)timer.Delta(), 0);
 	}
 	if (GetAsyncKeyState('A'))
 	{
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixTranslation(-3.5f * (float)timer.Delta(), 0, 0), ViewMatricies[0]);
-		ViewMatricies[1] = XMMatrixMultiply(XMMatrixTranslation(-3.5f * (float)timer.Delta(), 0, 0), ViewMatricies[1]);
+		cameras[0].Translate(-3.5f * (float)timer.Delta(), 0, 0);
+		cameras[1].Translate(-3.5f * (float)timer.Delta(), 0, 0);
 	}
 	if (GetAsyncKeyState('D'))
 	{
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixTranslation(3.5f * (float)timer.Delta(), 0, 0), ViewMatricies[0]);
-		ViewMatricies[1] = XMMatrixMultiply(XMMatrixTranslation(3.5f * (float)timer.Delta(), 0, 0), ViewMatricies[1]);
+		cameras[0].Translate(3.5f * (float)timer.Delta(), 0, 0);
+		cameras[1].Translate(3.5f * (float)timer.Delta(), 0, 0);
 	}
 
 	if (GetAsyncKeyState(VK_LEFT))
-	{
-		XMVECTOR tempPos = ViewMatricies[0].r[3];
-		ViewMatricies[0].r[3] = XMVectorSet(0, 0, 0, 1);
-		ViewMatricies[0] = XMMatrixMultiply(ViewMatricies[0], XMMatrixRotationY((float)timer.Delta() * -2));
-		ViewMatricies[0].r[3] = tempPos;
-	}
+		cameras[0].Rotate(XMMatrixRotationY((float)timer.Delta() * -2));
 	if (GetAsyncKeyState(VK_RIGHT))
-	{
-		XMVECTOR tempPos = ViewMatricies[0].r[3];
-		ViewMatricies[0].r[3] = XMVectorSet(0, 0, 0, 1);
-		ViewMatricies[0] = XMMatrixMultiply(ViewMatricies[0], XMMatrixRotationY((float)timer.Delta() * 2));
-		ViewMatricies[0].r[3] = tempPos;
-	}
+		cameras[0].Rotate(XMMatrixRotationY((float)timer.Delta() * 2));
 	if (GetAsyncKeyState(VK_UP))
-	{
-		XMVECTOR tempPos = ViewMatricies[0].r[3];
-		ViewMatricies[0].r[3] = XMVectorSet(0, 0, 0, 1);
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixRotationX((float)timer.Delta() * -2), ViewMatricies[0]);
-		ViewMatricies[0].r[3] = tempPos;
-	}
+		cameras[0].RotateLocal(XMMatrixRotationX((float)timer.Delta() * -2));
 	if (GetAsyncKeyState(VK_DOWN))
-	{
-		XMVECTOR tempPos = ViewMatricies[0].r[3];
-		ViewMatricies[0].r[3] = XMVectorSet(0, 0, 0, 1);
-		ViewMatricies[0] = XMMatrixMultiply(XMMatrixRotationX((float)timer.Delta() * 2), ViewMatricies[0]);
-		ViewMatricies[0].r[3] = tempPos;
-	}
-
-	ViewMatricies[0] = XMMatrixInverse(nullptr, ViewMatricies[0]);
-	ViewMatricies[1] = XMMatrixInverse(nullptr, ViewMatricies[1]);
+		cameras[0].RotateLocal(XMMatrixRotationX((float)timer.Delta() * 2));
 
 	if (GetAsyncKeyState('3'))
 	{
@@ -495,8 +593,165 @@ bool DEMO_APP::Run()
 			spotlightOn = 0;
 	}
 
+	// Pick up any textures that finished streaming and hand them to their objects
+	textureStreamer.Run();
+	for (int i = 0; i < 3; ++i)
+		entities.SetTexture(willowTreeEntities[i], 0, textureStreamer.GetShaderResourceView(glassTexture));
+	skyBox.SetShaderResourceView(textureStreamer.GetShaderResourceView(skyBoxTexture));
+	floorTexture.Run(deviceContext);
+
+	// Every constant of the frame goes into the ring first and reaches the GPU in one map;
+	// the draws below only bind their slice of it
+	constantRing.BeginFrame(deviceContext);
+
+	// Everything that moves is moved once a frame, before any view is looked at
+	float totalTime = (float)timer.TotalTime();
+	XMFLOAT4 spin;
+	XMStoreFloat4(&spin, XMQuaternionRotationRollPitchYaw(0, totalTime, 0));
+	transforms.SetLocalRotation(TRANSFORM_CUBE1, spin);
+	transforms.SetLocalRotation(TRANSFORM_STAR, spin);
+	XMStoreFloat4(&spin, XMQuaternionRotationRollPitchYaw(0, totalTime * 0.15f, 0));
+	transforms.SetLocalRotation(TRANSFORM_TURRET, spin);
+	for (unsigned int i = 0; i < NUMVIEWPORTS; ++i)
+	{
+		XMFLOAT3 cameraPosition;
+		XMStoreFloat3(&cameraPosition, cameras[i].GetPosition());
+		transforms.SetLocalPosition(TRANSFORM_SKY_BOX + i, cameraPosition);
+	}
+	transforms.Update();
+
+	entityRenderer.Update(entities, transforms, constantRing);
+
+	toStarObject.worldMatrix = transforms.GetWorldMatrix(TRANSFORM_STAR);
+	CONSTANT_ALLOCATION starConstants = constantRing.Write(&toStarObject, sizeof(toStarObject));
+
+	toObject.worldMatrix = transforms.GetWorldMatrix(TRANSFORM_POINT_TO_QUAD);
+	CONSTANT_ALLOCATION pointToQuadConstants = constantRing.Write(&toObject, sizeof(toObject));
+
+	toObject.worldMatrix = transforms.GetWorldMatrix(TRANSFORM_FLOOR);
+	CONSTANT_ALLOCATION floorConstants = constantRing.Write(&toObject, sizeof(toObject));
+
+	// Then what differs between the views: the camera, the spotlight it carries and the sky
+	// box around it
+	CONSTANT_ALLOCATION sceneConstants[NUMVIEWPORTS];
+	CONSTANT_ALLOCATION lightConstants[NUMVIEWPORTS];
+	CONSTANT_ALLOCATION skyBoxConstants[NUMVIEWPORTS];
+	for (currentViewport = 0; currentViewport < NUMVIEWPORTS; ++currentViewport)
+	{
+		Camera& camera = cameras[currentViewport];
+		XMVECTOR cameraPosition = camera.GetPosition();
+
+		toScene.viewMatrix = camera.GetViewMatrix();
+		toScene.projectionMatrix = camera.GetProjectionMatrix();
+		sceneConstants[currentViewport] = constantRing.Write(&toScene, sizeof(toScene));
+
+		toPS.color = XMFLOAT3(1, 1, 1);
+		XMStoreFloat4(&toPS.position, cameraPosition);
+		XMStoreFloat4(&toPS.direction, camera.GetForward());
+		toPS.ratios.x = 0.88f;
+		toPS.ratios.y = 0.8f;
+		toPS.ratios.z = 10;
+		toPS.ratios.w = (float)spotlightOn;
+		lightConstants[currentViewport] = constantRing.Write(&toPS, sizeof(toPS));
+
+		// Ask for as much texture detail as each streamed object covers on screen
+		float projectionScale = camera.GetProjectionMatrix().r[1].m128_f32[1];
+		float viewportHeight = viewports[currentViewport].Height;
+		for (int i = 0; i < 3; ++i)
+			textureStreamer.RequestFootprint(glassTexture, ProjectedSize(transforms.GetWorldMatrix(TRANSFORM_WILLOW_TREE + i).r[3], 1.0f, cameraPosition, projectionScale, viewportHeight));
+		textureStreamer.RequestFootprint(skyBoxTexture, viewportHeight);
+
+		toObject.worldMatrix = transforms.GetWorldMatrix(TRANSFORM_SKY_BOX + currentViewport);
+		skyBoxConstants[currentViewport] = constantRing.Write(&toObject, sizeof(toObject));
+	}
+
+	// Both viewports are culled in one pass over the objects, once they have all moved. The
+	// sky box and the point sprite are left out: one is always around the camera and the
+	// other is sized after projection.
+	XMFLOAT4 instancedCubes = instCube.GetBoundingSphere();
+	frustumCuller.SetSphere(CULLED_INSTANCED_CUBES, XMFLOAT3(instancedCubes.x, instancedCubes.y, instancedCubes.z), instancedCubes.w);
+	// The star's points are one unit from its center
+	frustumCuller.SetSphere(CULLED_STAR, transforms.GetWorldMatrix(TRANSFORM_STAR), 1.0f);
+	frustumCuller.SetSphere(CULLED_FLOOR, transforms.GetWorldMatrix(TRANSFORM_FLOOR), floor.GetBoundingRadius());
+	entityRenderer.Cull(entities, transforms, frustumCuller, CULLED_OBJECT_COUNT);
+	frustumCuller.SetViewCount(NUMVIEWPORTS);
+	for (unsigned int i = 0; i < NUMVIEWPORTS; ++i)
+		frustumCuller.SetView(i, cameras[i].GetFrustumPlanes());
+	frustumCuller.Cull();
+
+	// Then each view draws the big occluders into a small depth buffer and hides the spheres
+	// wholly behind them
+	unsigned int occluded[NUMVIEWPORTS];
+	for (unsigned int i = 0; i < NUMVIEWPORTS; ++i)
+	{
+		occlusionCuller.Begin(cameras[i].GetViewProjectionMatrix());
+		occlusionCuller.AddOccluder(floorOccluder, transforms.GetWorldMatrix(TRANSFORM_FLOOR));
+		occlusionCuller.AddOccluder(turretOccluder, transforms.GetWorldMatrix(TRANSFORM_TURRET));
+		occlusionCuller.Finish();
+
+		occluded[i] = 0;
+		const vector<unsigned int>& visible = frustumCuller.GetVisible(i);
+		for (unsigned int v = (unsigned int)visible.size(); v-- > 0;)
+		{
+			XMFLOAT4 sphere = frustumCuller.GetSphere(visible[v]);
+			if (!occlusionCuller.IsVisible(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w))
+			{
+				frustumCuller.Hide(i, visible[v]);
+				++occluded[i];
+			}
+		}
+	}
+
+	// Only the spheres that moved are refit in the tree
+	while (sceneTree.GetCount() < frustumCuller.GetCount())
+		sceneTree.Add(XMFLOAT3(0, 0, 0), 0);
+	for (unsigned int i = 0; i < frustumCuller.GetCount(); ++i)
+	{
+		XMFLOAT4 sphere = frustumCuller.GetSphere(i);
+		sceneTree.SetSphere(i, XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w);
+	}
+	sceneTree.Update();
+
+	// Clicking in the main view reports the nearest object under the cursor, by culler index
+	POINT cursor;
+	if ((GetAsyncKeyState(VK_LBUTTON) & 0x01) && GetCursorPos(&cursor) && ScreenToClient(window, &cursor))
+	{
+		const D3D11_VIEWPORT& viewport = viewports[0];
+		float x = ((float)cursor.x - viewport.TopLeftX) / viewport.Width * 2 - 1;
+		float y = 1 - ((float)cursor.y - viewport.TopLeftY) / viewport.Height * 2;
+		if (x >= -1 && x <= 1 && y >= -1 && y <= 1)
+		{
+			XMMATRIX clipToWorld = XMMatrixInverse(nullptr, cameras[0].GetViewProjectionMatrix());
+			XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0, 1), clipToWorld);
+			XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1, 1), clipToWorld);
+			float distance = 0;
+			unsigned int picked = sceneTree.RayCast(nearPoint, farPoint - nearPoint, FARPLANE, &distance);
+			char report[128];
+			if (picked == BVH_NONE)
+				sprintf_s(report, "Picked nothing\n");
+			else
+				sprintf_s(report, "Picked object %u of %u, %.1f units away\n", picked, sceneTree.GetCount(), distance);
+			OutputDebugStringA(report);
+		}
+	}
+
+	constantRing.Upload(&drawQueue, deviceContext);
+	instCube.Upload(&drawQueue);
+	if (constantRing.GetPeakFrameBytes() > reportedConstantBytes)
+	{
+		reportedConstantBytes = constantRing.GetPeakFrameBytes();
+		char report[128];
+		sprintf_s(report, "Constant ring: %u bytes per frame of %u, %u stalls\n", constantRing.GetFrameBytes(), constantRing.GetCapacity(), constantRing.GetStallCount());
+		OutputDebugStringA(report);
+	}
+
+	// The window can be resized between frames, which binds a new target behind the filter
+	drawQueue.ResetCounts();
+	stateFilter.ResetCounts();
+	stateFilter.Invalidate();
+
 	float color[4] = { 0, 0, 1, 1 };
-	deviceContext->ClearRenderTargetView(renderTargetView, color);
+	drawQueue.ClearRenderTarget(renderTargetView, color);
 	//if (GetCursorPos(&mousePos))
 	//{
 	//	int deltaX = prevMousePos.x - mousePos.x;
@@ -507,168 +762,126 @@ bool DEMO_APP::Run()
 	//}
 	for (currentViewport = 0; currentViewport < NUMVIEWPORTS; ++currentViewport)
 	{
-		deviceContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
-		deviceContext->RSSetViewports(1, &viewports[currentViewport]);
+		drawQueue.SetRenderTargets(renderTargetView, depthStencilView);
+		drawQueue.SetViewport(viewports[currentViewport]);
 
-		deviceContext->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH, 1, 0);
+		drawQueue.ClearDepth(depthStencilView, 1);
 
-		D3D11_MAPPED_SUBRESOURCE mapped;
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		XMMATRIX* temp = ((XMMATRIX*)mapped.pData);
-		cube1.SetWorldMatrix(&XMMatrixMultiply(XMMatrixRotationY((float)timer.Delta()), cube1.GetWorldMatrix()));
-		*temp = cube1.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
+		// The queue sorts each viewport's draws by state and, for blended ones, back to front
+		XMVECTOR eyePosition = cameras[currentViewport].GetPosition();
 
-		D3D11_MAPPED_SUBRESOURCE mapped2;
-		deviceContext->Map(constantBuffer[1], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped2);
-		XMMATRIX* temp2 = ((XMMATRIX*)mapped2.pData);
-		temp2[0] = ViewMatricies[currentViewport];
-		temp2[1] = ProjectionMatricies[currentViewport];
-		deviceContext->Unmap(constantBuffer[1], 0);
+		constantRing.Bind(&drawQueue, RENDER_STAGE_VERTEX, 1, sceneConstants[currentViewport]);
+		constantRing.Bind(&drawQueue, RENDER_STAGE_PIXEL, 0, lightConstants[currentViewport]);
+		environmentLighting.Bind(&drawQueue);
 
-		ViewMatricies[currentViewport] = XMMatrixInverse(nullptr, ViewMatricies[currentViewport]);
-		toPS.color = XMFLOAT3(1, 1, 1);
-		toPS.position.x = ViewMatricies[currentViewport].r[3].m128_f32[0];
-		toPS.position.y = ViewMatricies[currentViewport].r[3].m128_f32[1];
-		toPS.position.z = ViewMatricies[currentViewport].r[3].m128_f32[2];
-		toPS.position.w = ViewMatricies[currentViewport].r[3].m128_f32[3];
-		toPS.direction.x = ViewMatricies[currentViewport].r[2].m128_f32[0];
-		toPS.direction.y = ViewMatricies[currentViewport].r[2].m128_f32[1];
-		toPS.direction.z = ViewMatricies[currentViewport].r[2].m128_f32[2];
-		toPS.direction.w = ViewMatricies[currentViewport].r[2].m128_f32[3];
-		toPS.ratios.x = 0.88f;
-		toPS.ratios.y = 0.8f;
-		toPS.ratios.z = 10;
-		toPS.ratios.w = (float)spotlightOn;
-		ViewMatricies[currentViewport] = XMMatrixInverse(nullptr, ViewMatricies[currentViewport]);
-
-		D3D11_MAPPED_SUBRESOURCE mapped3;
-		deviceContext->Map(lightConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped3);
-		SEND_TO_PS* temp3 = ((SEND_TO_PS*)mapped3.pData);
-		*temp3 = toPS;
-		deviceContext->Unmap(lightConstantBuffer, 0);
-
-		deviceContext->PSSetConstantBuffers(0, 1, &lightConstantBuffer);
-
-		cube1.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		*temp = cube2.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
-		deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		cube2.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[3], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		SEND_TO_INST_OBJECT* temp4 = ((SEND_TO_INST_OBJECT*)mapped.pData);
-		temp4->worldMatrix[0] = instCube.GetWorldMatrix(0);
-		temp4->worldMatrix[1] = instCube.GetWorldMatrix(1);
-		temp4->worldMatrix[2] = instCube.GetWorldMatrix(2);
-		temp4->worldMatrix[3] = instCube.GetWorldMatrix(3);
-		temp4->worldMatrix[4] = instCube.GetWorldMatrix(4);
-		temp4->worldMatrix[5] = instCube.GetWorldMatrix(5);
-		deviceContext->Unmap(constantBuffer[3], 0);
-		deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		instCube.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		*temp = brazier.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
-		deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		brazier.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		*temp = XMMatrixMultiply(XMMatrixRotationY((float)timer.TotalTime() * 0.15f), turret.GetWorldMatrix());
-		deviceContext->Unmap(constantBuffer[0], 0);
-		deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		turret.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		*temp = pointToQuad.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
-		deviceContext->GSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		pointToQuad.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		XMMATRIX tempMatrix = XMMatrixIdentity();
-		ViewMatricies[currentViewport] = XMMatrixInverse(nullptr, ViewMatricies[currentViewport]);
-		tempMatrix.r[3] = ViewMatricies[currentViewport].r[3];
-		ViewMatricies[currentViewport] = XMMatrixInverse(nullptr, ViewMatricies[currentViewport]);
-		skyBox.SetWorldMatrix(&tempMatrix);
-		*temp = skyBox.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
-		deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
-
-		skyBox.Run(deviceContext);
-
-		deviceContext->Map(constantBuffer[2], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		triangleWorldMatrix = XMMatrixMultiply(XMMatrixRotationY((float)timer.Delta()), triangleWorldMatrix);
-		*temp = triangleWorldMatrix;
-		deviceContext->Unmap(constantBuffer[2], 0);
-
-		deviceContext->Map(constantBuffer[1], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped2);
-		temp2 = ((XMMATRIX*)mapped2.pData);
-		temp2[0] = ViewMatricies[currentViewport];
-		temp2[1] = ProjectionMatricies[currentViewport];
-		deviceContext->Unmap(constantBuffer[1], 0);
-
-		deviceContext->VSSetConstantBuffers(0, 3, constantBuffer);
-		deviceContext->IASetIndexBuffer(starIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-		unsigned int vertexSize = sizeof(SIMPLE_VERTEX);
-		unsigned int offset = 0;
-		deviceContext->IASetVertexBuffers(0, 1, &starBuffer, &vertexSize, &offset);
-		deviceContext->VSSetShader(vertexShader, NULL, 0);
-		deviceContext->PSSetShader(pixelShader, NULL, 0);
-		deviceContext->IASetInputLayout(layout);
-		deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		deviceContext->DrawIndexed(starNumIndicies, 0, 0);
-
-		vertexSize = sizeof(SIMPLE_VERTEX);
-		offset = 0;
-
-		deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-		temp = ((XMMATRIX*)mapped.pData);
-		*temp = floor.GetWorldMatrix();
-		deviceContext->Unmap(constantBuffer[0], 0);
+		entityRenderer.Submit(entities, transforms, frustumCuller, currentViewport, eyePosition, constantRing, &drawQueue);
 
-		// Draw Floor
-		floor.Run(deviceContext);
+		if (frustumCuller.IsVisible(currentViewport, CULLED_INSTANCED_CUBES))
+		{
+			drawQueue.SetSortDepth(CameraDistance(instCube.GetWorldMatrix(0), eyePosition));
+			instCube.Run(&drawQueue);
+		}
+
+		constantRing.Bind(&drawQueue, RENDER_STAGE_GEOMETRY, 0, pointToQuadConstants);
+		constantRing.Bind(&drawQueue, RENDER_STAGE_GEOMETRY, 1, sceneConstants[currentViewport]);
 
-		float distances[3];
-		distances[0] = XMVector4Length(willowTree[0].GetWorldMatrix().r[3] - ViewMatricies[currentViewport].r[3]).m128_f32[0];
-		distances[1] = XMVector4Length(willowTree[1].GetWorldMatrix().r[3] - ViewMatricies[currentViewport].r[3]).m128_f32[0];
-		distances[2] = XMVector4Length(willowTree[2].GetWorldMatrix().r[3] - ViewMatricies[currentViewport].r[3]).m128_f32[0];
+		drawQueue.SetSortDepth(CameraDistance(transforms.GetWorldMatrix(TRANSFORM_POINT_TO_QUAD), eyePosition));
+		pointToQuad.Run(&drawQueue);
 
-		vector<int> transparentIndicies = SortByDepth(distances, 3);
+		constantRing.Bind(&drawQueue, RENDER_STAGE_VERTEX, 0, skyBoxConstants[currentViewport]);
+
+		drawQueue.SetSortDepth(FARPLANE);
+		skyBox.Run(&drawQueue);
+
+		if (frustumCuller.IsVisible(currentViewport, CULLED_STAR))
+		{
+			constantRing.Bind(&drawQueue, RENDER_STAGE_VERTEX, 2, starConstants);
+			drawQueue.SetSortDepth(CameraDistance(transforms.GetWorldMatrix(TRANSFORM_STAR), eyePosition));
+			drawQueue.SetIndexBuffer(starIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+			drawQueue.SetVertexBuffer(starBuffer, sizeof(SIMPLE_VERTEX), 0);
+			drawQueue.SetVertexShader(vertexShader);
+			drawQueue.SetPixelShader(pixelShader);
+			drawQueue.SetInputLayout(layout);
+			drawQueue.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			drawQueue.DrawIndexed(starNumIndicies, 0, 0);
+		}
 
-		for (int i = 0; i < (int)transparentIndicies.size(); ++i)
+		// Draw Floor
+		if (frustumCuller.IsVisible(currentViewport, CULLED_FLOOR))
 		{
-			deviceContext->Map(constantBuffer[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-			temp = ((XMMATRIX*)mapped.pData);
-			*temp = willowTree[transparentIndicies[i]].GetWorldMatrix();
-			deviceContext->Unmap(constantBuffer[0], 0);
-			deviceContext->VSSetConstantBuffers(0, numConstantBuffers, constantBuffer);
+			constantRing.Bind(&drawQueue, RENDER_STAGE_VERTEX, 0, floorConstants);
+
+			drawQueue.SetSortDepth(CameraDistance(transforms.GetWorldMatrix(TRANSFORM_FLOOR), eyePosition));
+			floor.Run(&drawQueue);
+		}
 
-			willowTree[transparentIndicies[i]].Run(deviceContext);
+		drawQueue.Flush();
 
+		// And the floor again into the virtual texture's feedback target, from the main camera
+		// only. That pass sets its target and shader on the device context itself, so the queue
+		// and the filter have to forget what they last sent.
+		if (currentViewport == 0 && floorTexture.IsLoaded())
+		{
+			floorTexture.BeginFeedback(deviceContext, viewports[currentViewport]);
+			stateFilter.Invalidate();
+			constantRing.Bind(&stateFilter, RENDER_STAGE_VERTEX, 0, floorConstants);
+			floor.RunFeedback(&stateFilter);
+			floorTexture.EndFeedback(deviceContext);
+			stateFilter.Invalidate();
+			drawQueue.Invalidate();
 		}
 	}
 
+	constantRing.EndFrame(deviceContext);
+
 	if (antialiasedEnabled)
-		deviceContext->RSSetState(rasterizerStateEnabled);
+		drawQueue.SetRasterizerState(rasterizerStateEnabled);
 	else
-		deviceContext->RSSetState(rasterizerStateDisabled);
+		drawQueue.SetRasterizerState(rasterizerStateDisabled);
+
+	if (drawQueue.GetSubmittedStateCount() != reportedSubmittedStates || drawQueue.GetEmittedStateCount() != reportedEmittedStates ||
+		stateFilter.GetFilteredCount() != reportedFilteredStates)
+	{
+		reportedSubmittedStates = drawQueue.GetSubmittedStateCount();
+		reportedEmittedStates = drawQueue.GetEmittedStateCount();
+		reportedFilteredStates = stateFilter.GetFilteredCount();
+		char report[256];
+		sprintf_s(report, "Draw queue: %u state changes a frame made, %u sent, %u of those already bound (%u shaders, %u buffers, %u resources, %u blend/rasterizer)\n",
+			reportedSubmittedStates, reportedEmittedStates, reportedFilteredStates,
+			stateFilter.GetFilteredCount(RENDER_SET_VERTEX_SHADER) + stateFilter.GetFilteredCount(RENDER_SET_GEOMETRY_SHADER) + stateFilter.GetFilteredCount(RENDER_SET_PIXEL_SHADER),
+			stateFilter.GetFilteredCount(RENDER_SET_CONSTANT_BUFFERS) + stateFilter.GetFilteredCount(RENDER_SET_CONSTANT_BUFFER_RANGE),
+			stateFilter.GetFilteredCount(RENDER_SET_SHADER_RESOURCES) + stateFilter.GetFilteredCount(RENDER_SET_SAMPLERS),
+			stateFilter.GetFilteredCount(RENDER_SET_BLEND_STATE) + stateFilter.GetFilteredCount(RENDER_SET_RASTERIZER_STATE));
+		OutputDebugStringA(report);
+	}
+	if (drawQueue.GetSubmittedDrawCount() != reportedSubmittedDraws || drawQueue.GetEmittedDrawCount() != reportedEmittedDraws ||
+		drawQueue.GetReusedSortCount() != reportedReusedSorts)
+	{
+		reportedSubmittedDraws = drawQueue.GetSubmittedDrawCount();
+		reportedEmittedDraws = drawQueue.GetEmittedDrawCount();
+		reportedReusedSorts = drawQueue.GetReusedSortCount();
+		char report[128];
+		sprintf_s(report, "Draw queue: %u draws a frame made, %u sent, %u of %u sorts kept from last frame\n", reportedSubmittedDraws, reportedEmittedDraws,
+			reportedReusedSorts, drawQueue.GetSortCount());
+		OutputDebugStringA(report);
+	}
+	if (frustumCuller.GetVisible(0).size() != reportedVisible[0] || frustumCuller.GetVisible(1).size() != reportedVisible[1])
+	{
+		reportedVisible[0] = (unsigned int)frustumCuller.GetVisible(0).size();
+		reportedVisible[1] = (unsigned int)frustumCuller.GetVisible(1).size();
+		char report[128];
+		sprintf_s(report, "Frustum culling: %u of %u objects in the main view, %u in the overhead view\n", reportedVisible[0], frustumCuller.GetCount(), reportedVisible[1]);
+		OutputDebugStringA(report);
+	}
+	if (occluded[0] != reportedOccluded[0] || occluded[1] != reportedOccluded[1])
+	{
+		reportedOccluded[0] = occluded[0];
+		reportedOccluded[1] = occluded[1];
+		char report[128];
+		sprintf_s(report, "Occlusion culling: %u objects hidden in the main view, %u in the overhead view\n", occluded[0], occluded[1]);
+		OutputDebugStringA(report);
+	}
 
 	swapChain->Present(0, 0);
 
@@ -681,6 +894,15 @@ bool DEMO_APP::Run()
 
 bool DEMO_APP::ShutDown()
 {
+	textureStreamer.Shutdown();
+	fileReader.Shutdown();
+	texturePacker.Release();
+	environmentLighting.Release();
+	floorTexture.Release();
+	constantRing.Release();
+	drawQueue.Release();
+	entityRenderer.Release();
+	renderContext.Release();
 	SAFE_RELEASE(device);
 	SAFE_RELEASE(deviceContext);
 	SAFE_RELEASE(renderTargetView);
@@ -688,9 +910,6 @@ bool DEMO_APP::ShutDown()
 	SAFE_RELEASE(vertexShader);
 	SAFE_RELEASE(pixelShader);
 	SAFE_RELEASE(layout);
-	for (unsigned int i = 0; i < numConstantBuffers; ++i)
-		SAFE_RELEASE(constantBuffer[i]);
-	SAFE_RELEASE(lightConstantBuffer);
 	SAFE_RELEASE(starIndexBuffer);
 	SAFE_RELEASE(depthStencil);
 	SAFE_RELEASE(depthStencilView);
@@ -850,23 +1069,29 @@ XMMATRIX Movement(float time)
 	return matrix;
 }
 
-vector<int> SortByDepth(float distances[], int numItems)
+float CameraDistance(FXMMATRIX worldMatrix, FXMVECTOR cameraPosition)
 {
-	vector<int> indicies;
-	indicies.push_back(0);
-	indicies.push_back(1);
-	indicies.push_back(2);
+	return XMVector3Length(worldMatrix.r[3] - cameraPosition).m128_f32[0];
+}
 
-	for (int i = 1; i < numItems; ++i)
+float ProjectedSize(FXMVECTOR position, float radius, FXMVECTOR cameraPosition, float projectionScale, float viewportHeight)
+{
+	float distance = XMVector3Length(position - cameraPosition).m128_f32[0];
+	if (distance <= radius)
+		return viewportHeight;
+
+	// Diameter in NDC is 2 * radius / distance * projectionScale, and NDC spans two units
+	return radius / distance * projectionScale * viewportHeight;
+}
+
+// Radius of the sphere about the model's origin that holds every vertex, for culling
+float BoundingRadius(const Vertex verticies[], unsigned int numVerticies)
+{
+	float radiusSquared = 0;
+	for (unsigned int i = 0; i < numVerticies; ++i)
 	{
-		int counter = i;
-		while (counter > 0 && (distances[counter] > distances[counter - 1]))
-		{
-			swap(distances[counter], distances[counter - 1]);
-			swap(indicies[counter], indicies[counter - 1]);
-			counter--;
-		}
+		const XMFLOAT3& pos = verticies[i].pos;
+		radiusSquared = max(radiusSquared, pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
 	}
-
-	return indicies;
+	return sqrtf(radiusSquared);
 }
\ No newline at end of file